@@ -43,6 +43,9 @@ public:
     bool operator==(const BzMaterial& material) const;
     BzMaterial& operator=(const BzMaterial& material);
 
+    // the same for materials that are ==, the name does not count
+    unsigned int contentHash() const;
+
     void reset();
 
     void setReference() const;  // const exploits mutable "referenced" variable below
@@ -221,6 +224,13 @@ public:
     const BzMaterial* findMaterial(const std::string& name) const;
     const BzMaterial* getMaterial(int id) const;
     int getIndex(const BzMaterial* material) const;
+    int getCount() const;
+
+    // the materials given to addMaterial(), and the size that those
+    // which were the same as an earlier one would have added to the
+    // world database had they not been folded into it
+    int getAddCount() const;
+    int getFoldedSize() const;
 
     typedef std::set<std::string> TextureSet;
     void makeTextureList(TextureSet& set, bool referenced) const;
@@ -235,10 +245,38 @@ public:
     void printReference(std::ostream& out, const BzMaterial* mat) const;
 
 private:
+    void addName(const std::string& name, int index);
+
     std::vector<BzMaterial*> materials;
+
+    // the materials by their content hash, by name or alias (the
+    // first material with it), and by address, to save going through
+    // all of them for each face of a world made with a modeler
+    std::multimap<unsigned int, int> contentIndex;
+    std::map<std::string, int> nameIndex;
+    std::map<const BzMaterial*, int> materialIndex;
+
+    int addCount;
+    int foldedSize;
 };
 
 
+inline int BzMaterialManager::getCount() const
+{
+    return (int)materials.size();
+}
+
+inline int BzMaterialManager::getAddCount() const
+{
+    return addCount;
+}
+
+inline int BzMaterialManager::getFoldedSize() const
+{
+    return foldedSize;
+}
+
+
 extern BzMaterialManager MATERIALMGR;
 
 
@@ -28,6 +28,8 @@ class BoxBuilding;
 class PyramidBuilding;
 class BaseBuilding;
 class Teleporter;
+class MeshFaceBatch;
+class ColDetNode;
 
 
 typedef struct
@@ -50,13 +52,53 @@ typedef union
     } named;
 } SplitObsList;
 
+typedef struct
+{
+    int cell; // see CollisionManager::getCellList()
+    float inTime;
+    float outTime;
+} ColDetNodeHit;
+
 typedef struct
 {
     int count;
-    const class ColDetNode** list;
+    const ColDetNodeHit* list;
 } ColDetNodeList;
 
 
+// the results and scratch space of the queries made through it, so
+// that queries with different contexts can run at the same time
+class CollisionQuery
+{
+public:
+    CollisionQuery();
+
+private:
+    friend class CollisionManager;
+
+    void begin(int obstacleCount);
+    void addObstacle(Obstacle* obs);
+    void addObstacle(Obstacle* obs, const Ray* ray, const float* time);
+    bool isVisited(const Obstacle* obs) const;
+    void addNode(int cell, float inTime, float outTime);
+    const ObsList* getObstacles();
+    const float* getTimes();
+    const ColDetNodeList* getNodes();
+
+    std::vector<Obstacle*> obstacles;
+    std::vector<float> times;       // for rayTestTimes()
+    std::vector<float> slotTimes;   // the face times of one cell
+    std::vector<ColDetNodeHit> nodes;
+    std::vector<int> stack;         // the cells still to be visited
+    ObsList obsList;
+    ColDetNodeList nodeList;
+
+    // an obstacle was seen by this query if its stamp is the generation
+    std::vector<unsigned int> visited;
+    unsigned int generation;
+};
+
+
 // well you know my name is Simon, and I like to do drawings
 typedef void (*DrawLinesFunc)
 (int pointCount, float (*points)[3], int color);
@@ -79,24 +121,57 @@ public:
     const Extents& getWorldExtents() const;
 
 
+    // The tests below return lists that stay valid until the next test
+    // made with the same query.  The versions without a query share one
+    // and must only be used from the main thread.  Loading or clearing
+    // must not happen while any test is running.
+
     // test against an axis aligned bounding box
-    const ObsList* axisBoxTest (const Extents& extents);
+    const ObsList* axisBoxTest (const Extents& extents) const;
+    const ObsList* axisBoxTest (const Extents& extents,
+                                CollisionQuery& query) const;
 
     // test against a cylinder
     const ObsList* cylinderTest (const float *pos,
                                  float radius, float height) const;
+    const ObsList* cylinderTest (const float *pos,
+                                 float radius, float height,
+                                 CollisionQuery& query) const;
     // test against a box
     const ObsList* boxTest (const float* pos, float angle,
                             float dx, float dy, float dz) const;
+    const ObsList* boxTest (const float* pos, float angle,
+                            float dx, float dy, float dz,
+                            CollisionQuery& query) const;
     // test against a moving box
     const ObsList* movingBoxTest (const float* oldPos, float oldAngle,
                                   const float* pos, float angle,
                                   float dx, float dy, float dz) const;
+    const ObsList* movingBoxTest (const float* oldPos, float oldAngle,
+                                  const float* pos, float angle,
+                                  float dx, float dy, float dz,
+                                  CollisionQuery& query) const;
     // test against a Ray
     const ObsList* rayTest (const Ray* ray, float timeLeft) const;
-
-    // test against a Ray (and return a list of ColDetNodes)
+    const ObsList* rayTest (const Ray* ray, float timeLeft,
+                            CollisionQuery& query) const;
+
+    // test against a Ray, and where it hits: times[i] is the result of
+    // list[i]->intersect(), the mesh faces are done in batches
+    const ObsList* rayTestTimes (const Ray* ray, float timeLeft,
+                                 const float*& times) const;
+    const ObsList* rayTestTimes (const Ray* ray, float timeLeft,
+                                 const float*& times,
+                                 CollisionQuery& query) const;
+
+    // test against a Ray (and return a list of octree leaf cells)
     const ColDetNodeList* rayTestNodes (const Ray* ray, float timeLeft) const;
+    const ColDetNodeList* rayTestNodes (const Ray* ray, float timeLeft,
+                                        CollisionQuery& query) const;
+
+    // the obstacles and the extents of a cell from rayTestNodes()
+    void getCellList (int cell, ObsList& list) const;
+    void getCellExtents (int cell, Extents& exts) const;
 
     // test against a box and return a split list
     //const SplitObsList *boxTestSplit (const float* pos, float angle,
@@ -108,8 +183,43 @@ public:
 private:
 
     void setExtents(ObsList* list); // gather the extents
-
-    class ColDetNode* root;   // the root of the octree
+    void flatten(ColDetNode* root);
+    void flattenCell(ColDetNode* node, int cell);
+    void setCellExtents(int cell, const Extents& exts);
+
+    // the cells touching exts or maybe hit by the ray, out of count
+    // cells from first on, a bit for each
+    unsigned int touchingCells(int first, int count,
+                               const Extents& exts) const;
+    unsigned int rayCells(int first, int count, const Ray* ray) const;
+    bool rayHitsCell(int cell, const Ray* ray, float timeLeft,
+                     float* inTime, float* outTime) const;
+
+    void addCellObstacles(int cell, CollisionQuery& query) const;
+    void addCellObstacles(int cell, const Ray* ray,
+                          CollisionQuery& query) const;
+
+    // The octree is built by ColDetNode and then laid out in flat
+    // arrays, the root being cell 0.  The children of a cell come one
+    // after the other, and their extents are a block of cellBounds
+    // (the min x, y and z and then the max x, y and z of the eight of
+    // them side by side) so that they are tested together.  The
+    // obstacles of a leaf are a range of cellObstacles.  Cells and
+    // obstacles are in the order the queries visit them.
+    struct Cell
+    {
+        int first;      // the first child, or the first obstacle
+        int count;      // the obstacles in and under the cell
+        int childCount; // zero for a leaf
+        int bounds;     // its min x in cellBounds
+        int faceBatch;  // the mesh faces of a leaf in faceBatches, or -1
+    };
+    std::vector<Cell> cells;
+    std::vector<float> cellBounds;
+    std::vector<Obstacle*> cellObstacles;
+    std::vector<MeshFaceBatch*> faceBatches;
+
+    mutable CollisionQuery mainQuery; // for the tests without a query
 
     float worldSize;
     Extents gridExtents;
@@ -119,77 +229,12 @@ private:
 extern CollisionManager COLLISIONMGR;
 
 
-class ColDetNode
-{
-public:
-    ColDetNode(unsigned char depth, const Extents& exts, ObsList *fullList);
-    ~ColDetNode();
-
-    int getCount() const;
-    const ObsList* getList() const;
-    const Extents& getExtents() const;
-    float getInTime() const;
-    float getOutTime() const;
-
-    // these fill in the FullList return list
-    void axisBoxTest (const Extents& extents) const;
-    void boxTest (const float* pos, float angle, float dx, float dy, float dz) const;
-    void rayTest (const Ray* ray, float timeLeft) const;
-    void rayTestNodes (const Ray* ray, float timeLeft) const;
-
-    // this fills in the SplitList return list
-    // (FIXME: not yet implemented, boxTestSplit might be useful for radar)
-    //void boxTestSplit (const float* pos, float angle, float dx, float dy, float dz) const;
-
-    void tallyStats();
-    void draw(DrawLinesFunc drawLinesFunc);
-
-private:
-    void makeChildren ();
-    void resizeCell ();
-
-    unsigned char depth;
-    int count;
-    Extents extents;
-    unsigned char childCount;
-    ColDetNode* children[8];
-    ObsList fullList;
-    mutable float inTime, outTime;
-};
-
-
-inline int ColDetNode::getCount() const
-{
-    return count;
-}
-
-inline const ObsList* ColDetNode::getList() const
-{
-    return &fullList;
-}
-
-inline const Extents& ColDetNode::getExtents() const
-{
-    return extents;
-}
-
-inline float ColDetNode::getInTime() const
-{
-    return inTime;
-}
-
-inline float ColDetNode::getOutTime() const
-{
-    return outTime;
-}
-
-
 inline int CollisionManager::getObstacleCount() const
 {
-    if (root == NULL)
+    if (cells.empty())
         return 0;
     else
-        return root->getCount();
+        return cells[0].count;
 }
 
 inline const Extents& CollisionManager::getWorldExtents() const
@@ -48,6 +48,8 @@ public:
     bool isFlatTop() const;
 
     float intersect(const Ray&) const;
+    /// the box around every point intersect() can hit, with the margin
+    void getHitExtents(Extents& exts) const;
     void getNormal(const float* p, float* n) const;
     void get3DNormal(const float* p, float* n) const;
 
@@ -74,6 +76,7 @@ public:
     const float* getNormal(int index) const;
     const float* getTexcoord(int index) const;
     const float* getPlane() const;
+    const afvec4* getEdgePlanes() const;
     const BzMaterial* getMaterial() const;
     int getPhysicsDriver() const;
     bool noClusters() const;
@@ -99,6 +102,9 @@ public:
 public:
     mutable float scratchPad;
 
+    /// what getHitExtents() grows by for the rounding of box tests
+    static const float boxMargin;
+
 private:
     void finalize();
 
@@ -186,6 +192,11 @@ inline const float* MeshFace::getPlane() const
     return plane;
 }
 
+inline const afvec4* MeshFace::getEdgePlanes() const
+{
+    return edgePlanes;
+}
+
 inline int MeshFace::getVertexCount() const
 {
     return vertexCount;
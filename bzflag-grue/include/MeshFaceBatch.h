@@ -0,0 +1,99 @@
+/* bzflag
+ * Copyright (c) 1993-2021 Tim Riker
+ *
+ * This package is free software;  you can redistribute it and/or
+ * modify it under the terms of the license found in the file
+ * named COPYING that should have accompanied this file.
+ *
+ * THIS PACKAGE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+/* MeshFaceBatch:
+ *  The planes of a group of mesh faces, laid out to test
+ *  one ray against several faces at once.
+ */
+
+#ifndef BZF_MESH_FACE_BATCH_H
+#define BZF_MESH_FACE_BATCH_H
+
+#include "common.h"
+
+// system headers
+#include <vector>
+
+class Ray;
+class MeshFace;
+
+
+/** MeshFaceBatch keeps the plane and the edge planes of its faces side
+    by side, eight faces to a block, so that a ray is tested against a
+    whole block with AVX or SSE2 where the CPU has them.  Blocks whose
+    bounding box the ray misses are skipped.  The results are exactly
+    the ones MeshFace::intersect() gives face by face.
+
+    Faces are added with a slot, intersect() writes the time of each
+    face into its slot of the caller's array.
+*/
+class MeshFaceBatch
+{
+public:
+    MeshFaceBatch();
+
+    void addFace(const MeshFace* face, int slot);
+    void finalize();
+
+    int getCount() const;
+    /// the slots, in the order the faces were added
+    const int* getSlots() const;
+
+    /// times[slot] is where the ray hits the face added with that
+    /// slot, or -1.0f when it misses
+    void intersect(const Ray& ray, float* times) const;
+
+    /// the kernel in use, "avx", "sse2" or "scalar"
+    static const char* getKernelName();
+    /// use the named kernel instead of the fastest one, for testing;
+    /// false if this build or the CPU hasn't got it.  Not to be called
+    /// while any intersect() runs.
+    static bool useKernel(const char* name);
+
+private:
+    struct Block
+    {
+        int offset; // into data
+        int edges;  // the most edges of its faces
+        int slots[8];
+        float mins[3];
+        float maxs[3];
+    };
+
+    std::vector<const MeshFace*> faces;
+    std::vector<int> faceSlots;
+
+    std::vector<Block> blocks;
+    std::vector<float> data;
+};
+
+
+inline int MeshFaceBatch::getCount() const
+{
+    return (int)faceSlots.size();
+}
+
+inline const int* MeshFaceBatch::getSlots() const
+{
+    return faceSlots.empty() ? NULL : &faceSlots[0];
+}
+
+
+#endif // BZF_MESH_FACE_BATCH_H
+
+// Local Variables: ***
+// mode: C++ ***
+// tab-width: 4 ***
+// c-basic-offset: 4 ***
+// indent-tabs-mode: nil ***
+// End: ***
+// ex: shiftwidth=4 tabstop=4
@@ -71,6 +71,10 @@ public:
     static const char* getClassName(); // const
     bool isValid() const;
 
+    // the server unpacks its own database, it keeps the drawInfo and
+    // the extra vertex just the way they were packed
+    static void setServerUnpack(bool value);
+
     float intersect(const Ray&) const;
     void getNormal(const float* p, float* n) const;
     void get3DNormal(const float* p, float* n) const;
@@ -125,8 +129,25 @@ private:
                           const std::vector<int>& _texcoords,
                           float**& v, float**& n, float**& t);
 
+    // bounding volume hierarchy over the faces, for the rays cast by
+    // containsPoint().  an inner node's first child follows it, its
+    // second child is at 'first'.  a leaf holds 'count' faces from
+    // bvhFaces, starting at 'first'.
+    struct BVHNode
+    {
+        float mins[3];
+        float maxs[3];
+        int first;
+        int count;
+    };
+    void makeBVH();
+    int buildBVH(int first, int count, const std::vector<cfvec3>& centers,
+                 const std::vector<float>& boxes);
+    bool segmentHitsFace(const float origin[3], const float dir[3]) const;
+
 private:
     static const char* typeName;
+    static bool serverUnpack;
 
     std::string name;
 
@@ -148,6 +169,9 @@ private:
     // ray-vs-face tests and parity counts.
 
     MeshDrawInfo* drawInfo; // hidden data stored in extra texcoords
+
+    std::vector<BVHNode> bvhNodes;
+    std::vector<int> bvhFaces;
 };
 
 inline const char *MeshObstacle::getCheckTypes() const
@@ -17,14 +17,19 @@
 #include "common.h"
 
 /* system headers */
+#include <deque>
 #include <memory>
 #include <string>
 #include <map>
+#include <unordered_map>
+#include <vector>
 
 /* common interface headers */
 #include "PlayerInfo.h"
 #include "Address.h"
 #include "AresHandler.h"
+#include "NetPoller.h"
+#include "NetMessage.h"
 
 enum RxStatus
 {
@@ -67,6 +72,17 @@ struct MessageCount
 class NetHandler
 {
 public:
+    /** Outbound TCP lanes.  Queued data of a lane only goes out once the
+        lanes before it are empty, so a long chat burst or a world download
+        cannot hold back game state.
+    */
+    enum Lane
+    {
+        StateLane,    // everything not listed below
+        BulkLane,     // chat and world download chunks
+        LaneCount
+    };
+
     /** A default constructor.
         It needs a pointer to the Player basic Info,
         a socket address to address subsequent message at user,
@@ -91,32 +107,42 @@ public:
     static bool   initHandlers(struct sockaddr_in addr);
     static void   destroyHandlers();
 
-    /// General function to support the select statement
-    static void   setFd(fd_set *read_set, fd_set *write_set, int &maxFile);
-    static bool   isUdpFdSet(fd_set *read_set);
-    bool      isFdSet(fd_set *set);
+    /// Sockets are registered with the poller for as long as they live
+    static void   setPoller(NetPoller *poller);
+    static NetHandler*    getHandlerByFD(int fd);
 
     /// Supporting DNS Asynchronous resolver
+    static void   setDNSFd(fd_set *read_set, fd_set *write_set, int &maxFile);
     static void   checkDNS(fd_set *read_set, fd_set *write_set);
 
     /// return the opened socket, usable from all other network internal client
     static int    getUdpSocket();
 
+    /** Send queue limits, in bytes.
+        A player whose queue grows past high counts as congested until it
+        drains below low again, a player queueing more than max is kicked.
+    */
+    static void   setQueueLimits(int low, int high, int max);
+
 
     /**
         udpReceive will try to get the next udp message received
 
-        return the playerIndex if found, -1 when no player had an open udp
-        connection or -2 when a Ping Code Request has been detected.
+        return the playerIndex if found, -1 when there is nothing left to
+        read or -2 when a Ping Code Request has been detected.  Datagrams
+        that do not belong to any player are skipped.
 
-        buffer is the received message
+        buffer points at the received message, it stays valid until the
+        next call.  Datagrams are read from the socket in batches, so call
+        hasBufferedUDP() before relying on the socket readiness again.
 
         uaddr is the identifier of the remote address
 
         udpLinkRequest report if the received message is a valid udpLinkRequest
     */
-    static int    udpReceive(char *buffer, struct sockaddr_in *uaddr,
+    static int    udpReceive(char *&buffer, struct sockaddr_in *uaddr,
                              bool &udpLinkRequest);
+    static bool   hasBufferedUDP();
 
     /**
        tcpReceive try to get a message from the tcp connection
@@ -138,12 +164,38 @@ public:
         return pendingUDP;
     };
 
+    /// Number of complete messages received from players since the last reset
+    static unsigned long  getReceivedCount()
+    {
+        return receivedCount;
+    }
+    static void   resetReceivedCount()
+    {
+        receivedCount = 0;
+    }
+
+    /// UDP traffic and the system calls it took since the last reset
+    struct UdpStats
+    {
+        unsigned long datagramsIn;
+        unsigned long recvCalls;
+        unsigned long datagramsOut;
+        unsigned long sendCalls;
+    };
+    static const UdpStats& getUdpStats()
+    {
+        return udpStats;
+    }
+    static void   resetUdpStats();
+
     /// Send all buffered UDP messages, if any
     void      flushUDP();
     static void   flushAllUDP();
 
     int       pwrite(const void *b, int l);
-    int       pflush(fd_set *set);
+    /// queue a shared message, it is referenced instead of copied
+    int       pwrite(NetMessage *msg);
+    int       pflush();
     std::string   reasonToKick();
     const std::string getPlayerHostInfo();
     const char*   getTargetIP();
@@ -163,6 +215,26 @@ public:
         return outmsgSize > 0;
     }
 
+    /// send queue statistics
+    int       getQueuedBytes() const
+    {
+        return outmsgSize;
+    }
+    int       getPeakQueuedBytes() const
+    {
+        return peakQueued;
+    }
+    unsigned long getBytesDropped() const
+    {
+        return bytesDropped;
+    }
+    bool      isCongested() const
+    {
+        return congested;
+    }
+    float     getTimeAboveWatermark() const;
+    void      resetQueueStats();
+
     void      setPlayer ( PlayerInfo* p, int index );
 
     int       getPlayerID ( void )
@@ -195,13 +267,45 @@ public:
     {
         tcplen = 0;
     }
-    int       bufferedSend(const void *buffer, size_t length);
+    int       bufferedSend(const void *buffer, size_t length,
+                           Lane lane = StateLane);
+    int       bufferedSend(NetMessage *msg, Lane lane = StateLane);
 
     void      SetAllowUDP(bool set);
 private:
+    struct OutSegment
+    {
+        NetMessage    *msg;
+        size_t    offset;
+    };
+    struct UdpSegment
+    {
+        NetMessage    *msg; // NULL when the data was copied to udpOutputBuffer
+        const char    *data;
+        int       len;
+    };
+    enum
+    {
+        maxUdpSegments = 32
+    };
+
     int       send(const void *buffer, size_t length);
-    void      udpSend(const void *b, size_t l);
+    int       sendError();
+    int       sendQueue();
+    int       queueSend(const char *buffer, size_t length, NetMessage *shared,
+                        Lane lane);
+    void      updateWatermark();
+    bool      isUdpMessage(uint16_t code) const;
+    static Lane   laneFor(uint16_t code);
+    void      udpSend(const void *b, size_t l, NetMessage *shared = NULL);
+    void      udpAppend(const void *b, size_t l, NetMessage *shared);
+    void      udpRelease();
     bool      isMyUdpAddrPort(struct sockaddr_in uaddr);
+    static int    udpHandle(const char *buffer, int n, struct sockaddr_in *uaddr,
+                            bool &udpLinkRequest);
+    void      udpSendTo(const void *b, size_t l);
+    void      forgetUdpAddrPort();
+    void      registerFD();
 #ifdef NETWORK_STATS
     void      countMessage(uint16_t code, int len, int direction);
     void      dumpMessageStats();
@@ -211,6 +315,17 @@ private:
     static int    udpSocket;
     static NetHandler*    netPlayer[maxHandlers];
     static bool   pendingUDP;
+    static NetPoller* poller;
+    static unsigned long  receivedCount;
+    static std::vector<NetHandler*>   handlerByFD;
+    /// players by (address << 16 | port) of their inbound udp link
+    static std::unordered_map<uint64_t, int>  udpSenders;
+    /// players with udp output waiting for flushAllUDP()
+    static std::vector<NetHandler*>   udpQueue;
+    static UdpStats   udpStats;
+    static int    queueLowWater;
+    static int    queueHighWater;
+    static int    queueMaxBytes;
 
     AresHandler   *ares;
 
@@ -235,14 +350,26 @@ private:
     /// Closing flag
     bool      closed;
 
-    /// output buffer
-    int       outmsgOffset;
+    /// output queue, messages not yet (completely) sent
+    std::deque<OutSegment>    outQueue[LaneCount];
     int       outmsgSize;
-    int       outmsgCapacity;
-    char*     outmsg;
+    /// lane whose first message went out in part, it has to be finished first
+    int       partialLane;
+
+    /// send queue statistics
+    int       peakQueued;
+    unsigned long bytesDropped;
+    bool      congested;
+    TimeKeeper    congestedSince;
+    float     congestedTime;
 
+    /// udp output, the next datagram is gathered from these segments
     char      udpOutputBuffer[MaxPacketLen];
+    int       udpCopiedLen;
+    UdpSegment    udpSegments[maxUdpSegments];
+    int       udpSegmentCount;
     int       udpOutputLen;
+    bool      udpQueued;
 
     /// UDP connection
     bool      udpin; // udp inbound up, player is sending us udp
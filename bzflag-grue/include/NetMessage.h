@@ -0,0 +1,87 @@
+/* bzflag
+ * Copyright (c) 1993-2021 Tim Riker
+ *
+ * This package is free software;  you can redistribute it and/or
+ * modify it under the terms of the license found in the file
+ * named COPYING that should have accompanied this file.
+ *
+ * THIS PACKAGE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef __NETMESSAGE_H__
+#define __NETMESSAGE_H__
+
+/* common header */
+#include "common.h"
+
+/* system headers */
+#include <stddef.h>
+
+/** A packed message, header included, that can be queued for any number
+    of players without copying it.
+
+    A new message holds one reference.  Every outbound queue that keeps
+    the message around takes its own with ref(), and whoever is done with
+    it calls unref().  The last unref() frees the message.
+*/
+class NetMessage
+{
+public:
+    /// pack the header in front of len bytes of payload
+    static NetMessage*    create(uint16_t code, uint16_t len, const void *payload);
+    /// raw bytes, usually the unsent tail of a message
+    static NetMessage*    copy(const void *data, size_t size);
+
+    void      ref()
+    {
+        refCount++;
+    }
+    void      unref();
+
+    uint16_t  getCode() const
+    {
+        return code;
+    }
+    uint16_t  getLen() const
+    {
+        return len;
+    }
+
+    /// header and payload, getSize() bytes
+    const char*   getData() const
+    {
+        return (const char*)(this + 1);
+    }
+    size_t    getSize() const
+    {
+        return size;
+    }
+
+private:
+    static NetMessage*    allocate(size_t size);
+
+    NetMessage(size_t _size) : refCount(1), code(0), len(0), size(_size) {}
+    ~NetMessage() {}
+
+    char*     getBuffer()
+    {
+        return (char*)(this + 1);
+    }
+
+    int       refCount;
+    uint16_t  code;
+    uint16_t  len;
+    size_t    size;
+};
+
+#endif
+
+// Local Variables: ***
+// mode: C++ ***
+// tab-width: 4 ***
+// c-basic-offset: 4 ***
+// indent-tabs-mode: nil ***
+// End: ***
+// ex: shiftwidth=4 tabstop=4
@@ -0,0 +1,165 @@
+/* bzflag
+ * Copyright (c) 1993-2021 Tim Riker
+ *
+ * This package is free software;  you can redistribute it and/or
+ * modify it under the terms of the license found in the file
+ * named COPYING that should have accompanied this file.
+ *
+ * THIS PACKAGE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef __NETPOLLER_H__
+#define __NETPOLLER_H__
+
+// bzflag global header
+#include "global.h"
+
+/* system interface headers */
+#include <vector>
+
+/* common interface headers */
+#include "network.h"
+
+/** NetPoller waits for socket readiness on behalf of the server main loop.
+
+    Long lived sockets (listen socket, udp socket, player connections) are
+    registered once with add() and stay registered until remove().  Only the
+    sockets that are actually ready are reported back by wait(), so the cost
+    of a wakeup does not depend on the number of connected players.
+
+    Libraries that can only describe their interest with an fd_set (libcurl,
+    c-ares) hand it over each iteration with setTransient(); their results
+    come back as fd_sets through getTransientReadSet() and
+    getTransientWriteSet().
+
+    Sockets added as edge triggered are only reported when new data
+    arrives.  A consumer that stops reading before the socket would block
+    must call setPending() so the socket is reported again on the next
+    wait().
+*/
+class NetPoller
+{
+public:
+    enum Backend
+    {
+        SelectBackend,
+        EpollBackend
+    };
+
+    struct Event
+    {
+        int   fd;
+        bool  readable;
+        bool  writable;
+    };
+
+    /// create a poller using the requested backend, or select() when the
+    /// backend is not available on this platform
+    static NetPoller* create(Backend preferred);
+    static bool       isAvailable(Backend backend);
+    static bool       parseBackend(const char *name, Backend &backend);
+
+    virtual ~NetPoller();
+
+    virtual Backend   getBackend() const = 0;
+    const char*   getName() const;
+
+    /// register a socket for read readiness
+    void      add(int fd, bool edgeTriggered = false);
+    void      remove(int fd);
+    bool      isRegistered(int fd) const;
+
+    /// also report the socket when it becomes writable
+    void      setWantWrite(int fd, bool want);
+
+    /// report the socket as readable on the next wait() without asking the kernel
+    void      setPending(int fd);
+
+    /// fd_set interest of the libraries that cannot register sockets themselves
+    void      setTransient(fd_set &read_set, fd_set &write_set, int maxFile);
+
+    /// wait up to timeout seconds, returns the number of ready sockets or -1
+    int       wait(float timeout);
+
+    const std::vector<Event>& getEvents() const
+    {
+        return events;
+    }
+    fd_set*   getTransientReadSet()
+    {
+        return &transientReadReady;
+    }
+    fd_set*   getTransientWriteSet()
+    {
+        return &transientWriteReady;
+    }
+
+    /// statistics
+    unsigned long getWakeups() const
+    {
+        return wakeups;
+    }
+    unsigned long getEventCount() const
+    {
+        return eventCount;
+    }
+    int       getRegisteredCount() const
+    {
+        return registeredCount;
+    }
+    void      resetStats();
+
+protected:
+    NetPoller();
+
+    enum FdFlags
+    {
+        Registered     = 1 << 0,
+        EdgeTriggered  = 1 << 1,
+        WantWrite      = 1 << 2,
+        TransientRead  = 1 << 3,
+        TransientWrite = 1 << 4,
+        Pending        = 1 << 5
+    };
+
+    unsigned char getFlags(int fd) const
+    {
+        return (fd >= 0 && fd < (int)fdFlags.size()) ? fdFlags[fd] : 0;
+    }
+    void      setFlags(int fd, unsigned char flags);
+
+    /// backend hooks, called whenever the interest for fd changes
+    virtual void  updateInterest(int fd, unsigned char oldFlags,
+                                 unsigned char newFlags) = 0;
+    /// backend wait, appends ready sockets through addEvent()
+    virtual int   backendWait(float timeout) = 0;
+
+    void      addEvent(int fd, bool readable, bool writable);
+
+    std::vector<unsigned char>    fdFlags;
+    int       maxRegistered;
+
+private:
+    std::vector<Event>    events;
+    std::vector<int>  pending;
+    std::vector<int>  transientFds;
+    fd_set    transientReadReady;
+    fd_set    transientWriteReady;
+    int       transientReady;
+
+    int       registeredCount;
+    unsigned long wakeups;
+    unsigned long eventCount;
+};
+
+#endif
+
+// Local Variables: ***
+// mode: C++ ***
+// tab-width: 4 ***
+// c-basic-offset: 4 ***
+// indent-tabs-mode: nil ***
+// End: ***
+// ex: shiftwidth=4 tabstop=4
@@ -234,10 +234,10 @@ public:
     int getInsideSceneNodeCount() const;
     SceneNode** getInsideSceneNodeList() const;
 
-    /** This boolean is used by CollisionManager.
-        Someone else can 'friend'ify it later.
+    /** Position in the CollisionManager's obstacle list, set by its
+        load().  Queries use it to tell which obstacles they have seen.
     */
-    bool collisionState;
+    int collisionIndex;
 
     /** The maximum extent of any object parameter
      */
@@ -47,6 +47,9 @@ const char* const   DefaultMOTDServer = "https://www.bzflag.org/motd.php";
 const int       MaxPacketLen = 1024;
 const int       MaxUDPPacketLen = 68;
 
+// most of the world database a server sends ahead of MsgGetWorld requests
+const int       MaxWorldWindow = 256 * 1024;
+
 // the banned tag
 const char* const   BanRefusalString = "REFUSED:";
 
@@ -206,8 +209,10 @@ player to server messages:
             --> /id/
             <== MsgRemovePlayer
   MsgGetWorld       request for playing field database
-            --> bytes read so far
+            --> bytes read so far[, window]
             <-- MsgGetWorld
+            with a window, MsgGetWorld chunks keep coming until
+            bytes read so far + window
   MsgQueryGame      request for game state
             <-- MsgQueryGame
   MsgQueryPlayers   request for player list
@@ -273,7 +278,7 @@ server to player messages:
   MsgTeamUpdate     update of team info
             <== teamcount, [team, team-info]
   MsgGetWorld       chunk of world database
-            <-- bytes left, next 256 byte chunk of world database
+            <-- bytes left, next chunk of world database
   MsgAlive      player is alive
             <== id, position, forward-vector
   MsgKilled     player is dead
@@ -297,7 +302,7 @@ server to player messages:
   MsgQueryGame      game status
   MsgQueryPlayers   list of players
   MsgWantWHash      md5 digest of world file
-            <== temp|perm, digest
+            <== temp|perm, digest[, max window]
   MsgNegotiateFlags <== flagCount/[flagabbv]
   MsgNewRabbit      a new rabbit has been anointed
             <== id
@@ -47,6 +47,9 @@
  */
 class StateDatabase : public Singleton<StateDatabase>
 {
+private:
+    struct Item;
+
 public:
 
     typedef void (*Callback)(const std::string& name, void* userData);
@@ -168,6 +171,42 @@ public:
     bool              evalTriplet(const std::string& name, float data[3]);
     bool              evalPair(const std::string& name, float data[2]);
 
+    /** a handle names an entry without the lookup.  get one once with
+     * getHandle() and keep it, it stays valid for the life of the
+     * database whether or not the name is set.  reading the value of an
+     * unchanged entry through a handle is a single load.
+     */
+    class Handle
+    {
+    public:
+        Handle() : item(NULL) {}
+
+        bool              isValid() const
+        {
+            return item != NULL;
+        }
+
+    private:
+        friend class StateDatabase;
+        Handle(Item *_item) : item(_item) {}
+
+        Item*             item;
+    };
+
+    /** resolve a name to a handle.  neither adds an entry, both return
+     * an invalid handle for unknown names.  getHandle() is for names
+     * that must exist, it also asserts.
+     */
+    Handle            getHandle(const std::string& name);
+    Handle            findHandle(const std::string& name);
+
+    /** the same as the name based calls, the handle must be valid
+     */
+    float             eval(Handle handle);
+    bool              isSet(Handle handle) const;
+    bool              isTrue(Handle handle) const;
+    const std::string&        get(Handle handle) const;
+
     /** return true if the value associated with a name indicates
      * logical true, which is when the value is not empty and not
      * "0" and not "false" and not "no".
@@ -353,6 +392,20 @@ private:
     static bool           onCallback(Callback, void* userData,
                                      void* iterateData);
 
+    /** one step of a compiled expression, see compile()
+     */
+    struct Instruction
+    {
+    public:
+        enum Code { Number, Variable, Oper };
+
+        Code            code;
+        int             oper;
+        double          number;
+        Item*           variable;
+    };
+    typedef std::vector<Instruction> Program;
+
     struct Item
     {
     public:
@@ -366,15 +419,36 @@ private:
         bool            save;
         Permission          permission;
         CallbackList<Callback>  callbacks;
+
+        // eval() result, kept until this entry or one it reads changes
+        bool            evalValid;
+        float           evalValue;
+        bool            evaluating;
+
+        // the value compiled to postfix, and the entries it reads.  a
+        // name that does not exist yet is read as NaN
+        bool            compiled;
+        Program         program;
+        std::vector<Item*>      readsFrom;
+        std::vector<Item*>      readBy;
     };
     typedef std::map<std::string, Item> Map;
 
     Map::iterator         lookup(const std::string&);
     void              notify(Map::iterator);
 
+    float             evalItem(Item& item);
+    void              compile(Item& item);
+    void              uncompile(Item& item);
+    void              invalidate(Item& item);
+    float             execute(const Program& program);
+
 private:
     Map               items;
 
+    /// entries whose programs read names that did not exist yet
+    std::vector<Item*>        unresolvedReaders;
+
 public:
     class ExpressionToken
     {
@@ -416,9 +490,6 @@ public:
 
 private:
     static Expression     infixToPrefix(const Expression &infix);
-    float             evaluate(Expression e) const;
-    typedef std::map<std::string,float> EvalMap;
-    EvalMap           evalCache;
     bool              debug;
     bool              saveDefault;
     CallbackList<Callback>    globalCallbacks;
@@ -434,6 +505,30 @@ inline bool StateDatabase::getSaveDefault() const
     return saveDefault;
 }
 
+inline float StateDatabase::eval(Handle handle)
+{
+    Item *item = handle.item;
+    if (item->evalValid)
+        return item->evalValue;
+    return evalItem(*item);
+}
+
+inline bool StateDatabase::isSet(Handle handle) const
+{
+    return handle.item->isSet;
+}
+
+inline bool StateDatabase::isTrue(Handle handle) const
+{
+    return handle.item->isTrue;
+}
+
+inline const std::string& StateDatabase::get(Handle handle) const
+{
+    // unset entries always hold the empty string
+    return handle.item->value;
+}
+
 
 std::istream& operator>>(std::istream& src, StateDatabase::Expression& dst);
 std::string& operator>>(std::string& src, StateDatabase::Expression& dst);
@@ -18,6 +18,7 @@
 /* system interface headers */
 #include <string>
 #include <set>
+#include <vector>
 #include <algorithm>
 #include <string.h>
 
@@ -81,6 +82,11 @@
  * necessary to list all tenses of certain verbs, unless the rules can be
  * strictly and simply quantified.
  *
+ * All of the words are matched together in one pass over the input, by a
+ * tree of their letters that is walked with every reading of each input
+ * character at once (see findWords()), so the cost hardly grows with the
+ * number of words.  Only the words found that way are then located exactly.
+ *
  * There is also a simple filter mode which is not as resource intensive and
  * performs a literal match with the filter words (so you have to specify
  * absolutely everything you want to filter and all variations).    It is still
@@ -90,12 +96,12 @@ class WordFilter
 {
 public:
 
-    /** structure for a single filter word, and a compiled regular expression
+    /** structure for a single filter word, and its index in the matcher
      */
     typedef struct filterStruct
     {
         std::string word;
-        regex_t *compiled;
+        int index;
     } filter_t;
 
 
@@ -107,7 +113,7 @@ private:
     /** set of characters used to replace filtered content */
     std::string filterChars;
 
-    /** word expressions to be filtered including compiled regexp versions */
+    /** words to be filtered */
     struct expressionCompare
     {
         bool operator() (const filter_t& word1, const filter_t& word2) const
@@ -134,6 +140,33 @@ private:
     ExpCompareSet prefixes;
 
 
+    /** a letter of the filter words in the match tree.  words that
+     * start the same share their nodes, node 0 is the root.
+     */
+    struct MatchNode
+    {
+        char symbol;
+        /** index of the filter word ending here, or -1 */
+        int word;
+        /** the following letters, sorted by symbol */
+        std::vector<std::pair<char, int> > next;
+    };
+
+    /** used by the agressive filter */
+    std::vector<MatchNode> matchTree;
+
+    /** how many words have been added to the match tree */
+    int matchWords;
+
+    /** the filter word letters each input character may stand for */
+    std::vector<std::string> symbolsFor;
+
+    /** whether a character may stand for a letter, by letter * 256 +
+     * character
+     */
+    std::vector<bool> symbolMatches;
+
+
     /** utility method performs an actual replacement of
      * characters in an input character ray within a specified
      * range.
@@ -153,6 +186,16 @@ private:
      */
     inline void addSuffix(const char *word);
 
+    /** utility method tells whether character c may stand for a letter of
+     * a filter word
+     */
+    inline bool symbolMatch(char symbol, char c) const;
+
+    /** utility method returns the ways a run of a filter word letter may go
+     * on after character c, as a mask of gap states (see findWords())
+     */
+    inline unsigned int stayStates(char symbol, unsigned int state, char c) const;
+
 
 protected:
 
@@ -179,23 +222,46 @@ protected:
      */
     bool aggressiveFilter(char *input) const;
 
-    /** provides a pointer to a fresh compiled
-     * expression for some given expression
+    /** sets up which characters may stand for which
+     * letters of the filter words
+     */
+    void makeSymbolTable(void);
+
+    /** adds a word to the match tree */
+    void addToMatchTree(const std::string &word, int index);
+
+    /** marks the words of the match tree that can be
+     * found anywhere in the input, by their index
+     */
+    void findWords(const std::string &input, std::vector<bool> &found) const;
+
+    /** the end of the longest match of a word starting
+     * at a given position of the input, or -1
+     */
+    int findMatchEnd(const std::string &word, const std::string &input, int start) const;
+
+    /** finds the leftmost, and then longest, match of
+     * a word in the input
      */
-    regex_t *getCompiledExpression(const std::string &expression) const;
+    bool findMatch(const std::string &word, const std::string &input, int &start, int &end) const;
 
     /** returns a set of characters that represent the
      * given character in "l33t-speak"
      */
     std::string l33tspeakSetFromCharacter(const char c) const;
 
+    /** returns the set of characters a letter of a
+     * filter word matches
+     */
+    std::string symbolSetFromCharacter(const char c) const;
+
     /** returns what alphabetic character a given char
      * corresponds to (e.g. 3 => e, | => il)
      */
     std::string alphabeticSetFromCharacter(const char c) const;
 
-    /** expands a word into an uncompiled regular
-     *  expression.
+    /** expands a word into a regular expression that
+     *  describes what the word matches.
      */
     std::string expressionFromString(const std::string &word) const;
 
@@ -298,29 +364,67 @@ inline void WordFilter::appendUniqueChar(std::string& string, char c) const
 inline void WordFilter::addPrefix(const char *word)
 {
     filter_t fix;
-    std::pair<ExpCompareSet::iterator, bool> result;
     fix.word = std::string(word);
-    fix.compiled = getCompiledExpression(expressionFromString(fix.word));
-    result = prefixes.insert(fix);
-    if (!result.second && fix.compiled)
-    {
-        regfree(fix.compiled);
-        free(fix.compiled);
-    }
+    fix.index = -1;
+    prefixes.insert(fix);
 }
 
 inline void WordFilter::addSuffix(const char *word)
 {
     filter_t fix;
-    std::pair<ExpCompareSet::iterator, bool> result;
     fix.word = std::string(word);
-    fix.compiled = getCompiledExpression(expressionFromString(fix.word));
-    result = suffixes.insert(fix);
-    if (!result.second && fix.compiled)
+    fix.index = -1;
+    suffixes.insert(fix);
+}
+
+
+inline bool WordFilter::symbolMatch(char symbol, char c) const
+{
+    return symbolMatches[((unsigned char)symbol << 8) | (unsigned char)c];
+}
+
+
+/* a run of a letter is in state 0 while it repeats and in state 1 in the
+ * punctuation and white-space after it.  an 'f' may be followed by an 'h'
+ * ("ph"), right away (state 2) or after some punctuation (state 3).
+ */
+inline unsigned int WordFilter::stayStates(char symbol, unsigned int state, char c) const
+{
+    const bool gap = !isalpha((unsigned char)c);
+    const bool h = (c == 'h') || (c == 'H');
+    unsigned int states = 0;
+
+    if (symbol != 'f')
+    {
+        if ((state == 0) && symbolMatch(symbol, c))
+            states |= 1 << 0;
+        if (gap)
+            states |= 1 << 1;
+        return states;
+    }
+
+    switch (state)
     {
-        regfree(fix.compiled);
-        free(fix.compiled);
+    case 0:
+        if (symbolMatch(symbol, c))
+            states |= 1 << 0;
+        if (h)
+            states |= 1 << 2;
+        if (gap)
+            states |= 1 << 1;
+        break;
+    case 1:
+        if (h)
+            states |= 1 << 3;
+        if (gap)
+            states |= 1 << 1;
+        break;
+    default:
+        if (gap)
+            states |= 1 << 3;
+        break;
     }
+    return states;
 }
 
 
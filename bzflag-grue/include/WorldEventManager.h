@@ -32,6 +32,12 @@ class bz_EventHandler
 {
 public:
     bz_Plugin *plugin;
+
+    bz_EventHandler() : plugin(NULL)
+    {
+        for (int i = 0; i < bz_eLastEvent; i++)
+            handles[i] = false;
+    }
     virtual ~bz_EventHandler()
     {
         plugin = NULL;
@@ -46,6 +52,8 @@ public:
 
     bool HasEvent( bz_eEventType evt)
     {
+        if (evt >= 0 && evt < bz_eLastEvent)
+            return handles[evt];
         return std::find(HandledEvents.begin(),HandledEvents.end(),evt) != HandledEvents.end();
     }
 
@@ -53,6 +61,8 @@ public:
     {
         if (std::find(HandledEvents.begin(),HandledEvents.end(),evt) == HandledEvents.end())
             HandledEvents.push_back(evt);
+        if (evt >= 0 && evt < bz_eLastEvent)
+            handles[evt] = true;
     }
 
     void RemoveEvent( bz_eEventType evt )
@@ -61,7 +71,30 @@ public:
 
         if ( itr!= HandledEvents.end())
             HandledEvents.erase(itr);
+        if (evt >= 0 && evt < bz_eLastEvent)
+            handles[evt] = false;
+    }
+
+    void ClearEvents()
+    {
+        HandledEvents.clear();
+        for (int i = 0; i < bz_eLastEvent; i++)
+            handles[i] = false;
     }
+
+    // time spent in process(), including any events it fires itself
+    struct EventStats
+    {
+        EventStats() : calls(0), seconds(0.0), maxSeconds(0.0) {}
+
+        unsigned long calls;
+        double seconds;
+        double maxSeconds;
+    };
+    EventStats stats[bz_eLastEvent];
+
+private:
+    bool handles[bz_eLastEvent];
 };
 
 typedef std::vector<bz_EventHandler*> tvEventList;
@@ -79,9 +112,32 @@ public:
     void callEvents ( bz_eEventType eventType, bz_EventData   *eventData );
     void callEvents ( bz_EventData    *eventData );
 
+    // true if calling the event would reach anybody, so the caller can
+    // skip filling in the event data when it wouldn't
+    bool hasHandlers ( bz_eEventType eventType ) const
+    {
+        if (eventType >= 0 && eventType < bz_eLastEvent)
+            return !dispatchTable[eventType].empty();
+        return !eventList.empty();
+    }
+
+    const tvEventList& getHandlers ( void ) const
+    {
+        return eventList;
+    }
+    void resetStats ( void );
+
+    static const char* getEventName ( bz_eEventType eventType );
+
 private:
     tvEventList eventList;
 
+    // the handlers of each event type, in eventList order
+    tvEventList dispatchTable[bz_eLastEvent];
+    bool dispatchChanged;
+
+    void updateDispatch();
+
 protected:
 
     void processPending();
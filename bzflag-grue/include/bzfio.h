@@ -28,6 +28,11 @@ public:
     virtual ~LoggingCallback() {};
 
     virtual void log ( int level, const char* message ) = 0;
+    /// false if messages of this level would not be used at all
+    virtual bool wants ( int )
+    {
+        return true;
+    }
 };
 
 extern LoggingCallback  *loggingCallback;
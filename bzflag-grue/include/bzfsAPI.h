@@ -1568,6 +1568,12 @@ BZF_API int bz_getPlayerLag( int playerId );
 BZF_API int bz_getPlayerJitter( int playerId );
 BZF_API float bz_getPlayerPacketloss( int playerId );
 
+// player send queue info
+BZF_API int bz_getPlayerSendQueue( int playerId );
+BZF_API int bz_getPlayerSendQueuePeak( int playerId );
+BZF_API unsigned int bz_getPlayerBytesDropped( int playerId );
+BZF_API float bz_getPlayerTimeAboveWatermark( int playerId );
+
 class BZF_API bz_BasePlayerRecord
 {
 public:
@@ -1886,6 +1892,52 @@ BZF_API bool bz_registerCustomSlashCommand ( const char* command, bz_CustomSlash
 BZF_API bool bz_registerCustomSlashCommand (const char* command, bz_CustomSlashCommandHandler *handler);
 BZF_API bool bz_removeCustomSlashCommand ( const char* command );
 
+// timers
+
+// Call() runs from the server main loop once the delay has passed. Return
+// the number of seconds until the next call, or a negative value to stop.
+// Cancel pending timers in Cleanup(), the server does not do it for you.
+class bz_ScheduledCallback
+{
+public:
+    virtual ~bz_ScheduledCallback() {};
+    virtual float Call() = 0;
+};
+
+BZF_API int bz_scheduleCallback ( float delay, bz_ScheduledCallback *callback );
+BZF_API bool bz_cancelScheduledCallback ( int timerID );
+
+// deferred work
+
+// Run() is called from the server main loop, the server deletes the
+// callback afterwards. Unloading the plugin drops the callbacks it posted
+// that haven't run yet, without calling Run().
+class bz_MainThreadCallback
+{
+public:
+    virtual ~bz_MainThreadCallback() {};
+    virtual void Run() = 0;
+};
+
+// Work() runs on a worker thread and may block, but must not touch the
+// server. Done() then runs from the main loop, where the results can be
+// used, and the server deletes the job afterwards. Unloading a plugin
+// waits a few seconds for the jobs it started; Done() is not called for
+// those that take longer.
+class bz_AsyncJob
+{
+public:
+    virtual ~bz_AsyncJob() {};
+    virtual void Work() = 0;
+    virtual void Done() {};
+};
+
+// these two are the only API calls that may be made from other threads.
+// They return false while the plugin is being unloaded, the callback or
+// job is then not taken and still has to be deleted by the caller.
+BZF_API bool bz_postToMainThread ( bz_MainThreadCallback *callback, bz_Plugin *plugin );
+BZF_API bool bz_runAsync ( bz_AsyncJob *job, bz_Plugin *plugin );
+
 // spawning
 BZF_API bool bz_getStandardSpawn ( int playerID, float pos[3], float *rot );
 
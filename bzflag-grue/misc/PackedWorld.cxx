@@ -0,0 +1,138 @@
+/* bzflag
+ * Copyright (c) 1993-2021 Tim Riker
+ *
+ * This package is free software;  you can redistribute it and/or
+ * modify it under the terms of the license found in the file
+ * named COPYING that should have accompanied this file.
+ *
+ * THIS PACKAGE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+// interface header
+#include "PackedWorld.h"
+
+// system headers
+#include <stdio.h>
+#include <vector>
+#include <zlib.h>
+
+// common headers
+#include "BZDBCache.h"
+#include "BzMaterial.h"
+#include "CollisionManager.h"
+#include "DynamicColor.h"
+#include "MeshObstacle.h"
+#include "MeshTransform.h"
+#include "ObstacleMgr.h"
+#include "Pack.h"
+#include "PhysicsDriver.h"
+#include "Protocol.h"
+#include "StateDatabase.h"
+#include "TextureMatrix.h"
+#include "global.h"
+
+
+static bool readFile(const std::string& fileName, std::vector<char>& data)
+{
+    FILE* file = fopen(fileName.c_str(), "rb");
+    if (file == NULL)
+        return false;
+    char chunk[65536];
+    size_t got;
+    while ((got = fread(chunk, 1, sizeof(chunk), file)) > 0)
+        data.insert(data.end(), chunk, chunk + got);
+    const bool good = !ferror(file);
+    fclose(file);
+    return good;
+}
+
+
+bool loadPackedWorld(const std::string& fileName, float worldSize)
+{
+    for (unsigned int gi = 0; gi < numGlobalDBItems; ++gi)
+    {
+        if (globalDBItems[gi].value != NULL)
+            BZDB.set(globalDBItems[gi].name, globalDBItems[gi].value);
+    }
+    BZDB.setFloat(StateDatabase::BZDB_WORLDSIZE, worldSize);
+    BZDBCache::init();
+
+    std::vector<char> data;
+    if (!readFile(fileName, data))
+    {
+        printf("* Could not read %s\n", fileName.c_str());
+        return false;
+    }
+
+    // the header of the network copy, as WorldBuilder::unpack() reads it
+    uint16_t len, code, version;
+    uint32_t uncompressedSize, compressedSize;
+    const void* buf = &data[0];
+    if (data.size() < WorldCodeHeaderSize + 4)
+    {
+        printf("* %s is too short for a world\n", fileName.c_str());
+        return false;
+    }
+    buf = nboUnpackUShort(buf, len);
+    buf = nboUnpackUShort(buf, code);
+    buf = nboUnpackUShort(buf, version);
+    buf = nboUnpackUInt(buf, uncompressedSize);
+    buf = nboUnpackUInt(buf, compressedSize);
+    if ((code != WorldCodeHeader) || (version != mapVersion) ||
+            ((size_t)compressedSize > (data.size() - WorldCodeHeaderSize - 4)))
+    {
+        printf("* %s was not written by bzfs -cacheout\n", fileName.c_str());
+        return false;
+    }
+
+    std::vector<char> world(uncompressedSize);
+    uLongf destLen = uncompressedSize;
+    if ((uncompress((Bytef*)&world[0], &destLen, (const Bytef*)buf,
+                    compressedSize) != Z_OK) || (destLen != uncompressedSize))
+    {
+        printf("* Could not decompress %s\n", fileName.c_str());
+        return false;
+    }
+
+    // the obstacles and what they refer to, the teleporter links and
+    // the rest after them play no part in collisions
+    nboUseErrorChecking(true);
+    nboSetBufferLength(uncompressedSize);
+    nboClearBufferError();
+    buf = &world[0];
+    DYNCOLORMGR.clear();
+    buf = DYNCOLORMGR.unpack(buf);
+    TEXMATRIXMGR.clear();
+    buf = TEXMATRIXMGR.unpack(buf);
+    MATERIALMGR.clear();
+    buf = MATERIALMGR.unpack(buf);
+    PHYDRVMGR.clear();
+    buf = PHYDRVMGR.unpack(buf);
+    TRANSFORMMGR.clear();
+    buf = TRANSFORMMGR.unpack(buf);
+    OBSTACLEMGR.clear();
+    MeshObstacle::setServerUnpack(true);
+    buf = OBSTACLEMGR.unpack(buf);
+    MeshObstacle::setServerUnpack(false);
+    nboUseErrorChecking(false);
+    if (nboGetBufferError())
+    {
+        printf("* %s overran while unpacking\n", fileName.c_str());
+        return false;
+    }
+
+    OBSTACLEMGR.makeWorld();
+    COLLISIONMGR.load();
+    return true;
+}
+
+
+// Local Variables: ***
+// mode: C++ ***
+// tab-width: 4 ***
+// c-basic-offset: 4 ***
+// indent-tabs-mode: nil ***
+// End: ***
+// ex: shiftwidth=4 tabstop=4
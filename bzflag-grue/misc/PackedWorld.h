@@ -0,0 +1,45 @@
+/* bzflag
+ * Copyright (c) 1993-2021 Tim Riker
+ *
+ * This package is free software;  you can redistribute it and/or
+ * modify it under the terms of the license found in the file
+ * named COPYING that should have accompanied this file.
+ *
+ * THIS PACKAGE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+//  PackedWorld.h
+//    Loads the world database written by bzfs -cacheout, the way the
+//    client unpacks it, and builds the collision octree over it.  It
+//    lets the tools in misc work on real maps without the BZW reader.
+
+#ifndef __PACKEDWORLD_H__
+#define __PACKEDWORLD_H__
+
+
+#include "common.h"
+
+// system headers
+#include <string>
+
+
+// sets the BZDB defaults and _worldSize, then fills OBSTACLEMGR and
+// COLLISIONMGR from the file; prints what went wrong and returns false
+// if it could not
+bool loadPackedWorld(const std::string& fileName, float worldSize);
+
+
+#endif // __PACKEDWORLD_H__
+
+
+/*
+ * Local Variables: ***
+ * mode: C++ ***
+ * tab-width: 4 ***
+ * c-basic-offset: 4 ***
+ * indent-tabs-mode: nil ***
+ * End: ***
+ * ex: shiftwidth=4 tabstop=4
+ */
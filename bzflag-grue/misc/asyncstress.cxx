@@ -0,0 +1,404 @@
+/* bzflag
+ * Copyright (c) 1993-2021 Tim Riker
+ *
+ * This package is free software;  you can redistribute it and/or
+ * modify it under the terms of the license found in the file
+ * named COPYING that should have accompanied this file.
+ *
+ * THIS PACKAGE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+
+//  ASYNCSTRESS
+//
+//  A stress test of AsyncWork the way plugins use it through
+//  bz_postToMainThread() and bz_runAsync().  Make believe plugins each
+//  have threads of their own that post to the main thread and start
+//  jobs as fast as they can, and the jobs post their results too.
+//  Meanwhile the main thread unloads one plugin after another the way
+//  unload1Plugin() does and loads it again at the same address:
+//  finish(), stop its threads as Cleanup() would, drop its code, then
+//  forget().  A few jobs take longer than the unload waits for, so
+//  they get cancelled and the plugin's code is left loaded for them.
+//
+//  Any done() that runs once the plugin is being unloaded, other than
+//  of the jobs finish() waits for, and any task of the plugin deleted
+//  after its code was dropped, would have called into unloaded code.
+//  Those are counted as failures.
+//
+
+// system headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <mutex>
+#include <random>
+#include <set>
+#include <thread>
+#include <vector>
+
+// common headers
+#include "common.h"
+#include "TimeKeeper.h"
+#include "version.h"
+
+// bzfs headers
+#include "AsyncWork.h"
+
+
+int debugLevel = 0;
+
+enum PluginState
+{
+    Loaded,
+    Unloading,
+    Unloaded
+};
+
+class Plugin
+{
+public:
+    Plugin() : state(Loaded), generation(0), running(false) {}
+
+    std::atomic<int>  state;
+    // a new one for each load, tasks know which load made them
+    std::atomic<int>  generation;
+    std::atomic<bool> running;
+    std::vector<std::thread> threads;
+};
+
+static Plugin* plugins = NULL;
+
+// the loads whose code was left in memory for cancelled jobs
+static std::mutex keptMutex;
+static std::set<std::pair<const Plugin*, int> > kept;
+
+static std::atomic<long> created(0);
+static std::atomic<long> destroyed(0);
+static std::atomic<long> postsMade(0);
+static std::atomic<long> jobsStarted(0);
+static std::atomic<long> refused(0);
+static std::atomic<long> postsRun(0);
+static std::atomic<long> jobsDone(0);
+static std::atomic<int> failures(0);
+
+static int threadsPerPlugin = 4;
+static int stuckEvery = 2000;
+
+
+static void fail(const char* what, const Plugin* plugin, int generation)
+{
+    static std::mutex printMutex;
+    if (failures++ < 10)
+    {
+        std::lock_guard<std::mutex> lock(printMutex);
+        printf("* %s, plugin %d load %d\n", what, (int)(plugin - plugins),
+               generation);
+    }
+}
+
+
+static bool isKept(const Plugin* plugin, int generation)
+{
+    std::lock_guard<std::mutex> lock(keptMutex);
+    return kept.find(std::make_pair(plugin, generation)) != kept.end();
+}
+
+
+// the code of the load that made a task, as the task would call into it
+static bool isCodeLoaded(const Plugin* plugin, int generation)
+{
+    if ((plugin->generation == generation) && (plugin->state != Unloaded))
+        return true;
+    return isKept(plugin, generation);
+}
+
+
+class PluginTask : public AsyncWork::Task
+{
+public:
+    PluginTask(Plugin* _plugin, int _generation) : AsyncWork::Task(_plugin),
+        plugin(_plugin), generation(_generation)
+    {
+        created++;
+    }
+    virtual ~PluginTask()
+    {
+        if (!isCodeLoaded(plugin, generation))
+            fail("a task was deleted after its plugin was unloaded", plugin,
+                 generation);
+        destroyed++;
+    }
+
+protected:
+    Plugin* plugin;
+    int     generation;
+};
+
+
+class PostTask : public PluginTask
+{
+public:
+    PostTask(Plugin* _plugin, int _generation) :
+        PluginTask(_plugin, _generation) {}
+
+    virtual void done()
+    {
+        if ((plugin->generation != generation) || (plugin->state != Loaded))
+            fail("a post ran while its plugin was being unloaded", plugin,
+                 generation);
+        postsRun++;
+    }
+};
+
+
+class JobTask : public PluginTask
+{
+public:
+    JobTask(Plugin* _plugin, int _generation, bool _stuck) :
+        PluginTask(_plugin, _generation), stuck(_stuck) {}
+
+    virtual void work()
+    {
+        if (stuck)
+            TimeKeeper::sleep(0.2f);
+        // a result handed back the way plugin jobs do it
+        PostTask* result = new PostTask(plugin, generation);
+        if (!asyncWork.post(result))
+        {
+            refused++;
+            delete result;
+        }
+        else
+            postsMade++;
+    }
+    virtual void done()
+    {
+        // finish() waits for the jobs, so they may end while unloading
+        if ((plugin->generation != generation) || (plugin->state == Unloaded))
+            fail("a job's done() ran after its plugin was unloaded", plugin,
+                 generation);
+        jobsDone++;
+    }
+
+private:
+    bool stuck;
+};
+
+
+static void hammer(Plugin* plugin, unsigned int seed)
+{
+    std::minstd_rand random(seed);
+    const int generation = plugin->generation;
+    while (plugin->running)
+    {
+        // don't let the main thread fall too far behind
+        if (asyncWork.getOutstanding() > 1000)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        if (random() % 4 != 0)
+        {
+            PostTask* task = new PostTask(plugin, generation);
+            if (asyncWork.post(task))
+                postsMade++;
+            else
+            {
+                refused++;
+                delete task;
+            }
+        }
+        else
+        {
+            JobTask* task = new JobTask(plugin, generation,
+                                        (random() % stuckEvery) == 0);
+            if (asyncWork.run(task))
+                jobsStarted++;
+            else
+            {
+                refused++;
+                delete task;
+            }
+        }
+    }
+}
+
+
+static void load(Plugin* plugin)
+{
+    plugin->generation++;
+    plugin->state = Loaded;
+    plugin->running = true;
+    for (int t = 0; t < threadsPerPlugin; t++)
+        plugin->threads.push_back(std::thread(hammer, plugin,
+                                              (unsigned int)(plugin->generation * 97 + t)));
+}
+
+
+// what unload1Plugin() does, gives whether the code could be dropped
+static bool unload(Plugin* plugin, float timeout)
+{
+    plugin->state = Unloading;
+    const bool idle = asyncWork.finish(plugin, timeout);
+
+    // Cleanup() stops the plugin's threads
+    plugin->running = false;
+    for (size_t t = 0; t < plugin->threads.size(); t++)
+        plugin->threads[t].join();
+    plugin->threads.clear();
+
+    if (!idle)
+    {
+        std::lock_guard<std::mutex> lock(keptMutex);
+        kept.insert(std::make_pair((const Plugin*)plugin, (int)plugin->generation));
+    }
+    plugin->state = Unloaded;
+    asyncWork.forget(plugin);
+    return idle;
+}
+
+
+static void printHelp(const char* execName)
+{
+    printf("usage: %s [options]\n", execName);
+    printf("  -p <plugins>  : make believe plugins (default 8)\n");
+    printf("  -t <threads>  : threads of each plugin (default 4)\n");
+    printf("  -s <seconds>  : how long to keep at it (default 5)\n");
+    printf("  -u <ms>       : time between unloads (default 20)\n");
+    printf("  -w <ms>       : how long an unload waits for jobs (default 50)\n");
+    printf("\n");
+    printf("One job in %d takes 200 ms, longer than an unload waits.\n",
+           stuckEvery);
+}
+
+
+int main(int argc, char** argv)
+{
+    const char* execName = argv[0];
+    int pluginCount = 8;
+    double seconds = 5.0;
+    double unloadEvery = 0.02;
+    float timeout = 0.05f;
+
+    printf("\nASYNCSTRESS-%s\nProtocol BZFS%s\n\n",
+           getAppVersion(), getProtocolVersion());
+
+    for (int arg = 1; arg < argc; arg += 2)
+    {
+        const char *opt = argv[arg];
+        if ((strcmp("-p", opt) != 0) && (strcmp("-t", opt) != 0) &&
+                (strcmp("-s", opt) != 0) && (strcmp("-u", opt) != 0) &&
+                (strcmp("-w", opt) != 0))
+        {
+            printHelp(execName);
+            exit(strcmp("-h", opt) == 0 ? 0 : 1);
+        }
+        if ((arg + 1) >= argc)
+        {
+            printf("* Missing the %s parameter\n\n", opt);
+            printHelp(execName);
+            exit(1);
+        }
+        if (strcmp("-p", opt) == 0)
+            pluginCount = atoi(argv[arg + 1]);
+        else if (strcmp("-t", opt) == 0)
+            threadsPerPlugin = atoi(argv[arg + 1]);
+        else if (strcmp("-s", opt) == 0)
+            seconds = atof(argv[arg + 1]);
+        else if (strcmp("-u", opt) == 0)
+            unloadEvery = atof(argv[arg + 1]) / 1000.0;
+        else
+            timeout = (float)(atof(argv[arg + 1]) / 1000.0);
+    }
+    if ((pluginCount < 1) || (threadsPerPlugin < 1) || (seconds <= 0.0) ||
+            (unloadEvery <= 0.0) || (timeout <= 0.0f))
+    {
+        printHelp(execName);
+        exit(1);
+    }
+
+    asyncWork.init();
+    plugins = new Plugin[pluginCount];
+    for (int p = 0; p < pluginCount; p++)
+        load(&plugins[p]);
+    printf("%d plugins with %d threads each, an unload every %.0f ms\n\n",
+           pluginCount, threadsPerPlugin, unloadEvery * 1000.0);
+
+    // the main loop, unloading and loading again as it goes
+    int unloads = 0;
+    int leftLoaded = 0;
+    double longestUnload = 0.0;
+    const TimeKeeper start = TimeKeeper::getCurrent();
+    TimeKeeper nextUnload = start;
+    nextUnload += unloadEvery;
+    while (TimeKeeper::getCurrent() - start < seconds)
+    {
+        asyncWork.clearWakeup();
+        asyncWork.processCompleted();
+        if (TimeKeeper::getCurrent() - nextUnload < 0.0)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        Plugin* plugin = &plugins[unloads % pluginCount];
+        const TimeKeeper unloadStart = TimeKeeper::getCurrent();
+        if (!unload(plugin, timeout))
+            leftLoaded++;
+        const double unloadTime = TimeKeeper::getCurrent() - unloadStart;
+        if (unloadTime > longestUnload)
+            longestUnload = unloadTime;
+        unloads++;
+        load(plugin);
+        nextUnload += unloadEvery;
+    }
+
+    // unload the lot, wait out the stuck jobs, then shut down
+    for (int p = 0; p < pluginCount; p++)
+    {
+        if (!unload(&plugins[p], timeout))
+            leftLoaded++;
+    }
+    const TimeKeeper drain = TimeKeeper::getCurrent();
+    while ((asyncWork.getOutstanding() > 0) &&
+            (TimeKeeper::getCurrent() - drain < 2.0))
+    {
+        asyncWork.clearWakeup();
+        asyncWork.processCompleted();
+        TimeKeeper::sleep(0.001f);
+    }
+    asyncWork.stop();
+    delete[] plugins;
+    const double elapsed = TimeKeeper::getCurrent() - start;
+
+    printf("%12ld posts, %ld run\n", (long)postsMade, (long)postsRun);
+    printf("%12ld jobs, %ld done\n", (long)jobsStarted, (long)jobsDone);
+    printf("%12ld turned away while unloading\n", (long)refused);
+    printf("%12d unloads, %d left the code loaded for cancelled jobs\n",
+           unloads + pluginCount, leftLoaded);
+    printf("%12.1f ms the longest unload\n", longestUnload * 1000.0);
+    printf("%12.0f tasks a second\n", (double)created / elapsed);
+    if (created != destroyed)
+    {
+        printf("\n* %ld tasks were never deleted\n", (long)(created - destroyed));
+        failures++;
+    }
+    if (failures)
+    {
+        printf("\n* %d failures\n", (int)failures);
+        return 1;
+    }
+    return 0;
+}
+
+
+// Local Variables: ***
+// mode: C++ ***
+// tab-width: 4 ***
+// c-basic-offset: 4 ***
+// indent-tabs-mode: nil ***
+// End: ***
+// ex: shiftwidth=4 tabstop=4
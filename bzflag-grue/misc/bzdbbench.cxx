@@ -0,0 +1,169 @@
+/* bzflag
+ * Copyright (c) 1993-2021 Tim Riker
+ *
+ * This package is free software;  you can redistribute it and/or
+ * modify it under the terms of the license found in the file
+ * named COPYING that should have accompanied this file.
+ *
+ * THIS PACKAGE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+
+//  BZDBBENCH
+//
+//  Times BZDB.eval() of an expression on top of a chain of others, by
+//  name and by handle, against parsing the expression, which is what
+//  every change used to cost each reader.  It also times a change at
+//  the bottom of the chain followed by a read at the top, and checks
+//  that the change reached every expression that depends on it.
+//
+
+// system headers
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+// common headers
+#include "common.h"
+#include "StateDatabase.h"
+#include "TimeKeeper.h"
+#include "version.h"
+
+
+int debugLevel = 0;
+
+
+static void printHelp(const char* execName)
+{
+    printf("usage: %s [options]\n", execName);
+    printf("  -n <reads>  : reads of each kind (default 20000000)\n");
+    printf("\n");
+    printf("_d is \"(_c + _a) ^ 2\", _c is \"_b + 1\" and _b is \"_a * 3\".\n");
+}
+
+
+static void report(const char *what, int count, double seconds)
+{
+    printf("  %-24s %10.1f ns\n", what, seconds * 1e9 / count);
+}
+
+
+static int check(const char *what, float value, float expected)
+{
+    const bool good = isnan(expected) ? isnan(value) : (value == expected);
+    if (good)
+        return 0;
+    printf("* %s is %f, not %f\n", what, value, expected);
+    return 1;
+}
+
+
+int main(int argc, char** argv)
+{
+    const char* execName = argv[0];
+    int reads = 20000000;
+
+    printf("\nBZDBBENCH-%s\nProtocol BZFS%s\n\n",
+           getAppVersion(), getProtocolVersion());
+
+    for (int arg = 1; arg < argc; arg += 2)
+    {
+        const char *opt = argv[arg];
+        if (strcmp("-n", opt) != 0)
+        {
+            printHelp(execName);
+            exit(strcmp("-h", opt) == 0 ? 0 : 1);
+        }
+        if ((arg + 1) >= argc)
+        {
+            printf("* Missing the %s parameter\n\n", opt);
+            printHelp(execName);
+            exit(1);
+        }
+        reads = atoi(argv[arg + 1]);
+    }
+    if (reads < 1)
+    {
+        printHelp(execName);
+        exit(1);
+    }
+
+    BZDB.set("_a", "2");
+    BZDB.set("_b", "_a * 3");
+    BZDB.set("_c", "_b + 1");
+    BZDB.set("_d", "(_c + _a) ^ 2");
+    const StateDatabase::Handle handle = BZDB.getHandle("_d");
+
+    // keep the compiler from dropping the reads
+    volatile float sink = 0.0f;
+
+    printf("%d reads of _d:\n", reads);
+    TimeKeeper start = TimeKeeper::getCurrent();
+    for (int i = 0; i < reads; i++)
+        sink = BZDB.eval("_d");
+    report("by name", reads, TimeKeeper::getCurrent() - start);
+
+    start = TimeKeeper::getCurrent();
+    for (int i = 0; i < reads; i++)
+        sink = BZDB.eval(handle);
+    report("by handle", reads, TimeKeeper::getCurrent() - start);
+
+    // parsing is slow, a small share of the reads is plenty
+    const int parses = (reads / 100) + 1;
+    start = TimeKeeper::getCurrent();
+    for (int i = 0; i < parses; i++)
+    {
+        std::string value = "(_c + _a) ^ 2";
+        StateDatabase::Expression expression;
+        value >> expression;
+        sink = (float)expression.size();
+    }
+    report("parsing it", parses, TimeKeeper::getCurrent() - start);
+
+    const int changes = (reads / 10) + 1;
+    start = TimeKeeper::getCurrent();
+    for (int i = 0; i < changes; i++)
+    {
+        BZDB.setFloat("_a", (float)(i & 7));
+        sink = BZDB.eval(handle);
+    }
+    report("changing _a, reading _d", changes, TimeKeeper::getCurrent() - start);
+    (void)sink;
+
+    int errors = 0;
+    BZDB.set("_a", "1");
+    errors += check("_b", BZDB.eval("_b"), 3.0f);
+    errors += check("_c", BZDB.eval("_c"), 4.0f);
+    errors += check("_d", BZDB.eval(handle), 25.0f);
+    BZDB.set("_a", "_d");
+    errors += check("a cycle", BZDB.eval(handle), NAN);
+    BZDB.set("_a", "_nothing + 1");
+    errors += check("an unknown name", BZDB.eval(handle), NAN);
+    BZDB.set("_nothing", "4");
+    errors += check("a name set later", BZDB.eval(handle), 441.0f);
+    if (BZDB.findHandle("_neverSet").isValid())
+    {
+        printf("* an unknown name has a handle\n");
+        errors++;
+    }
+
+    if (errors)
+    {
+        printf("\n* %d checks failed\n", errors);
+        return 1;
+    }
+    return 0;
+}
+
+
+// Local Variables: ***
+// mode: C++ ***
+// tab-width: 4 ***
+// c-basic-offset: 4 ***
+// indent-tabs-mode: nil ***
+// End: ***
+// ex: shiftwidth=4 tabstop=4
@@ -0,0 +1,1471 @@
+/* bzflag
+ * Copyright (c) 1993-2021 Tim Riker
+ *
+ * This package is free software;  you can redistribute it and/or
+ * modify it under the terms of the license found in the file
+ * named COPYING that should have accompanied this file.
+ *
+ * THIS PACKAGE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+
+//  BZRRANALYZE
+//
+//  This program turns record/replay files into tables of the
+//  players, tank states, shots, kills and flag events in them,
+//  so that match statistics can be worked out over many
+//  recordings without replaying them through a server.
+//
+//  The files are read as a stream, and several are read at once.
+//  Each table goes to a CSV file, to a binary column file, or both.
+//  Times are in seconds from the first packet of the recording,
+//  except for the start of each recording in the files table.
+//
+//  The binary column files (.bzc) are in network byte order:
+//
+//    u32 magic ("BZcl"), u32 version, u32 number of columns
+//    for each column:  u8 type, u8 length of the name, the name
+//    then a group of rows for each recording, to the end of the file:
+//      u32 number of rows, then each column in turn, all its rows:
+//        ByteColumn  u8
+//        ShortColumn int16
+//        IntColumn   int32
+//        FloatColumn float, NaN where unknown
+//        TimeColumn  int64 microseconds, as two u32 (high word first)
+//        TextColumn  u8 length, then the bytes
+//
+
+// system headers
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <zlib.h>
+
+// common headers
+#include "common.h"
+#include "global.h"
+#include "Protocol.h"
+#include "Pack.h"
+#include "Flag.h"
+#include "PlayerState.h"
+#include "ShotUpdate.h"
+#include "TextUtils.h"
+#include "version.h"
+
+// bzfs headers
+#include "RecordReplay.h"
+
+// local headers
+#include "MsgStrings.h"
+
+
+typedef uint8_t u8;
+typedef unsigned long long u64;
+
+static const u32 ReplayMagic = 0x7272425A; // "rrBZ"
+
+static const u32 ColumnMagic = 0x425A636C; // "BZcl"
+static const u32 ColumnVersion = 0x0001;
+
+// bytes read from a version 1 file at a time
+static const unsigned int ChunkSize = 256 * 1024;
+// no block written by bzfs is near this, so a bigger one is garbage
+static const u32 MaxBlockSize = 16 * 1024 * 1024;
+
+int debugLevel = 0;
+
+
+/****************************************************************************/
+
+// Tables
+// ------
+
+enum ColumnType
+{
+    ByteColumn  = 0,
+    ShortColumn = 1,
+    IntColumn   = 2,
+    FloatColumn = 3,
+    TimeColumn  = 4,
+    TextColumn  = 5
+};
+
+struct ColumnDef
+{
+    const char *name;
+    ColumnType type;
+};
+
+static const ColumnDef fileColumns[] =
+{
+    { "file",     IntColumn },
+    { "name",     TextColumn },
+    { "version",  ByteColumn },
+    { "start",    TimeColumn },
+    { "length",   TimeColumn },
+    { "packets",  IntColumn }
+};
+
+static const ColumnDef playerColumns[] =
+{
+    { "file",     IntColumn },
+    { "time",     TimeColumn },
+    { "player",   ByteColumn },
+    { "event",    TextColumn },
+    { "team",     ShortColumn },
+    { "type",     ShortColumn },
+    { "callsign", TextColumn }
+};
+
+static const ColumnDef stateColumns[] =
+{
+    { "file",     IntColumn },
+    { "time",     TimeColumn },
+    { "player",   ByteColumn },
+    { "status",   ShortColumn },
+    { "x",        FloatColumn },
+    { "y",        FloatColumn },
+    { "z",        FloatColumn },
+    { "vx",       FloatColumn },
+    { "vy",       FloatColumn },
+    { "vz",       FloatColumn },
+    { "azimuth",  FloatColumn },
+    { "angvel",   FloatColumn }
+};
+
+static const ColumnDef shotColumns[] =
+{
+    { "file",     IntColumn },
+    { "time",     TimeColumn },
+    { "player",   ByteColumn },
+    { "shot",     IntColumn },
+    { "flag",     TextColumn },
+    { "team",     ShortColumn },
+    { "x",        FloatColumn },
+    { "y",        FloatColumn },
+    { "z",        FloatColumn },
+    { "vx",       FloatColumn },
+    { "vy",       FloatColumn },
+    { "vz",       FloatColumn },
+    { "lifetime", FloatColumn }
+};
+
+static const ColumnDef killColumns[] =
+{
+    { "file",     IntColumn },
+    { "time",     TimeColumn },
+    { "victim",   ByteColumn },
+    { "killer",   ByteColumn },
+    { "reason",   ShortColumn },
+    { "shot",     ShortColumn },
+    { "flag",     TextColumn },
+    { "x",        FloatColumn },
+    { "y",        FloatColumn },
+    { "z",        FloatColumn },
+    { "killer_x", FloatColumn },
+    { "killer_y", FloatColumn },
+    { "killer_z", FloatColumn }
+};
+
+static const ColumnDef flagColumns[] =
+{
+    { "file",     IntColumn },
+    { "time",     TimeColumn },
+    { "event",    TextColumn },
+    { "player",   ByteColumn },
+    { "to",       ByteColumn },
+    { "flag",     IntColumn },
+    { "type",     TextColumn },
+    { "team",     ShortColumn },
+    { "x",        FloatColumn },
+    { "y",        FloatColumn },
+    { "z",        FloatColumn },
+    { "held",     FloatColumn }
+};
+
+enum TableId
+{
+    FileTable = 0,
+    PlayerTable,
+    StateTable,
+    ShotTable,
+    KillTable,
+    FlagTable,
+    TableCount
+};
+
+struct TableDef
+{
+    const char *name;
+    const ColumnDef *columns;
+    int count;
+};
+
+#define countof(a) ((int)(sizeof(a) / sizeof(a[0])))
+
+static const TableDef tableDefs[TableCount] =
+{
+    { "files",   fileColumns,   countof(fileColumns) },
+    { "players", playerColumns, countof(playerColumns) },
+    { "states",  stateColumns,  countof(stateColumns) },
+    { "shots",   shotColumns,   countof(shotColumns) },
+    { "kills",   killColumns,   countof(killColumns) },
+    { "flags",   flagColumns,   countof(flagColumns) }
+};
+
+
+// The rows of one table, kept by column.  Values are added a row at a
+// time, column after column.
+class Table
+{
+public:
+    Table() : def(NULL), next(0), rows(0) {}
+
+    void      init(const TableDef *_def)
+    {
+        def = _def;
+        columns.resize(def->count);
+    }
+
+    void      addInt(long long value)
+    {
+        columns[next].ints.push_back(value);
+        nextColumn();
+    }
+    void      addFloat(float value)
+    {
+        columns[next].floats.push_back(value);
+        nextColumn();
+    }
+    void      addText(const std::string& value)
+    {
+        columns[next].texts.push_back(value);
+        nextColumn();
+    }
+
+    const TableDef *def;
+    struct Column
+    {
+        std::vector<long long>   ints;
+        std::vector<float>       floats;
+        std::vector<std::string> texts;
+    };
+    std::vector<Column> columns;
+    int       next;
+    u32       rows;
+
+private:
+    void      nextColumn()
+    {
+        if (++next == def->count)
+        {
+            next = 0;
+            rows++;
+        }
+    }
+};
+
+
+// What came out of one recording
+struct Analysis
+{
+    Analysis() : done(false), ok(false), version(0), start(0), length(0),
+        packets(0), bytes(0)
+    {
+        for (int i = 0; i < TableCount; i++)
+            tables[i].init(&tableDefs[i]);
+    }
+
+    bool      done;
+    bool      ok;
+    std::string error;
+    u32       version;
+    RRtime    start;
+    RRtime    length;
+    u64       packets;
+    u64       bytes;
+    std::map<u16, u64> codeCounts;
+    Table     tables[TableCount];
+};
+
+
+/****************************************************************************/
+
+// Reading
+// -------
+
+static const void *nboUnpackRRtime(const void *buf, RRtime& value)
+{
+    u32 msb, lsb;
+    buf = nboUnpackUInt(buf, msb);
+    buf = nboUnpackUInt(buf, lsb);
+    value = ((RRtime)msb << 32) + (RRtime)lsb;
+    return buf;
+}
+
+
+// Goes through the packets of a recording in order, holding only a
+// chunk of a version 1 file, or a block of a version 2 one, at a time.
+class RecordStream
+{
+public:
+    RecordStream() : file(NULL), blocks(false), pos(0), end(0),
+        ended(false) {}
+    ~RecordStream()
+    {
+        if (file != NULL)
+            fclose(file);
+    }
+
+    bool      open(const char *name, ReplayHeader& header,
+                   std::string& error);
+    /// the next packet, its data is good until the next call
+    bool      next(RRpacket& p);
+    u64       fileBytes() const;
+
+private:
+    bool      fill(size_t need);
+    bool      readBlock();
+
+    FILE      *file;
+    bool      blocks;
+    std::vector<char> buf;
+    std::vector<char> packed;
+    size_t    pos;
+    size_t    end;
+    bool      ended;
+};
+
+
+bool RecordStream::open(const char *name, ReplayHeader& h,
+                        std::string& error)
+{
+    file = fopen(name, "rb");
+    if (file == NULL)
+    {
+        error = strerror(errno);
+        return false;
+    }
+
+    char buffer[ReplayHeaderSize];
+    if (fread(buffer, ReplayHeaderSize, 1, file) != 1)
+    {
+        error = "no header";
+        return false;
+    }
+    const void *b = nboUnpackUInt(buffer, h.magic);
+    b = nboUnpackUInt(b, h.version);
+    b = nboUnpackUInt(b, h.offset);
+    b = nboUnpackRRtime(b, h.filetime);
+    b = nboUnpackUInt(b, h.player);
+    b = nboUnpackUInt(b, h.flagsSize);
+    nboUnpackUInt(b, h.worldSize);
+    h.flags = NULL;
+    h.world = NULL;
+
+    if (h.magic != ReplayMagic)
+    {
+        error = "not a recording";
+        return false;
+    }
+    if (h.version > ReplayBlockVersion)
+    {
+        error = TextUtils::format("unknown version %u", h.version);
+        return false;
+    }
+
+    // the packets follow the flags and the world
+    if (fseek(file, h.offset, SEEK_SET) != 0)
+    {
+        error = "no packets";
+        return false;
+    }
+    blocks = (h.version >= ReplayBlockVersion);
+
+    return true;
+}
+
+
+bool RecordStream::next(RRpacket& p)
+{
+    if (!fill(RRpacketHdrSize))
+        return false;
+
+    const void *b = nboUnpackUShort(&buf[pos], p.mode);
+    b = nboUnpackUShort(b, p.code);
+    b = nboUnpackUInt(b, p.len);
+    b = nboUnpackUInt(b, p.nextFilePos);
+    b = nboUnpackUInt(b, p.prevFilePos);
+    nboUnpackRRtime(b, p.timestamp);
+
+    if (p.len > (MaxPacketLen - ((int)sizeof(u16) * 2)))
+    {
+        fprintf(stderr, "next: ERROR, packet length = %u\n", p.len);
+        ended = true;
+        return false;
+    }
+    if (!fill(RRpacketHdrSize + p.len))
+        return false;
+
+    p.next = NULL;
+    p.prev = NULL;
+    p.data = (p.len == 0) ? NULL : &buf[pos + RRpacketHdrSize];
+    pos += RRpacketHdrSize + p.len;
+
+    return true;
+}
+
+
+bool RecordStream::fill(size_t need)
+{
+    while ((end - pos) < need)
+    {
+        if (ended)
+            return false;
+
+        // keep what is left of the last packet at the front
+        if (pos > 0)
+        {
+            memmove(&buf[0], &buf[pos], end - pos);
+            end -= pos;
+            pos = 0;
+        }
+
+        if (blocks)
+        {
+            if (!readBlock())
+                ended = true;
+        }
+        else
+        {
+            if (buf.size() < (end + ChunkSize))
+                buf.resize(end + ChunkSize);
+            const size_t got = fread(&buf[end], 1, ChunkSize, file);
+            if (got == 0)
+                ended = true;
+            end += got;
+        }
+    }
+    return true;
+}
+
+
+bool RecordStream::readBlock()
+{
+    char hdr[RRblockHdrSize];
+    if (fread(hdr, RRblockHdrSize, 1, file) != 1)
+        return false;
+
+    u32 rawLen, packedLen, coding;
+    const void *b = nboUnpackUInt(hdr, rawLen);
+    b = nboUnpackUInt(b, packedLen);
+    nboUnpackUInt(b, coding);
+    if ((rawLen == 0) || (packedLen == 0) || (coding == IndexBlock))
+        return false;
+    if ((rawLen > MaxBlockSize) || (packedLen > MaxBlockSize))
+    {
+        fprintf(stderr, "readBlock: ERROR, block size = %u\n", rawLen);
+        return false;
+    }
+
+    if (buf.size() < (end + rawLen))
+        buf.resize(end + rawLen);
+
+    if ((coding == StoredBlock) && (packedLen == rawLen))
+    {
+        if (fread(&buf[end], rawLen, 1, file) != 1)
+            return false;
+    }
+    else if (coding == ZlibBlock)
+    {
+        packed.resize(packedLen);
+        if (fread(&packed[0], packedLen, 1, file) != 1)
+            return false;
+        uLongf len = rawLen;
+        if ((uncompress((Bytef *)&buf[end], &len, (const Bytef *)&packed[0],
+                        packedLen) != Z_OK) || (len != rawLen))
+        {
+            fprintf(stderr, "readBlock: ERROR, bad block\n");
+            return false;
+        }
+    }
+    else
+    {
+        fprintf(stderr, "readBlock: ERROR, coding = %u\n", coding);
+        return false;
+    }
+
+    end += rawLen;
+    return true;
+}
+
+
+u64 RecordStream::fileBytes() const
+{
+    if (file == NULL)
+        return 0;
+    const long size = ftell(file);
+    return (size < 0) ? 0 : (u64)size;
+}
+
+
+/****************************************************************************/
+
+// Decoding
+// --------
+
+// Follows the game through the packets of one recording, adding rows to
+// the tables as things happen.  Only packets that were broadcast count
+// as events, the state packets of each update only tell who is there.
+class Analyzer
+{
+public:
+    Analyzer(int fileIndex, Analysis& result);
+
+    void      packet(const RRpacket& p);
+
+private:
+    struct Tank
+    {
+        bool      present;
+        bool      placed;
+        std::string callsign;
+        float     pos[3];
+    };
+    struct Carry
+    {
+        int       player;
+        RRtime    since;
+    };
+
+    void      addPlayer(RRtime t, const void *d);
+    void      removePlayer(RRtime t, const void *d);
+    void      playerUpdate(RRtime t, u16 code, const void *d);
+    void      shotBegin(RRtime t, const void *d);
+    void      killed(RRtime t, const void *d);
+    void      grabFlag(RRtime t, const void *d);
+    void      dropFlag(RRtime t, const void *d);
+    void      captureFlag(RRtime t, const void *d);
+    void      transferFlag(RRtime t, const void *d);
+    void      flagUpdate(const void *d);
+
+    void      startRow(TableId id, RRtime t);
+    void      addPos(Table& table, int player);
+    float     heldFor(u16 flag, int player, RRtime t);
+    std::string flagType(u16 flag) const;
+
+    int       fileIndex;
+    Analysis& result;
+    bool      started;
+    RRtime    start;
+
+    Tank      tanks[256];
+    std::map<u16, Carry> carries;
+    std::map<u16, std::string> flagTypes;
+
+    // room for the unpackers to read past the end of a short packet
+    char      scratch[MaxPacketLen + 256];
+};
+
+
+Analyzer::Analyzer(int _fileIndex, Analysis& _result)
+    : fileIndex(_fileIndex), result(_result), started(false), start(0)
+{
+    for (int i = 0; i < 256; i++)
+    {
+        tanks[i].present = false;
+        tanks[i].placed = false;
+    }
+    memset(scratch, 0, sizeof(scratch));
+}
+
+
+void Analyzer::packet(const RRpacket& p)
+{
+    if (!started)
+    {
+        start = p.timestamp;
+        started = true;
+    }
+    result.packets++;
+    result.codeCounts[p.code]++;
+    // wrapping around rather than overflowing on a garbled time
+    const RRtime t = (RRtime)((u64)p.timestamp - (u64)start);
+    result.length = t;
+
+    if ((p.mode != RealPacket) && (p.mode != StatePacket))
+        return;
+
+    if (p.len > 0)
+        memcpy(scratch, p.data, p.len);
+    const void *d = scratch;
+
+    if (p.mode == StatePacket)
+    {
+        if (p.code == MsgAddPlayer)
+            addPlayer(t, d);
+        else if (p.code == MsgFlagUpdate)
+            flagUpdate(d);
+    }
+    else
+    {
+        switch (p.code)
+        {
+        case MsgAddPlayer:
+            addPlayer(t, d);
+            break;
+        case MsgRemovePlayer:
+            removePlayer(t, d);
+            break;
+        case MsgPlayerUpdate:
+        case MsgPlayerUpdateSmall:
+            playerUpdate(t, p.code, d);
+            break;
+        case MsgShotBegin:
+            shotBegin(t, d);
+            break;
+        case MsgKilled:
+            killed(t, d);
+            break;
+        case MsgGrabFlag:
+            grabFlag(t, d);
+            break;
+        case MsgDropFlag:
+            dropFlag(t, d);
+            break;
+        case MsgCaptureFlag:
+            captureFlag(t, d);
+            break;
+        case MsgTransferFlag:
+            transferFlag(t, d);
+            break;
+        case MsgFlagUpdate:
+            flagUpdate(d);
+            break;
+        default:
+            break;
+        }
+    }
+
+    memset(scratch, 0, p.len);
+}
+
+
+void Analyzer::addPlayer(RRtime t, const void *d)
+{
+    u8 index;
+    u16 type, team, wins, losses, tks;
+    char callsign[CallSignLen];
+    d = nboUnpackUByte(d, index);
+    d = nboUnpackUShort(d, type);
+    d = nboUnpackUShort(d, team);
+    d = nboUnpackUShort(d, wins);
+    d = nboUnpackUShort(d, losses);
+    d = nboUnpackUShort(d, tks);
+    nboUnpackString(d, callsign, CallSignLen);
+    callsign[CallSignLen - 1] = '\0';
+
+    // every update repeats the players that are there
+    Tank& tank = tanks[index];
+    if (tank.present && (tank.callsign == callsign))
+        return;
+    tank.present = true;
+    tank.placed = false;
+    tank.callsign = callsign;
+
+    startRow(PlayerTable, t);
+    Table& table = result.tables[PlayerTable];
+    table.addInt(index);
+    table.addText("join");
+    table.addInt((int16_t)team);
+    table.addInt((int16_t)type);
+    table.addText(callsign);
+}
+
+
+void Analyzer::removePlayer(RRtime t, const void *d)
+{
+    u8 index;
+    nboUnpackUByte(d, index);
+
+    Tank& tank = tanks[index];
+    if (!tank.present)
+        return;
+    tank.present = false;
+    tank.placed = false;
+
+    startRow(PlayerTable, t);
+    Table& table = result.tables[PlayerTable];
+    table.addInt(index);
+    table.addText("part");
+    table.addInt(NoTeam);
+    table.addInt(-1);
+    table.addText(tank.callsign);
+}
+
+
+void Analyzer::playerUpdate(RRtime t, u16 code, const void *d)
+{
+    float timestamp;
+    u8 index;
+    PlayerState state;
+    d = nboUnpackFloat(d, timestamp);
+    d = nboUnpackUByte(d, index);
+    state.unpack(d, code);
+
+    Tank& tank = tanks[index];
+    tank.placed = true;
+    memcpy(tank.pos, state.pos, sizeof(tank.pos));
+
+    startRow(StateTable, t);
+    Table& table = result.tables[StateTable];
+    table.addInt(index);
+    table.addInt(state.status);
+    for (int i = 0; i < 3; i++)
+        table.addFloat(state.pos[i]);
+    for (int i = 0; i < 3; i++)
+        table.addFloat(state.velocity[i]);
+    table.addFloat(state.azimuth);
+    table.addFloat(state.angVel);
+}
+
+
+void Analyzer::shotBegin(RRtime t, const void *d)
+{
+    FiringInfo finfo;
+    finfo.unpack(d);
+    const ShotUpdate& shot = finfo.shot;
+
+    startRow(ShotTable, t);
+    Table& table = result.tables[ShotTable];
+    table.addInt(shot.player);
+    table.addInt(shot.id);
+    table.addText(finfo.flagType->flagAbbv);
+    table.addInt(shot.team);
+    for (int i = 0; i < 3; i++)
+        table.addFloat(shot.pos[i]);
+    for (int i = 0; i < 3; i++)
+        table.addFloat(shot.vel[i]);
+    table.addFloat(finfo.lifetime);
+}
+
+
+void Analyzer::killed(RRtime t, const void *d)
+{
+    u8 victim, killer;
+    int16_t reason, shot;
+    FlagType *type;
+    d = nboUnpackUByte(d, victim);
+    d = nboUnpackUByte(d, killer);
+    d = nboUnpackShort(d, reason);
+    d = nboUnpackShort(d, shot);
+    FlagType::unpack(d, type);
+
+    startRow(KillTable, t);
+    Table& table = result.tables[KillTable];
+    table.addInt(victim);
+    table.addInt(killer);
+    table.addInt(reason);
+    table.addInt(shot);
+    table.addText((type != Flags::Null) ? type->flagAbbv : "");
+    addPos(table, victim);
+    addPos(table, killer);
+}
+
+
+void Analyzer::grabFlag(RRtime t, const void *d)
+{
+    u8 player;
+    u16 flagid;
+    Flag flag;
+    d = nboUnpackUByte(d, player);
+    d = nboUnpackUShort(d, flagid);
+    flag.unpack(d);
+    flagTypes[flagid] = flag.type->flagAbbv;
+
+    startRow(FlagTable, t);
+    Table& table = result.tables[FlagTable];
+    table.addText("grab");
+    table.addInt(player);
+    table.addInt(NoPlayer);
+    table.addInt(flagid);
+    table.addText(flag.type->flagAbbv);
+    table.addInt(NoTeam);
+    for (int i = 0; i < 3; i++)
+        table.addFloat(flag.position[i]);
+    table.addFloat(NAN);
+
+    Carry& carry = carries[flagid];
+    carry.player = player;
+    carry.since = t;
+}
+
+
+void Analyzer::dropFlag(RRtime t, const void *d)
+{
+    u8 player;
+    u16 flagid;
+    Flag flag;
+    d = nboUnpackUByte(d, player);
+    d = nboUnpackUShort(d, flagid);
+    flag.unpack(d);
+    flagTypes[flagid] = flag.type->flagAbbv;
+
+    startRow(FlagTable, t);
+    Table& table = result.tables[FlagTable];
+    table.addText("drop");
+    table.addInt(player);
+    table.addInt(NoPlayer);
+    table.addInt(flagid);
+    table.addText(flag.type->flagAbbv);
+    table.addInt(NoTeam);
+    for (int i = 0; i < 3; i++)
+        table.addFloat(flag.position[i]);
+    table.addFloat(heldFor(flagid, player, t));
+
+    carries.erase(flagid);
+}
+
+
+void Analyzer::captureFlag(RRtime t, const void *d)
+{
+    u8 player;
+    u16 flagid, team;
+    d = nboUnpackUByte(d, player);
+    d = nboUnpackUShort(d, flagid);
+    nboUnpackUShort(d, team);
+
+    startRow(FlagTable, t);
+    Table& table = result.tables[FlagTable];
+    table.addText("capture");
+    table.addInt(player);
+    table.addInt(NoPlayer);
+    table.addInt(flagid);
+    table.addText(flagType(flagid));
+    table.addInt((int16_t)team);
+    addPos(table, player);
+    table.addFloat(heldFor(flagid, player, t));
+
+    carries.erase(flagid);
+}
+
+
+void Analyzer::transferFlag(RRtime t, const void *d)
+{
+    u8 from, to;
+    u16 flagid;
+    Flag flag;
+    d = nboUnpackUByte(d, from);
+    d = nboUnpackUByte(d, to);
+    d = nboUnpackUShort(d, flagid);
+    flag.unpack(d);
+    flagTypes[flagid] = flag.type->flagAbbv;
+
+    startRow(FlagTable, t);
+    Table& table = result.tables[FlagTable];
+    table.addText("transfer");
+    table.addInt(from);
+    table.addInt(to);
+    table.addInt(flagid);
+    table.addText(flag.type->flagAbbv);
+    table.addInt(NoTeam);
+    addPos(table, from);
+    table.addFloat(heldFor(flagid, from, t));
+
+    Carry& carry = carries[flagid];
+    carry.player = to;
+    carry.since = t;
+}
+
+
+void Analyzer::flagUpdate(const void *d)
+{
+    u16 count, index;
+    d = nboUnpackUShort(d, count);
+    for (int i = 0; i < (int)count; i++)
+    {
+        // a corrupt count must not run off the packet
+        if ((const char *)d >= (scratch + MaxPacketLen))
+            break;
+        Flag flag;
+        d = nboUnpackUShort(d, index);
+        d = flag.unpack(d);
+        flagTypes[index] = flag.type->flagAbbv;
+    }
+}
+
+
+void Analyzer::startRow(TableId id, RRtime t)
+{
+    Table& table = result.tables[id];
+    table.addInt(fileIndex);
+    table.addInt(t);
+}
+
+
+void Analyzer::addPos(Table& table, int player)
+{
+    const Tank& tank = tanks[player & 0xFF];
+    for (int i = 0; i < 3; i++)
+        table.addFloat(tank.placed ? tank.pos[i] : NAN);
+}
+
+
+// seconds since the player got the flag, NaN if that wasn't seen
+float Analyzer::heldFor(u16 flag, int player, RRtime t)
+{
+    std::map<u16, Carry>::const_iterator it = carries.find(flag);
+    if ((it == carries.end()) || (it->second.player != player))
+        return NAN;
+    return (float)(RRtime)((u64)t - (u64)it->second.since) * 1.0e-6f;
+}
+
+
+std::string Analyzer::flagType(u16 flag) const
+{
+    std::map<u16, std::string>::const_iterator it = flagTypes.find(flag);
+    return (it == flagTypes.end()) ? "" : it->second;
+}
+
+
+static void analyzeFile(int index, const char *name, Analysis& result)
+{
+    RecordStream stream;
+    ReplayHeader header;
+    if (!stream.open(name, header, result.error))
+        return;
+    result.version = header.version;
+
+    Analyzer analyzer(index, result);
+    RRpacket p;
+    bool first = true;
+    while (stream.next(p))
+    {
+        if (first)
+        {
+            result.start = p.timestamp;
+            first = false;
+        }
+        analyzer.packet(p);
+    }
+    result.bytes = stream.fileBytes();
+
+    Table& table = result.tables[FileTable];
+    table.addInt(index);
+    table.addText(name);
+    table.addInt(result.version);
+    table.addInt(result.start);
+    table.addInt(result.length);
+    table.addInt((long long)result.packets);
+
+    result.ok = true;
+}
+
+
+/****************************************************************************/
+
+// Writing
+// -------
+
+class TableFiles
+{
+public:
+    TableFiles() : csv(NULL), bin(NULL) {}
+    ~TableFiles()
+    {
+        close();
+    }
+
+    bool      open(const std::string& base, const TableDef *def,
+                   bool useCSV, bool useBinary);
+    void      write(const Table& table);
+    bool      close();
+
+private:
+    void      writeCSV(const Table& table);
+    void      writeBinary(const Table& table);
+
+    FILE      *csv;
+    FILE      *bin;
+    std::vector<char> out;
+};
+
+
+static void csvText(std::string& line, const std::string& text)
+{
+    if (text.find_first_of(",\"\r\n") == std::string::npos)
+    {
+        line += text;
+        return;
+    }
+    line += '"';
+    for (size_t i = 0; i < text.size(); i++)
+    {
+        if (text[i] == '"')
+            line += '"';
+        line += text[i];
+    }
+    line += '"';
+}
+
+
+bool TableFiles::open(const std::string& base, const TableDef *def,
+                      bool useCSV, bool useBinary)
+{
+    if (useCSV)
+    {
+        const std::string name = base + ".csv";
+        csv = fopen(name.c_str(), "w");
+        if (csv == NULL)
+        {
+            perror(name.c_str());
+            return false;
+        }
+        std::string line;
+        for (int i = 0; i < def->count; i++)
+        {
+            if (i > 0)
+                line += ',';
+            line += def->columns[i].name;
+        }
+        fprintf(csv, "%s\n", line.c_str());
+    }
+
+    if (useBinary)
+    {
+        const std::string name = base + ".bzc";
+        bin = fopen(name.c_str(), "wb");
+        if (bin == NULL)
+        {
+            perror(name.c_str());
+            return false;
+        }
+        char hdr[3 * sizeof(u32)];
+        void *b = nboPackUInt(hdr, ColumnMagic);
+        b = nboPackUInt(b, ColumnVersion);
+        nboPackUInt(b, def->count);
+        fwrite(hdr, sizeof(hdr), 1, bin);
+        for (int i = 0; i < def->count; i++)
+        {
+            const u8 len = (u8)strlen(def->columns[i].name);
+            char col[2];
+            b = nboPackUByte(col, (u8)def->columns[i].type);
+            nboPackUByte(b, len);
+            fwrite(col, sizeof(col), 1, bin);
+            fwrite(def->columns[i].name, len, 1, bin);
+        }
+    }
+
+    return true;
+}
+
+
+void TableFiles::write(const Table& table)
+{
+    if (table.rows == 0)
+        return;
+    if (csv != NULL)
+        writeCSV(table);
+    if (bin != NULL)
+        writeBinary(table);
+}
+
+
+void TableFiles::writeCSV(const Table& table)
+{
+    const TableDef *def = table.def;
+    std::string line;
+    char buffer[32];
+
+    for (u32 row = 0; row < table.rows; row++)
+    {
+        line.clear();
+        for (int i = 0; i < def->count; i++)
+        {
+            if (i > 0)
+                line += ',';
+            const Table::Column& col = table.columns[i];
+            switch (def->columns[i].type)
+            {
+            case ByteColumn:
+            case ShortColumn:
+            case IntColumn:
+                snprintf(buffer, sizeof(buffer), "%lld", col.ints[row]);
+                line += buffer;
+                break;
+            case FloatColumn:
+                if (!isnan(col.floats[row]))
+                {
+                    snprintf(buffer, sizeof(buffer), "%g", col.floats[row]);
+                    line += buffer;
+                }
+                break;
+            case TimeColumn:
+            {
+                const long long t = col.ints[row];
+                snprintf(buffer, sizeof(buffer), "%s%lld.%06lld",
+                         (t < 0) ? "-" : "", llabs(t) / 1000000,
+                         llabs(t) % 1000000);
+                line += buffer;
+                break;
+            }
+            case TextColumn:
+                csvText(line, col.texts[row]);
+                break;
+            }
+        }
+        line += '\n';
+        fwrite(line.data(), line.size(), 1, csv);
+    }
+}
+
+
+void TableFiles::writeBinary(const Table& table)
+{
+    const TableDef *def = table.def;
+    const u32 rows = table.rows;
+
+    out.resize(sizeof(u32));
+    nboPackUInt(&out[0], rows);
+
+    for (int i = 0; i < def->count; i++)
+    {
+        const Table::Column& col = table.columns[i];
+        size_t at = out.size();
+        switch (def->columns[i].type)
+        {
+        case ByteColumn:
+        {
+            out.resize(at + rows);
+            void *b = &out[at];
+            for (u32 row = 0; row < rows; row++)
+                b = nboPackUByte(b, (u8)col.ints[row]);
+            break;
+        }
+        case ShortColumn:
+        {
+            out.resize(at + rows * sizeof(int16_t));
+            void *b = &out[at];
+            for (u32 row = 0; row < rows; row++)
+                b = nboPackShort(b, (int16_t)col.ints[row]);
+            break;
+        }
+        case IntColumn:
+        {
+            out.resize(at + rows * sizeof(int32_t));
+            void *b = &out[at];
+            for (u32 row = 0; row < rows; row++)
+                b = nboPackInt(b, (int32_t)col.ints[row]);
+            break;
+        }
+        case FloatColumn:
+        {
+            out.resize(at + rows * sizeof(float));
+            void *b = &out[at];
+            for (u32 row = 0; row < rows; row++)
+                b = nboPackFloat(b, col.floats[row]);
+            break;
+        }
+        case TimeColumn:
+        {
+            out.resize(at + rows * 2 * sizeof(u32));
+            void *b = &out[at];
+            for (u32 row = 0; row < rows; row++)
+            {
+                const u64 t = (u64)col.ints[row];
+                b = nboPackUInt(b, (u32)(t >> 32));
+                b = nboPackUInt(b, (u32)(t & 0xFFFFFFFF));
+            }
+            break;
+        }
+        case TextColumn:
+            for (u32 row = 0; row < rows; row++)
+            {
+                const std::string& text = col.texts[row];
+                const size_t len = (text.size() > 255) ? 255 : text.size();
+                out.push_back((char)len);
+                out.insert(out.end(), text.begin(), text.begin() + len);
+            }
+            break;
+        }
+    }
+
+    fwrite(&out[0], out.size(), 1, bin);
+}
+
+
+bool TableFiles::close()
+{
+    bool ok = true;
+    if ((csv != NULL) && (fclose(csv) != 0))
+        ok = false;
+    if ((bin != NULL) && (fclose(bin) != 0))
+        ok = false;
+    csv = NULL;
+    bin = NULL;
+    return ok;
+}
+
+
+/****************************************************************************/
+
+// Main
+// ----
+
+static void printHelp(const char* execName)
+{
+    printf("usage:\t%s [options] <filename> ...\n\n", execName);
+    printf("  -h          : print help\n");
+    printf("  -d <dir>    : put the tables in this directory (default .)\n");
+    printf("  -f <format> : csv, bin or both (default both)\n");
+    printf("  -j <count>  : read this many files at once\n");
+    printf("  -v          : count the packets of each type\n");
+    printf("\n");
+    printf("  writes files, players, states, shots, kills and flags tables\n");
+    printf("\n");
+    return;
+}
+
+
+int main(int argc, char** argv)
+{
+    const char* execName = argv[0];
+    std::string outDir = ".";
+    bool useCSV = true;
+    bool useBinary = true;
+    int threads = (int)std::thread::hardware_concurrency();
+    bool verbose = false;
+
+    printf("\nBZRRANALYZE-%s\nProtocol BZFS%s\n\n",
+           getAppVersion(), getProtocolVersion());
+
+    int arg = 1;
+    while ((arg < argc) && (argv[arg][0] == '-'))
+    {
+        const char *opt = argv[arg];
+        if (strcmp("-h", opt) == 0)
+        {
+            printHelp(execName);
+            exit(0);
+        }
+        else if (strcmp("-v", opt) == 0)
+        {
+            verbose = true;
+            arg++;
+            continue;
+        }
+        else if ((strcmp("-d", opt) != 0) && (strcmp("-f", opt) != 0) &&
+                 (strcmp("-j", opt) != 0))
+        {
+            printf("* Unknown option %s\n\n", opt);
+            printHelp(execName);
+            exit(1);
+        }
+
+        if ((arg + 1) >= argc)
+        {
+            printf("* Missing the %s parameter\n\n", opt);
+            printHelp(execName);
+            exit(1);
+        }
+        const char *value = argv[arg + 1];
+        if (strcmp("-d", opt) == 0)
+            outDir = value;
+        else if (strcmp("-j", opt) == 0)
+            threads = atoi(value);
+        else if (strcmp("csv", value) == 0)
+        {
+            useCSV = true;
+            useBinary = false;
+        }
+        else if (strcmp("bin", value) == 0)
+        {
+            useCSV = false;
+            useBinary = true;
+        }
+        else if (strcmp("both", value) == 0)
+            useCSV = useBinary = true;
+        else
+        {
+            printf("* Unknown format %s\n\n", value);
+            printHelp(execName);
+            exit(1);
+        }
+        arg += 2;
+    }
+
+    if (arg >= argc)
+    {
+        printf("* Missing filename\n\n");
+        printHelp(execName);
+        exit(1);
+    }
+    const int fileCount = argc - arg;
+    char **names = argv + arg;
+    if (threads < 1)
+        threads = 1;
+    if (threads > fileCount)
+        threads = fileCount;
+
+    // the flag types are only looked up by the workers
+    Flags::init();
+
+    TableFiles files[TableCount];
+    for (int i = 0; i < TableCount; i++)
+    {
+        if (!files[i].open(outDir + "/" + tableDefs[i].name, &tableDefs[i],
+                           useCSV, useBinary))
+            exit(1);
+    }
+
+    // the workers take the files in turn, and the tables are written in
+    // the same order, so no more than a few results wait to be written
+    std::vector<Analysis*> results(fileCount, (Analysis *)NULL);
+    std::mutex mutex;
+    std::condition_variable cond;
+    int nextFile = 0;
+    int written = 0;
+    const int window = threads * 2;
+
+    std::chrono::steady_clock::time_point startTime =
+        std::chrono::steady_clock::now();
+
+    std::vector<std::thread> workers;
+    for (int w = 0; w < threads; w++)
+    {
+        workers.push_back(std::thread([&]()
+        {
+            while (true)
+            {
+                int i;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    cond.wait(lock, [&]()
+                    {
+                        return (nextFile >= fileCount) ||
+                               (nextFile < (written + window));
+                    });
+                    if (nextFile >= fileCount)
+                        return;
+                    i = nextFile++;
+                }
+
+                Analysis *result = new Analysis;
+                analyzeFile(i, names[i], *result);
+
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    results[i] = result;
+                    result->done = true;
+                }
+                cond.notify_all();
+            }
+        }));
+    }
+
+    u64 totalPackets = 0;
+    u64 totalBytes = 0;
+    u32 totalRows[TableCount] = {0};
+    std::map<u16, u64> codeCounts;
+    int failed = 0;
+
+    for (int i = 0; i < fileCount; i++)
+    {
+        Analysis *result;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cond.wait(lock, [&]()
+            {
+                return (results[i] != NULL) && results[i]->done;
+            });
+            result = results[i];
+            results[i] = NULL;
+        }
+
+        if (result->ok)
+        {
+            printf("%s: version %u, %llu packets, %s\n", names[i],
+                   result->version, result->packets,
+                   TextUtils::format("%lld.%03lld seconds",
+                                     (long long)(result->length / 1000000),
+                                     (long long)((result->length % 1000000) / 1000)).c_str());
+            for (int t = 0; t < TableCount; t++)
+            {
+                files[t].write(result->tables[t]);
+                totalRows[t] += result->tables[t].rows;
+            }
+            totalPackets += result->packets;
+            totalBytes += result->bytes;
+            std::map<u16, u64>::const_iterator it;
+            for (it = result->codeCounts.begin();
+                    it != result->codeCounts.end(); ++it)
+                codeCounts[it->first] += it->second;
+        }
+        else
+        {
+            printf("%s: %s\n", names[i], result->error.c_str());
+            failed++;
+        }
+        delete result;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            written++;
+        }
+        cond.notify_all();
+    }
+
+    for (int w = 0; w < threads; w++)
+        workers[w].join();
+
+    bool ok = true;
+    for (int i = 0; i < TableCount; i++)
+        ok = files[i].close() && ok;
+
+    const double seconds = std::chrono::duration<double>(
+                               std::chrono::steady_clock::now() - startTime).count();
+
+    printf("\n");
+    if (verbose)
+    {
+        std::map<u16, u64>::const_iterator it;
+        for (it = codeCounts.begin(); it != codeCounts.end(); ++it)
+            printf("%-24s %llu\n", MsgStrings::strMsgCode(it->first), it->second);
+        printf("\n");
+    }
+    for (int i = 0; i < TableCount; i++)
+        printf("%-8s %u rows\n", tableDefs[i].name, totalRows[i]);
+    printf("\n%i files, %llu packets, %.1f MB in %.2f seconds with %i threads\n",
+           fileCount - failed, totalPackets, (double)totalBytes / (1024.0 * 1024.0),
+           seconds, threads);
+    printf("%.0f packets/sec\n",
+           (seconds > 0.0) ? ((double)totalPackets / seconds) : 0.0);
+
+    if (!ok)
+    {
+        printf("* Couldn't write all the tables\n");
+        return 1;
+    }
+    return (failed > 0) ? 1 : 0;
+}
+
+/****************************************************************************/
+
+// Local Variables: ***
+// mode: C++ ***
+// tab-width: 4 ***
+// c-basic-offset: 4 ***
+// indent-tabs-mode: nil ***
+// End: ***
+// ex: shiftwidth=4 tabstop=4
@@ -0,0 +1,307 @@
+/* bzflag
+ * Copyright (c) 1993-2021 Tim Riker
+ *
+ * This package is free software;  you can redistribute it and/or
+ * modify it under the terms of the license found in the file
+ * named COPYING that should have accompanied this file.
+ *
+ * THIS PACKAGE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+
+//  COLLBENCH
+//
+//  Runs random ray, axis box and cylinder tests against the collision
+//  octree of a world on 1, 2, 4 ... threads at once, each thread with
+//  a CollisionQuery of its own.  Every result is checked against the
+//  same test made on one thread through the calls without a query, so
+//  it also shows that queries with their own contexts can be run side
+//  by side.  The world comes from bzfs -world <file> -cacheout <file>.
+//
+
+// system headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+// common headers
+#include "common.h"
+#include "BZDBCache.h"
+#include "CollisionManager.h"
+#include "Ray.h"
+#include "TimeKeeper.h"
+#include "version.h"
+
+// local headers
+#include "PackedWorld.h"
+
+
+int debugLevel = 0;
+
+enum TestType
+{
+    RayTest,
+    BoxTest,
+    CylinderTest,
+    TestTypes
+};
+
+static const char* testNames[TestTypes] = { "ray", "axis box", "cylinder" };
+
+struct Test
+{
+    TestType type;
+    float pos[3];
+    float dir[3];   // rays only
+    float size[3];  // box half widths, or cylinder radius and height
+};
+
+
+static void printHelp(const char* execName)
+{
+    printf("usage: %s [options]\n", execName);
+    printf("  -w <file>     : world written by bzfs -cacheout (required)\n");
+    printf("  -s <size>     : the world's _worldSize (default 800)\n");
+    printf("  -n <tests>    : tests of each kind (default 200000)\n");
+    printf("  -t <threads>  : most threads, doubling from 1 (default 8)\n");
+}
+
+
+static float randRange(float low, float high)
+{
+    return low + ((high - low) * ((float)rand() / RAND_MAX));
+}
+
+
+// a hash of the obstacles in the order found, which the octree and the
+// test fix, so any difference between two runs of a test shows
+static uint64_t hashList(const ObsList* list)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (int i = 0; i < list->count; i++)
+    {
+        hash ^= (uint64_t)(size_t)list->list[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash ^ (uint64_t)list->count;
+}
+
+
+// the test through the calls without a query, adding up what it found
+static uint64_t runTest(const Test& test, float timeLeft, long& found)
+{
+    const ObsList* list;
+    switch (test.type)
+    {
+    case RayTest:
+    {
+        const Ray ray(test.pos, test.dir);
+        list = COLLISIONMGR.rayTest(&ray, timeLeft);
+        break;
+    }
+    case BoxTest:
+    {
+        Extents exts;
+        for (int a = 0; a < 3; a++)
+        {
+            exts.mins[a] = test.pos[a] - test.size[a];
+            exts.maxs[a] = test.pos[a] + test.size[a];
+        }
+        list = COLLISIONMGR.axisBoxTest(exts);
+        break;
+    }
+    default:
+        list = COLLISIONMGR.cylinderTest(test.pos, test.size[0], test.size[1]);
+        break;
+    }
+    found += list->count;
+    return hashList(list);
+}
+
+
+static uint64_t runTest(const Test& test, float timeLeft,
+                        CollisionQuery& query)
+{
+    switch (test.type)
+    {
+    case RayTest:
+    {
+        const Ray ray(test.pos, test.dir);
+        return hashList(COLLISIONMGR.rayTest(&ray, timeLeft, query));
+    }
+    case BoxTest:
+    {
+        Extents exts;
+        for (int a = 0; a < 3; a++)
+        {
+            exts.mins[a] = test.pos[a] - test.size[a];
+            exts.maxs[a] = test.pos[a] + test.size[a];
+        }
+        return hashList(COLLISIONMGR.axisBoxTest(exts, query));
+    }
+    default:
+        return hashList(COLLISIONMGR.cylinderTest(test.pos, test.size[0],
+                        test.size[1], query));
+    }
+}
+
+
+// the share of the tests of one thread, and what it found
+static void runThread(const std::vector<Test>* tests, size_t first,
+                      size_t last, std::vector<uint64_t>* results)
+{
+    CollisionQuery query;
+    for (size_t i = first; i < last; i++)
+        (*results)[i] = runTest((*tests)[i], 1.0f, query);
+}
+
+
+int main(int argc, char** argv)
+{
+    const char* execName = argv[0];
+    std::string worldFile;
+    float worldSize = 800.0f;
+    int count = 200000;
+    int maxThreads = 8;
+
+    printf("\nCOLLBENCH-%s\nProtocol BZFS%s\n\n",
+           getAppVersion(), getProtocolVersion());
+
+    for (int arg = 1; arg < argc; arg += 2)
+    {
+        const char *opt = argv[arg];
+        if ((strcmp("-w", opt) != 0) && (strcmp("-s", opt) != 0) &&
+                (strcmp("-n", opt) != 0) && (strcmp("-t", opt) != 0))
+        {
+            printHelp(execName);
+            exit(strcmp("-h", opt) == 0 ? 0 : 1);
+        }
+        if ((arg + 1) >= argc)
+        {
+            printf("* Missing the %s parameter\n\n", opt);
+            printHelp(execName);
+            exit(1);
+        }
+        if (strcmp("-w", opt) == 0)
+            worldFile = argv[arg + 1];
+        else if (strcmp("-s", opt) == 0)
+            worldSize = (float)atof(argv[arg + 1]);
+        else if (strcmp("-n", opt) == 0)
+            count = atoi(argv[arg + 1]);
+        else
+            maxThreads = atoi(argv[arg + 1]);
+    }
+    if (worldFile.empty() || (worldSize <= 0.0f) || (count < 1) ||
+            (maxThreads < 1))
+    {
+        printHelp(execName);
+        exit(1);
+    }
+
+    TimeKeeper start = TimeKeeper::getCurrent();
+    if (!loadPackedWorld(worldFile, worldSize))
+        return 1;
+    printf("%s: %d obstacles, loaded in %.2f s\n", worldFile.c_str(),
+           COLLISIONMGR.getObstacleCount(), TimeKeeper::getCurrent() - start);
+
+    // tests spread over the world, about tank sized, rays going any way
+    const Extents& exts = COLLISIONMGR.getWorldExtents();
+    const float tankRadius = BZDBCache::tankRadius;
+    const float tankHeight = BZDBCache::tankHeight;
+    srand(1);
+    std::vector<Test> tests(count * TestTypes);
+    for (size_t i = 0; i < tests.size(); i++)
+    {
+        Test& test = tests[i];
+        test.type = (TestType)(i % TestTypes);
+        for (int a = 0; a < 3; a++)
+            test.pos[a] = randRange(exts.mins[a], exts.maxs[a]);
+        if (test.type == RayTest)
+        {
+            // as far as a shot goes in a second, about
+            test.dir[0] = randRange(-100.0f, 100.0f);
+            test.dir[1] = randRange(-100.0f, 100.0f);
+            test.dir[2] = randRange(-10.0f, 10.0f);
+            test.pos[2] = randRange(exts.mins[2], exts.mins[2] + 20.0f);
+        }
+        else if (test.type == BoxTest)
+        {
+            test.size[0] = tankRadius;
+            test.size[1] = tankRadius;
+            test.size[2] = tankHeight * 0.5f;
+        }
+        else
+        {
+            test.size[0] = tankRadius;
+            test.size[1] = tankHeight;
+        }
+    }
+
+    // the reference, through the calls without a query
+    std::vector<uint64_t> reference(tests.size());
+    long found = 0;
+    start = TimeKeeper::getCurrent();
+    for (size_t i = 0; i < tests.size(); i++)
+        reference[i] = runTest(tests[i], 1.0f, found);
+    const double referenceTime = TimeKeeper::getCurrent() - start;
+    printf("%d tests of each of", count);
+    for (int t = 0; t < TestTypes; t++)
+        printf("%s %s", (t == 0) ? "" : ",", testNames[t]);
+    printf("\n%.1f obstacles found a test, %.2f us a test without a query\n\n",
+           (double)found / tests.size(), referenceTime * 1e6 / tests.size());
+
+    printf("%8s %14s %12s %12s\n", "threads", "tests /s", "us a test",
+           "mismatches");
+    int errors = 0;
+    const unsigned int cpus = std::thread::hardware_concurrency();
+    for (int threads = 1; threads <= maxThreads; threads *= 2)
+    {
+        std::vector<uint64_t> results(tests.size());
+        std::vector<std::thread> workers;
+        start = TimeKeeper::getCurrent();
+        for (int t = 0; t < threads; t++)
+        {
+            const size_t first = tests.size() * t / threads;
+            const size_t last = tests.size() * (t + 1) / threads;
+            workers.push_back(std::thread(runThread, &tests, first, last,
+                                          &results));
+        }
+        for (size_t t = 0; t < workers.size(); t++)
+            workers[t].join();
+        const double elapsed = TimeKeeper::getCurrent() - start;
+
+        int mismatches = 0;
+        for (size_t i = 0; i < tests.size(); i++)
+        {
+            if (results[i] != reference[i])
+                mismatches++;
+        }
+        errors += mismatches;
+        printf("%8d %14.0f %12.2f %12d\n", threads, tests.size() / elapsed,
+               elapsed * 1e6 / tests.size(), mismatches);
+    }
+    if ((cpus > 0) && ((int)cpus < maxThreads))
+        printf("\n%u CPUs, the runs on more threads than that share them\n",
+               cpus);
+
+    if (errors)
+    {
+        printf("\n* %d results differ from the reference\n", errors);
+        return 1;
+    }
+    return 0;
+}
+
+
+// Local Variables: ***
+// mode: C++ ***
+// tab-width: 4 ***
+// c-basic-offset: 4 ***
+// indent-tabs-mode: nil ***
+// End: ***
+// ex: shiftwidth=4 tabstop=4
@@ -0,0 +1,922 @@
+/* bzflag
+ * Copyright (c) 1993-2021 Tim Riker
+ *
+ * This package is free software;  you can redistribute it and/or
+ * modify it under the terms of the license found in the file
+ * named COPYING that should have accompanied this file.
+ *
+ * THIS PACKAGE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+
+//  DRAWBENCH
+//
+//  Draws the mesh faces of a world offscreen, through EGL without a
+//  window, and gives the CPU time and the draw calls of a frame.  The
+//  faces are grouped the way MeshSceneNodeGenerator does it: each mesh
+//  has a fragment for each material that two or more of its faces use,
+//  and the other faces are drawn one by one.  The fragments are drawn
+//  as the client draws them, from client arrays or from display lists,
+//  and from buffer objects too.  They can also be batched, the faces
+//  of the fragments of all of the meshes that share a material and a
+//  cell of the octree, or a square of the world, making one node.
+//
+//  The frames are seen from a grid of spots on the ground, facing
+//  eight ways from each.  Nodes are culled by their extents and drawn
+//  a material at a time, as the renderer does with its gstates.  The
+//  CPU time is of this thread, from the culling to the last draw call,
+//  so it leaves out the rasterizing that a software renderer does on
+//  threads of its own; the finished time waits for that too.  Only the
+//  mesh faces are drawn, no textures are loaded, the materials that
+//  have one get a plain one.  The world comes from bzfs -world <file>
+//  -cacheout <file>.
+//
+
+// system headers
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <map>
+#include <string>
+#include <vector>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+// common headers
+#include "common.h"
+#include "BzMaterial.h"
+#include "CollisionManager.h"
+#include "MeshDrawInfo.h"
+#include "MeshFace.h"
+#include "MeshObstacle.h"
+#include "ObstacleMgr.h"
+#include "TimeKeeper.h"
+#include "version.h"
+
+// local headers
+#include "PackedWorld.h"
+
+
+int debugLevel = 0;
+
+static const int frameWidth = 800;
+static const int frameHeight = 450;
+
+// beyond GL 1.1, from the context
+static PFNGLGENBUFFERSPROC glGenBuffersP = NULL;
+static PFNGLBINDBUFFERPROC glBindBufferP = NULL;
+static PFNGLBUFFERDATAPROC glBufferDataP = NULL;
+static PFNGLDELETEBUFFERSPROC glDeleteBuffersP = NULL;
+static PFNGLGENFRAMEBUFFERSPROC glGenFramebuffersP = NULL;
+static PFNGLBINDFRAMEBUFFERPROC glBindFramebufferP = NULL;
+static PFNGLGENRENDERBUFFERSPROC glGenRenderbuffersP = NULL;
+static PFNGLBINDRENDERBUFFERPROC glBindRenderbufferP = NULL;
+static PFNGLRENDERBUFFERSTORAGEPROC glRenderbufferStorageP = NULL;
+static PFNGLFRAMEBUFFERRENDERBUFFERPROC glFramebufferRenderbufferP = NULL;
+static PFNGLCHECKFRAMEBUFFERSTATUSPROC glCheckFramebufferStatusP = NULL;
+
+enum DrawStyle
+{
+    ArrayStyle,
+    ListStyle,
+    BufferStyle,
+    DrawStyles
+};
+
+static const char* styleNames[DrawStyles] =
+{
+    "client arrays", "display lists", "buffer objects"
+};
+
+enum GroupType
+{
+    ByMesh,
+    BySquare,
+    ByCell
+};
+
+struct Grouping
+{
+    GroupType type;
+    float squareSize;
+    int cellDepth;
+};
+
+// a scene node, either one face or a fragment of triangles
+struct DrawNode
+{
+    const BzMaterial* material;
+    int materialIndex;
+    float mins[3];
+    float maxs[3];
+    bool single;
+    GLsizei vertexCount;
+    std::vector<float> vertices;
+    std::vector<float> normals;
+    std::vector<float> texcoords;
+    GLuint list;
+    GLuint buffer;
+};
+
+struct View
+{
+    float eye[3];
+    float dir[3];
+};
+
+struct FrameStats
+{
+    double cpuTime;
+    double finishedTime;
+    long drawCalls;
+    long stateChanges;
+    long triangles;
+};
+
+struct MaterialState
+{
+    const BzMaterial* material;
+    GLuint texture;
+};
+
+static std::vector<MaterialState> materials;
+static std::map<const BzMaterial*, int> materialIndices;
+
+
+static double getThreadTime()
+{
+#ifdef CLOCK_THREAD_CPUTIME_ID
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (double)ts.tv_sec + ((double)ts.tv_nsec * 1.0e-9);
+#else
+    return TimeKeeper::getCurrent().getSeconds();
+#endif
+}
+
+
+static void printHelp(const char* execName)
+{
+    printf("usage: %s [options]\n", execName);
+    printf("  -w <file>   : world written by bzfs -cacheout (required)\n");
+    printf("  -s <size>   : the world's _worldSize (default 800)\n");
+    printf("  -g <spots>  : spots along each side of the grid (default 6)\n");
+    printf("  -r <runs>   : runs, the best one counts (default 3)\n");
+}
+
+
+//
+// The offscreen context
+//
+
+static bool makeContext()
+{
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC)
+        eglGetProcAddress("eglGetPlatformDisplayEXT");
+    EGLDisplay display = EGL_NO_DISPLAY;
+    if (getPlatformDisplay != NULL)
+        display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA,
+                                     EGL_DEFAULT_DISPLAY, NULL);
+    if (display == EGL_NO_DISPLAY)
+        display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    EGLint major, minor;
+    if ((display == EGL_NO_DISPLAY) || !eglInitialize(display, &major, &minor))
+    {
+        printf("* No EGL display (error 0x%x)\n", eglGetError());
+        return false;
+    }
+    if (!eglBindAPI(EGL_OPENGL_API))
+    {
+        printf("* EGL has no desktop OpenGL\n");
+        return false;
+    }
+    const EGLint configAttribs[] =
+    {
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE
+    };
+    EGLConfig config = NULL;
+    EGLint configs = 0;
+    eglChooseConfig(display, configAttribs, &config, 1, &configs);
+    EGLContext context = eglCreateContext(display, (configs > 0) ? config : NULL,
+                                          EGL_NO_CONTEXT, NULL);
+    if ((context == EGL_NO_CONTEXT) ||
+            !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+    {
+        printf("* No OpenGL context without a surface (error 0x%x)\n",
+               eglGetError());
+        return false;
+    }
+
+    glGenBuffersP = (PFNGLGENBUFFERSPROC)eglGetProcAddress("glGenBuffers");
+    glBindBufferP = (PFNGLBINDBUFFERPROC)eglGetProcAddress("glBindBuffer");
+    glBufferDataP = (PFNGLBUFFERDATAPROC)eglGetProcAddress("glBufferData");
+    glDeleteBuffersP =
+        (PFNGLDELETEBUFFERSPROC)eglGetProcAddress("glDeleteBuffers");
+    glGenFramebuffersP =
+        (PFNGLGENFRAMEBUFFERSPROC)eglGetProcAddress("glGenFramebuffers");
+    glBindFramebufferP =
+        (PFNGLBINDFRAMEBUFFERPROC)eglGetProcAddress("glBindFramebuffer");
+    glGenRenderbuffersP =
+        (PFNGLGENRENDERBUFFERSPROC)eglGetProcAddress("glGenRenderbuffers");
+    glBindRenderbufferP =
+        (PFNGLBINDRENDERBUFFERPROC)eglGetProcAddress("glBindRenderbuffer");
+    glRenderbufferStorageP = (PFNGLRENDERBUFFERSTORAGEPROC)
+                             eglGetProcAddress("glRenderbufferStorage");
+    glFramebufferRenderbufferP = (PFNGLFRAMEBUFFERRENDERBUFFERPROC)
+                                 eglGetProcAddress("glFramebufferRenderbuffer");
+    glCheckFramebufferStatusP = (PFNGLCHECKFRAMEBUFFERSTATUSPROC)
+                                eglGetProcAddress("glCheckFramebufferStatus");
+    if (!glGenBuffersP || !glBindBufferP || !glBufferDataP ||
+            !glDeleteBuffersP || !glGenFramebuffersP || !glBindFramebufferP ||
+            !glGenRenderbuffersP || !glBindRenderbufferP ||
+            !glRenderbufferStorageP || !glFramebufferRenderbufferP ||
+            !glCheckFramebufferStatusP)
+    {
+        printf("* The context has no buffer or framebuffer objects\n");
+        return false;
+    }
+
+    // somewhere to draw
+    GLuint framebuffer, renderbuffers[2];
+    glGenFramebuffersP(1, &framebuffer);
+    glBindFramebufferP(GL_FRAMEBUFFER, framebuffer);
+    glGenRenderbuffersP(2, renderbuffers);
+    glBindRenderbufferP(GL_RENDERBUFFER, renderbuffers[0]);
+    glRenderbufferStorageP(GL_RENDERBUFFER, GL_RGBA8, frameWidth, frameHeight);
+    glFramebufferRenderbufferP(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                               GL_RENDERBUFFER, renderbuffers[0]);
+    glBindRenderbufferP(GL_RENDERBUFFER, renderbuffers[1]);
+    glRenderbufferStorageP(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24,
+                           frameWidth, frameHeight);
+    glFramebufferRenderbufferP(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                               GL_RENDERBUFFER, renderbuffers[1]);
+    if (glCheckFramebufferStatusP(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        printf("* The offscreen framebuffer is incomplete\n");
+        return false;
+    }
+
+    printf("%s, %s\n", (const char*)glGetString(GL_RENDERER),
+           (const char*)glGetString(GL_VERSION));
+    return true;
+}
+
+
+// the state the client draws the world with, more or less
+static void setupState(float farPlane)
+{
+    glViewport(0, 0, frameWidth, frameHeight);
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_CULL_FACE);
+    glEnable(GL_LIGHTING);
+    glEnable(GL_LIGHT0);
+    glEnable(GL_COLOR_MATERIAL);
+    glColorMaterial(GL_FRONT_AND_BACK, GL_AMBIENT_AND_DIFFUSE);
+    glShadeModel(GL_SMOOTH);
+    glClearColor(0.5f, 0.6f, 0.9f, 1.0f);
+    const GLfloat sun[4] = { 0.3f, 0.4f, 0.86f, 0.0f };
+    glLightfv(GL_LIGHT0, GL_POSITION, sun);
+
+    // 60 degrees up and down, like the default displayFOV
+    const float nearPlane = 1.0f;
+    const float top = nearPlane * tanf(30.0f * (float)M_PI / 180.0f);
+    const float right = top * ((float)frameWidth / (float)frameHeight);
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    glFrustum(-right, right, -top, top, nearPlane, farPlane);
+    glMatrixMode(GL_MODELVIEW);
+
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_NORMAL_ARRAY);
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+}
+
+
+static int getMaterialIndex(const BzMaterial* material)
+{
+    std::map<const BzMaterial*, int>::const_iterator it =
+        materialIndices.find(material);
+    if (it != materialIndices.end())
+        return it->second;
+
+    static std::map<std::string, GLuint> textures;
+    MaterialState state;
+    state.material = material;
+    state.texture = 0;
+    if ((material->getTextureCount() > 0) &&
+            !material->getTexture(0).empty())
+    {
+        GLuint& texture = textures[material->getTexture(0)];
+        if (texture == 0)
+        {
+            // a plain stand in, so that the binds still happen
+            unsigned char pixels[64 * 64 * 4];
+            const unsigned char shade = (unsigned char)(64 + (textures.size() * 37) % 192);
+            memset(pixels, shade, sizeof(pixels));
+            glGenTextures(1, &texture);
+            glBindTexture(GL_TEXTURE_2D, texture);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 64, 64, 0, GL_RGBA,
+                         GL_UNSIGNED_BYTE, pixels);
+        }
+        state.texture = texture;
+    }
+    const int index = (int)materials.size();
+    materials.push_back(state);
+    materialIndices[material] = index;
+    return index;
+}
+
+
+//
+// Grouping the faces into nodes
+//
+
+// MeshSceneNodeGenerator leaves these out
+static bool groundClippedFace(const MeshFace* face)
+{
+    return (face->getPlane()[2] < -0.9f) &&
+           (face->getExtents().maxs[2] < 0.001f);
+}
+
+
+static void addSingle(std::vector<DrawNode>& nodes, const MeshFace* face)
+{
+    DrawNode node;
+    node.material = face->getMaterial();
+    node.materialIndex = getMaterialIndex(node.material);
+    memcpy(node.mins, face->getExtents().mins, sizeof(node.mins));
+    memcpy(node.maxs, face->getExtents().maxs, sizeof(node.maxs));
+    node.single = true;
+    node.vertexCount = face->getVertexCount();
+    for (int v = 0; v < face->getVertexCount(); v++)
+    {
+        const float* normal = face->useNormals() ? face->getNormal(v)
+                              : face->getPlane();
+        for (int a = 0; a < 3; a++)
+        {
+            node.vertices.push_back(face->getVertex(v)[a]);
+            node.normals.push_back(normal[a]);
+        }
+        for (int a = 0; a < 2; a++)
+            node.texcoords.push_back(face->useTexcoords() ?
+                                     face->getTexcoord(v)[a] : 0.0f);
+    }
+    node.list = 0;
+    node.buffer = 0;
+    nodes.push_back(node);
+}
+
+
+// the triangles of MeshFragSceneNode, fans done the hard way
+static void addFragment(std::vector<DrawNode>& nodes,
+                        const std::vector<const MeshFace*>& faces)
+{
+    if (faces.size() == 1)
+    {
+        addSingle(nodes, faces[0]);
+        return;
+    }
+    DrawNode node;
+    node.material = faces[0]->getMaterial();
+    node.materialIndex = getMaterialIndex(node.material);
+    node.single = false;
+    node.vertexCount = 0;
+    Extents exts;
+    for (size_t f = 0; f < faces.size(); f++)
+    {
+        const MeshFace* face = faces[f];
+        exts.expandToBox(face->getExtents());
+        const int count = face->getVertexCount();
+        for (int t = 0; t < (count - 2); t++)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                const int v = (k == 0) ? 0 : ((t + k) % count);
+                const float* normal = face->useNormals() ? face->getNormal(v)
+                                      : face->getPlane();
+                for (int a = 0; a < 3; a++)
+                {
+                    node.vertices.push_back(face->getVertex(v)[a]);
+                    node.normals.push_back(normal[a]);
+                }
+                for (int a = 0; a < 2; a++)
+                    node.texcoords.push_back(face->useTexcoords() ?
+                                             face->getTexcoord(v)[a] : 0.0f);
+                node.vertexCount++;
+            }
+        }
+    }
+    memcpy(node.mins, exts.mins, sizeof(node.mins));
+    memcpy(node.maxs, exts.maxs, sizeof(node.maxs));
+    node.list = 0;
+    node.buffer = 0;
+    nodes.push_back(node);
+}
+
+
+// the cube the scene octree is made in, Z on its minimum
+static void getOctreeCube(Extents& cube)
+{
+    const Extents& world = COLLISIONMGR.getWorldExtents();
+    cube = world;
+    float width = 0.0f;
+    for (int a = 0; a < 3; a++)
+    {
+        if (world.getWidth(a) > width)
+            width = world.getWidth(a);
+    }
+    for (int a = 0; a < 2; a++)
+    {
+        const float adjust = 0.5f * (width - world.getWidth(a));
+        cube.mins[a] -= adjust;
+        cube.maxs[a] += adjust;
+    }
+    cube.maxs[2] = cube.mins[2] + width;
+}
+
+
+static void makeNodes(const Grouping& grouping, std::vector<DrawNode>& nodes,
+                      int& skippedMeshes)
+{
+    nodes.clear();
+    skippedMeshes = 0;
+
+    // the batches, by material and then by square or cell
+    typedef std::pair<const BzMaterial*, std::pair<int, int> > BatchKey;
+    std::map<BatchKey, std::vector<const MeshFace*> > batches;
+    Extents cube;
+    getOctreeCube(cube);
+    const float cellSize = (cube.maxs[0] - cube.mins[0]) /
+                           (float)(1 << grouping.cellDepth);
+
+    const ObstacleList& meshes = OBSTACLEMGR.getMeshes();
+    for (unsigned int m = 0; m < meshes.size(); m++)
+    {
+        const MeshObstacle* mesh = (const MeshObstacle*)meshes[m];
+        if ((mesh->getDrawInfo() != NULL) && mesh->getDrawInfo()->isValid())
+        {
+            // drawn by MeshSceneNode, not by fragments
+            skippedMeshes++;
+            continue;
+        }
+        if (mesh->noClusters())
+        {
+            for (int f = 0; f < mesh->getFaceCount(); f++)
+                addSingle(nodes, mesh->getFace(f));
+            continue;
+        }
+
+        // the faces of each material, in the order of the mesh
+        std::map<const BzMaterial*, std::vector<const MeshFace*> > byMaterial;
+        std::vector<const BzMaterial*> order;
+        for (int f = 0; f < mesh->getFaceCount(); f++)
+        {
+            const MeshFace* face = mesh->getFace(f);
+            if (groundClippedFace(face))
+                continue;
+            if (face->noClusters())
+            {
+                addSingle(nodes, face);
+                continue;
+            }
+            std::vector<const MeshFace*>& faces = byMaterial[face->getMaterial()];
+            if (faces.empty())
+                order.push_back(face->getMaterial());
+            faces.push_back(face);
+        }
+
+        for (size_t o = 0; o < order.size(); o++)
+        {
+            const std::vector<const MeshFace*>& faces = byMaterial[order[o]];
+            if ((faces.size() == 1) || (grouping.type == ByMesh))
+            {
+                addFragment(nodes, faces);
+                continue;
+            }
+            for (size_t f = 0; f < faces.size(); f++)
+            {
+                const Extents& exts = faces[f]->getExtents();
+                float middle[3];
+                for (int a = 0; a < 3; a++)
+                    middle[a] = 0.5f * (exts.mins[a] + exts.maxs[a]);
+                std::pair<int, int> place;
+                if (grouping.type == BySquare)
+                {
+                    place.first = (int)floorf(middle[0] / grouping.squareSize);
+                    place.second = (int)floorf(middle[1] / grouping.squareSize);
+                }
+                else
+                {
+                    // the cell at that depth, numbered along X, Y and Z
+                    const int side = 1 << grouping.cellDepth;
+                    int cell[3];
+                    for (int a = 0; a < 3; a++)
+                    {
+                        cell[a] = (int)floorf((middle[a] - cube.mins[a]) / cellSize);
+                        if (cell[a] < 0)
+                            cell[a] = 0;
+                        else if (cell[a] >= side)
+                            cell[a] = side - 1;
+                    }
+                    place.first = cell[0] + (side * cell[1]);
+                    place.second = cell[2];
+                }
+                batches[BatchKey(order[o], place)].push_back(faces[f]);
+            }
+        }
+    }
+
+    std::map<BatchKey, std::vector<const MeshFace*> >::const_iterator it;
+    for (it = batches.begin(); it != batches.end(); ++it)
+        addFragment(nodes, it->second);
+}
+
+
+static void loadNodes(std::vector<DrawNode>& nodes, DrawStyle style)
+{
+    for (size_t n = 0; n < nodes.size(); n++)
+    {
+        DrawNode& node = nodes[n];
+        if (node.single)
+            continue;
+        if (style == ListStyle)
+        {
+            node.list = glGenLists(1);
+            glNewList(node.list, GL_COMPILE);
+            glVertexPointer(3, GL_FLOAT, 0, &node.vertices[0]);
+            glNormalPointer(GL_FLOAT, 0, &node.normals[0]);
+            glTexCoordPointer(2, GL_FLOAT, 0, &node.texcoords[0]);
+            glDrawArrays(GL_TRIANGLES, 0, node.vertexCount);
+            glEndList();
+        }
+        else if (style == BufferStyle)
+        {
+            // the vertices, then the normals, then the texcoords
+            const size_t v = node.vertices.size() * sizeof(float);
+            const size_t t = node.texcoords.size() * sizeof(float);
+            glGenBuffersP(1, &node.buffer);
+            glBindBufferP(GL_ARRAY_BUFFER, node.buffer);
+            std::vector<float> data(node.vertices);
+            data.insert(data.end(), node.normals.begin(), node.normals.end());
+            data.insert(data.end(), node.texcoords.begin(), node.texcoords.end());
+            glBufferDataP(GL_ARRAY_BUFFER, (GLsizeiptr)(v + v + t), &data[0],
+                          GL_STATIC_DRAW);
+        }
+    }
+    glBindBufferP(GL_ARRAY_BUFFER, 0);
+}
+
+
+static void freeNodes(std::vector<DrawNode>& nodes)
+{
+    for (size_t n = 0; n < nodes.size(); n++)
+    {
+        if (nodes[n].list != 0)
+            glDeleteLists(nodes[n].list, 1);
+        if (nodes[n].buffer != 0)
+            glDeleteBuffersP(1, &nodes[n].buffer);
+        nodes[n].list = 0;
+        nodes[n].buffer = 0;
+    }
+}
+
+
+//
+// Drawing the frames
+//
+
+static void makeViews(int spots, std::vector<View>& views)
+{
+    const Extents& world = COLLISIONMGR.getWorldExtents();
+    for (int x = 0; x < spots; x++)
+    {
+        for (int y = 0; y < spots; y++)
+        {
+            for (int h = 0; h < 8; h++)
+            {
+                View view;
+                view.eye[0] = world.mins[0] + (world.getWidth(0) * (x + 0.5f) / spots);
+                view.eye[1] = world.mins[1] + (world.getWidth(1) * (y + 0.5f) / spots);
+                // about where a tank's eyes are
+                view.eye[2] = 1.6f;
+                const float heading = (float)h * (float)M_PI / 4.0f;
+                view.dir[0] = cosf(heading);
+                view.dir[1] = sinf(heading);
+                view.dir[2] = 0.0f;
+                views.push_back(view);
+            }
+        }
+    }
+}
+
+
+// the inward planes of the view's frustum
+static void makePlanes(const View& view, float farPlane, float planes[6][4])
+{
+    const float tanY = tanf(30.0f * (float)M_PI / 180.0f);
+    const float tanX = tanY * ((float)frameWidth / (float)frameHeight);
+    const float* f = view.dir;
+    const float r[3] = { f[1], -f[0], 0.0f };
+    const float u[3] = { 0.0f, 0.0f, 1.0f };
+    for (int a = 0; a < 3; a++)
+    {
+        planes[0][a] = f[a];
+        planes[1][a] = -f[a];
+        planes[2][a] = r[a] + (f[a] * tanX);
+        planes[3][a] = -r[a] + (f[a] * tanX);
+        planes[4][a] = u[a] + (f[a] * tanY);
+        planes[5][a] = -u[a] + (f[a] * tanY);
+    }
+    for (int p = 0; p < 6; p++)
+    {
+        planes[p][3] = -((planes[p][0] * view.eye[0]) +
+                         (planes[p][1] * view.eye[1]) +
+                         (planes[p][2] * view.eye[2]));
+    }
+    planes[0][3] -= 1.0f;
+    planes[1][3] += farPlane;
+}
+
+
+static bool isOutside(const DrawNode& node, const float planes[6][4])
+{
+    for (int p = 0; p < 6; p++)
+    {
+        const float* plane = planes[p];
+        float dist = plane[3];
+        for (int a = 0; a < 3; a++)
+            dist += plane[a] * ((plane[a] > 0.0f) ? node.maxs[a] : node.mins[a]);
+        if (dist < 0.0f)
+            return true;
+    }
+    return false;
+}
+
+
+static void setMaterial(const MaterialState& state)
+{
+    if (state.texture != 0)
+    {
+        glEnable(GL_TEXTURE_2D);
+        glBindTexture(GL_TEXTURE_2D, state.texture);
+    }
+    else
+        glDisable(GL_TEXTURE_2D);
+    const float* specular = state.material->getSpecular();
+    glMaterialfv(GL_FRONT_AND_BACK, GL_SPECULAR, specular);
+    glMaterialf(GL_FRONT_AND_BACK, GL_SHININESS, state.material->getShininess());
+}
+
+
+static void drawNode(const DrawNode& node, DrawStyle style)
+{
+    // the node's color, as WallSceneNode::setColor() does
+    glColor4fv(node.material->getDiffuse());
+
+    if (node.single)
+    {
+        // MeshPolySceneNode draws with glBegin()
+        glBegin(GL_TRIANGLE_FAN);
+        for (int v = 0; v < node.vertexCount; v++)
+        {
+            glNormal3fv(&node.normals[v * 3]);
+            glTexCoord2fv(&node.texcoords[v * 2]);
+            glVertex3fv(&node.vertices[v * 3]);
+        }
+        glEnd();
+        return;
+    }
+
+    switch (style)
+    {
+    case ListStyle:
+        glCallList(node.list);
+        break;
+    case BufferStyle:
+    {
+        const size_t v = node.vertices.size() * sizeof(float);
+        glBindBufferP(GL_ARRAY_BUFFER, node.buffer);
+        glVertexPointer(3, GL_FLOAT, 0, (const GLvoid*)0);
+        glNormalPointer(GL_FLOAT, 0, (const GLvoid*)v);
+        glTexCoordPointer(2, GL_FLOAT, 0, (const GLvoid*)(v + v));
+        glDrawArrays(GL_TRIANGLES, 0, node.vertexCount);
+        glBindBufferP(GL_ARRAY_BUFFER, 0);
+        break;
+    }
+    default:
+        glVertexPointer(3, GL_FLOAT, 0, &node.vertices[0]);
+        glNormalPointer(GL_FLOAT, 0, &node.normals[0]);
+        glTexCoordPointer(2, GL_FLOAT, 0, &node.texcoords[0]);
+        glDrawArrays(GL_TRIANGLES, 0, node.vertexCount);
+        break;
+    }
+}
+
+
+static void drawFrames(const std::vector<DrawNode>& nodes, DrawStyle style,
+                       const std::vector<View>& views, float farPlane,
+                       FrameStats& stats)
+{
+    memset(&stats, 0, sizeof(stats));
+    std::vector<std::vector<const DrawNode*> > buckets(materials.size());
+    for (size_t i = 0; i < views.size(); i++)
+    {
+        const View& view = views[i];
+        const TimeKeeper start = TimeKeeper::getCurrent();
+        const double cpuStart = getThreadTime();
+
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glLoadIdentity();
+        // looking along the view, Z up
+        const float* f = view.dir;
+        const GLfloat look[16] =
+        {
+            f[1], 0.0f, -f[0], 0.0f,
+            -f[0], 0.0f, -f[1], 0.0f,
+            0.0f, 1.0f, 0.0f, 0.0f,
+            0.0f, 0.0f, 0.0f, 1.0f
+        };
+        glMultMatrixf(look);
+        glTranslatef(-view.eye[0], -view.eye[1], -view.eye[2]);
+
+        // cull the nodes and put them in with their materials
+        float planes[6][4];
+        makePlanes(view, farPlane, planes);
+        for (size_t n = 0; n < nodes.size(); n++)
+        {
+            const DrawNode& node = nodes[n];
+            if (!isOutside(node, planes))
+                buckets[node.materialIndex].push_back(&node);
+        }
+
+        for (size_t m = 0; m < buckets.size(); m++)
+        {
+            std::vector<const DrawNode*>& bucket = buckets[m];
+            if (bucket.empty())
+                continue;
+            setMaterial(materials[m]);
+            stats.stateChanges++;
+            for (size_t n = 0; n < bucket.size(); n++)
+            {
+                drawNode(*bucket[n], style);
+                stats.drawCalls++;
+                stats.triangles += bucket[n]->single ?
+                                   (bucket[n]->vertexCount - 2) : (bucket[n]->vertexCount / 3);
+            }
+            bucket.clear();
+        }
+
+        stats.cpuTime += getThreadTime() - cpuStart;
+        glFinish();
+        stats.finishedTime += TimeKeeper::getCurrent() - start;
+    }
+}
+
+
+int main(int argc, char** argv)
+{
+    const char* execName = argv[0];
+    std::string worldFile;
+    float worldSize = 800.0f;
+    int spots = 6;
+    int runs = 3;
+
+    printf("\nDRAWBENCH-%s\nProtocol BZFS%s\n\n",
+           getAppVersion(), getProtocolVersion());
+
+    for (int arg = 1; arg < argc; arg += 2)
+    {
+        const char *opt = argv[arg];
+        if ((strcmp("-w", opt) != 0) && (strcmp("-s", opt) != 0) &&
+                (strcmp("-g", opt) != 0) && (strcmp("-r", opt) != 0))
+        {
+            printHelp(execName);
+            exit(strcmp("-h", opt) == 0 ? 0 : 1);
+        }
+        if ((arg + 1) >= argc)
+        {
+            printf("* Missing the %s parameter\n\n", opt);
+            printHelp(execName);
+            exit(1);
+        }
+        if (strcmp("-w", opt) == 0)
+            worldFile = argv[arg + 1];
+        else if (strcmp("-s", opt) == 0)
+            worldSize = (float)atof(argv[arg + 1]);
+        else if (strcmp("-g", opt) == 0)
+            spots = atoi(argv[arg + 1]);
+        else
+            runs = atoi(argv[arg + 1]);
+    }
+    if (worldFile.empty() || (worldSize <= 0.0f) || (spots < 1) || (runs < 1))
+    {
+        printHelp(execName);
+        exit(1);
+    }
+
+    if (!loadPackedWorld(worldFile, worldSize))
+        return 1;
+    if (!makeContext())
+        return 1;
+
+    const Extents& world = COLLISIONMGR.getWorldExtents();
+    const float farPlane = sqrtf((world.getWidth(0) * world.getWidth(0)) +
+                                 (world.getWidth(1) * world.getWidth(1)));
+    setupState(farPlane);
+    std::vector<View> views;
+    makeViews(spots, views);
+
+    const Grouping groupings[] =
+    {
+        { ByMesh, 0.0f, 0 },
+        { BySquare, 200.0f, 0 },
+        { ByCell, 0.0f, 2 },
+        { ByCell, 0.0f, 3 },
+        { ByCell, 0.0f, 4 }
+    };
+    printf("%s: %d meshes, %d frames %dx%d, best of %d runs\n\n",
+           worldFile.c_str(), (int)OBSTACLEMGR.getMeshes().size(),
+           (int)views.size(), frameWidth, frameHeight, runs);
+
+    printf("%-16s %-15s %6s %8s %8s %9s %9s %9s\n", "style", "nodes",
+           "count", "draws", "states", "tris", "cpu ms", "done ms");
+    int errors = 0;
+    long meshTriangles = -1;
+    for (int s = 0; s < DrawStyles; s++)
+    {
+        const DrawStyle style = (DrawStyle)s;
+        for (size_t g = 0; g < bzcountof(groupings); g++)
+        {
+            const Grouping& grouping = groupings[g];
+            std::vector<DrawNode> nodes;
+            int skippedMeshes;
+            makeNodes(grouping, nodes, skippedMeshes);
+            if ((s == 0) && (g == 0) && (skippedMeshes > 0))
+                printf("(%d meshes with draw info are left out)\n", skippedMeshes);
+
+            // every grouping has to hold the same triangles
+            long triangles = 0;
+            for (size_t n = 0; n < nodes.size(); n++)
+                triangles += nodes[n].single ? (nodes[n].vertexCount - 2)
+                             : (nodes[n].vertexCount / 3);
+            if (meshTriangles < 0)
+                meshTriangles = triangles;
+            else if (triangles != meshTriangles)
+            {
+                printf("* %ld triangles, not %ld\n", triangles, meshTriangles);
+                errors++;
+            }
+
+            loadNodes(nodes, style);
+            FrameStats best;
+            for (int r = 0; r < runs; r++)
+            {
+                FrameStats stats;
+                drawFrames(nodes, style, views, farPlane, stats);
+                if ((r == 0) || (stats.cpuTime < best.cpuTime))
+                    best = stats;
+            }
+            freeNodes(nodes);
+
+            char name[32];
+            if (grouping.type == ByMesh)
+                snprintf(name, sizeof(name), "by mesh");
+            else if (grouping.type == BySquare)
+                snprintf(name, sizeof(name), "%.0f squares", grouping.squareSize);
+            else
+                snprintf(name, sizeof(name), "cells, depth %d", grouping.cellDepth);
+            const double frames = (double)views.size();
+            printf("%-16s %-15s %6d %8.1f %8.1f %9.0f %9.3f %9.3f\n",
+                   (g == 0) ? styleNames[s] : "", name, (int)nodes.size(),
+                   best.drawCalls / frames, best.stateChanges / frames,
+                   best.triangles / frames, best.cpuTime * 1000.0 / frames,
+                   best.finishedTime * 1000.0 / frames);
+        }
+    }
+    printf("\ndraws, states, tris and the times are per frame\n");
+
+    if (glGetError() != GL_NO_ERROR)
+    {
+        printf("\n* OpenGL gave an error\n");
+        errors++;
+    }
+    return errors ? 1 : 0;
+}
+
+
+// Local Variables: ***
+// mode: C++ ***
+// tab-width: 4 ***
+// c-basic-offset: 4 ***
+// indent-tabs-mode: nil ***
+// End: ***
+// ex: shiftwidth=4 tabstop=4
@@ -0,0 +1,341 @@
+/* bzflag
+ * Copyright (c) 1993-2021 Tim Riker
+ *
+ * This package is free software;  you can redistribute it and/or
+ * modify it under the terms of the license found in the file
+ * named COPYING that should have accompanied this file.
+ *
+ * THIS PACKAGE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+
+//  FACEBENCH
+//
+//  Times each MeshFaceBatch kernel this build and CPU can run, forcing
+//  them in turn, on the rays of a world: the ray tests of the collision
+//  octree, which batch the faces of each cell, and whole meshes in one
+//  batch.  Every time a kernel gives is checked against the scalar
+//  MeshFace::intersect() of the same face, and has to be the same to
+//  the bit.  The world comes from bzfs -world <file> -cacheout <file>.
+//
+
+// system headers
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// common headers
+#include "common.h"
+#include "CollisionManager.h"
+#include "MeshFace.h"
+#include "MeshFaceBatch.h"
+#include "MeshObstacle.h"
+#include "ObstacleMgr.h"
+#include "Ray.h"
+#include "TimeKeeper.h"
+#include "version.h"
+
+// local headers
+#include "PackedWorld.h"
+
+
+int debugLevel = 0;
+
+static const char* kernels[] = { "avx", "sse2", "scalar" };
+
+static int errors = 0;
+
+struct TestRay
+{
+    float origin[3];
+    float dir[3];
+    float timeLeft;
+};
+
+
+static void printHelp(const char* execName)
+{
+    printf("usage: %s [options]\n", execName);
+    printf("  -w <file>   : world written by bzfs -cacheout (required)\n");
+    printf("  -s <size>   : the world's _worldSize (default 800)\n");
+    printf("  -n <rays>   : rays of each kind (default 100000)\n");
+    printf("\n");
+    printf("Half the rays drop straight down onto the world, the way spawns\n");
+    printf("and flags are placed, the other half aim at random mesh faces.\n");
+}
+
+
+static float randRange(float low, float high)
+{
+    return low + ((high - low) * ((float)rand() / RAND_MAX));
+}
+
+
+static bool sameTime(float a, float b)
+{
+    return (memcmp(&a, &b, sizeof(float)) == 0) || (isnan(a) && isnan(b));
+}
+
+
+static void fail(const char* kernel, const char* what, float got, float want)
+{
+    if (errors++ < 5)
+        printf("* %s: %s is %.9g, MeshFace::intersect() gives %.9g\n",
+               kernel, what, got, want);
+}
+
+
+// the octree's batched ray tests, checked obstacle by obstacle
+static double octreeRays(const char* kernel, const std::vector<TestRay>& rays,
+                         long& tested)
+{
+    TimeKeeper start = TimeKeeper::getCurrent();
+    for (size_t i = 0; i < rays.size(); i++)
+    {
+        const Ray ray(rays[i].origin, rays[i].dir);
+        const float* times;
+        const ObsList* list = COLLISIONMGR.rayTestTimes(&ray, rays[i].timeLeft,
+                              times);
+        tested += list->count;
+    }
+    const double elapsed = TimeKeeper::getCurrent() - start;
+
+    // checked again apart, so that the checks aren't timed
+    for (size_t i = 0; i < rays.size(); i++)
+    {
+        const Ray ray(rays[i].origin, rays[i].dir);
+        const float* times;
+        const ObsList* list = COLLISIONMGR.rayTestTimes(&ray, rays[i].timeLeft,
+                              times);
+        for (int o = 0; o < list->count; o++)
+        {
+            const float want = list->list[o]->intersect(ray);
+            if (!sameTime(times[o], want))
+                fail(kernel, "an octree ray", times[o], want);
+        }
+    }
+    return elapsed;
+}
+
+
+// what the octree's ray tests did before, intersect() on each obstacle
+static double octreeRaysScalar(const std::vector<TestRay>& rays)
+{
+    volatile float sink = 0.0f;
+    TimeKeeper start = TimeKeeper::getCurrent();
+    for (size_t i = 0; i < rays.size(); i++)
+    {
+        const Ray ray(rays[i].origin, rays[i].dir);
+        const ObsList* list = COLLISIONMGR.rayTest(&ray, rays[i].timeLeft);
+        for (int o = 0; o < list->count; o++)
+            sink = list->list[o]->intersect(ray);
+    }
+    (void)sink;
+    return TimeKeeper::getCurrent() - start;
+}
+
+
+// every ray against every face of one mesh, in one batch
+static double meshRays(const char* kernel, const MeshFaceBatch& batch,
+                       const MeshObstacle* mesh,
+                       const std::vector<TestRay>& rays)
+{
+    std::vector<float> times(mesh->getFaceCount());
+    TimeKeeper start = TimeKeeper::getCurrent();
+    for (size_t i = 0; i < rays.size(); i++)
+    {
+        const Ray ray(rays[i].origin, rays[i].dir);
+        batch.intersect(ray, &times[0]);
+    }
+    const double elapsed = TimeKeeper::getCurrent() - start;
+
+    for (size_t i = 0; i < rays.size(); i++)
+    {
+        const Ray ray(rays[i].origin, rays[i].dir);
+        batch.intersect(ray, &times[0]);
+        for (int f = 0; f < mesh->getFaceCount(); f++)
+        {
+            const float want = mesh->getFace(f)->intersect(ray);
+            if (!sameTime(times[f], want))
+                fail(kernel, "a mesh ray", times[f], want);
+        }
+    }
+    return elapsed;
+}
+
+
+static double meshRaysScalar(const MeshObstacle* mesh,
+                             const std::vector<TestRay>& rays)
+{
+    volatile float sink = 0.0f;
+    TimeKeeper start = TimeKeeper::getCurrent();
+    for (size_t i = 0; i < rays.size(); i++)
+    {
+        const Ray ray(rays[i].origin, rays[i].dir);
+        for (int f = 0; f < mesh->getFaceCount(); f++)
+            sink = mesh->getFace(f)->intersect(ray);
+    }
+    (void)sink;
+    return TimeKeeper::getCurrent() - start;
+}
+
+
+// a ray from somewhere around a face to its middle, and past it
+static void aimAt(const MeshFace* face, TestRay& ray)
+{
+    float middle[3] = { 0.0f, 0.0f, 0.0f };
+    const int count = face->getVertexCount();
+    for (int v = 0; v < count; v++)
+    {
+        for (int a = 0; a < 3; a++)
+            middle[a] += face->getVertex(v)[a] / count;
+    }
+    for (int a = 0; a < 3; a++)
+    {
+        ray.origin[a] = middle[a] + randRange(-50.0f, 50.0f);
+        ray.dir[a] = middle[a] - ray.origin[a];
+    }
+    ray.timeLeft = 2.0f;
+}
+
+
+int main(int argc, char** argv)
+{
+    const char* execName = argv[0];
+    std::string worldFile;
+    float worldSize = 800.0f;
+    int count = 100000;
+
+    printf("\nFACEBENCH-%s\nProtocol BZFS%s\n\n",
+           getAppVersion(), getProtocolVersion());
+
+    for (int arg = 1; arg < argc; arg += 2)
+    {
+        const char *opt = argv[arg];
+        if ((strcmp("-w", opt) != 0) && (strcmp("-s", opt) != 0) &&
+                (strcmp("-n", opt) != 0))
+        {
+            printHelp(execName);
+            exit(strcmp("-h", opt) == 0 ? 0 : 1);
+        }
+        if ((arg + 1) >= argc)
+        {
+            printf("* Missing the %s parameter\n\n", opt);
+            printHelp(execName);
+            exit(1);
+        }
+        if (strcmp("-w", opt) == 0)
+            worldFile = argv[arg + 1];
+        else if (strcmp("-s", opt) == 0)
+            worldSize = (float)atof(argv[arg + 1]);
+        else
+            count = atoi(argv[arg + 1]);
+    }
+    if (worldFile.empty() || (worldSize <= 0.0f) || (count < 1))
+    {
+        printHelp(execName);
+        exit(1);
+    }
+
+    if (!loadPackedWorld(worldFile, worldSize))
+        return 1;
+
+    const ObstacleList& meshes = OBSTACLEMGR.getMeshes();
+    std::vector<const MeshFace*> faces;
+    const MeshObstacle* biggest = NULL;
+    for (unsigned int m = 0; m < meshes.size(); m++)
+    {
+        const MeshObstacle* mesh = (const MeshObstacle*)meshes[m];
+        for (int f = 0; f < mesh->getFaceCount(); f++)
+            faces.push_back(mesh->getFace(f));
+        if (!biggest || (mesh->getFaceCount() > biggest->getFaceCount()))
+            biggest = mesh;
+    }
+    printf("%s: %d obstacles, %d meshes with %d faces\n", worldFile.c_str(),
+           COLLISIONMGR.getObstacleCount(), (int)meshes.size(),
+           (int)faces.size());
+    if (faces.empty())
+    {
+        printf("* The world has no mesh faces to test\n");
+        return 1;
+    }
+
+    srand(1);
+    const Extents& exts = COLLISIONMGR.getWorldExtents();
+    std::vector<TestRay> rays(count * 2);
+    for (int i = 0; i < count; i++)
+    {
+        TestRay& drop = rays[i * 2];
+        drop.origin[0] = randRange(exts.mins[0], exts.maxs[0]);
+        drop.origin[1] = randRange(exts.mins[1], exts.maxs[1]);
+        drop.origin[2] = exts.maxs[2] + 1.0f;
+        drop.dir[0] = drop.dir[1] = 0.0f;
+        drop.dir[2] = -1.0f;
+        drop.timeLeft = MAXFLOAT;
+        aimAt(faces[rand() % faces.size()], rays[(i * 2) + 1]);
+    }
+
+    // a share of the rays at the biggest mesh, which go through every face
+    std::vector<TestRay> meshTestRays(std::max(1, count / 10));
+    for (size_t i = 0; i < meshTestRays.size(); i++)
+        aimAt(biggest->getFace(rand() % biggest->getFaceCount()), meshTestRays[i]);
+    MeshFaceBatch batch;
+    for (int f = 0; f < biggest->getFaceCount(); f++)
+        batch.addFace(biggest->getFace(f), f);
+    batch.finalize();
+
+    const char* picked = MeshFaceBatch::getKernelName();
+    printf("%d octree rays; %d rays at the biggest mesh, %d faces\n",
+           (int)rays.size(), (int)meshTestRays.size(), biggest->getFaceCount());
+    printf("the kernel picked at start up is %s\n\n", picked);
+
+    printf("%-14s %14s %14s %14s %11s\n", "kernel", "octree rays/s",
+           "mesh rays/s", "faces/s", "mismatches");
+    long tested = 0;
+    double elapsed = octreeRaysScalar(rays);
+    double meshElapsed = meshRaysScalar(biggest, meshTestRays);
+    printf("%-14s %14.0f %14.0f %14.0f\n", "face by face",
+           rays.size() / elapsed, meshTestRays.size() / meshElapsed,
+           (double)meshTestRays.size() * biggest->getFaceCount() / meshElapsed);
+    for (size_t k = 0; k < bzcountof(kernels); k++)
+    {
+        if (!MeshFaceBatch::useKernel(kernels[k]))
+        {
+            printf("%-14s %14s\n", kernels[k], "not available");
+            continue;
+        }
+        const int before = errors;
+        tested = 0;
+        elapsed = octreeRays(kernels[k], rays, tested);
+        meshElapsed = meshRays(kernels[k], batch, biggest, meshTestRays);
+        printf("%-14s %14.0f %14.0f %14.0f %11d\n", kernels[k],
+               rays.size() / elapsed, meshTestRays.size() / meshElapsed,
+               (double)meshTestRays.size() * biggest->getFaceCount() / meshElapsed,
+               errors - before);
+    }
+    printf("\n%.1f obstacles tested an octree ray\n",
+           (double)tested / rays.size());
+    MeshFaceBatch::useKernel(picked);
+
+    if (errors)
+    {
+        printf("\n* %d times differ from MeshFace::intersect()\n", errors);
+        return 1;
+    }
+    return 0;
+}
+
+
+// Local Variables: ***
+// mode: C++ ***
+// tab-width: 4 ***
+// c-basic-offset: 4 ***
+// indent-tabs-mode: nil ***
+// End: ***
+// ex: shiftwidth=4 tabstop=4
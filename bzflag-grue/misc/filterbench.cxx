@@ -0,0 +1,585 @@
+/* bzflag
+ * Copyright (c) 1993-2021 Tim Riker
+ *
+ * This package is free software;  you can redistribute it and/or
+ * modify it under the terms of the license found in the file
+ * named COPYING that should have accompanied this file.
+ *
+ * THIS PACKAGE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+
+//  FILTERBENCH
+//
+//  Checks the aggressive WordFilter against the filter it replaced,
+//  which ran a regular expression per filter word, prefix and suffix.
+//  Both filter the lines of a chat log, chat lines with mangled filter
+//  words put in (l33t, case, repeats, spacing, "ph", prefixes and
+//  suffixes) and random lines.  They have to return the same and
+//  change the same characters of every line, and both are timed.
+//
+
+// system headers
+#include <ctype.h>
+#include <regex.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+// common headers
+#include "common.h"
+#include "TextUtils.h"
+#include "TimeKeeper.h"
+#include "WordFilter.h"
+#include "version.h"
+
+
+int debugLevel = 0;
+
+
+static void printHelp(const char* execName)
+{
+    printf("usage: %s [options]\n", execName);
+    printf("  -w <file>   : filter words (default misc/multilingualSwearList.txt)\n");
+    printf("  -c <file>   : chat log (default ../TestFiles/chats.txt)\n");
+    printf("  -m <lines>  : chat lines with mangled words (default 9000)\n");
+    printf("  -r <lines>  : random lines (default 8000)\n");
+    printf("\n");
+    printf("The default files are found from the top of the source tree.\n");
+}
+
+
+// the aggressive filter the way it was.  it borrows the expressions and
+// the punctuation table from WordFilter, which have not changed.
+class RegexFilter : public WordFilter
+{
+public:
+    RegexFilter();
+    ~RegexFilter();
+
+    void addWord(const std::string &word);
+    unsigned int wordCount() const;
+    bool filter(char *input) const;
+
+private:
+    typedef std::map<std::string, regex_t*> ExpressionMap;
+
+    regex_t *compile(const std::string &word) const;
+    void filterCharacters(char *input, int start, int length) const;
+
+    ExpressionMap filters[MAX_FILTER_SETS];
+    ExpressionMap prefixes;
+    ExpressionMap suffixes;
+};
+
+
+RegexFilter::RegexFilter()
+{
+    static const char *suffixWords[] =
+    {
+        "dom", "ity", "ment", "sion", "tion", "ness", "ance", "ence", "er",
+        "or", "ist", "ive", "ic", "al", "able", "y", "ous", "ful", "less",
+        "en", "ize", "ate", "ify", "fy", "ed", "ly", "a", "e", "i", "o", "u",
+        "z", "r", "ah", "io", "rs", "rz", "in", "n", "ster", "meister", "s",
+        "es", "ing", "let", NULL
+    };
+    static const char *prefixWords[] =
+    {
+        "bz", "beze", "u", "you", "ura", "k", NULL
+    };
+    for (int i = 0; suffixWords[i]; i++)
+        suffixes[suffixWords[i]] = compile(suffixWords[i]);
+    for (int i = 0; prefixWords[i]; i++)
+        prefixes[prefixWords[i]] = compile(prefixWords[i]);
+}
+
+
+RegexFilter::~RegexFilter()
+{
+    std::vector<ExpressionMap*> maps;
+    for (int i = 0; i < MAX_FILTER_SETS; i++)
+        maps.push_back(&filters[i]);
+    maps.push_back(&prefixes);
+    maps.push_back(&suffixes);
+    for (size_t m = 0; m < maps.size(); m++)
+    {
+        for (ExpressionMap::iterator i = maps[m]->begin(); i != maps[m]->end(); ++i)
+        {
+            regfree(i->second);
+            delete i->second;
+        }
+    }
+}
+
+
+regex_t *RegexFilter::compile(const std::string &word) const
+{
+    regex_t *compiled = new regex_t;
+    if (regcomp(compiled, expressionFromString(word).c_str(),
+                REG_EXTENDED | REG_ICASE) != 0)
+    {
+        printf("* unable to compile the expression for [%s]\n", word.c_str());
+        exit(1);
+    }
+    return compiled;
+}
+
+
+void RegexFilter::addWord(const std::string &word)
+{
+    ExpressionMap &bin = filters[(unsigned char)word[0]];
+    if (bin.find(word) == bin.end())
+        bin[word] = compile(word);
+}
+
+
+unsigned int RegexFilter::wordCount() const
+{
+    unsigned int count = 0;
+    for (int i = 0; i < MAX_FILTER_SETS; i++)
+        count += filters[i].size();
+    return count;
+}
+
+
+// marks what it filters with '*', the checks only look at which
+// characters changed
+void RegexFilter::filterCharacters(char *input, int start, int length) const
+{
+    if (((int)strlen(input) < start) || (length <= 0))
+        return;
+    for (int j = 0; j < length; j++)
+    {
+        if (TextUtils::isAlphanumeric(input[start + j]))
+            input[start + j] = '*';
+    }
+}
+
+
+bool RegexFilter::filter(char *input) const
+{
+    bool filtered = false;
+    regmatch_t match[1];
+    const int inputLength = strlen(input);
+    std::string sInput = input;
+    std::vector<int> matchPair;
+
+    // the letters a word could start with
+    std::string wordIndices;
+    char previousChar = 0;
+    for (int counter = 0; counter < inputLength; counter++)
+    {
+        const char c = tolower(sInput[counter]);
+        if (!isalpha(previousChar) && TextUtils::isVisible(c))
+        {
+            if (TextUtils::isPunctuation(c))
+            {
+                const std::string puncChars = alphabeticSetFromCharacter(c);
+                for (unsigned int cnt = 0; cnt < puncChars.size(); cnt++)
+                {
+                    if (wordIndices.find(tolower(puncChars[cnt])) == std::string::npos)
+                        wordIndices += tolower(puncChars[cnt]);
+                }
+            }
+            if (wordIndices.find(c) == std::string::npos)
+                wordIndices += c;
+        }
+        previousChar = c;
+    }
+
+    // and the letters after a prefix
+    for (ExpressionMap::const_iterator i = prefixes.begin(); i != prefixes.end(); ++i)
+    {
+        if ((regexec(i->second, sInput.c_str(), 1, match, 0) == 0) &&
+                (match[0].rm_eo < inputLength) && isalpha(sInput[match[0].rm_eo]) &&
+                !((match[0].rm_so > 0) && isalpha(sInput[match[0].rm_so - 1])))
+        {
+            const char c = tolower(sInput[match[0].rm_eo]);
+            if (wordIndices.find(c) == std::string::npos)
+                wordIndices += c;
+        }
+    }
+
+    for (unsigned int j = 0; j < wordIndices.size(); j++)
+    {
+        const ExpressionMap &bin = filters[(unsigned char)wordIndices[j]];
+        for (ExpressionMap::const_iterator i = bin.begin(); i != bin.end(); ++i)
+        {
+            // a match that is not a whole word ends the search for this word
+            bool matched = true;
+            while (matched)
+            {
+                matched = false;
+                if (regexec(i->second, sInput.c_str(), 1, match, 0) != 0)
+                    continue;
+                int startOffset = match[0].rm_so;
+                int endOffset = match[0].rm_eo;
+
+                if ((startOffset > 1) && isalpha(sInput[startOffset - 1]))
+                {
+                    bool foundit = false;
+                    for (ExpressionMap::const_iterator k = prefixes.begin();
+                            k != prefixes.end(); ++k)
+                    {
+                        if (regexec(k->second, sInput.c_str(), 1, match, 0) != 0)
+                            continue;
+                        if ((match[0].rm_so > 1) && isalpha(sInput[match[0].rm_so - 1]))
+                            continue;
+                        if (match[0].rm_eo == startOffset)
+                        {
+                            startOffset = match[0].rm_so;
+                            foundit = true;
+                            break;
+                        }
+                    }
+                    if (!foundit)
+                        continue;
+                }
+
+                if ((endOffset < inputLength - 1) && isalpha(sInput[endOffset]))
+                {
+                    bool foundit = false;
+                    for (ExpressionMap::const_iterator k = suffixes.begin();
+                            k != suffixes.end(); ++k)
+                    {
+                        if (regexec(k->second, sInput.c_str() + endOffset, 1, match, 0) != 0)
+                            continue;
+                        if ((match[0].rm_eo < inputLength - endOffset) &&
+                                isalpha(sInput[endOffset + match[0].rm_eo]))
+                            continue;
+                        if (match[0].rm_so == 0)
+                        {
+                            endOffset += match[0].rm_eo;
+                            foundit = true;
+                            break;
+                        }
+                    }
+                    if (!foundit)
+                        continue;
+                }
+
+                const int matchLength = endOffset - startOffset;
+                if (matchLength > 3)
+                {
+                    bool foundAlpha = false;
+                    for (size_t p = 0; (p < sInput.size()) && !foundAlpha; p++)
+                        foundAlpha = isalpha(sInput[p]);
+                    if (!foundAlpha)
+                        continue;
+                }
+
+                matchPair.push_back(startOffset);
+                matchPair.push_back(matchLength);
+                filtered = true;
+                matched = true;
+                sInput.replace(startOffset, matchLength, std::string(matchLength, 'W'));
+            }
+        }
+    }
+
+    for (size_t l = 0; l < matchPair.size(); l += 2)
+        filterCharacters(input, matchPair[l], matchPair[l + 1]);
+    return filtered;
+}
+
+
+static bool readLines(const char *fileName, std::vector<std::string> &lines)
+{
+    std::ifstream in(fileName);
+    if (!in)
+    {
+        printf("* Can not read %s\n", fileName);
+        return false;
+    }
+    std::string line;
+    while (std::getline(in, line))
+    {
+        if (!line.empty() && (line[line.size() - 1] == '\r'))
+            line.resize(line.size() - 1);
+        if (!line.empty())
+            lines.push_back(line);
+    }
+    return true;
+}
+
+
+// the words of a filter file, trimmed as WordFilter::loadFromFile() does
+static void filterWords(const std::vector<std::string> &lines,
+                        std::vector<std::string> &words)
+{
+    for (size_t i = 0; i < lines.size(); i++)
+    {
+        std::string word = lines[i].substr(0, lines[i].find('#'));
+        const size_t first = word.find_first_not_of("\r\n\t ");
+        if (first == std::string::npos)
+            continue;
+        word = word.substr(first, word.find_last_not_of("\r\n\t ") + 1 - first);
+        std::transform(word.begin(), word.end(), word.begin(), tolower);
+        words.push_back(word);
+    }
+}
+
+
+static int randomInt(int n)
+{
+    return rand() % n;
+}
+
+
+static bool chance(float p)
+{
+    return ((float)rand() / RAND_MAX) < p;
+}
+
+
+// a filter word spelled the ways people get around filters
+static std::string mangle(const std::string &word)
+{
+    static const char *leet[][2] =
+    {
+        { "a", "4@" }, { "b", "8" }, { "c", "(" }, { "e", "3" }, { "f", "p" },
+        { "g", "96" }, { "i", "l1|!/" }, { "l", "i1!|/" }, { "o", "0" },
+        { "s", "$z5" }, { "t", "+7" }, { "v", "/" }, { "w", "/" }, { "z", "s" }
+    };
+    static const char *gaps[] = { " ", ".", "-", "_", "*" };
+    static const char *hs[] = { "h", "H", " h", ".h " };
+    static const char *prefixes[] = { "bz", "u", "k", "ur", "x", "the", "mega" };
+    static const char *suffixes[] =
+    {
+        "s", "es", "ed", "ing", "er", "ers", "y", "z", "in", "ish", "x", "q"
+    };
+
+    std::string out;
+    for (size_t i = 0; i < word.size(); i++)
+    {
+        const char letter = word[i];
+        std::string c(1, letter);
+        const float r = (float)rand() / RAND_MAX;
+        if (r < 0.3f)
+        {
+            const char *replacements = NULL;
+            for (size_t l = 0; l < bzcountof(leet); l++)
+            {
+                if (leet[l][0][0] == tolower(letter))
+                    replacements = leet[l][1];
+            }
+            if ((r < 0.15f) && replacements)
+                c = replacements[randomInt(strlen(replacements))];
+            else
+                c = (char)toupper(letter);
+        }
+        if (chance(0.1f))
+            c = (randomInt(2) ? c + c : c + c + c);
+        out += c;
+        if (chance(0.08f))
+            out += gaps[randomInt(bzcountof(gaps))];
+        else if ((tolower(letter) == 'f') && chance(0.02f))
+            out += hs[randomInt(bzcountof(hs))];
+    }
+    if (chance(0.2f))
+        out = prefixes[randomInt(bzcountof(prefixes))] + out;
+    if (chance(0.3f))
+        out += suffixes[randomInt(bzcountof(suffixes))];
+    return out;
+}
+
+
+// a chat line with a few mangled filter words put in between its words
+static std::string mangledLine(const std::vector<std::string> &chats,
+                               const std::vector<std::string> &words)
+{
+    std::string text = chats[randomInt(chats.size())];
+    const size_t colon = text.find(": ");
+    if (colon != std::string::npos)
+        text = text.substr(colon + 2);
+    std::vector<std::string> parts = TextUtils::tokenize(text, " ");
+    const int count = 1 + randomInt(3);
+    for (int k = 0; k < count; k++)
+        parts.insert(parts.begin() + randomInt(parts.size() + 1),
+                     mangle(words[randomInt(words.size())]));
+    if (chance(0.2f))
+        parts.insert(parts.begin(), parts[randomInt(parts.size())] +
+                     parts[randomInt(parts.size())]);
+
+    std::string line;
+    for (size_t i = 0; i < parts.size(); i++)
+        line += (i ? " " : "") + parts[i];
+    return line.substr(0, 127);
+}
+
+
+static std::string randomLine()
+{
+    static const char *symbols =
+        "abcdefghijklmnopqrstuvwxyzABEHSW0134579$@!|/\\()+*._- #";
+    std::string line(5 + randomInt(56), ' ');
+    for (size_t i = 0; i < line.size(); i++)
+        line[i] = symbols[randomInt(strlen(symbols))];
+    return line;
+}
+
+
+// the characters a filter changed, as a string of '.' and 'X'
+static std::string changes(const std::string &before, const char *after)
+{
+    std::string mask(before.size(), '.');
+    for (size_t i = 0; i < before.size(); i++)
+    {
+        if (before[i] != after[i])
+            mask[i] = 'X';
+    }
+    return mask;
+}
+
+
+// filters every line with both filters, returns how many differ
+static int compare(const char *what, const std::vector<std::string> &lines,
+                   const WordFilter &filter, const RegexFilter &regexFilter)
+{
+    int filtered = 0;
+    int differ = 0;
+    double filterTime = 0.0;
+    double regexTime = 0.0;
+    for (size_t i = 0; i < lines.size(); i++)
+    {
+        std::vector<char> a(lines[i].c_str(), lines[i].c_str() + lines[i].size() + 1);
+        std::vector<char> b(a);
+
+        TimeKeeper start = TimeKeeper::getCurrent();
+        const bool found = filter.filter(&a[0]);
+        filterTime += TimeKeeper::getCurrent() - start;
+
+        start = TimeKeeper::getCurrent();
+        const bool regexFound = regexFilter.filter(&b[0]);
+        regexTime += TimeKeeper::getCurrent() - start;
+
+        if (regexFound)
+            filtered++;
+        const std::string mask = changes(lines[i], &a[0]);
+        const std::string regexMask = changes(lines[i], &b[0]);
+        if ((found != regexFound) || (mask != regexMask))
+        {
+            if (differ++ < 10)
+                printf("* differs: [%s]\n  matcher %d %s\n  regex   %d %s\n",
+                       lines[i].c_str(), found, mask.c_str(), regexFound,
+                       regexMask.c_str());
+        }
+    }
+
+    const double n = lines.empty() ? 1.0 : (double)lines.size();
+    printf("%-8s %7d %9d %7d %12.1f %12.1f %7.1fx\n", what, (int)lines.size(),
+           filtered, differ, regexTime * 1e6 / n, filterTime * 1e6 / n,
+           (filterTime > 0.0) ? regexTime / filterTime : 0.0);
+    return differ;
+}
+
+
+int main(int argc, char** argv)
+{
+    const char* execName = argv[0];
+    std::string wordFile = "misc/multilingualSwearList.txt";
+    std::string chatFile = "../TestFiles/chats.txt";
+    int mangledLines = 9000;
+    int randomLines = 8000;
+
+    printf("\nFILTERBENCH-%s\nProtocol BZFS%s\n\n",
+           getAppVersion(), getProtocolVersion());
+
+    for (int arg = 1; arg < argc; arg += 2)
+    {
+        const char *opt = argv[arg];
+        if ((strcmp("-w", opt) != 0) && (strcmp("-c", opt) != 0) &&
+                (strcmp("-m", opt) != 0) && (strcmp("-r", opt) != 0))
+        {
+            printHelp(execName);
+            exit(strcmp("-h", opt) == 0 ? 0 : 1);
+        }
+        if ((arg + 1) >= argc)
+        {
+            printf("* Missing the %s parameter\n\n", opt);
+            printHelp(execName);
+            exit(1);
+        }
+        if (strcmp("-w", opt) == 0)
+            wordFile = argv[arg + 1];
+        else if (strcmp("-c", opt) == 0)
+            chatFile = argv[arg + 1];
+        else if (strcmp("-m", opt) == 0)
+            mangledLines = atoi(argv[arg + 1]);
+        else
+            randomLines = atoi(argv[arg + 1]);
+    }
+    if ((mangledLines < 0) || (randomLines < 0))
+    {
+        printHelp(execName);
+        exit(1);
+    }
+
+    std::vector<std::string> chats;
+    std::vector<std::string> wordLines;
+    if (!readLines(chatFile.c_str(), chats) || !readLines(wordFile.c_str(), wordLines))
+        exit(1);
+    std::vector<std::string> words;
+    filterWords(wordLines, words);
+    if (chats.empty() || words.empty())
+    {
+        printf("* Nothing to filter with\n");
+        exit(1);
+    }
+
+    TimeKeeper start = TimeKeeper::getCurrent();
+    WordFilter filter;
+    filter.loadFromFile(wordFile);
+    const double loadTime = TimeKeeper::getCurrent() - start;
+
+    start = TimeKeeper::getCurrent();
+    RegexFilter regexFilter;
+    for (size_t i = 0; i < words.size(); i++)
+        regexFilter.addWord(words[i]);
+    const double regexLoadTime = TimeKeeper::getCurrent() - start;
+
+    printf("%u words, loaded in %.1fms with expressions, %.1fms without\n\n",
+           regexFilter.wordCount(), regexLoadTime * 1e3, loadTime * 1e3);
+    if (filter.wordCount() != regexFilter.wordCount())
+    {
+        printf("* WordFilter loaded %lu words\n", filter.wordCount());
+        exit(1);
+    }
+
+    srand(1);
+    std::vector<std::string> mangled;
+    for (int i = 0; i < mangledLines; i++)
+        mangled.push_back(mangledLine(chats, words));
+    std::vector<std::string> random;
+    for (int i = 0; i < randomLines; i++)
+        random.push_back(randomLine());
+
+    printf("%-8s %7s %9s %7s %12s %12s %8s\n", "lines", "count", "filtered",
+           "differ", "regex us", "matcher us", "speedup");
+    int differ = compare("chats", chats, filter, regexFilter);
+    differ += compare("mangled", mangled, filter, regexFilter);
+    differ += compare("random", random, filter, regexFilter);
+
+    if (differ)
+    {
+        printf("\n* %d lines differ\n", differ);
+        return 1;
+    }
+    return 0;
+}
+
+
+// Local Variables: ***
+// mode: C++ ***
+// tab-width: 4 ***
+// c-basic-offset: 4 ***
+// indent-tabs-mode: nil ***
+// End: ***
+// ex: shiftwidth=4 tabstop=4
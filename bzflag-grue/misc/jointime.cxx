@@ -0,0 +1,468 @@
+/* bzflag
+ * Copyright (c) 1993-2021 Tim Riker
+ *
+ * This package is free software;  you can redistribute it and/or
+ * modify it under the terms of the license found in the file
+ * named COPYING that should have accompanied this file.
+ *
+ * THIS PACKAGE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+
+//  JOINTIME
+//
+//  Times how long a client takes to join a running bzfs, from the
+//  connect until the last chunk of the world database has come in,
+//  through a loopback proxy that holds back everything it passes on
+//  for half of a given round trip time.  At each round trip time the
+//  world is downloaded twice: with one MsgGetWorld request per chunk,
+//  the way older clients ask, and with a window for the server to
+//  send ahead.  Both downloads have to be the same to the byte.
+//
+
+// system headers
+#include <errno.h>
+#include <math.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <deque>
+#include <string>
+#include <thread>
+#include <vector>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+// common headers
+#include "common.h"
+#include "network.h"
+#include "Pack.h"
+#include "Protocol.h"
+#include "TimeKeeper.h"
+#include "version.h"
+
+
+int debugLevel = 0;
+
+
+static void printHelp(const char* execName)
+{
+    printf("usage: %s [options]\n", execName);
+    printf("  -h <host>     : the bzfs to join (default 127.0.0.1)\n");
+    printf("  -p <port>     : its port (default %d)\n", ServerPort);
+    printf("  -r <ms,...>   : round trip times to add (default 0,20,50,100)\n");
+    printf("\n");
+    printf("Start bzfs with the world first, for instance:\n");
+    printf("  bzfs -world Hydrapocalypse.bzw -p 5999\n");
+}
+
+
+static bool sendAll(int fd, const char* data, size_t size)
+{
+    while (size > 0)
+    {
+        const ssize_t sent = send(fd, data, size, 0);
+        if (sent < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        data += sent;
+        size -= sent;
+    }
+    return true;
+}
+
+
+static bool recvAll(int fd, char* data, size_t size)
+{
+    while (size > 0)
+    {
+        const ssize_t got = recv(fd, data, size, 0);
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got <= 0)
+            return false;
+        data += got;
+        size -= got;
+    }
+    return true;
+}
+
+
+static int connectTo(const struct sockaddr_in& addr)
+{
+    const int fd = (int)socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+    if (connect(fd, (const struct sockaddr*)&addr, sizeof(addr)) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    const int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (const char*)&on, sizeof(on));
+    return fd;
+}
+
+
+//
+// The proxy takes one connection and passes everything on, both ways,
+// oneWay seconds after it came in.  A read that gave nothing is passed
+// on as a shutdown, when its turn comes.
+//
+
+struct Delayed
+{
+    double due;
+    std::string data;
+};
+
+static void runProxy(int listenFd, struct sockaddr_in server, double oneWay)
+{
+    int fds[2];
+    fds[0] = (int)accept(listenFd, NULL, NULL);
+    if (fds[0] < 0)
+        return;
+    fds[1] = connectTo(server);
+    if (fds[1] < 0)
+    {
+        close(fds[0]);
+        return;
+    }
+    const int on = 1;
+    setsockopt(fds[0], IPPROTO_TCP, TCP_NODELAY, (const char*)&on, sizeof(on));
+
+    // [0] is from the client to the server, [1] the other way
+    std::deque<Delayed> queues[2];
+    bool reading[2] = { true, true };
+    bool writing[2] = { true, true };
+    const TimeKeeper start = TimeKeeper::getCurrent();
+    char buffer[65536];
+    while (writing[0] || writing[1])
+    {
+        const double now = TimeKeeper::getCurrent() - start;
+        double next = -1.0;
+        for (int d = 0; d < 2; d++)
+        {
+            std::deque<Delayed>& queue = queues[d];
+            while (!queue.empty() && queue.front().due <= now)
+            {
+                const std::string& data = queue.front().data;
+                if (data.empty())
+                {
+                    shutdown(fds[1 - d], SHUT_WR);
+                    writing[d] = false;
+                }
+                else if (!sendAll(fds[1 - d], data.data(), data.size()))
+                    reading[d] = writing[d] = false;
+                queue.pop_front();
+            }
+            if (!queue.empty() && ((next < 0.0) || (queue.front().due < next)))
+                next = queue.front().due;
+        }
+
+        struct pollfd pfds[2];
+        int count = 0;
+        int which[2];
+        for (int d = 0; d < 2; d++)
+        {
+            if (!reading[d])
+                continue;
+            pfds[count].fd = fds[d];
+            pfds[count].events = POLLIN;
+            pfds[count].revents = 0;
+            which[count++] = d;
+        }
+        if ((count == 0) && (next < 0.0))
+            break;
+        const int timeout = (next < 0.0) ? 1000
+                            : (int)ceil((next - now) * 1000.0);
+        if (poll(pfds, count, timeout) <= 0)
+            continue;
+
+        for (int p = 0; p < count; p++)
+        {
+            if (pfds[p].revents == 0)
+                continue;
+            const int d = which[p];
+            const ssize_t got = recv(fds[d], buffer, sizeof(buffer), 0);
+            if ((got < 0) && (errno == EINTR))
+                continue;
+            Delayed delayed;
+            delayed.due = (TimeKeeper::getCurrent() - start) + oneWay;
+            if (got > 0)
+                delayed.data.assign(buffer, got);
+            else
+                reading[d] = false;
+            queues[d].push_back(delayed);
+        }
+    }
+    close(fds[0]);
+    close(fds[1]);
+}
+
+
+static bool sendMessage(int fd, uint16_t code, const void* data, uint16_t len)
+{
+    char message[MaxPacketLen];
+    void* buf = nboPackUShort(message, len);
+    buf = nboPackUShort(buf, code);
+    memcpy(buf, data, len);
+    return sendAll(fd, message, 4 + len);
+}
+
+
+static bool readMessage(int fd, uint16_t& code, std::vector<char>& body)
+{
+    char header[4];
+    if (!recvAll(fd, header, sizeof(header)))
+        return false;
+    uint16_t len;
+    const void* buf = nboUnpackUShort(header, len);
+    nboUnpackUShort(buf, code);
+    body.resize(len);
+    return (len == 0) || recvAll(fd, &body[0], len);
+}
+
+
+// joins as a client would up to the end of the world download, and
+// gives how long it took or a negative time when something went wrong
+static double join(const struct sockaddr_in& addr, bool windowed,
+                   std::string& world, uint32_t& window)
+{
+    world.clear();
+    window = 0;
+    const TimeKeeper start = TimeKeeper::getCurrent();
+    const int fd = connectTo(addr);
+    if (fd < 0)
+        return -1.0;
+    struct timeval timeout = { 300, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout,
+               sizeof(timeout));
+
+    // the server's version and our player id
+    char hello[9];
+    if (!sendAll(fd, BZ_CONNECT_HEADER, strlen(BZ_CONNECT_HEADER)) ||
+            !recvAll(fd, hello, sizeof(hello)) ||
+            (strncmp(hello, "BZFS", 4) != 0))
+    {
+        close(fd);
+        return -1.0;
+    }
+
+    // the digest, and from newer servers how far they will send ahead
+    uint16_t code;
+    std::vector<char> body;
+    if (!sendMessage(fd, MsgWantWHash, NULL, 0))
+    {
+        close(fd);
+        return -1.0;
+    }
+    do
+    {
+        if (!readMessage(fd, code, body))
+        {
+            close(fd);
+            return -1.0;
+        }
+    }
+    while (code != MsgWantWHash);
+    const char* end = (const char*)memchr(body.data(), 0, body.size());
+    if (windowed && end && (end + 1 + sizeof(uint32_t) <= body.data() + body.size()))
+        nboUnpackUInt(end + 1, window);
+
+    uint32_t ptr = 0;
+    uint32_t acked = 0;
+    char request[8];
+    void* buf = nboPackUInt(request, ptr);
+    if (window > 0)
+        buf = nboPackUInt(buf, window);
+    bool good = sendMessage(fd, MsgGetWorld, request, (char*)buf - request);
+    while (good)
+    {
+        good = readMessage(fd, code, body);
+        if (!good || (code != MsgGetWorld))
+            continue;
+        if (body.size() < sizeof(uint32_t))
+        {
+            good = false;
+            break;
+        }
+        uint32_t left;
+        nboUnpackUInt(body.data(), left);
+        world.append(body.data() + 4, body.size() - 4);
+        ptr += (uint32_t)body.size() - 4;
+        if (left == 0)
+            break;
+        if ((window > 0) && ((ptr - acked) < (window / 2)))
+            continue;
+        buf = nboPackUInt(request, ptr);
+        if (window > 0)
+            buf = nboPackUInt(buf, window);
+        good = sendMessage(fd, MsgGetWorld, request, (char*)buf - request);
+        acked = ptr;
+    }
+    const double elapsed = TimeKeeper::getCurrent() - start;
+    close(fd);
+    return good ? elapsed : -1.0;
+}
+
+
+// a join through a proxy that adds rtt seconds to every round trip
+static double joinThrough(const struct sockaddr_in& server, double rtt,
+                          bool windowed, std::string& world, uint32_t& window)
+{
+    const int listenFd = (int)socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    socklen_t addrLen = sizeof(addr);
+    if ((listenFd < 0) ||
+            (bind(listenFd, (struct sockaddr*)&addr, sizeof(addr)) < 0) ||
+            (listen(listenFd, 1) < 0) ||
+            (getsockname(listenFd, (struct sockaddr*)&addr, &addrLen) < 0))
+    {
+        printf("* Could not start the proxy: %s\n", strerror(errno));
+        exit(1);
+    }
+
+    std::thread proxy(runProxy, listenFd, server, rtt / 2.0);
+    const double elapsed = join(addr, windowed, world, window);
+    if (elapsed < 0.0)
+    {
+        // let the proxy's accept() return if the connect never came
+        const int fd = connectTo(addr);
+        if (fd >= 0)
+            close(fd);
+    }
+    proxy.join();
+    close(listenFd);
+    return elapsed;
+}
+
+
+int main(int argc, char** argv)
+{
+    const char* execName = argv[0];
+    std::string host = "127.0.0.1";
+    int port = ServerPort;
+    std::string rttList = "0,20,50,100";
+
+    // the proxy may still pass chunks on to a client that has hung up
+    signal(SIGPIPE, SIG_IGN);
+
+    printf("\nJOINTIME-%s\nProtocol BZFS%s\n\n",
+           getAppVersion(), getProtocolVersion());
+
+    for (int arg = 1; arg < argc; arg += 2)
+    {
+        const char *opt = argv[arg];
+        if ((strcmp("-h", opt) != 0) && (strcmp("-p", opt) != 0) &&
+                (strcmp("-r", opt) != 0))
+        {
+            printHelp(execName);
+            exit(strcmp("-help", opt) == 0 ? 0 : 1);
+        }
+        if ((arg + 1) >= argc)
+        {
+            printf("* Missing the %s parameter\n\n", opt);
+            printHelp(execName);
+            exit(1);
+        }
+        if (strcmp("-h", opt) == 0)
+            host = argv[arg + 1];
+        else if (strcmp("-p", opt) == 0)
+            port = atoi(argv[arg + 1]);
+        else
+            rttList = argv[arg + 1];
+    }
+
+    std::vector<double> rtts;
+    for (const char* p = rttList.c_str(); *p; )
+    {
+        char* next;
+        const double rtt = strtod(p, &next);
+        if ((next == p) || (rtt < 0.0))
+        {
+            printHelp(execName);
+            exit(1);
+        }
+        rtts.push_back(rtt / 1000.0);
+        p = (*next == ',') ? next + 1 : next;
+    }
+    if (rtts.empty() || (port <= 0) || (port > 65535))
+    {
+        printHelp(execName);
+        exit(1);
+    }
+
+    struct sockaddr_in server;
+    memset(&server, 0, sizeof(server));
+    server.sin_family = AF_INET;
+    server.sin_port = htons((unsigned short)port);
+    if (inet_pton(AF_INET, host.c_str(), &server.sin_addr) != 1)
+    {
+        printf("* %s is not an IPv4 address\n", host.c_str());
+        exit(1);
+    }
+
+    std::string reference;
+    uint32_t window;
+    if (join(server, true, reference, window) < 0.0)
+    {
+        printf("* Could not download the world from %s:%d\n", host.c_str(),
+               port);
+        return 1;
+    }
+    printf("%s:%d, %u bytes of world", host.c_str(), port,
+           (unsigned int)reference.size());
+    if (window > 0)
+        printf(", sent up to %u bytes ahead\n\n", window);
+    else
+        printf(", the server doesn't send ahead\n\n");
+
+    printf("%8s %14s %14s %10s %11s\n", "rtt ms", "per chunk s", "windowed s",
+           "speedup", "mismatches");
+    int errors = 0;
+    for (size_t r = 0; r < rtts.size(); r++)
+    {
+        double times[2];
+        int mismatches = 0;
+        for (int windowed = 0; windowed < 2; windowed++)
+        {
+            std::string world;
+            times[windowed] = joinThrough(server, rtts[r], windowed != 0,
+                                          world, window);
+            if ((times[windowed] < 0.0) || (world != reference))
+                mismatches++;
+        }
+        errors += mismatches;
+        printf("%8.0f %14.3f %14.3f %9.1fx %11d\n", rtts[r] * 1000.0,
+               times[0], times[1], times[0] / times[1], mismatches);
+    }
+    printf("\nfrom the connect until the last chunk has come in\n");
+
+    if (errors)
+    {
+        printf("\n* %d downloads failed or differ from the first one\n", errors);
+        return 1;
+    }
+    return 0;
+}
+
+
+// Local Variables: ***
+// mode: C++ ***
+// tab-width: 4 ***
+// c-basic-offset: 4 ***
+// indent-tabs-mode: nil ***
+// End: ***
+// ex: shiftwidth=4 tabstop=4
@@ -0,0 +1,231 @@
+/* bzflag
+ * Copyright (c) 1993-2021 Tim Riker
+ *
+ * This package is free software;  you can redistribute it and/or
+ * modify it under the terms of the license found in the file
+ * named COPYING that should have accompanied this file.
+ *
+ * THIS PACKAGE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+
+//  MESHBENCH
+//
+//  Times MeshObstacle::containsPoint() on spheres of growing face
+//  counts, against the scan over every face it did before the faces
+//  got a bounding volume hierarchy.  Both have to agree on every point.
+//
+
+// system headers
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+// common headers
+#include "common.h"
+#include "BzMaterial.h"
+#include "MeshFace.h"
+#include "MeshObstacle.h"
+#include "MeshTransform.h"
+#include "Ray.h"
+#include "TimeKeeper.h"
+#include "vectors_old.h"
+#include "version.h"
+
+
+int debugLevel = 0;
+
+static const float radius = 50.0f;
+
+
+static void printHelp(const char* execName)
+{
+    printf("usage: %s [options]\n", execName);
+    printf("  -n <points>  : random points per sphere (default 20000)\n");
+    printf("  -m <faces>   : largest sphere, in faces (default 16384)\n");
+    printf("\n");
+    printf("The spheres start at 64 faces and grow four times each step.\n");
+    printf("Points fill the sphere's bounding box, about half are inside.\n");
+}
+
+
+// a sphere of rings x segments quads, facing out, centered on the origin
+static MeshObstacle* makeSphere(int rings, int segments)
+{
+    std::vector<cfvec3> vertices;
+    for (int r = 0; r <= rings; r++)
+    {
+        const float theta = (float)(M_PI * r / rings);
+        for (int s = 0; s < segments; s++)
+        {
+            const float phi = (float)(2.0 * M_PI * s / segments);
+            const float v[3] = { radius * sinf(theta) * cosf(phi),
+                                 radius * sinf(theta) * sinf(phi),
+                                 radius * cosf(theta)
+                               };
+            vertices.push_back(cfvec3(v));
+        }
+    }
+
+    std::vector<char> checkTypes(1, MeshObstacle::CheckInside);
+    std::vector<cfvec3> checkPoints(1, cfvec3());
+    const std::vector<cfvec3> normals;
+    const std::vector<cfvec2> texcoords;
+    const MeshTransform xform;
+    MeshObstacle* mesh = new MeshObstacle(xform, checkTypes, checkPoints,
+                                          vertices, normals, texcoords,
+                                          rings * segments, false, false,
+                                          false, false, false);
+
+    const std::vector<int> none;
+    for (int r = 0; r < rings; r++)
+    {
+        for (int s = 0; s < segments; s++)
+        {
+            const int next = (s + 1) % segments;
+            std::vector<int> face;
+            face.push_back((r * segments) + s);
+            face.push_back(((r + 1) * segments) + s);
+            face.push_back(((r + 1) * segments) + next);
+            face.push_back((r * segments) + next);
+            // the poles' quads have two corners in one place
+            if (r == 0)
+                face.erase(face.begin() + 3);
+            else if (r == (rings - 1))
+                face.erase(face.begin() + 1);
+            mesh->addFace(face, none, none, BzMaterial::getDefault(), -1,
+                          false, false, false, false, false, false);
+        }
+    }
+    mesh->finalize();
+    return mesh;
+}
+
+
+// containsPoint() the way it was, every segment against every face
+static bool scanContainsPoint(const MeshObstacle* mesh, const float point[3])
+{
+    const char* checkTypes = mesh->getCheckTypes();
+    const afvec3* checkPoints = mesh->getCheckPoints();
+    bool hasOutsides = false;
+    for (int c = 0; c < mesh->getCheckCount(); c++)
+    {
+        const bool inside = (checkTypes[c] == MeshObstacle::CheckInside);
+        float origin[3];
+        float dir[3];
+        if (inside)
+        {
+            memcpy(origin, point, sizeof(origin));
+            vec3sub(dir, checkPoints[c], point);
+        }
+        else
+        {
+            hasOutsides = true;
+            memcpy(origin, checkPoints[c], sizeof(origin));
+            vec3sub(dir, point, checkPoints[c]);
+        }
+        const Ray ray(origin, dir);
+        bool hit = false;
+        for (int f = 0; (f < mesh->getFaceCount()) && !hit; f++)
+        {
+            const float hittime = mesh->getFace(f)->intersect(ray);
+            hit = (hittime > 0.0f) && (hittime <= 1.0f);
+        }
+        if (inside && !hit)
+            return true;
+        if (!inside && !hit)
+            return false;
+    }
+    return hasOutsides;
+}
+
+
+int main(int argc, char** argv)
+{
+    const char* execName = argv[0];
+    int points = 20000;
+    int maxFaces = 16384;
+
+    printf("\nMESHBENCH-%s\nProtocol BZFS%s\n\n",
+           getAppVersion(), getProtocolVersion());
+
+    for (int arg = 1; arg < argc; arg += 2)
+    {
+        const char *opt = argv[arg];
+        if ((strcmp("-n", opt) != 0) && (strcmp("-m", opt) != 0))
+        {
+            printHelp(execName);
+            exit(strcmp("-h", opt) == 0 ? 0 : 1);
+        }
+        if ((arg + 1) >= argc)
+        {
+            printf("* Missing the %s parameter\n\n", opt);
+            printHelp(execName);
+            exit(1);
+        }
+        if (strcmp("-n", opt) == 0)
+            points = atoi(argv[arg + 1]);
+        else
+            maxFaces = atoi(argv[arg + 1]);
+    }
+    if ((points < 1) || (maxFaces < 64))
+    {
+        printHelp(execName);
+        exit(1);
+    }
+
+    srand(1);
+    std::vector<float> coords(points * 3);
+    for (size_t i = 0; i < coords.size(); i++)
+        coords[i] = radius * 1.1f * (2.0f * ((float)rand() / RAND_MAX) - 1.0f);
+
+    printf("%8s %10s %14s %14s %8s\n", "faces", "inside", "scan /s",
+           "hierarchy /s", "speedup");
+    int errors = 0;
+    for (int size = 8; (size * size) <= maxFaces; size *= 2)
+    {
+        MeshObstacle* mesh = makeSphere(size, size);
+
+        std::vector<char> scanned(points);
+        TimeKeeper start = TimeKeeper::getCurrent();
+        for (int p = 0; p < points; p++)
+            scanned[p] = scanContainsPoint(mesh, &coords[p * 3]);
+        const double scanTime = TimeKeeper::getCurrent() - start;
+
+        int inside = 0;
+        start = TimeKeeper::getCurrent();
+        for (int p = 0; p < points; p++)
+        {
+            const bool contained = mesh->containsPoint(&coords[p * 3]);
+            if (contained)
+                inside++;
+            if (contained != (scanned[p] != 0))
+                errors++;
+        }
+        const double bvhTime = TimeKeeper::getCurrent() - start;
+
+        printf("%8d %10d %14.0f %14.0f %7.1fx\n", mesh->getFaceCount(), inside,
+               points / scanTime, points / bvhTime, scanTime / bvhTime);
+        delete mesh;
+    }
+
+    if (errors)
+    {
+        printf("\n* %d points disagree\n", errors);
+        return 1;
+    }
+    return 0;
+}
+
+
+// Local Variables: ***
+// mode: C++ ***
+// tab-width: 4 ***
+// c-basic-offset: 4 ***
+// indent-tabs-mode: nil ***
+// End: ***
+// ex: shiftwidth=4 tabstop=4
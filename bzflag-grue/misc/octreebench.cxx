@@ -0,0 +1,395 @@
+/* bzflag
+ * Copyright (c) 1993-2021 Tim Riker
+ *
+ * This package is free software;  you can redistribute it and/or
+ * modify it under the terms of the license found in the file
+ * named COPYING that should have accompanied this file.
+ *
+ * THIS PACKAGE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+
+//  OCTREEBENCH
+//
+//  Times the walks of the collision octree: cylinder, axis box and ray
+//  tests, rays with their hit times and rays down to the leaf cells,
+//  best of several runs over the same random queries.  Where the kernel
+//  lets perf_event_open() count them, the cache references and misses
+//  and the L1 data cache read misses of each query are given too.  The
+//  world comes from bzfs -world <file> -cacheout <file>.
+//
+
+// system headers
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#ifdef __linux__
+#  include <linux/perf_event.h>
+#  include <sys/ioctl.h>
+#  include <sys/syscall.h>
+#  include <unistd.h>
+#endif
+
+// common headers
+#include "common.h"
+#include "BZDBCache.h"
+#include "CollisionManager.h"
+#include "Ray.h"
+#include "TimeKeeper.h"
+#include "version.h"
+
+// local headers
+#include "PackedWorld.h"
+
+
+int debugLevel = 0;
+
+enum QueryType
+{
+    CylinderQuery,
+    BoxQuery,
+    RayQuery,
+    RayTimesQuery,
+    RayNodesQuery,
+    QueryTypes
+};
+
+static const char* queryNames[QueryTypes] =
+{
+    "cylinder", "axis box", "ray", "ray, times", "ray, nodes"
+};
+
+struct Query
+{
+    float pos[3];
+    float dir[3];
+};
+
+
+//
+// The hardware counters, where there are any.  Containers and virtual
+// machines often have none, and perf_event_paranoid may forbid them.
+//
+
+enum CounterType
+{
+    CacheReferences,
+    CacheMisses,
+    L1ReadMisses,
+    CounterTypes
+};
+
+class Counters
+{
+public:
+    Counters();
+    ~Counters();
+
+    bool isAvailable() const;
+    const std::string& getProblem() const;
+
+    void start();
+    // the counts since start()
+    void stop(uint64_t counts[CounterTypes]);
+
+private:
+    int fds[CounterTypes];
+    std::string problem;
+};
+
+
+Counters::Counters()
+{
+    for (int c = 0; c < CounterTypes; c++)
+        fds[c] = -1;
+#ifdef __linux__
+    static const uint32_t types[CounterTypes] =
+    {
+        PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE
+    };
+    static const uint64_t configs[CounterTypes] =
+    {
+        PERF_COUNT_HW_CACHE_REFERENCES,
+        PERF_COUNT_HW_CACHE_MISSES,
+        PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+        (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)
+    };
+    for (int c = 0; c < CounterTypes; c++)
+    {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = types[c];
+        attr.config = configs[c];
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fds[c] = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+        if (fds[c] < 0)
+        {
+            problem = std::string("perf_event_open: ") + strerror(errno);
+            break;
+        }
+    }
+    if (!problem.empty())
+    {
+        for (int c = 0; c < CounterTypes; c++)
+        {
+            if (fds[c] >= 0)
+                close(fds[c]);
+            fds[c] = -1;
+        }
+    }
+#else
+    problem = "no perf_event_open() on this system";
+#endif
+}
+
+
+Counters::~Counters()
+{
+#ifdef __linux__
+    for (int c = 0; c < CounterTypes; c++)
+    {
+        if (fds[c] >= 0)
+            close(fds[c]);
+    }
+#endif
+}
+
+
+bool Counters::isAvailable() const
+{
+    return problem.empty();
+}
+
+
+const std::string& Counters::getProblem() const
+{
+    return problem;
+}
+
+
+void Counters::start()
+{
+#ifdef __linux__
+    for (int c = 0; c < CounterTypes; c++)
+    {
+        if (fds[c] < 0)
+            continue;
+        ioctl(fds[c], PERF_EVENT_IOC_RESET, 0);
+        ioctl(fds[c], PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+}
+
+
+void Counters::stop(uint64_t counts[CounterTypes])
+{
+    for (int c = 0; c < CounterTypes; c++)
+    {
+        counts[c] = 0;
+#ifdef __linux__
+        if (fds[c] < 0)
+            continue;
+        ioctl(fds[c], PERF_EVENT_IOC_DISABLE, 0);
+        if (read(fds[c], &counts[c], sizeof(counts[c])) != sizeof(counts[c]))
+            counts[c] = 0;
+#endif
+    }
+}
+
+
+static void printHelp(const char* execName)
+{
+    printf("usage: %s [options]\n", execName);
+    printf("  -w <file>     : world written by bzfs -cacheout (required)\n");
+    printf("  -s <size>     : the world's _worldSize (default 800)\n");
+    printf("  -n <queries>  : queries of each kind (default 100000)\n");
+    printf("  -r <runs>     : runs, the best one counts (default 5)\n");
+}
+
+
+static float randRange(float low, float high)
+{
+    return low + ((high - low) * ((float)rand() / RAND_MAX));
+}
+
+
+// runs the queries of one kind, returns what they found
+static long runQueries(QueryType type, const std::vector<Query>& queries,
+                       CollisionQuery& context)
+{
+    const float radius = BZDBCache::tankRadius;
+    const float height = BZDBCache::tankHeight;
+    long found = 0;
+    for (size_t i = 0; i < queries.size(); i++)
+    {
+        const Query& q = queries[i];
+        switch (type)
+        {
+        case CylinderQuery:
+            found += COLLISIONMGR.cylinderTest(q.pos, radius, height,
+                                               context)->count;
+            break;
+        case BoxQuery:
+        {
+            const float mins[3] = { q.pos[0] - radius, q.pos[1] - radius, q.pos[2] };
+            const float maxs[3] = { q.pos[0] + radius, q.pos[1] + radius,
+                                    q.pos[2] + height
+                                  };
+            const Extents exts(mins, maxs);
+            found += COLLISIONMGR.axisBoxTest(exts, context)->count;
+            break;
+        }
+        case RayQuery:
+        {
+            const Ray ray(q.pos, q.dir);
+            found += COLLISIONMGR.rayTest(&ray, 1.0f, context)->count;
+            break;
+        }
+        case RayTimesQuery:
+        {
+            const Ray ray(q.pos, q.dir);
+            const float* times;
+            found += COLLISIONMGR.rayTestTimes(&ray, 1.0f, times, context)->count;
+            break;
+        }
+        default:
+        {
+            const Ray ray(q.pos, q.dir);
+            found += COLLISIONMGR.rayTestNodes(&ray, 1.0f, context)->count;
+            break;
+        }
+        }
+    }
+    return found;
+}
+
+
+int main(int argc, char** argv)
+{
+    const char* execName = argv[0];
+    std::string worldFile;
+    float worldSize = 800.0f;
+    int count = 100000;
+    int runs = 5;
+
+    printf("\nOCTREEBENCH-%s\nProtocol BZFS%s\n\n",
+           getAppVersion(), getProtocolVersion());
+
+    for (int arg = 1; arg < argc; arg += 2)
+    {
+        const char *opt = argv[arg];
+        if ((strcmp("-w", opt) != 0) && (strcmp("-s", opt) != 0) &&
+                (strcmp("-n", opt) != 0) && (strcmp("-r", opt) != 0))
+        {
+            printHelp(execName);
+            exit(strcmp("-h", opt) == 0 ? 0 : 1);
+        }
+        if ((arg + 1) >= argc)
+        {
+            printf("* Missing the %s parameter\n\n", opt);
+            printHelp(execName);
+            exit(1);
+        }
+        if (strcmp("-w", opt) == 0)
+            worldFile = argv[arg + 1];
+        else if (strcmp("-s", opt) == 0)
+            worldSize = (float)atof(argv[arg + 1]);
+        else if (strcmp("-n", opt) == 0)
+            count = atoi(argv[arg + 1]);
+        else
+            runs = atoi(argv[arg + 1]);
+    }
+    if (worldFile.empty() || (worldSize <= 0.0f) || (count < 1) || (runs < 1))
+    {
+        printHelp(execName);
+        exit(1);
+    }
+
+    if (!loadPackedWorld(worldFile, worldSize))
+        return 1;
+    printf("%s: %d obstacles\n", worldFile.c_str(),
+           COLLISIONMGR.getObstacleCount());
+
+    // tanks and shots near the ground, where the obstacles are
+    const Extents& exts = COLLISIONMGR.getWorldExtents();
+    srand(1);
+    std::vector<Query> queries(count);
+    for (int i = 0; i < count; i++)
+    {
+        Query& q = queries[i];
+        q.pos[0] = randRange(exts.mins[0], exts.maxs[0]);
+        q.pos[1] = randRange(exts.mins[1], exts.maxs[1]);
+        q.pos[2] = randRange(exts.mins[2], exts.mins[2] + 20.0f);
+        // a shot's travel in a second, about
+        q.dir[0] = randRange(-100.0f, 100.0f);
+        q.dir[1] = randRange(-100.0f, 100.0f);
+        q.dir[2] = randRange(-5.0f, 5.0f);
+    }
+
+    Counters counters;
+    if (counters.isAvailable())
+        printf("%d queries of each kind, best of %d runs\n\n", count, runs);
+    else
+    {
+        printf("%d queries of each kind, best of %d runs, no cache counters\n",
+               count, runs);
+        printf("(%s)\n\n", counters.getProblem().c_str());
+    }
+
+    printf("%-12s %12s %8s", "query", "queries/s", "found");
+    if (counters.isAvailable())
+        printf(" %10s %10s %10s", "cache refs", "misses", "L1D misses");
+    printf("\n");
+
+    CollisionQuery context;
+    for (int t = 0; t < QueryTypes; t++)
+    {
+        const QueryType type = (QueryType)t;
+        double best = 0.0;
+        long found = 0;
+        uint64_t bestCounts[CounterTypes] = { 0, 0, 0 };
+        for (int r = 0; r < runs; r++)
+        {
+            uint64_t counts[CounterTypes];
+            counters.start();
+            const TimeKeeper start = TimeKeeper::getCurrent();
+            found = runQueries(type, queries, context);
+            const double elapsed = TimeKeeper::getCurrent() - start;
+            counters.stop(counts);
+            if ((r == 0) || (elapsed < best))
+            {
+                best = elapsed;
+                memcpy(bestCounts, counts, sizeof(bestCounts));
+            }
+        }
+        printf("%-12s %12.0f %8.1f", queryNames[t], count / best,
+               (double)found / count);
+        if (counters.isAvailable())
+        {
+            for (int c = 0; c < CounterTypes; c++)
+                printf(" %10.2f", (double)bestCounts[c] / count);
+        }
+        printf("\n");
+    }
+    if (counters.isAvailable())
+        printf("\nthe counts are per query\n");
+
+    return 0;
+}
+
+
+// Local Variables: ***
+// mode: C++ ***
+// tab-width: 4 ***
+// c-basic-offset: 4 ***
+// indent-tabs-mode: nil ***
+// End: ***
+// ex: shiftwidth=4 tabstop=4
@@ -0,0 +1,431 @@
+/* bzflag
+ * Copyright (c) 1993-2021 Tim Riker
+ *
+ * This package is free software;  you can redistribute it and/or
+ * modify it under the terms of the license found in the file
+ * named COPYING that should have accompanied this file.
+ *
+ * THIS PACKAGE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+
+//  POLLBENCH
+//
+//  A loopback benchmark of the bzfs main loop wait.  It connects
+//  clients to NetHandler over TCP and links their UDP the way real
+//  clients do.  A thread then sends player updates over both at a
+//  fixed rate while the main thread waits for them and reads them
+//  the way the bzfs main loop does.  It reports loop wakeups per
+//  second and the CPU time of the waiting thread per packet, with
+//  each NetPoller backend and with the loop bzfs had before the
+//  poller, which built an fd_set of every player for select() and
+//  scanned every player slot afterwards.
+//
+
+// system headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+// common headers
+#include "common.h"
+#include "network.h"
+#include "NetPoller.h"
+#include "Pack.h"
+#include "Protocol.h"
+#include "TimeKeeper.h"
+#include "version.h"
+
+// game headers
+#include "NetHandler.h"
+#include "PlayerInfo.h"
+
+
+int debugLevel = 0;
+
+// one simulated client
+struct Client
+{
+    int         udp;
+    int         tcp;
+    int         serverFD;
+    PlayerInfo      *info;
+    NetHandler      *handler;
+};
+
+static std::vector<Client> clients;
+
+// what the sender has done, for the waiting side
+static std::atomic<bool> sending;
+static std::atomic<long> tcpSent;
+static std::atomic<long> udpSent;
+
+
+static void printHelp(const char* execName)
+{
+    printf("usage: %s [options]\n", execName);
+    printf("  -c <clients>  : simulated clients (default 100)\n");
+    printf("  -r <packets>  : packets per second, over all clients (default 20000)\n");
+    printf("  -s <seconds>  : how long each loop is driven (default 3)\n");
+    printf("\n");
+    printf("Half of the packets go over TCP, half over UDP.\n");
+}
+
+
+static void packUpdate(char *buffer, uint16_t code, const void *data, uint16_t len)
+{
+    void *buf = buffer;
+    buf = nboPackUShort(buf, len);
+    buf = nboPackUShort(buf, code);
+    if (len > 0)
+        memcpy(buf, data, len);
+}
+
+
+static void sendUdp(const Client &c, uint16_t code, const void *data, uint16_t len)
+{
+    char buffer[MaxPacketLen];
+    packUpdate(buffer, code, data, len);
+    send(c.udp, buffer, len + 4, 0);
+}
+
+
+static bool setup(int count)
+{
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    if (!NetHandler::initHandlers(addr))
+        return false;
+    AddrLen addrLen = sizeof(addr);
+    getsockname(NetHandler::getUdpSocket(), (struct sockaddr *)&addr, &addrLen);
+
+    struct sockaddr_in listenAddr;
+    memset(&listenAddr, 0, sizeof(listenAddr));
+    listenAddr.sin_family = AF_INET;
+    listenAddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    const int listenFD = (int)socket(AF_INET, SOCK_STREAM, 0);
+    addrLen = sizeof(listenAddr);
+    if ((listenFD < 0) ||
+            (bind(listenFD, (struct sockaddr *)&listenAddr, sizeof(listenAddr)) != 0) ||
+            (listen(listenFD, 5) != 0) ||
+            (getsockname(listenFD, (struct sockaddr *)&listenAddr, &addrLen) != 0))
+    {
+        perror("listen socket");
+        return false;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        Client c;
+        c.tcp = (int)socket(AF_INET, SOCK_STREAM, 0);
+        if ((c.tcp < 0) ||
+                (connect(c.tcp, (struct sockaddr *)&listenAddr, sizeof(listenAddr)) != 0))
+        {
+            perror("client connection");
+            return false;
+        }
+        // clients send their updates right away
+        int on = 1;
+        setsockopt(c.tcp, IPPROTO_TCP, TCP_NODELAY, (SSOType)&on, sizeof(on));
+
+        struct sockaddr_in peerAddr;
+        addrLen = sizeof(peerAddr);
+        c.serverFD = (int)accept(listenFD, (struct sockaddr *)&peerAddr, &addrLen);
+        if (c.serverFD < 0)
+        {
+            perror("accept");
+            return false;
+        }
+        BzfNetwork::setNonBlocking(c.serverFD);
+
+        c.udp = (int)socket(AF_INET, SOCK_DGRAM, 0);
+        struct sockaddr_in local;
+        memset(&local, 0, sizeof(local));
+        local.sin_family = AF_INET;
+        local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if ((c.udp < 0) ||
+                (bind(c.udp, (struct sockaddr *)&local, sizeof(local)) != 0) ||
+                (connect(c.udp, (struct sockaddr *)&addr, sizeof(addr)) != 0))
+        {
+            perror("client socket");
+            return false;
+        }
+
+        c.info = new PlayerInfo(i);
+        c.handler = new NetHandler(c.info, peerAddr, i, c.serverFD);
+        clients.push_back(c);
+    }
+    close(listenFD);
+
+    // link udp both ways, as a client does
+    int linked = 0;
+    for (int i = 0; i < count; i++)
+    {
+        const uint8_t index = (uint8_t)i;
+        sendUdp(clients[i], MsgUDPLinkRequest, &index, 1);
+        sendUdp(clients[i], MsgUDPLinkEstablished, NULL, 0);
+
+        char *buffer;
+        struct sockaddr_in uaddr;
+        bool udpLinkRequest;
+        while (NetHandler::udpReceive(buffer, &uaddr, udpLinkRequest) != -1)
+        {
+            if (udpLinkRequest)
+                linked++;
+        }
+    }
+    if (linked != count)
+    {
+        printf("* only %d of %d clients linked udp\n", linked, count);
+        return false;
+    }
+    return true;
+}
+
+
+// sends rate packets a second for a while, a millisecond's worth at a time
+static void sendLoop(int rate, float seconds)
+{
+    char update[MaxPacketLen];
+    char payload[32];
+    memset(payload, 'u', sizeof(payload));
+    packUpdate(update, MsgPlayerUpdateSmall, payload, sizeof(payload));
+    const int size = (int)sizeof(payload) + 4;
+
+    const TimeKeeper start = TimeKeeper::getCurrent();
+    long packets = 0;
+    while (true)
+    {
+        const double elapsed = TimeKeeper::getCurrent() - start;
+        if (elapsed >= seconds)
+            break;
+        const long due = (long)(elapsed * rate);
+        for (; packets < due; packets++)
+        {
+            const Client &c = clients[(packets / 2) % clients.size()];
+            if (packets & 1)
+            {
+                if (send(c.udp, update, size, 0) == size)
+                    udpSent++;
+            }
+            else
+            {
+                if (send(c.tcp, update, size, 0) == size)
+                    tcpSent++;
+            }
+        }
+        TimeKeeper::sleep(0.001f);
+    }
+    sending = false;
+}
+
+
+static double threadCPU()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + (ts.tv_nsec * 1e-9);
+}
+
+
+static int drainUdp()
+{
+    int received = 0;
+    char *buffer;
+    struct sockaddr_in uaddr;
+    bool udpLinkRequest;
+    while (NetHandler::udpReceive(buffer, &uaddr, udpLinkRequest) >= 0)
+        received++;
+    return received;
+}
+
+
+// one pass of the bzfs main loop with the poller, returns the packets read
+static int pollerPass(NetPoller *poller)
+{
+    if (poller->wait(0.1f) <= 0)
+        return 0;
+
+    int received = 0;
+    const std::vector<NetPoller::Event> &events = poller->getEvents();
+    for (size_t k = 0; k < events.size(); k++)
+    {
+        if (events[k].fd == NetHandler::getUdpSocket())
+            received += drainUdp();
+    }
+    for (size_t k = 0; k < events.size(); k++)
+    {
+        const NetPoller::Event &event = events[k];
+        NetHandler *handler = NetHandler::getHandlerByFD(event.fd);
+        if (!handler || !event.readable)
+            continue;
+        // one message per pass, another look next time if there was one
+        if (handler->tcpReceive() == ReadAll)
+        {
+            received++;
+            poller->setPending(event.fd);
+        }
+    }
+    return received;
+}
+
+
+// one pass of the loop before the poller, an fd_set of everybody for
+// select() and a scan over every player slot after it
+static int selectPass(unsigned long &wakeups)
+{
+    fd_set read_set;
+    FD_ZERO(&read_set);
+    int maxFile = NetHandler::getUdpSocket();
+    FD_SET(maxFile, &read_set);
+    for (int i = 0; i < maxHandlers; i++)
+    {
+        if (i < (int)clients.size())
+        {
+            FD_SET(clients[i].serverFD, &read_set);
+            if (clients[i].serverFD > maxFile)
+                maxFile = clients[i].serverFD;
+        }
+    }
+
+    struct timeval timeout;
+    timeout.tv_sec = 0;
+    timeout.tv_usec = 100000;
+    const int nfound = select(maxFile + 1, &read_set, NULL, NULL, &timeout);
+    wakeups++;
+    if (nfound <= 0)
+        return 0;
+
+    int received = 0;
+    if (FD_ISSET(NetHandler::getUdpSocket(), &read_set))
+        received += drainUdp();
+    for (int i = 0; i < maxHandlers; i++)
+    {
+        if ((i < (int)clients.size()) && FD_ISSET(clients[i].serverFD, &read_set) &&
+                (clients[i].handler->tcpReceive() == ReadAll))
+            received++;
+    }
+    return received;
+}
+
+
+static void run(const char *name, NetPoller *poller, int rate, float seconds)
+{
+    NetHandler::setPoller(poller);
+    if (poller)
+        poller->resetStats();
+
+    tcpSent = 0;
+    udpSent = 0;
+    sending = true;
+    std::thread sender(sendLoop, rate, seconds);
+
+    const TimeKeeper start = TimeKeeper::getCurrent();
+    const double startCPU = threadCPU();
+    unsigned long wakeups = 0;
+    long received = 0;
+    TimeKeeper lastPacket = start;
+    while (true)
+    {
+        const int n = poller ? pollerPass(poller) : selectPass(wakeups);
+        received += n;
+        if (n > 0)
+            lastPacket = TimeKeeper::getCurrent();
+        // done when everything is in, or nothing came for a while (lost udp)
+        if (!sending && ((received >= tcpSent + udpSent) ||
+                         (TimeKeeper::getCurrent() - lastPacket > 0.5f)))
+            break;
+    }
+    const double cpu = threadCPU() - startCPU;
+    const double wall = lastPacket - start;
+    sender.join();
+    if (poller)
+        wakeups = poller->getWakeups();
+
+    const long sent = tcpSent + udpSent;
+    printf("  %-8s %9ld %10.0f %9.1f %9.2f %9.2f\n", name, received,
+           (wall > 0.0) ? wakeups / wall : 0.0, wakeups ? (double)received / wakeups : 0.0,
+           received ? cpu * 1e6 / received : 0.0, (wall > 0.0) ? 100.0 * cpu / wall : 0.0);
+    if (received < sent)
+        printf("  * %ld of %ld packets were lost\n", sent - received, sent);
+}
+
+
+int main(int argc, char** argv)
+{
+    const char* execName = argv[0];
+    int count = 100;
+    int rate = 20000;
+    float seconds = 3.0f;
+
+    printf("\nPOLLBENCH-%s\nProtocol BZFS%s\n\n",
+           getAppVersion(), getProtocolVersion());
+
+    for (int arg = 1; arg < argc; arg += 2)
+    {
+        const char *opt = argv[arg];
+        if ((strcmp("-c", opt) != 0) && (strcmp("-r", opt) != 0) &&
+                (strcmp("-s", opt) != 0))
+        {
+            printHelp(execName);
+            exit(strcmp("-h", opt) == 0 ? 0 : 1);
+        }
+        if ((arg + 1) >= argc)
+        {
+            printf("* Missing the %s parameter\n\n", opt);
+            printHelp(execName);
+            exit(1);
+        }
+        if (strcmp("-c", opt) == 0)
+            count = atoi(argv[arg + 1]);
+        else if (strcmp("-r", opt) == 0)
+            rate = atoi(argv[arg + 1]);
+        else
+            seconds = (float)atof(argv[arg + 1]);
+    }
+    if ((count < 1) || (count > maxHandlers) || (rate < 1) || (seconds <= 0.0f))
+    {
+        printHelp(execName);
+        exit(1);
+    }
+
+    if (!setup(count))
+        exit(1);
+    printf("%d clients, %d packets a second for %.1f seconds\n\n", count, rate, seconds);
+    printf("  %-8s %9s %10s %9s %9s %9s\n", "loop", "packets", "wakeups/s",
+           "per wake", "cpu us", "cpu %");
+
+    run("old", NULL, rate, seconds);
+    const NetPoller::Backend backends[] = { NetPoller::SelectBackend, NetPoller::EpollBackend };
+    for (size_t b = 0; b < bzcountof(backends); b++)
+    {
+        if (!NetPoller::isAvailable(backends[b]))
+            continue;
+        NetPoller *poller = NetPoller::create(backends[b]);
+        run(poller->getName(), poller, rate, seconds);
+        NetHandler::setPoller(NULL);
+        delete poller;
+    }
+
+    return 0;
+}
+
+
+// Local Variables: ***
+// mode: C++ ***
+// tab-width: 4 ***
+// c-basic-offset: 4 ***
+// indent-tabs-mode: nil ***
+// End: ***
+// ex: shiftwidth=4 tabstop=4
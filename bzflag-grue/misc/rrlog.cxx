@@ -24,6 +24,8 @@
 #include <sys/types.h>
 #include <string.h>
 #include <time.h>
+#include <vector>
+#include <zlib.h>
 #ifndef _WIN32
 #  include <sys/time.h>
 #  include <unistd.h>
@@ -47,6 +49,7 @@
 
 static void printHelp(const char* execName);
 static bool loadHeader(ReplayHeader *h, FILE *f);
+static FILE *unpackBlocks(FILE *f);
 static RRpacket *loadPacket(FILE *f);
 static const void *nboUnpackRRtime(const void *buf, RRtime& value);
 static std::string strRRtime(RRtime timestamp);
@@ -144,6 +147,17 @@ int main(int argc, char** argv)
         fclose(file);
         exit(1);
     }
+    if (header.version >= ReplayBlockVersion)
+    {
+        FILE *unpacked = unpackBlocks(file);
+        fclose(file);
+        file = unpacked;
+        if (file == NULL)
+        {
+            printf("Couldn't unpack the packets\n");
+            exit(1);
+        }
+    }
 
     unsigned int secs = header.filetime / 1000000;
     unsigned int days = secs / (24 * 60 * 60);
@@ -296,6 +310,65 @@ static bool loadHeader(ReplayHeader *h, FILE *f)
 
 /****************************************************************************/
 
+// the packets after the header, out of their blocks
+static FILE *unpackBlocks(FILE *f)
+{
+    FILE *out = tmpfile();
+    if (out == NULL)
+        return NULL;
+
+    std::vector<char> raw, packed;
+    char hdr[RRblockHdrSize];
+    while (fread(hdr, RRblockHdrSize, 1, f) == 1)
+    {
+        u32 rawLen, packedLen, coding;
+        const void *buf = nboUnpackUInt(hdr, rawLen);
+        buf = nboUnpackUInt(buf, packedLen);
+        nboUnpackUInt(buf, coding);
+        if ((rawLen == 0) || (packedLen == 0))
+            break;
+
+        packed.resize(packedLen);
+        if (fread(&packed[0], packedLen, 1, f) != 1)
+        {
+            fprintf(stderr, "unpackBlocks: the last block is cut short\n");
+            break;
+        }
+
+        if (coding == IndexBlock)
+            break; // the last one, not packets
+        else if ((coding == StoredBlock) && (packedLen == rawLen))
+            raw.swap(packed);
+        else if (coding == ZlibBlock)
+        {
+            raw.resize(rawLen);
+            uLongf len = rawLen;
+            if ((uncompress((Bytef *)&raw[0], &len, (const Bytef *)&packed[0],
+                            packedLen) != Z_OK) || (len != rawLen))
+            {
+                fprintf(stderr, "unpackBlocks: ERROR, bad block\n");
+                break;
+            }
+        }
+        else
+        {
+            fprintf(stderr, "unpackBlocks: ERROR, coding = %u\n", coding);
+            break;
+        }
+
+        if (fwrite(&raw[0], rawLen, 1, out) != 1)
+        {
+            fclose(out);
+            return NULL;
+        }
+    }
+
+    rewind(out);
+    return out;
+}
+
+/****************************************************************************/
+
 static RRpacket* loadPacket(FILE *f)
 {
     RRpacket *p;
@@ -0,0 +1,431 @@
+/* bzflag
+ * Copyright (c) 1993-2021 Tim Riker
+ *
+ * This package is free software;  you can redistribute it and/or
+ * modify it under the terms of the license found in the file
+ * named COPYING that should have accompanied this file.
+ *
+ * THIS PACKAGE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+
+//  RRSEEK
+//
+//  Times how long bzfs takes to load a recording and to skip around
+//  in it.  It writes a synthetic recording in both file versions, an
+//  hour of it by default, loads them the way /replay load does and
+//  makes random skips of up to half an hour either way.  Each skip
+//  is checked against a walk over the packets, the way /replay skip
+//  used to find its update, and the walk is timed too.
+//
+//  It also loads a version 2 file whose first block claims to be
+//  huge, which has to fail without allocating anything for it.
+//
+
+// system headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <zlib.h>
+#ifndef _WIN32
+#  include <sys/resource.h>
+#endif
+
+// common headers
+#include "common.h"
+#include "Pack.h"
+#include "Protocol.h"
+#include "TimeKeeper.h"
+#include "version.h"
+
+// bzfs headers
+#include "RecordReplay.h"
+#include "ReplayReader.h"
+
+
+int debugLevel = 0;
+
+// what the file header would hold, the reader only skips it
+static const u32 dataStart = 4096;
+// a block as RecordWriter makes them
+static const unsigned int blockSize = 64 * 1024;
+static const RRtime second = 1000000;
+
+
+static void printHelp(const char* execName)
+{
+    printf("usage: %s [options]\n", execName);
+    printf("  -m <minutes>  : length of the recording (default 60)\n");
+    printf("  -r <packets>  : packets per second (default 480)\n");
+    printf("  -u <seconds>  : seconds between updates (default 10)\n");
+    printf("  -s <skips>    : random skips to make (default 30)\n");
+    printf("  -d <dir>      : where the files go (default /tmp)\n");
+}
+
+
+static void *nboPackRRtime(void *buf, RRtime value)
+{
+    buf = nboPackUInt(buf, (u32) (value >> 32));       // msb's
+    buf = nboPackUInt(buf, (u32) (value & 0xFFFFFFFF)); // lsb's
+    return buf;
+}
+
+
+// the packet bytes of a recording, laid out as from dataStart
+static void makePackets(int minutes, int rate, int updateGap,
+                        std::vector<char>& bytes,
+                        std::vector<ReplayReader::IndexEntry>& updates,
+                        u32& lastPacketPos)
+{
+    const RRtime start = (RRtime)1600000000 * second;
+    const RRtime end = start + (RRtime)minutes * 60 * second;
+    const RRtime step = second / rate;
+    RRtime nextUpdate = start;
+    u32 prevPos = 0;
+    char data[256];
+    for (RRtime t = start; t < end; t += step)
+    {
+        const bool update = (t >= nextUpdate);
+        if (update)
+            nextUpdate += (RRtime)updateGap * second;
+
+        // mostly small player updates, now and then something bigger
+        const u32 len = update ? 200 : ((rand() % 16) == 0) ? 120 : 32;
+        for (u32 i = 0; i < len; i++)
+            data[i] = (char)(rand() % 16);
+
+        const u32 pos = dataStart + (u32)bytes.size();
+        char hdr[RRpacketHdrSize];
+        memset(hdr, 0, sizeof(hdr));
+        void *buf = nboPackUShort(hdr, update ? UpdatePacket : RealPacket);
+        buf = nboPackUShort(buf, MsgPlayerUpdateSmall);
+        buf = nboPackUInt(buf, len);
+        buf = nboPackUInt(buf, pos + RRpacketHdrSize + len);
+        buf = nboPackUInt(buf, prevPos);
+        nboPackRRtime(buf, t);
+        bytes.insert(bytes.end(), hdr, hdr + RRpacketHdrSize);
+        bytes.insert(bytes.end(), data, data + len);
+
+        if (update)
+        {
+            ReplayReader::IndexEntry entry;
+            entry.filePos = pos;
+            entry.timestamp = t;
+            updates.push_back(entry);
+        }
+        prevPos = pos;
+    }
+    lastPacketPos = prevPos;
+}
+
+
+static void writeBlockHeader(FILE *f, u32 rawLen, u32 packedLen, u32 coding)
+{
+    char hdr[RRblockHdrSize];
+    void *buf = nboPackUInt(hdr, rawLen);
+    buf = nboPackUInt(buf, packedLen);
+    nboPackUInt(buf, coding);
+    fwrite(hdr, RRblockHdrSize, 1, f);
+}
+
+
+static bool writeFile(const std::string& name, u32 version,
+                      const std::vector<char>& bytes,
+                      const std::vector<ReplayReader::IndexEntry>& updates,
+                      u32 lastPacketPos)
+{
+    FILE *f = fopen(name.c_str(), "wb");
+    if (f == NULL)
+        return false;
+    const std::vector<char> header(dataStart, 0);
+    fwrite(&header[0], dataStart, 1, f);
+
+    if (version < ReplayBlockVersion)
+        fwrite(&bytes[0], bytes.size(), 1, f);
+    else
+    {
+        std::vector<Bytef> packed(compressBound(blockSize));
+        for (size_t pos = 0; pos < bytes.size(); pos += blockSize)
+        {
+            const u32 rawLen = (u32)std::min((size_t)blockSize, bytes.size() - pos);
+            uLongf packedLen = (uLongf)packed.size();
+            compress2(&packed[0], &packedLen, (const Bytef *)&bytes[pos], rawLen,
+                      Z_DEFAULT_COMPRESSION);
+            writeBlockHeader(f, rawLen, (u32)packedLen, ZlibBlock);
+            fwrite(&packed[0], packedLen, 1, f);
+        }
+        std::vector<char> index;
+        ReplayReader::packIndex(updates, lastPacketPos, index);
+        writeBlockHeader(f, (u32)index.size(), (u32)index.size(), IndexBlock);
+        fwrite(&index[0], index.size(), 1, f);
+    }
+    return (fclose(f) == 0);
+}
+
+
+static double loadFile(ReplayReader& reader, const std::string& name,
+                       u32 version)
+{
+    FILE *f = fopen(name.c_str(), "rb");
+    if (f == NULL)
+        return -1.0;
+    const TimeKeeper start = TimeKeeper::getCurrent();
+    const bool loaded = reader.open(f, version, dataStart, name + ".idx");
+    const double seconds = TimeKeeper::getCurrent() - start;
+    fclose(f);
+    return loaded ? seconds : -1.0;
+}
+
+
+// where /replay skip used to land, packet by packet
+static u32 walkToUpdate(const ReplayReader& reader, u32 filePos,
+                        RRtime target, bool forward)
+{
+    RRpacket p;
+    if (!reader.readPacket(filePos, &p))
+        return 0;
+    while (true)
+    {
+        const u32 pos = forward ? p.nextFilePos : p.prevFilePos;
+        if ((forward && (pos <= filePos)) || (!forward && (pos >= filePos)) ||
+                !reader.readPacket(pos, &p))
+            return 0;
+        filePos = pos;
+        if (p.mode != UpdatePacket)
+            continue;
+        if (forward ? (p.timestamp >= target) : (p.timestamp <= target))
+            return filePos;
+    }
+}
+
+
+struct Latency
+{
+    Latency() : total(0.0), most(0.0), count(0) {}
+    void add(double seconds)
+    {
+        total += seconds;
+        if (seconds > most)
+            most = seconds;
+        count++;
+    }
+    double total;
+    double most;
+    int count;
+};
+
+
+static bool skipAround(const ReplayReader& reader, int skips, int minutes,
+                       Latency& indexed, Latency& walked)
+{
+    // the packets the skips start from, like ReplayPos can be at any
+    std::vector<u32> starts;
+    RRpacket p;
+    for (u32 pos = dataStart; reader.readPacket(pos, &p); pos = p.nextFilePos)
+    {
+        if ((rand() % 1000) == 0)
+            starts.push_back(pos);
+        if (p.nextFilePos <= pos)
+            break;
+    }
+    if (starts.empty())
+        return false;
+
+    const int range = ((minutes < 30) ? minutes : 30) * 60;
+    bool same = true;
+    for (int s = 0; s < skips; s++)
+    {
+        const u32 from = starts[rand() % starts.size()];
+        reader.readPacket(from, &p);
+        const int offset = (rand() % (2 * range + 1)) - range;
+        const bool forward = (offset >= 0);
+        const RRtime target = p.timestamp + (RRtime)offset * second;
+
+        TimeKeeper start = TimeKeeper::getCurrent();
+        const u32 found = forward ? reader.nextUpdate(from, target) :
+                          reader.prevUpdate(from, target);
+        indexed.add(TimeKeeper::getCurrent() - start);
+
+        start = TimeKeeper::getCurrent();
+        const u32 expected = walkToUpdate(reader, from, target, forward);
+        walked.add(TimeKeeper::getCurrent() - start);
+
+        if (found != expected)
+        {
+            printf("* a skip of %ds from %u landed on %u, the walk on %u\n",
+                   offset, from, found, expected);
+            same = false;
+        }
+    }
+    return same;
+}
+
+
+static void report(const char *what, const Latency& l)
+{
+    printf("  %-10s mean %10.1fus   max %10.1fus\n", what,
+           1.0e6 * l.total / (l.count ? l.count : 1), 1.0e6 * l.most);
+}
+
+
+// the most memory the process has had, in KB
+static long getPeakMemory()
+{
+#ifndef _WIN32
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+        return usage.ru_maxrss;
+#endif
+    return 0;
+}
+
+
+// a version 2 file whose first block is much bigger than RecordWriter
+// makes them must not be loaded, nor that much memory be asked for
+static bool checkHugeBlock(const std::string& name)
+{
+    FILE *f = fopen(name.c_str(), "wb");
+    if (f == NULL)
+        return false;
+    const std::vector<char> header(dataStart, 0);
+    fwrite(&header[0], dataStart, 1, f);
+    writeBlockHeader(f, 0xFFFFFFF0, 0xFFFFFFF0, ZlibBlock);
+    fwrite(&header[0], 64, 1, f);
+    writeBlockHeader(f, 0xFFFFFFF0, 0xFFFFFFF0, IndexBlock);
+    fclose(f);
+
+    const long peak = getPeakMemory();
+    ReplayReader reader;
+    const bool loaded = (loadFile(reader, name, ReplayBlockVersion) >= 0.0);
+    const bool empty = !loaded || (reader.getUpdateCount() == 0);
+    const bool small = (getPeakMemory() - peak) < (64 * 1024);
+    remove(name.c_str());
+    remove((name + ".idx").c_str());
+    return empty && small;
+}
+
+
+int main(int argc, char** argv)
+{
+    const char* execName = argv[0];
+    int minutes = 60;
+    int rate = 480;
+    int updateGap = 10;
+    int skips = 30;
+    std::string dir = "/tmp";
+
+    printf("\nRRSEEK-%s\nProtocol BZFS%s\n\n",
+           getAppVersion(), getProtocolVersion());
+
+    for (int arg = 1; arg < argc; arg += 2)
+    {
+        const char *opt = argv[arg];
+        if ((strcmp("-m", opt) != 0) && (strcmp("-r", opt) != 0) &&
+                (strcmp("-u", opt) != 0) && (strcmp("-s", opt) != 0) &&
+                (strcmp("-d", opt) != 0))
+        {
+            printHelp(execName);
+            exit(strcmp("-h", opt) == 0 ? 0 : 1);
+        }
+        if ((arg + 1) >= argc)
+        {
+            printf("* Missing the %s parameter\n\n", opt);
+            printHelp(execName);
+            exit(1);
+        }
+        if (strcmp("-d", opt) == 0)
+        {
+            dir = argv[arg + 1];
+            continue;
+        }
+        const int value = atoi(argv[arg + 1]);
+        if (strcmp("-m", opt) == 0)
+            minutes = value;
+        else if (strcmp("-r", opt) == 0)
+            rate = value;
+        else if (strcmp("-u", opt) == 0)
+            updateGap = value;
+        else
+            skips = value;
+    }
+    if ((minutes < 1) || (rate < 1) || (rate > 10000) || (updateGap < 1) ||
+            (skips < 1))
+    {
+        printHelp(execName);
+        exit(1);
+    }
+
+    srand(1);
+    std::vector<char> bytes;
+    std::vector<ReplayReader::IndexEntry> updates;
+    u32 lastPacketPos;
+    makePackets(minutes, rate, updateGap, bytes, updates, lastPacketPos);
+    if (bytes.size() > (0xFFFFFFFF - dataStart))
+    {
+        printf("* the recording does not fit 32 bit file positions\n");
+        exit(1);
+    }
+    printf("%d minutes, %d packets a second, %d updates, %.1fMB of packets\n\n",
+           minutes, rate, (int)updates.size(), bytes.size() / 1.0e6);
+
+    bool ok = true;
+    for (u32 version = 1; version <= ReplayBlockVersion; version++)
+    {
+        const std::string name = dir + "/rrseek-v" + (version == 1 ? "1" : "2") + ".rec";
+        remove((name + ".idx").c_str());
+        if (!writeFile(name, version, bytes, updates, lastPacketPos))
+        {
+            printf("* could not write %s\n", name.c_str());
+            exit(1);
+        }
+
+        ReplayReader reader;
+        const double firstLoad = loadFile(reader, name, version);
+        if (firstLoad < 0.0)
+        {
+            printf("* could not load %s\n", name.c_str());
+            exit(1);
+        }
+        if (version == 1)
+        {
+            printf("version 1: loaded in %.1fms building the index", firstLoad * 1.0e3);
+            printf(", %.1fms with it saved\n", loadFile(reader, name, version) * 1.0e3);
+        }
+        else
+            printf("version 2: loaded in %.1fms with its own index\n", firstLoad * 1.0e3);
+        if (reader.getUpdateCount() != updates.size())
+        {
+            printf("* %d updates were indexed\n", (int)reader.getUpdateCount());
+            ok = false;
+        }
+
+        Latency indexed, walked;
+        ok = skipAround(reader, skips, minutes, indexed, walked) && ok;
+        report("index", indexed);
+        report("walk", walked);
+        printf("\n");
+
+        reader.close();
+        remove(name.c_str());
+        remove((name + ".idx").c_str());
+    }
+
+    const bool rejected = checkHugeBlock(dir + "/rrseek-huge.rec");
+    printf("a huge block is %s\n", rejected ? "rejected" : "* NOT rejected");
+
+    return (ok && rejected) ? 0 : 1;
+}
+
+
+// Local Variables: ***
+// mode: C++ ***
+// tab-width: 4 ***
+// c-basic-offset: 4 ***
+// indent-tabs-mode: nil ***
+// End: ***
+// ex: shiftwidth=4 tabstop=4
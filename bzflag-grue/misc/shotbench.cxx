@@ -0,0 +1,315 @@
+/* bzflag
+ * Copyright (c) 1993-2021 Tim Riker
+ *
+ * This package is free software;  you can redistribute it and/or
+ * modify it under the terms of the license found in the file
+ * named COPYING that should have accompanied this file.
+ *
+ * THIS PACKAGE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+
+//  SHOTBENCH
+//
+//  Times the shot manager of bzfs with 10k shots in flight: adding
+//  them, looking them up by GUID and by (player, local shot id), the
+//  metadata calls plugins make, updates, removal, the dead shot cache
+//  and players leaving.  For comparison the lookups are also done the
+//  way the manager did them before shots were indexed, by a scan over
+//  the shot list.  Every lookup is checked.
+//
+
+// system headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+// common headers
+#include "common.h"
+#include "Flag.h"
+#include "TimeKeeper.h"
+#include "version.h"
+
+// bzfs headers
+#include "ShotManager.h"
+
+
+int debugLevel = 0;
+
+static int errors = 0;
+
+
+static void printHelp(const char* execName)
+{
+    printf("usage: %s [options]\n", execName);
+    printf("  -n <shots>    : shots in flight (default 10000)\n");
+    printf("  -p <players>  : players firing them (default 200)\n");
+    printf("  -l <lookups>  : lookups of each kind (default 1000000)\n");
+}
+
+
+static void report(const char *what, int count, double seconds)
+{
+    printf("  %-26s %9d %12.1f ns\n", what, count, seconds * 1e9 / count);
+}
+
+
+static void fail(const char *what, uint32_t guid)
+{
+    if (errors++ < 10)
+        printf("* %s, shot %08x\n", what, guid);
+}
+
+
+// a lookup the way it was, a scan over every shot
+static Shots::ShotRef scanByID(const Shots::ShotList &shots, uint32_t guid)
+{
+    for (size_t i = 0; i < shots.size(); i++)
+    {
+        if (shots[i]->GetGUID() == guid)
+            return shots[i];
+    }
+    return NULL;
+}
+
+
+static uint32_t scanByLocalID(const Shots::ShotList &shots, PlayerId player,
+                              uint16_t id)
+{
+    for (size_t i = 0; i < shots.size(); i++)
+    {
+        if ((shots[i]->GetPlayerID() == player) && (shots[i]->Info.shot.id == id))
+            return shots[i]->GetGUID();
+    }
+    return 0;
+}
+
+
+int main(int argc, char** argv)
+{
+    const char* execName = argv[0];
+    int count = 10000;
+    int players = 200;
+    int lookups = 1000000;
+
+    printf("\nSHOTBENCH-%s\nProtocol BZFS%s\n\n",
+           getAppVersion(), getProtocolVersion());
+
+    for (int arg = 1; arg < argc; arg += 2)
+    {
+        const char *opt = argv[arg];
+        if ((strcmp("-n", opt) != 0) && (strcmp("-p", opt) != 0) &&
+                (strcmp("-l", opt) != 0))
+        {
+            printHelp(execName);
+            exit(strcmp("-h", opt) == 0 ? 0 : 1);
+        }
+        if ((arg + 1) >= argc)
+        {
+            printf("* Missing the %s parameter\n\n", opt);
+            printHelp(execName);
+            exit(1);
+        }
+        const int value = atoi(argv[arg + 1]);
+        if (strcmp("-n", opt) == 0)
+            count = value;
+        else if (strcmp("-p", opt) == 0)
+            players = value;
+        else
+            lookups = value;
+    }
+    if ((count < 1) || (players < 1) || (players > 200) || (lookups < 1) ||
+            ((count / players) > 0xffff))
+    {
+        printHelp(execName);
+        exit(1);
+    }
+
+    Flags::init();
+    Shots::Manager manager;
+    manager.Init();
+    srand(1);
+
+    FiringInfo info;
+    memset(&info.shot, 0, sizeof(info.shot));
+    info.timeSent = 0.0f;
+    info.flagType = Flags::Null;
+    // nothing expires while it is timed
+    info.lifetime = 1.0e6f;
+
+    printf("%d shots of %d players\n", count, players);
+    std::vector<uint32_t> guids(count);
+    TimeKeeper start = TimeKeeper::getCurrent();
+    for (int i = 0; i < count; i++)
+    {
+        info.shot.player = (PlayerId)(i % players);
+        info.shot.id = (uint16_t)(i / players);
+        guids[i] = manager.AddShot(info, info.shot.player);
+    }
+    report("AddShot", count, TimeKeeper::getCurrent() - start);
+
+    std::vector<int> picks(lookups);
+    for (int i = 0; i < lookups; i++)
+        picks[i] = rand() % count;
+    // the scans take a lot longer, a share of the lookups is plenty
+    const int scans = std::max(1, lookups / 100);
+
+    Shots::ShotList all;
+    for (int p = 0; p < players; p++)
+    {
+        const Shots::ShotList list = manager.LiveShotsForPlayer((PlayerId)p);
+        all.insert(all.end(), list.begin(), list.end());
+    }
+    if ((int)all.size() != count)
+        fail("the players' lists miss shots", 0);
+    // shuffled, the old list was in no useful order either
+    std::random_shuffle(all.begin(), all.end());
+
+    start = TimeKeeper::getCurrent();
+    for (int i = 0; i < lookups; i++)
+    {
+        const uint32_t guid = guids[picks[i]];
+        Shots::ShotRef shot = manager.FindShot(guid);
+        if (!shot || (shot->GetGUID() != guid))
+            fail("FindShot missed", guid);
+    }
+    report("FindShot", lookups, TimeKeeper::getCurrent() - start);
+
+    start = TimeKeeper::getCurrent();
+    for (int i = 0; i < scans; i++)
+    {
+        if (!scanByID(all, guids[picks[i]]))
+            fail("the scan missed", guids[picks[i]]);
+    }
+    report("FindShot, scanning", scans, TimeKeeper::getCurrent() - start);
+
+    start = TimeKeeper::getCurrent();
+    for (int i = 0; i < lookups; i++)
+    {
+        const int s = picks[i];
+        const uint32_t guid = manager.FindShotGUID((PlayerId)(s % players),
+                              (uint16_t)(s / players));
+        if (guid != guids[s])
+            fail("FindShotGUID missed", guids[s]);
+    }
+    report("FindShotGUID", lookups, TimeKeeper::getCurrent() - start);
+
+    start = TimeKeeper::getCurrent();
+    for (int i = 0; i < scans; i++)
+    {
+        const int s = picks[i];
+        if (scanByLocalID(all, (PlayerId)(s % players), (uint16_t)(s / players)) != guids[s])
+            fail("the local id scan missed", guids[s]);
+    }
+    report("FindShotGUID, scanning", scans, TimeKeeper::getCurrent() - start);
+
+    start = TimeKeeper::getCurrent();
+    size_t listed = 0;
+    for (int i = 0; i < lookups; i += players)
+    {
+        for (int p = 0; p < players; p++)
+            listed += manager.LiveShotsForPlayer((PlayerId)p).size();
+    }
+    const int listCalls = ((lookups + players - 1) / players) * players;
+    report("LiveShotsForPlayer", listCalls, TimeKeeper::getCurrent() - start);
+    if (listed != (size_t)(listCalls / players) * count)
+        fail("LiveShotsForPlayer lost shots", 0);
+
+    start = TimeKeeper::getCurrent();
+    for (int i = 0; i < count; i++)
+    {
+        Shots::ShotRef shot = manager.FindShot(guids[i]);
+        shot->SetMetaData("owner", (uint32_t)i);
+        shot->SetMetaData("turret", "north");
+    }
+    report("SetMetaData, twice", count, TimeKeeper::getCurrent() - start);
+
+    start = TimeKeeper::getCurrent();
+    for (int i = 0; i < lookups; i++)
+    {
+        Shots::ShotRef shot = manager.FindShot(guids[picks[i]]);
+        if (!shot->HasMetaData("turret") || (shot->GetMetaDataI("owner") != (uint32_t)picks[i]))
+            fail("the metadata is wrong", guids[picks[i]]);
+    }
+    report("Has, GetMetaDataI", lookups, TimeKeeper::getCurrent() - start);
+
+    const int updates = 100;
+    start = TimeKeeper::getCurrent();
+    for (int i = 0; i < updates; i++)
+        manager.Update();
+    report("Update", updates, TimeKeeper::getCurrent() - start);
+
+    // every other shot ends, in random order
+    std::vector<int> order;
+    for (int i = 0; i < count; i += 2)
+        order.push_back(i);
+    std::random_shuffle(order.begin(), order.end());
+    start = TimeKeeper::getCurrent();
+    for (size_t i = 0; i < order.size(); i++)
+        manager.RemoveShot(guids[order[i]]);
+    report("RemoveShot", (int)order.size(), TimeKeeper::getCurrent() - start);
+
+    // ended shots stay in the dead shot cache
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        const int s = order[i];
+        if (!manager.FindShot(guids[s]) ||
+                (manager.FindShotGUID((PlayerId)(s % players), (uint16_t)(s / players)) != guids[s]))
+            fail("a dead shot is not cached", guids[s]);
+    }
+
+    Shots::Manager::DeadShotCacheTime = 0.0;
+    start = TimeKeeper::getCurrent();
+    manager.Update();
+    report("Update, expiring", (int)order.size(), TimeKeeper::getCurrent() - start);
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        if (manager.FindShot(guids[order[i]]))
+            fail("an expired shot is still found", guids[order[i]]);
+    }
+
+    // the freed slots are taken again, the old GUIDs must not match
+    info.shot.player = 0;
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        info.shot.id = (uint16_t)(0x8000 + i);
+        const uint32_t guid = manager.AddShot(info, 0);
+        if (std::find(guids.begin(), guids.end(), guid) != guids.end())
+            fail("a GUID came back", guid);
+    }
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        if (manager.FindShot(guids[order[i]]))
+            fail("a stale GUID found a new shot", guids[order[i]]);
+    }
+
+    start = TimeKeeper::getCurrent();
+    for (int p = 0; p < players; p++)
+        manager.RemovePlayer((PlayerId)p);
+    report("RemovePlayer", players, TimeKeeper::getCurrent() - start);
+    for (int i = 0; i < count; i++)
+    {
+        if (manager.FindShot(guids[i]))
+            fail("a shot of a player who left is found", guids[i]);
+    }
+
+    if (errors)
+    {
+        printf("\n* %d checks failed\n", errors);
+        return 1;
+    }
+    return 0;
+}
+
+
+// Local Variables: ***
+// mode: C++ ***
+// tab-width: 4 ***
+// c-basic-offset: 4 ***
+// indent-tabs-mode: nil ***
+// End: ***
+// ex: shiftwidth=4 tabstop=4
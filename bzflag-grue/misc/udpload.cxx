@@ -0,0 +1,365 @@
+/* bzflag
+ * Copyright (c) 1993-2021 Tim Riker
+ *
+ * This package is free software;  you can redistribute it and/or
+ * modify it under the terms of the license found in the file
+ * named COPYING that should have accompanied this file.
+ *
+ * THIS PACKAGE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+
+//  UDPLOAD
+//
+//  A loopback load generator for the UDP path of bzfs.  It links
+//  players to NetHandler the way clients do, floods it with player
+//  updates and measures datagrams per second and system calls per
+//  datagram, both ways.  For comparison it also runs the loop bzfs
+//  used before the batched path, one recvfrom() or sendto() per
+//  datagram and a scan over the player slots per sender.
+//
+
+// system headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include <sys/socket.h>
+
+// common headers
+#include "common.h"
+#include "network.h"
+#include "Pack.h"
+#include "Protocol.h"
+#include "TimeKeeper.h"
+#include "version.h"
+
+// game headers
+#include "NetHandler.h"
+#include "PlayerInfo.h"
+
+
+int debugLevel = 0;
+
+// one simulated client
+struct Client
+{
+    int         udp;
+    int         tcp[2];
+    PlayerInfo      *info;
+    NetHandler      *handler;
+    struct sockaddr_in  addr;
+};
+
+static std::vector<Client> clients;
+static int burst = 32;
+
+// what the old receive loop matched senders against
+static struct sockaddr_in slotAddr[maxHandlers];
+static bool slotUsed[maxHandlers];
+
+
+static void printHelp(const char* execName)
+{
+    printf("usage: %s [options]\n", execName);
+    printf("  -p <players>   : simulated players (default 32)\n");
+    printf("  -r <rounds>    : updates sent by every player (default 2000)\n");
+    printf("  -s <bytes>     : size of an update payload (default 36)\n");
+    printf("  -b <datagrams> : most datagrams queued before the server\n");
+    printf("                   reads (default 32)\n");
+    printf("\n");
+    printf("Every round each player sends one update to the server socket\n");
+    printf("and the server sends one update back to each player.  Only the\n");
+    printf("server side is timed.\n");
+}
+
+
+static void sendFromClient(const Client &c, uint16_t code, const void *data,
+                           uint16_t len)
+{
+    char buffer[MaxPacketLen];
+    void *buf = buffer;
+    buf = nboPackUShort(buf, len);
+    buf = nboPackUShort(buf, code);
+    if (len > 0)
+        memcpy(buf, data, len);
+    send(c.udp, buffer, len + 4, 0);
+}
+
+
+static void drainClients()
+{
+    char buffer[MaxPacketLen];
+    for (size_t i = 0; i < clients.size(); i++)
+    {
+        while (recv(clients[i].udp, buffer, sizeof(buffer), 0) > 0)
+            ;
+    }
+}
+
+
+static bool setup(int players)
+{
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    if (!NetHandler::initHandlers(addr))
+        return false;
+    AddrLen addrLen = sizeof(addr);
+    getsockname(NetHandler::getUdpSocket(), (struct sockaddr *)&addr, &addrLen);
+
+    for (int i = 0; i < players; i++)
+    {
+        Client c;
+        c.udp = (int)socket(AF_INET, SOCK_DGRAM, 0);
+        struct sockaddr_in local;
+        memset(&local, 0, sizeof(local));
+        local.sin_family = AF_INET;
+        local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if ((c.udp < 0) ||
+                (bind(c.udp, (struct sockaddr *)&local, sizeof(local)) != 0) ||
+                (connect(c.udp, (struct sockaddr *)&addr, sizeof(addr)) != 0))
+        {
+            perror("client socket");
+            return false;
+        }
+        BzfNetwork::setNonBlocking(c.udp);
+        addrLen = sizeof(c.addr);
+        getsockname(c.udp, (struct sockaddr *)&c.addr, &addrLen);
+
+        // the tcp side is never used, it only needs to be a socket
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, c.tcp) != 0)
+        {
+            perror("socketpair");
+            return false;
+        }
+        c.info = new PlayerInfo(i);
+        c.handler = new NetHandler(c.info, local, i, c.tcp[0]);
+        clients.push_back(c);
+
+        slotAddr[i] = c.addr;
+        slotUsed[i] = true;
+    }
+
+    // link udp both ways, as a client does
+    int linked = 0;
+    for (int i = 0; i < players; i++)
+    {
+        const uint8_t index = (uint8_t)i;
+        sendFromClient(clients[i], MsgUDPLinkRequest, &index, 1);
+        sendFromClient(clients[i], MsgUDPLinkEstablished, NULL, 0);
+
+        char *buffer;
+        struct sockaddr_in uaddr;
+        bool udpLinkRequest;
+        while (NetHandler::udpReceive(buffer, &uaddr, udpLinkRequest) != -1)
+        {
+            if (udpLinkRequest)
+                linked++;
+        }
+    }
+    if (linked != players)
+    {
+        printf("* only %d of %d players linked udp\n", linked, players);
+        return false;
+    }
+    return true;
+}
+
+
+// the receive loop before batching, one recvfrom() and a slot scan each
+static int oldReceive()
+{
+    int received = 0;
+    while (true)
+    {
+        char buffer[MaxPacketLen];
+        struct sockaddr_in uaddr;
+        AddrLen recvlen = sizeof(uaddr);
+        const int n = recvfrom(NetHandler::getUdpSocket(), buffer, MaxUDPPacketLen, 0,
+                               (struct sockaddr *)&uaddr, &recvlen);
+        if (n < 0)
+            break;
+        for (int pi = 0; pi < maxHandlers; pi++)
+        {
+            if (slotUsed[pi] && (slotAddr[pi].sin_port == uaddr.sin_port) &&
+                    (memcmp(&slotAddr[pi].sin_addr, &uaddr.sin_addr,
+                            sizeof(uaddr.sin_addr)) == 0))
+            {
+                received++;
+                break;
+            }
+        }
+    }
+    return received;
+}
+
+
+static int newReceive()
+{
+    int received = 0;
+    char *buffer;
+    struct sockaddr_in uaddr;
+    bool udpLinkRequest;
+    while (NetHandler::udpReceive(buffer, &uaddr, udpLinkRequest) >= 0)
+        received++;
+    return received;
+}
+
+
+static void report(const char *what, int datagrams, unsigned long calls,
+                   double seconds)
+{
+    printf("  %-12s %9d datagrams %10.0f /s %7.3f calls each\n", what, datagrams,
+           (seconds > 0.0) ? datagrams / seconds : 0.0,
+           datagrams ? (double)calls / datagrams : 0.0);
+}
+
+
+static void runReceive(bool batched, int rounds, const char *update, int size)
+{
+    int received = 0;
+    double seconds = 0.0;
+    NetHandler::resetUdpStats();
+    unsigned long oldCalls = 0;
+    for (int r = 0; r < rounds; r++)
+    {
+        for (size_t first = 0; first < clients.size(); first += burst)
+        {
+            const size_t last = std::min(first + burst, clients.size());
+            for (size_t i = first; i < last; i++)
+                sendFromClient(clients[i], MsgPlayerUpdateSmall, update, (uint16_t)size);
+
+            const TimeKeeper start = TimeKeeper::getCurrent();
+            if (batched)
+                received += newReceive();
+            else
+            {
+                const int n = oldReceive();
+                received += n;
+                // every datagram and the one that would block
+                oldCalls += n + 1;
+            }
+            seconds += TimeKeeper::getCurrent() - start;
+        }
+    }
+    report(batched ? "batched" : "per datagram", received,
+           batched ? NetHandler::getUdpStats().recvCalls : oldCalls, seconds);
+    if (received != rounds * (int)clients.size())
+        printf("  * %d datagrams were lost, try a smaller -b\n",
+               rounds * (int)clients.size() - received);
+}
+
+
+static void runSend(bool batched, int rounds, const char *update, int size)
+{
+    char buffer[MaxPacketLen];
+    void *buf = buffer;
+    buf = nboPackUShort(buf, (uint16_t)size);
+    buf = nboPackUShort(buf, MsgPlayerUpdateSmall);
+    memcpy(buf, update, size);
+
+    int sent = 0;
+    double seconds = 0.0;
+    NetHandler::resetUdpStats();
+    unsigned long oldCalls = 0;
+    for (int r = 0; r < rounds; r++)
+    {
+        const TimeKeeper start = TimeKeeper::getCurrent();
+        if (batched)
+        {
+            for (size_t i = 0; i < clients.size(); i++)
+                clients[i].handler->pwrite(buffer, size + 4);
+            NetHandler::flushAllUDP();
+        }
+        else
+        {
+            for (size_t i = 0; i < clients.size(); i++)
+            {
+                if (sendto(NetHandler::getUdpSocket(), buffer, size + 4, 0,
+                           (struct sockaddr *)&clients[i].addr,
+                           sizeof(clients[i].addr)) > 0)
+                    sent++;
+                oldCalls++;
+            }
+        }
+        seconds += TimeKeeper::getCurrent() - start;
+        drainClients();
+    }
+    if (batched)
+        sent = NetHandler::getUdpStats().datagramsOut;
+    report(batched ? "batched" : "per datagram", sent,
+           batched ? NetHandler::getUdpStats().sendCalls : oldCalls, seconds);
+}
+
+
+int main(int argc, char** argv)
+{
+    const char* execName = argv[0];
+    int players = 32;
+    int rounds = 2000;
+    int size = 36;
+
+    printf("\nUDPLOAD-%s\nProtocol BZFS%s\n\n",
+           getAppVersion(), getProtocolVersion());
+
+    for (int arg = 1; arg < argc; arg += 2)
+    {
+        const char *opt = argv[arg];
+        if ((strcmp("-p", opt) != 0) && (strcmp("-r", opt) != 0) &&
+                (strcmp("-s", opt) != 0) && (strcmp("-b", opt) != 0))
+        {
+            printHelp(execName);
+            exit(strcmp("-h", opt) == 0 ? 0 : 1);
+        }
+        if ((arg + 1) >= argc)
+        {
+            printf("* Missing the %s parameter\n\n", opt);
+            printHelp(execName);
+            exit(1);
+        }
+        const int value = atoi(argv[arg + 1]);
+        if (strcmp("-p", opt) == 0)
+            players = value;
+        else if (strcmp("-r", opt) == 0)
+            rounds = value;
+        else if (strcmp("-b", opt) == 0)
+            burst = value;
+        else
+            size = value;
+    }
+    if ((players < 1) || (players > maxHandlers) || (rounds < 1) || (burst < 1) ||
+            (size < 0) || (size > MaxUDPPacketLen - 4))
+    {
+        printHelp(execName);
+        exit(1);
+    }
+
+    if (!setup(players))
+        exit(1);
+    printf("%d players, %d rounds, %d byte updates\n\n", players, rounds, size + 4);
+
+    std::vector<char> update(size + 1, 'u');
+    printf("receive:\n");
+    runReceive(false, rounds, &update[0], size);
+    runReceive(true, rounds, &update[0], size);
+    printf("send:\n");
+    runSend(false, rounds, &update[0], size);
+    runSend(true, rounds, &update[0], size);
+
+    return 0;
+}
+
+
+// Local Variables: ***
+// mode: C++ ***
+// tab-width: 4 ***
+// c-basic-offset: 4 ***
+// indent-tabs-mode: nil ***
+// End: ***
+// ex: shiftwidth=4 tabstop=4
@@ -6,7 +6,6 @@
 #include <stdexcept>
 #include <string>
 #include <array>
-#include <thread>
 
 class OpenAI : public bz_Plugin
 {
@@ -63,14 +62,28 @@ void broadcastMsg(std::string msg)
     bz_sendTextMessage(BZ_SERVER, BZ_ALLUSERS, msg.c_str());
 }
 
-void makeOpenAICall(std::string msg)
+// the runner takes a while, keep it off the main loop
+class OpenAICall : public bz_AsyncJob
 {
-    bz_debugMessage(0, "Message to server");
-    std::string cmd = "./openai_runner.py \"" + msg + "\"";
-    std::string output = exec(cmd.c_str());
-    bz_debugMessage(0, "Exec finished");
-    broadcastMsg(output);
-}
+public:
+    OpenAICall(const std::string &m) : msg(m) {}
+
+    virtual void Work()
+    {
+        std::string cmd = "./openai_runner.py \"" + msg + "\"";
+        output = exec(cmd.c_str());
+    }
+
+    virtual void Done()
+    {
+        bz_debugMessage(0, "Exec finished");
+        broadcastMsg(output);
+    }
+
+private:
+    std::string msg;
+    std::string output;
+};
 
 void OpenAI::Event(bz_EventData *eventData)
 {
@@ -89,8 +102,8 @@ void OpenAI::Event(bz_EventData *eventData)
 
                 if (strcmp(beginning.c_str(), "Server, ") == 0)
                 {
-                    std::thread t1(makeOpenAICall, msg);
-                    t1.detach();
+                    bz_debugMessage(0, "Message to server");
+                    bz_runAsync(new OpenAICall(msg), this);
                 }
             }
         }
@@ -104,14 +104,15 @@ const Obstacle* ShotStrategy::getFirstBuilding(const Ray& ray,
     }
 
     //check everything else
-    const ObsList* olist = COLLISIONMGR.rayTest (&ray, t);
+    const float* times;
+    const ObsList* olist = COLLISIONMGR.rayTestTimes (&ray, t, times);
 
     for (i = 0; i < (unsigned int)olist->count; i++)
     {
         const Obstacle* obs = olist->list[i];
         if (!obs->isShootThrough())
         {
-            const float timet = obs->intersect(ray);
+            const float timet = times[i];
             if (obs->getType() == Teleporter::getClassName())
             {
                 const Teleporter* tele = (const Teleporter*) obs;
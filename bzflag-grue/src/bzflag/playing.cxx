@@ -213,6 +213,8 @@ static std::string  worldUrl;
 static std::string  worldCachePath;
 static std::string  md5Digest;
 static uint32_t     worldPtr = 0;
+static uint32_t     worldAcked = 0;
+static uint32_t     worldWindow = 0;
 static char     *worldDatabase = NULL;
 static bool     isCacheTemp;
 static std::ostream *cacheOut = NULL;
@@ -1829,10 +1831,13 @@ void WorldDownLoader::askToBZFS()
 {
     HUDDialogStack::get()->setFailedMessage("Downloading World...");
     char message[MaxPacketLen];
-    // ask for world
-    nboPackUInt(message, 0);
-    serverLink->send(MsgGetWorld, sizeof(uint32_t), message);
+    // ask for world, and have the server send ahead if it can
+    void *buf = nboPackUInt(message, 0);
+    if (worldWindow > 0)
+        buf = nboPackUInt(buf, worldWindow);
+    serverLink->send(MsgGetWorld, (char*)buf - message, message);
     worldPtr = 0;
+    worldAcked = 0;
     if (cacheOut)
         delete cacheOut;
     cacheOut = FILEMGR.createDataOutStream(worldCachePath, true, true);
@@ -2065,6 +2070,16 @@ static void     handleServerMessage(bool human, uint16_t code,
         isCacheTemp = hexDigest[0] == 't';
         md5Digest = &hexDigest[1];
 
+        // newer servers say how much of the world they'll send ahead
+        worldWindow = 0;
+        const char *end = (const char*)memchr(hexDigest, 0, len);
+        if (end && (end + 1 + sizeof(uint32_t) <= hexDigest + len))
+        {
+            nboUnpackUInt((const char*)msg + (end + 1 - hexDigest), worldWindow);
+            if (worldWindow > uint32_t(MaxWorldWindow))
+                worldWindow = MaxWorldWindow;
+        }
+
         worldDownLoader->start(hexDigest);
         delete [] hexDigest;
         break;
@@ -2078,11 +2093,17 @@ static void     handleServerMessage(bool human, uint16_t code,
         bool last = processWorldChunk(buf, len - 4, bytesLeft);
         if (!last)
         {
-            char message[MaxPacketLen];
-            // ask for next chunk
             worldPtr += len - 4;
-            nboPackUInt(message, worldPtr);
-            serverLink->send(MsgGetWorld, sizeof(uint32_t), message);
+            // ask for the next chunk, or let the server know how far we
+            // got once half of the window has come in
+            if (worldWindow > 0 && worldPtr - worldAcked < worldWindow / 2)
+                break;
+            char message[MaxPacketLen];
+            void *msgBuf = nboPackUInt(message, worldPtr);
+            if (worldWindow > 0)
+                msgBuf = nboPackUInt(msgBuf, worldWindow);
+            serverLink->send(MsgGetWorld, (char*)msgBuf - message, message);
+            worldAcked = worldPtr;
             break;
         }
         if (cacheOut)
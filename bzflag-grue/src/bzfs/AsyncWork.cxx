@@ -0,0 +1,396 @@
+/* bzflag
+ * Copyright (c) 1993-2021 Tim Riker
+ *
+ * This package is free software;  you can redistribute it and/or
+ * modify it under the terms of the license found in the file
+ * named COPYING that should have accompanied this file.
+ *
+ * THIS PACKAGE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+/* interface header */
+#include "AsyncWork.h"
+
+/* system implementation headers */
+#ifndef _WIN32
+#  include <fcntl.h>
+#  include <unistd.h>
+#endif
+#if defined(__linux__)
+#  include <sys/eventfd.h>
+#endif
+
+/* common implementation headers */
+#include "bzfio.h"
+#include "TimeKeeper.h"
+
+AsyncWork asyncWork;
+
+// the task whose work() this worker thread is running
+static thread_local AsyncWork::Task *currentTask = NULL;
+
+AsyncWork::AsyncWork() : stopping(false), working(0), completed(NULL), outstanding(0),
+    wakeFD(-1), wakeWriteFD(-1)
+{
+}
+
+AsyncWork::~AsyncWork()
+{
+    stop();
+}
+
+int AsyncWork::init()
+{
+    if (wakeFD != -1)
+        return wakeFD;
+
+#if defined(__linux__)
+    wakeFD = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    wakeWriteFD = wakeFD;
+#elif !defined(_WIN32)
+    int fds[2];
+    if (pipe(fds) == 0)
+    {
+        for (int i = 0; i < 2; i++)
+        {
+            fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL, 0) | O_NONBLOCK);
+            fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+        }
+        wakeFD = fds[0];
+        wakeWriteFD = fds[1];
+    }
+#endif
+    if (wakeFD == -1)
+        logDebugMessage(2,"no wakeup descriptor for async work, polling for it\n");
+    return wakeFD;
+}
+
+void AsyncWork::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(jobMutex);
+        stopping = true;
+    }
+    jobReady.notify_all();
+
+    // a task stuck in work() must not keep the server from exiting
+    const TimeKeeper start = TimeKeeper::getCurrent();
+    while (!workers.empty() && working > 0 && TimeKeeper::getCurrent() - start < 2.0)
+        TimeKeeper::sleep(0.01f);
+    const bool stuck = (!workers.empty() && working > 0);
+    if (stuck)
+        logDebugMessage(1,"%d async tasks are still running, not waiting for them\n",
+                        (int)working);
+    for (size_t i = 0; i < workers.size(); i++)
+    {
+        if (stuck)
+            workers[i].detach();
+        else
+            workers[i].join();
+    }
+    workers.clear();
+
+    {
+        std::lock_guard<std::mutex> lock(jobMutex);
+        for (size_t i = 0; i < jobs.size(); i++)
+            delete jobs[i];
+        jobs.clear();
+        owned.clear();
+        closed.clear();
+    }
+
+    Task *task = completed.exchange(NULL);
+    while (task)
+    {
+        Task *next = task->next;
+        delete task;
+        task = next;
+    }
+    outstanding = 0;
+
+#ifndef _WIN32
+    if (wakeWriteFD != -1 && wakeWriteFD != wakeFD)
+        ::close(wakeWriteFD);
+    if (wakeFD != -1)
+        ::close(wakeFD);
+#endif
+    wakeFD = wakeWriteFD = -1;
+}
+
+bool AsyncWork::post(Task *task)
+{
+    if (!task)
+        return false;
+    task->posted = true;
+    if (!track(task))
+        return false;
+    outstanding++;
+    complete(task);
+    return true;
+}
+
+bool AsyncWork::run(Task *task)
+{
+    if (!task)
+        return false;
+    if (!track(task))
+        return false;
+    outstanding++;
+
+    {
+        std::lock_guard<std::mutex> lock(jobMutex);
+        if (!stopping)
+        {
+            if (workers.empty())
+                startWorkers();
+            jobs.push_back(task);
+            task = NULL;
+        }
+    }
+
+    if (task)
+    {
+        // shutting down, there's nobody left to do it for us
+        task->work();
+        complete(task);
+        return true;
+    }
+    jobReady.notify_one();
+    return true;
+}
+
+void AsyncWork::startWorkers()
+{
+    // the work is expected to sleep on i/o, not to burn cpu
+    unsigned int count = std::thread::hardware_concurrency();
+    if (count < 2)
+        count = 2;
+    else if (count > 4)
+        count = 4;
+
+    for (unsigned int i = 0; i < count; i++)
+        workers.push_back(std::thread(&AsyncWork::workerLoop, this));
+    logDebugMessage(2,"started %d async worker threads\n", count);
+}
+
+void AsyncWork::workerLoop()
+{
+    while (true)
+    {
+        Task *task;
+        {
+            std::unique_lock<std::mutex> lock(jobMutex);
+            while (!stopping && jobs.empty())
+                jobReady.wait(lock);
+            if (stopping)
+                return;
+            task = jobs.front();
+            jobs.pop_front();
+            working++;
+        }
+
+        currentTask = task;
+        try
+        {
+            task->work();
+        }
+        catch (...)
+        {
+            // an exception must not take the server down with it, done()
+            // still gets to report whatever the task managed to do
+        }
+        currentTask = NULL;
+
+        {
+            std::lock_guard<std::mutex> lock(jobMutex);
+            working--;
+            // stop() gave up on us, there's nobody left to hand it to
+            if (stopping)
+            {
+                delete task;
+                return;
+            }
+        }
+        complete(task);
+    }
+}
+
+void AsyncWork::complete(Task *task)
+{
+    Task *head = completed.load(std::memory_order_relaxed);
+    do
+        task->next = head;
+    while (!completed.compare_exchange_weak(head, task, std::memory_order_release,
+                                            std::memory_order_relaxed));
+
+    // only the first one needs to wake the main loop, the rest ride along
+    if (head || wakeWriteFD == -1)
+        return;
+
+#if defined(__linux__)
+    const uint64_t one = 1;
+    ssize_t written = write(wakeWriteFD, &one, sizeof(one));
+#elif !defined(_WIN32)
+    const char one = 1;
+    ssize_t written = write(wakeWriteFD, &one, sizeof(one));
+#endif
+#ifndef _WIN32
+    // a full counter or pipe is as awake as it gets
+    (void)written;
+#endif
+}
+
+bool AsyncWork::track(Task *task)
+{
+    if (!task->owner && !currentTask)
+        return true;
+    std::lock_guard<std::mutex> lock(jobMutex);
+    // a cancelled task's owner may be gone already
+    if (currentTask && currentTask->cancelled)
+        return false;
+    if (!task->owner)
+        return true;
+    if (closed.find(task->owner) != closed.end())
+        return false;
+    owned.insert(task);
+    return true;
+}
+
+bool AsyncWork::isBusy(const void *owner)
+{
+    std::lock_guard<std::mutex> lock(jobMutex);
+    for (std::set<Task*>::const_iterator itr = owned.begin(); itr != owned.end(); ++itr)
+    {
+        if ((*itr)->owner == owner && !(*itr)->cancelled)
+            return true;
+    }
+    return false;
+}
+
+void AsyncWork::clearWakeup()
+{
+    if (wakeFD == -1)
+        return;
+
+#if defined(__linux__)
+    uint64_t count;
+    ssize_t got = read(wakeFD, &count, sizeof(count));
+    (void)got;
+#elif !defined(_WIN32)
+    char buf[64];
+    while (read(wakeFD, buf, sizeof(buf)) > 0)
+        ;
+#endif
+}
+
+float AsyncWork::getWaitTime(float maxWait) const
+{
+    if (completed.load(std::memory_order_relaxed))
+        return 0.0f;
+    // nothing can wake us, have a look every now and then
+    if (wakeFD == -1 && outstanding > 0 && maxWait > 0.05f)
+        return 0.05f;
+    return maxWait;
+}
+
+void AsyncWork::processCompleted()
+{
+    // the main loop clears the wakeup before calling us, so whatever gets
+    // pushed after the exchange below wakes it up again
+    if (!completed.load(std::memory_order_relaxed))
+        return;
+    Task *task = completed.exchange(NULL, std::memory_order_acquire);
+
+    // they were pushed newest first
+    Task *ordered = NULL;
+    while (task)
+    {
+        Task *next = task->next;
+        task->next = ordered;
+        ordered = task;
+        task = next;
+    }
+
+    while (ordered)
+    {
+        Task *next = ordered->next;
+        bool dropped = false;
+        if (ordered->owner)
+        {
+            std::lock_guard<std::mutex> lock(jobMutex);
+            owned.erase(ordered);
+            // what was posted before finish() is dropped, not run
+            dropped = ordered->cancelled || (ordered->posted &&
+                                             closed.find(ordered->owner) != closed.end());
+        }
+        if (!dropped)
+            ordered->done();
+        delete ordered;
+        outstanding--;
+        ordered = next;
+    }
+}
+
+bool AsyncWork::finish(const void *owner, float timeout)
+{
+    {
+        std::lock_guard<std::mutex> lock(jobMutex);
+        closed.insert(owner);
+    }
+
+    const TimeKeeper start = TimeKeeper::getCurrent();
+    while (true)
+    {
+        clearWakeup();
+        processCompleted();
+        if (!isBusy(owner))
+            return true;
+        if (TimeKeeper::getCurrent() - start >= timeout)
+            break;
+        TimeKeeper::sleep(0.01f);
+    }
+
+    // what hasn't started yet never will, the rest finishes unseen
+    std::vector<Task*> dropped;
+    {
+        std::lock_guard<std::mutex> lock(jobMutex);
+        for (std::deque<Task*>::iterator itr = jobs.begin(); itr != jobs.end(); )
+        {
+            if ((*itr)->owner == owner)
+            {
+                owned.erase(*itr);
+                dropped.push_back(*itr);
+                itr = jobs.erase(itr);
+            }
+            else
+                ++itr;
+        }
+        for (std::set<Task*>::iterator itr = owned.begin(); itr != owned.end(); ++itr)
+        {
+            if ((*itr)->owner == owner)
+                (*itr)->cancelled = true;
+        }
+    }
+    for (size_t i = 0; i < dropped.size(); i++)
+        delete dropped[i];
+    outstanding -= (int)dropped.size();
+    logDebugMessage(1,"cancelled async tasks that took longer than %.1f seconds\n",
+                    timeout);
+    return false;
+}
+
+void AsyncWork::forget(const void *owner)
+{
+    std::lock_guard<std::mutex> lock(jobMutex);
+    closed.erase(owner);
+}
+
+// Local Variables: ***
+// mode: C++ ***
+// tab-width: 4 ***
+// c-basic-offset: 4 ***
+// indent-tabs-mode: nil ***
+// End: ***
+// ex: shiftwidth=4 tabstop=4
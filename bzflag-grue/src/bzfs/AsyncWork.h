@@ -0,0 +1,150 @@
+/* bzflag
+ * Copyright (c) 1993-2021 Tim Riker
+ *
+ * This package is free software;  you can redistribute it and/or
+ * modify it under the terms of the license found in the file
+ * named COPYING that should have accompanied this file.
+ *
+ * THIS PACKAGE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef __ASYNCWORK_H__
+#define __ASYNCWORK_H__
+
+#include "common.h"
+
+/* system interface headers */
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+/** AsyncWork lets code that must not block the main loop hand blocking
+    work to a small pool of worker threads, and lets any thread hand
+    results back to the main loop.
+
+    A task's work() runs on a worker thread, its done() later runs on the
+    main thread from processCompleted().  Finished tasks are pushed onto a
+    lock free list that only the main thread takes from; the first push
+    onto an empty list writes to a wakeup descriptor, registered with the
+    poller, so a sleeping main loop notices right away.
+
+    Only post() and run() may be called from other threads.
+
+    A task may name an owner, such as the plugin it runs code of.  Before
+    the owner goes away finish() drops what it posted and waits for what
+    it runs; tasks that take too long are cancelled, their done() never
+    runs.  From then on until forget() the owner's new tasks are turned
+    away, so none can slip in while its code is being unloaded, and so is
+    anything a cancelled task tries to start, for good.
+*/
+class AsyncWork
+{
+public:
+    class Task
+    {
+    public:
+        Task(const void *_owner = NULL) : next(NULL), owner(_owner),
+            posted(false), cancelled(false) {}
+        virtual ~Task() {}
+
+        /// worker thread, nothing of the server may be touched here
+        virtual void  work() {}
+        /// main thread, the task is deleted afterwards
+        virtual void  done() = 0;
+
+    private:
+        friend class AsyncWork;
+        Task      *next;
+        const void    *owner;
+        bool      posted;
+        bool      cancelled;
+    };
+
+    AsyncWork();
+    ~AsyncWork();
+
+    /// create the wakeup descriptor, -1 when the platform has none
+    int       init();
+    /// stop the workers, unfinished tasks are dropped
+    void      stop();
+
+    /// call done() on the main thread, from any thread.  false when the
+    /// task's owner is going away, the task is then left to the caller
+    bool      post(Task *task);
+    /// call work() on a worker thread, then done() on the main thread.
+    /// false like post()
+    bool      run(Task *task);
+
+    int       getWakeFD() const
+    {
+        return wakeFD;
+    }
+    /// the wakeup descriptor was reported readable
+    void      clearWakeup();
+    /// seconds the main loop may sleep without missing a completion
+    float     getWaitTime(float maxWait) const;
+    /// call done() for everything finished so far, main thread only
+    void      processCompleted();
+    /// wait until the owner's tasks are done, main thread only.  after
+    /// timeout seconds the rest is cancelled and false returned, the
+    /// owner's code may then still be running on a worker thread
+    bool      finish(const void *owner, float timeout);
+    /// the owner finish() was called for is gone, another one may come
+    /// to have its address.  main thread only
+    void      forget(const void *owner);
+
+    /// statistics
+    int       getOutstanding() const
+    {
+        return outstanding;
+    }
+    int       getThreadCount() const
+    {
+        return (int)workers.size();
+    }
+
+private:
+    void      startWorkers();
+    void      workerLoop();
+    void      complete(Task *task);
+    bool      track(Task *task);
+    bool      isBusy(const void *owner);
+
+    // workers
+    std::vector<std::thread>  workers;
+    std::deque<Task*> jobs;
+    std::mutex    jobMutex;
+    std::condition_variable   jobReady;
+    bool      stopping;
+    std::atomic<int>  working;
+
+    // unfinished tasks that have an owner, under jobMutex
+    std::set<Task*>   owned;
+    // owners between finish() and forget(), under jobMutex
+    std::set<const void*> closed;
+
+    // completed tasks, newest first
+    std::atomic<Task*>    completed;
+    std::atomic<int>  outstanding;
+
+    int       wakeFD;
+    int       wakeWriteFD;
+};
+
+extern AsyncWork asyncWork;
+
+#endif
+
+// Local Variables: ***
+// mode: C++ ***
+// tab-width: 4 ***
+// c-basic-offset: 4 ***
+// indent-tabs-mode: nil ***
+// End: ***
+// ex: shiftwidth=4 tabstop=4
@@ -14,8 +14,6 @@
 #include "BZWReader.h"
 
 // implementation-specific system headers
-#include <fstream>
-#include <sstream>
 #include <ctype.h>
 
 // implementation-specific bzflag headers
@@ -50,18 +48,22 @@
 #include "BaseBuilding.h"
 #include "TextUtils.h"
 #include "StateDatabase.h"
+#include "md5.h"
 
 // bzfs specific headers
 #include "bzfs.h"
 
 
 BZWReader::BZWReader(std::string filename) : cURLManager(), location(filename),
-    input(NULL)
+    input(NULL), cacheable(true)
 {
     static const std::string httpProtocol("http://");
     static const std::string ftpProtocol("ftp://");
     static const std::string fileProtocol("file:/");
 
+    TimeKeeper startTime = TimeKeeper::getCurrent();
+    stageTimes.load = stageTimes.parse = stageTimes.build = 0.0;
+
     errorHandler = new BZWError(location);
 
     if ((filename.substr(0, httpProtocol.size()) == httpProtocol)
@@ -70,10 +72,11 @@ BZWReader::BZWReader(std::string filename) : cURLManager(), location(filename),
     {
         setURL(location);
         performWait();
-        input = new std::istringstream(httpData);
+        source.takeData(httpData);
     }
     else
-        input = new std::ifstream(filename.c_str(), std::ios::in);
+        source.openFile(filename);
+    input = new std::istream(&source);
 
     // .BZW is the official worldfile extension, warn for others
     if ((filename.length() < 4) ||
@@ -84,8 +87,10 @@ BZWReader::BZWReader(std::string filename) : cURLManager(), location(filename),
                                   "world file extension is not .bzw, trying to load anyway"), 0);
     }
 
-    if (input->peek() == EOF)
+    if (source.atEnd())
         errorHandler->fatalError(std::string("could not find bzflag world file"), 0);
+
+    stageTimes.load = TimeKeeper::getCurrent() - startTime;
 }
 
 
@@ -105,32 +110,6 @@ void BZWReader::finalization(char *data, unsigned int length, bool good)
         httpData = "";
 }
 
-void BZWReader::readToken(char *buffer, int n)
-{
-    int c = -1;
-
-    // skip whitespace
-    while (input->good() && (c = input->get()) != -1 && isspace(c) && c != '\n')
-        ;
-
-    // read up to whitespace or n - 1 characters into buffer
-    int i = 0;
-    if (c != -1 && c != '\n')
-    {
-        buffer[i++] = c;
-        while (input->good() && i < n - 1 && (c = input->get()) != -1 && !isspace(c))
-            buffer[i++] = (char)c;
-    }
-
-    // terminate string
-    buffer[i] = 0;
-
-    // put back last character we didn't use
-    if (c != -1 && isspace(c))
-        input->putback(c);
-}
-
-
 static bool parseNormalObject(const char* token, WorldFileObject** object)
 {
     WorldFileObject* tmpObj = NULL;
@@ -187,7 +166,7 @@ bool BZWReader::readWorldStream(std::vector<WorldFileObject*>& wlist,
                                 GroupDefinition* groupDef)
 {
     // make sure input is valid
-    if (input->peek() == EOF)
+    if (source.atEnd())
     {
         errorHandler->fatalError(std::string("unexpected EOF"), 0);
         return false;
@@ -204,9 +183,14 @@ bool BZWReader::readWorldStream(std::vector<WorldFileObject*>& wlist,
     std::string customObject;
     std::vector<std::string>  customLines;
 
+    // where the objects that have to be kept as text start
+    size_t objectStart = 0;
+    size_t newObjectStart = 0;
+    bool keepObject = false;
+
     bool gotWorld = false;
 
-    while (!input->eof() && !input->fail() && input->good())
+    while (input->good() && !source.atEnd())
     {
         // watch out for starting a new object when one is already in progress
         if (newObject)
@@ -224,11 +208,13 @@ bool BZWReader::readWorldStream(std::vector<WorldFileObject*>& wlist,
                 }
             }
             object = newObject;
+            objectStart = newObjectStart;
             newObject = NULL;
         }
 
         // read first token but do not skip newlines
-        readToken(buffer, sizeof(buffer));
+        const size_t lineStart = source.getOffset();
+        source.readToken(buffer, sizeof(buffer));
         if (strcmp(buffer, "") == 0)
         {
             // ignore blank line
@@ -257,7 +243,10 @@ bool BZWReader::readWorldStream(std::vector<WorldFileObject*>& wlist,
                         delete object;
                     }
                     else
+                    {
+                        keepObject = !object->usesDatabase();
                         wlist.push_back(object);
+                    }
                 }
                 else if (customObject.size())
                 {
@@ -267,6 +256,7 @@ bool BZWReader::readWorldStream(std::vector<WorldFileObject*>& wlist,
                         data.data.push_back(customLines[i]);
                     customObjectMap[customObject]->MapObject(bz_ApiString(customObject),&data);
                     object = NULL;
+                    cacheable = false;
                 }
                 object = NULL;
             }
@@ -293,7 +283,7 @@ bool BZWReader::readWorldStream(std::vector<WorldFileObject*>& wlist,
             }
             else
             {
-                readToken(buffer, sizeof(buffer));
+                source.readToken(buffer, sizeof(buffer));
                 if (strlen(buffer) > 0)
                 {
                     if (OBSTACLEMGR.findGroupDef(buffer) != NULL)
@@ -328,7 +318,7 @@ bool BZWReader::readWorldStream(std::vector<WorldFileObject*>& wlist,
         }
         else if (strcasecmp(buffer, "group") == 0)
         {
-            readToken(buffer, sizeof(buffer));
+            source.readToken(buffer, sizeof(buffer));
             if (strlen(buffer) <= 0)
             {
                 errorHandler->warning(
@@ -339,7 +329,7 @@ bool BZWReader::readWorldStream(std::vector<WorldFileObject*>& wlist,
         }
         else if (strcasecmp(buffer, "teleporter") == 0)
         {
-            readToken(buffer, sizeof(buffer));
+            source.readToken(buffer, sizeof(buffer));
             newObject = new CustomGate(buffer);
 
         }
@@ -349,10 +339,11 @@ bool BZWReader::readWorldStream(std::vector<WorldFileObject*>& wlist,
         else if (strcasecmp(buffer, "include") == 0)
         {
             // NOTE: intentionally undocumented  (at the moment)
-            readToken(buffer, sizeof(buffer));
+            source.readToken(buffer, sizeof(buffer));
             std::string incName = buffer;
             if (object == NULL)
             {
+                cacheable = false;
                 // FIXME - check for recursion
                 //       - better filename handling ("", spaces, and / vs. \\)
                 //       - make relative names work from the base file location
@@ -448,11 +439,22 @@ bool BZWReader::readWorldStream(std::vector<WorldFileObject*>& wlist,
             // return false;
         }
 
+        if (newObject)
+            newObjectStart = lineStart;
+
         // discard remainder of line
-        while (input->good() && input->peek() != '\n')
-            input->get(buffer, sizeof(buffer));
-        input->getline(buffer, sizeof(buffer));
+        if (input->good())
+            source.skipLine();
         ++line;
+
+        if (keepObject)
+        {
+            serverObjects.append(source.getData() + objectStart,
+                                 source.getOffset() - objectStart);
+            if (serverObjects[serverObjects.size() - 1] != '\n')
+                serverObjects += '\n';
+            keepObject = false;
+        }
     }
 
     bool retval = true;
@@ -474,6 +476,30 @@ bool BZWReader::readWorldStream(std::vector<WorldFileObject*>& wlist,
 }
 
 
+static void makeLocalBases()
+{
+    const ObstacleList& baseList = OBSTACLEMGR.getBases();
+    for (unsigned int i = 0; i < baseList.size(); i++)
+    {
+        const BaseBuilding* base = (const BaseBuilding*) baseList[i];
+        TeamColor color = (TeamColor)base->getTeam();
+        if (bases.find(color) == bases.end())
+            bases[color] = TeamBases((TeamColor)color);
+        bases[color].addBase(base->getPosition(), base->getSize(),
+                             base->getRotation());
+    }
+}
+
+
+std::string BZWReader::getDigest() const
+{
+    MD5 md5;
+    md5.update((const unsigned char*)source.getData(), source.getSize());
+    md5.finalize();
+    return md5.hexdigest();
+}
+
+
 WorldInfo* BZWReader::defineWorldFromFile()
 {
     // create world object
@@ -485,6 +511,7 @@ WorldInfo* BZWReader::defineWorldFromFile()
     }
 
     // read file
+    TimeKeeper startTime = TimeKeeper::getCurrent();
     std::vector<WorldFileObject*> list;
     GroupDefinition* worldDef = const_cast<GroupDefinition*>(OBSTACLEMGR.getWorld());
     if (!readWorldStream(list, worldDef))
@@ -494,6 +521,8 @@ WorldInfo* BZWReader::defineWorldFromFile()
         delete myWorld;
         return NULL;
     }
+    TimeKeeper parsedTime = TimeKeeper::getCurrent();
+    stageTimes.parse = parsedTime - startTime;
 
     if (!BZDB.isTrue("noWalls"))
         makeWalls();
@@ -502,27 +531,70 @@ WorldInfo* BZWReader::defineWorldFromFile()
     OBSTACLEMGR.makeWorld();
 
     // make local bases
-    unsigned int i;
-    const ObstacleList& baseList = OBSTACLEMGR.getBases();
-    for (i = 0; i < baseList.size(); i++)
-    {
-        const BaseBuilding* base = (const BaseBuilding*) baseList[i];
-        TeamColor color = (TeamColor)base->getTeam();
-        if (bases.find(color) == bases.end())
-            bases[color] = TeamBases((TeamColor)color);
-        bases[color].addBase(base->getPosition(), base->getSize(),
-                             base->getRotation());
-    }
+    makeLocalBases();
 
     // add objects
     const unsigned int n = list.size();
-    for (i = 0; i < n; ++i)
+    for (unsigned int i = 0; i < n; ++i)
         list[i]->writeToWorld(myWorld);
 
     // clean up
     emptyWorldFileObjectList(list);
     myWorld->finishWorld();
 
+    stageTimes.build = TimeKeeper::getCurrent() - parsedTime;
+    logDebugMessage(2,"%s: %lu bytes loaded in %.3f, parsed in %.3f, built in %.3f seconds\n",
+                    location.c_str(), (unsigned long)source.getSize(),
+                    stageTimes.load, stageTimes.parse, stageTimes.build);
+
+    return myWorld;
+}
+
+
+WorldInfo* BZWReader::defineWorldFromDatabase(const void *database, unsigned int size,
+        const std::string& objects)
+{
+    WorldInfo *myWorld = new WorldInfo;
+
+    // the remaining objects come first, as they did in the file, so that
+    // the world block sets up BZDB before anything else
+    TimeKeeper startTime = TimeKeeper::getCurrent();
+    std::string text = objects;
+    source.takeData(text);
+    input->clear();
+    std::vector<WorldFileObject*> list;
+    GroupDefinition* worldDef = const_cast<GroupDefinition*>(OBSTACLEMGR.getWorld());
+    if (!objects.empty() && !readWorldStream(list, worldDef))
+    {
+        emptyWorldFileObjectList(list);
+        delete myWorld;
+        return NULL;
+    }
+    TimeKeeper parsedTime = TimeKeeper::getCurrent();
+    stageTimes.parse = parsedTime - startTime;
+
+    // the obstacles, walls included, and what goes with them
+    if (!myWorld->unpackDatabase(database, size))
+    {
+        emptyWorldFileObjectList(list);
+        delete myWorld;
+        return NULL;
+    }
+    OBSTACLEMGR.makeWorld();
+
+    makeLocalBases();
+
+    const unsigned int n = list.size();
+    for (unsigned int i = 0; i < n; ++i)
+        list[i]->writeToWorld(myWorld);
+
+    emptyWorldFileObjectList(list);
+    myWorld->finishWorld();
+
+    stageTimes.build = TimeKeeper::getCurrent() - parsedTime;
+    logDebugMessage(2,"%s: unpacked %u bytes in %.3f seconds\n",
+                    location.c_str(), size, stageTimes.build);
+
     return myWorld;
 }
 
@@ -27,6 +27,9 @@
 #include "BZWError.h"
 #include "cURLManager.h"
 
+/* bzfs headers */
+#include "BZWSource.h"
+
 class WorldFileObject;
 class WorldInfo;
 
@@ -38,18 +41,53 @@ public:
 
     // external interface
     WorldInfo *defineWorldFromFile();
+    // rebuild a world from its packed database and the objects that
+    // aren't in it, as saved from an earlier defineWorldFromFile()
+    WorldInfo *defineWorldFromDatabase(const void *database, unsigned int size,
+                                       const std::string& objects);
+
+    // MD5 of the world file text
+    std::string getDigest() const;
+    // false if the world depends on more than its own text
+    bool isCacheable() const
+    {
+        return cacheable;
+    }
+    // the text of the objects that go into the world but not into its
+    // packed database
+    const std::string& getServerObjects() const
+    {
+        return serverObjects;
+    }
+
+    // seconds spent in each stage of the last defineWorldFromFile()
+    struct StageTimes
+    {
+        double load;    // mapping or downloading the file
+        double parse;   // reading the objects
+        double build;   // making the world out of them
+    };
+    const StageTimes& getStageTimes() const
+    {
+        return stageTimes;
+    }
 
 private:
     // functions for internal use
-    void readToken(char *buffer, int n);
     bool readWorldStream(std::vector<WorldFileObject*>& wlist,
                          class GroupDefinition* groupDef);
     void finalization(char *data, unsigned int length, bool good);
 
     // stream to open
     std::string location;
+    BZWSource source;
     std::istream *input;
 
+    StageTimes stageTimes;
+
+    bool cacheable;
+    std::string serverObjects;
+
     // data/dependent objects
     BZWError *errorHandler;
 
@@ -0,0 +1,325 @@
+/* bzflag
+ * Copyright (c) 1993-2021 Tim Riker
+ *
+ * This package is free software;  you can redistribute it and/or
+ * modify it under the terms of the license found in the file
+ * named COPYING that should have accompanied this file.
+ *
+ * THIS PACKAGE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+// interface header
+#include "BZWSource.h"
+
+// implementation-specific system headers
+#include <fstream>
+#include <sstream>
+#include <ctype.h>
+#include <string.h>
+#ifndef _WIN32
+#  include <fcntl.h>
+#  include <unistd.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#endif
+
+
+BZWSource::BZWSource() : begin(NULL), end(NULL), size(0), backChar(0),
+    backResume(NULL), mapping(NULL)
+{
+    setData(NULL, 0);
+}
+
+
+BZWSource::~BZWSource()
+{
+    release();
+}
+
+
+void BZWSource::release()
+{
+#ifndef _WIN32
+    if (mapping)
+        munmap(mapping, size);
+#endif
+    mapping = NULL;
+    storage.clear();
+    setData(NULL, 0);
+}
+
+
+void BZWSource::setData(const char *data, size_t length)
+{
+    begin = data;
+    end = data + length;
+    size = length;
+    backResume = NULL;
+    // nothing ever writes through these, putbacks that would are diverted
+    setg(const_cast<char*>(begin), const_cast<char*>(begin), const_cast<char*>(end));
+}
+
+
+bool BZWSource::openFile(const std::string& filename)
+{
+    release();
+
+#ifndef _WIN32
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+    {
+        void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED)
+        {
+#ifdef MADV_SEQUENTIAL
+            madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+#endif
+            close(fd);
+            mapping = map;
+            setData((const char*)map, (size_t)st.st_size);
+            return true;
+        }
+    }
+    close(fd);
+#endif
+
+    // no mapping, read it all in
+    std::ifstream file(filename.c_str(), std::ios::in | std::ios::binary);
+    if (!file)
+        return false;
+    std::ostringstream data;
+    data << file.rdbuf();
+    storage = data.str();
+    setData(storage.data(), storage.size());
+    return true;
+}
+
+
+void BZWSource::takeData(std::string& data)
+{
+    release();
+    storage.swap(data);
+    setData(storage.data(), storage.size());
+}
+
+
+size_t BZWSource::getOffset() const
+{
+    if (backResume)
+        return backResume - begin - 1;
+    return gptr() - begin;
+}
+
+
+bool BZWSource::atEnd()
+{
+    return sgetc() == traits_type::eof();
+}
+
+
+BZWSource::int_type BZWSource::underflow()
+{
+    // done with the putback character, back to the text
+    if (backResume)
+    {
+        setg(const_cast<char*>(begin), const_cast<char*>(backResume),
+             const_cast<char*>(end));
+        backResume = NULL;
+    }
+    if (gptr() < egptr())
+        return traits_type::to_int_type(*gptr());
+    return traits_type::eof();
+}
+
+
+BZWSource::int_type BZWSource::pbackfail(int_type c)
+{
+    // the text is read only, so a character that differs from what was
+    // read gets a buffer of its own
+    if (traits_type::eq_int_type(c, traits_type::eof()) || backResume)
+        return traits_type::eof();
+    backResume = gptr();
+    backChar = traits_type::to_char_type(c);
+    setg(&backChar, &backChar, &backChar + 1);
+    return c;
+}
+
+
+void BZWSource::readToken(char *buffer, int n)
+{
+    const int_type eof = traits_type::eof();
+    int_type c = eof;
+
+    // skip whitespace
+    while ((c = sbumpc()) != eof && isspace(c) && c != '\n')
+        ;
+
+    // read up to whitespace or n - 1 characters into buffer
+    int i = 0;
+    if (c != eof && c != '\n')
+    {
+        buffer[i++] = (char)c;
+        while (i < n - 1 && (c = sbumpc()) != eof && !isspace(c))
+            buffer[i++] = (char)c;
+    }
+
+    // terminate string
+    buffer[i] = 0;
+
+    // put back last character we didn't use
+    if (c != eof && isspace(c))
+        sungetc();
+}
+
+
+void BZWSource::skipLine()
+{
+    while (sgetc() != traits_type::eof())
+    {
+        char *next = gptr();
+        char *last = egptr();
+        char *newline = (char*)memchr(next, '\n', last - next);
+        if (newline)
+        {
+            setg(eback(), newline + 1, last);
+            return;
+        }
+        setg(eback(), last, last);
+    }
+}
+
+
+bool BZWSource::parseFloat(float &value)
+{
+    // exact powers of ten, any float product or quotient with them is
+    // rounded just like strtof() would round the decimal
+    static const float powersOfTen[] =
+    {
+        1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f
+    };
+
+    if (backResume)
+        return false;
+
+    const char *p = gptr();
+    const char *last = egptr();
+
+    bool negative = false;
+    if (p < last && (*p == '-' || *p == '+'))
+    {
+        negative = (*p == '-');
+        p++;
+    }
+
+    unsigned int mantissa = 0;
+    int digits = 0;
+    int fraction = 0;
+    for (; p < last && isdigit((unsigned char)*p); p++, digits++)
+    {
+        mantissa = mantissa * 10 + (*p - '0');
+        if (mantissa > (1 << 24))
+            return false;
+    }
+    if (p < last && *p == '.')
+    {
+        for (p++; p < last && isdigit((unsigned char)*p); p++, digits++, fraction++)
+        {
+            mantissa = mantissa * 10 + (*p - '0');
+            if (mantissa > (1 << 24) || fraction >= 10)
+                return false;
+        }
+    }
+
+    // exponents, oddities, and numbers at the very end go the slow way
+    if (digits == 0 || p >= last || !isspace((unsigned char)*p))
+        return false;
+
+    value = (float)mantissa;
+    if (fraction)
+        value /= powersOfTen[fraction];
+    if (negative)
+        value = -value;
+
+    setg(eback(), const_cast<char*>(p), egptr());
+    return true;
+}
+
+
+bool BZWSource::readFloats(std::istream& input, float *values, int count)
+{
+    BZWSource *source = dynamic_cast<BZWSource*>(input.rdbuf());
+
+    for (int i = 0; i < count; i++)
+    {
+        if (source && input.good())
+        {
+            int_type c;
+            while ((c = source->sgetc()) != traits_type::eof() && isspace(c))
+                source->sbumpc();
+            if (source->parseFloat(values[i]))
+                continue;
+        }
+        if (!(input >> values[i]))
+            return false;
+    }
+    return true;
+}
+
+
+bool BZWSource::readIntLine(std::istream& input, std::vector<int>& list)
+{
+    BZWSource *source = dynamic_cast<BZWSource*>(input.rdbuf());
+    if (!source || !input.good() || source->backResume)
+        return false;
+
+    const char *p = source->gptr();
+    const char *newline = (const char*)memchr(p, '\n', source->egptr() - p);
+    if (!newline)
+        return false;
+
+    list.clear();
+    while (true)
+    {
+        while (p < newline && isspace((unsigned char)*p))
+            p++;
+        if (p == newline)
+            break;
+
+        bool negative = false;
+        if (*p == '-' || *p == '+')
+        {
+            negative = (*p == '-');
+            p++;
+        }
+        int value = 0;
+        int digits = 0;
+        for (; p < newline && isdigit((unsigned char)*p) && digits < 9; p++, digits++)
+            value = value * 10 + (*p - '0');
+
+        // leave anything unusual to the istream
+        if (digits == 0 || (p < newline && !isspace((unsigned char)*p)))
+        {
+            list.clear();
+            return false;
+        }
+        list.push_back(negative ? -value : value);
+    }
+
+    source->setg(source->eback(), const_cast<char*>(newline), source->egptr());
+    return true;
+}
+
+
+// Local Variables: ***
+// mode: C++ ***
+// tab-width: 4 ***
+// c-basic-offset: 4 ***
+// indent-tabs-mode: nil ***
+// End: ***
+// ex: shiftwidth=4 tabstop=4
@@ -0,0 +1,100 @@
+/* bzflag
+ * Copyright (c) 1993-2021 Tim Riker
+ *
+ * This package is free software;  you can redistribute it and/or
+ * modify it under the terms of the license found in the file
+ * named COPYING that should have accompanied this file.
+ *
+ * THIS PACKAGE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef __BZWSOURCE_H__
+#define __BZWSOURCE_H__
+
+// bzflag common header
+#include "common.h"
+
+// system headers
+#include <streambuf>
+#include <istream>
+#include <string>
+#include <vector>
+
+/** BZWSource holds the text of a world file and hands it out as a
+    std::streambuf, without copying it.  Files are mapped into memory
+    where the platform allows, downloaded worlds are read straight from
+    the download buffer.
+
+    The object parsers keep reading through std::istream, but the token
+    and line scanning of BZWReader, and the number lists that make up
+    most of a mesh, go directly to the memory.  Anything that doesn't
+    look like a plain number is left to the istream, so both paths
+    accept exactly the same input.
+*/
+class BZWSource : public std::streambuf
+{
+public:
+    BZWSource();
+    ~BZWSource();
+
+    /// map or read the file, false if it can't be opened
+    bool      openFile(const std::string& filename);
+    /// use the contents of data, which is emptied
+    void      takeData(std::string& data);
+
+    const char    *getData() const
+    {
+        return begin;
+    }
+    size_t    getSize() const
+    {
+        return size;
+    }
+    /// how far into the text reading has got
+    size_t    getOffset() const;
+    bool      atEnd();
+
+    /// read a token from the current line, like BZWReader always did
+    void      readToken(char *buffer, int n);
+    /// discard the rest of the line, newline included
+    void      skipLine();
+
+    /// input >> values[0] >> ... >> values[count - 1]
+    static bool   readFloats(std::istream& input, float *values, int count);
+    /// the integers on the rest of the line, the newline stays unread;
+    /// false when there was something else on it and nothing was read
+    static bool   readIntLine(std::istream& input, std::vector<int>& list);
+
+protected:
+    virtual int_type  underflow();
+    virtual int_type  pbackfail(int_type c);
+
+private:
+    void      release();
+    void      setData(const char *data, size_t length);
+
+    bool      parseFloat(float &value);
+
+    const char    *begin;
+    const char    *end;
+    size_t    size;
+
+    // a putback that doesn't match the text goes here
+    char      backChar;
+    const char    *backResume;
+
+    void      *mapping;
+    std::string   storage;
+};
+
+#endif
+
+// Local Variables: ***
+// mode: C++ ***
+// tab-width: 4 ***
+// c-basic-offset: 4 ***
+// indent-tabs-mode: nil ***
+// End: ***
+// ex: shiftwidth=4 tabstop=4
@@ -79,6 +79,8 @@ const char *usageString =
     "[-h] "
     "[-handicap] "
     "[-helpmsg <file> <name>] "
+    "[-httpdir <directory>] "
+    "[-httpworld] "
     "[-i interface] "
     "[-j] "
     "[-jitterdrop <num>] "
@@ -100,9 +102,11 @@ const char *usageString =
     "[-p <port>] "
     "[-packetlossdrop <num>] "
     "[-packetlosswarn <%>] "
+    "[-parsebench <filename>] "
     "[-passwd <password>] "
     "[-pidfile <filename>] "
     "[-poll <variable>=<value>] "
+    "[-poller {epoll|select}] "
 #ifdef PRINTSCORE
     "[-printscore] "
 #endif
@@ -123,11 +127,13 @@ const char *usageString =
     "[-s <flag-count>] "
     "[-sa] "
     "[-sb] "
+    "[-sendqueue <low>,<high>,<max>] "
     "[-set <name> <value>] "
     "[-setforced <name> <value>] "
     "[-sl <id> <num>] "
     "[-spamtime <time>] "
     "[-spamwarn <warnAmt>] "
+    "[-spawnbench <count>] "
     "[-speedtol <tolerance>] "
     "[-srvmsg <text>] "
     "[-st <time>] "
@@ -150,6 +156,7 @@ const char *usageString =
     "[-vars <filename>] "
     "[-version] "
     "[-world <filename>] "
+    "[-worldcache <filename>] "
     "[-worldsize <world size>] "
     "[-ws <number of wall sides>] ";
 
@@ -186,6 +193,8 @@ const char *extraUsageString =
     "\t-h: use random building heights\n"
     "\t-handicap: give advantage based on relative playing ability\n"
     "\t-helpmsg: show the lines in <file> on command /help <name>\n"
+    "\t-httpdir: serve the files in <directory> over HTTP on the game port\n"
+    "\t-httpworld: serve the world over HTTP on the game port, and tell clients to get it there\n"
     "\t-i: listen on <interface>\n"
     "\t-j: allow jumping\n"
     "\t-jitterdrop: drop player after this many jitter warnings\n"
@@ -208,9 +217,12 @@ const char *extraUsageString =
     "\t-p: use alternative port (default=5154)\n"
     "\t-packetlossdrop: drop player after this many packetloss warnings\n"
     "\t-packetlosswarn: packetloss warning threshold [%]\n"
+    "\t-parsebench: time loading, parsing, building and packing a world file, then exit\n"
     "\t-passwd: specify a <password> for operator commands\n"
     "\t-pidfile: write the process id into <filename> on startup\n"
     "\t-poll: configure several aspects of the in-game polling system\n"
+    "\t-poller: socket polling backend for the main loop (default=epoll where\n"
+    "\t\tavailable, select otherwise)\n"
 #ifdef PRINTSCORE
     "\t-printscore: write score to stdout whenever it changes\n"
 #endif
@@ -231,6 +243,8 @@ const char *extraUsageString =
     "\t-s: allow up to <num> super flags (default=16)\n"
     "\t-sa: insert antidote superflags\n"
     "\t-sb: allow tanks to respawn on buildings\n"
+    "\t-sendqueue: send queue sizes in kB, a player counts as congested above\n"
+    "\t\t<high> until back below <low> and is kicked past <max> (default=4,8,16)\n"
     "\t-set <name> <value>: set a BZDB variable's value\n"
     "\t-setforced <name> <value>: set a BZDB variable's value (whether it\n"
     "\t\texists or not)\n"
@@ -239,6 +253,8 @@ const char *extraUsageString =
     "\t\tmessages sent that are alike\n"
     "\t-spamwarn <warnAmt>: warn a spammer that sends messages before\n"
     "\t\tspamtime times out <warnAmt> many times\n"
+    "\t-spawnbench: time <count> spawns, and the spawn map being made again\n"
+    "\t\tmeanwhile, on the world, then exit\n"
     "\t-speedtol: multiplier of normal speed for auto kick (default=1.25)\n"
     "\t\tshould not be less than 1.0\n"
     "\t-srvmsg: specify a <msg> to print upon client login\n"
@@ -263,6 +279,7 @@ const char *extraUsageString =
     "\t-vars: file to read for worlds configuration variables\n"
     "\t-version: print version and exit\n"
     "\t-world: world file to load\n"
+    "\t-worldcache: keep a precompiled copy of the world file, to start from while it is current\n"
     "\t-worldsize: numeric value for the size of the world (default=400)\n"
     "\t-ws: numeric value for the number off outer walls (default=4)\n"
     "\n"
@@ -815,6 +832,17 @@ void parse(int argc, char **argv, CmdLineOptions &options, bool fromWorldFile)
             }
             i++;
         }
+        else if (strcmp(argv[i], "-httpdir") == 0)
+        {
+            checkFromWorldFile(argv[i], fromWorldFile);
+            checkArgc(1, i, argc, argv[i]);
+            options.httpDir = argv[i];
+        }
+        else if (strcmp(argv[i], "-httpworld") == 0)
+        {
+            checkFromWorldFile(argv[i], fromWorldFile);
+            options.httpWorld = true;
+        }
         else if (strcmp(argv[i], "-i") == 0)
         {
             checkFromWorldFile(argv[i], fromWorldFile);
@@ -977,6 +1005,12 @@ void parse(int argc, char **argv, CmdLineOptions &options, bool fromWorldFile)
             checkArgc(1, i, argc, argv[i]);
             options.packetlosswarnthresh = atoi(argv[i])/1000.0f;
         }
+        else if (strcmp(argv[i], "-parsebench") == 0)
+        {
+            checkFromWorldFile(argv[i], fromWorldFile);
+            checkArgc(1, i, argc, argv[i]);
+            options.parseBench = argv[i];
+        }
         else if (strcmp(argv[i], "-passwd") == 0 || strcmp(argv[i], "-password") == 0)
         {
             checkFromWorldFile(argv[i], fromWorldFile);
@@ -1028,6 +1062,18 @@ void parse(int argc, char **argv, CmdLineOptions &options, bool fromWorldFile)
                 options.voteTime = (unsigned short int)atoi(args[1].c_str());
             else
                 std::cerr << "unknown variable for -poll, skipping";
+        }
+        else if (strcmp(argv[i], "-poller") == 0)
+        {
+            checkFromWorldFile(argv[i], fromWorldFile);
+            checkArgc(1, i, argc, argv[i]);
+            if (!NetPoller::parseBackend(argv[i], options.pollerBackend))
+            {
+                std::cerr << "unknown poller backend " << argv[i] << ", expected epoll or select" << std::endl;
+                usage(argv[0]);
+            }
+            else if (!NetPoller::isAvailable(options.pollerBackend))
+                std::cerr << "poller backend " << argv[i] << " is not available, using select" << std::endl;
 #ifdef PRINTSCORE
         }
         else if (strcmp(argv[i], "-printscore") == 0)
@@ -1187,6 +1233,28 @@ void parse(int argc, char **argv, CmdLineOptions &options, bool fromWorldFile)
             // respawns on buildings
             options.respawnOnBuildings = true;
         }
+        else if (strcmp(argv[i], "-sendqueue") == 0)
+        {
+            checkFromWorldFile(argv[i], fromWorldFile);
+            checkArgc(1, i, argc, argv[i]);
+            std::vector<std::string> sizes = TextUtils::tokenize(argv[i], std::string(","));
+            if (sizes.size() != 3)
+            {
+                std::cerr << "-sendqueue expects <low>,<high>,<max>" << std::endl;
+                usage(argv[0]);
+            }
+            const int low  = atoi(sizes[0].c_str());
+            const int high = atoi(sizes[1].c_str());
+            const int max  = atoi(sizes[2].c_str());
+            if (low < 0 || high < low || max < high || max < 1)
+            {
+                std::cerr << "-sendqueue sizes must satisfy 0 <= low <= high <= max" << std::endl;
+                usage(argv[0]);
+            }
+            options.sendQueueLow  = low * 1024;
+            options.sendQueueHigh = high * 1024;
+            options.sendQueueMax  = max * 1024;
+        }
         else if (strcmp(argv[i], "-set") == 0)
         {
             const char *name, *value;
@@ -1252,6 +1320,17 @@ void parse(int argc, char **argv, CmdLineOptions &options, bool fromWorldFile)
             options.spamWarnMax = atoi(argv[i]);
             logDebugMessage(1,"using spam warn threshold of %d\n", options.spamWarnMax);
         }
+        else if (strcmp(argv[i], "-spawnbench") == 0)
+        {
+            checkFromWorldFile(argv[i], fromWorldFile);
+            checkArgc(1, i, argc, argv[i]);
+            options.spawnBench = atoi(argv[i]);
+            if (options.spawnBench < 1)
+            {
+                std::cerr << "ERROR: invalid spawn count [" << argv[i] << "]" << std::endl;
+                usage(argv[0]);
+            }
+        }
         else if (strcmp(argv[i], "-speedtol") == 0)
         {
             checkArgc(1, i, argc, argv[i]);
@@ -1477,6 +1556,12 @@ void parse(int argc, char **argv, CmdLineOptions &options, bool fromWorldFile)
             if (options.useTeleporters)
                 std::cerr << "-t is meaningless when using a custom world, ignoring" << std::endl;
         }
+        else if (strcmp(argv[i], "-worldcache") == 0)
+        {
+            checkFromWorldFile(argv[i], fromWorldFile);
+            checkArgc(1, i, argc, argv[i]);
+            options.worldCache = argv[i];
+        }
         else if (strcmp(argv[i], "-worldsize") == 0)
         {
             checkArgc(1, i, argc, argv[i]);
@@ -26,6 +26,7 @@
 #include "Flag.h"
 #include "WordFilter.h"
 #include "TextChunkManager.h"
+#include "NetPoller.h"
 
 /* bzfs-specific headers */
 #include "AccessControlList.h"
@@ -59,7 +60,7 @@ struct CmdLineOptions
     CmdLineOptions()
         : wksPort(ServerPort), gameType(TeamFFA), gameOptions(0),
           rabbitSelection(ScoreRabbitSelection), msgTimer(0), spamWarnMax(5),
-          servermsg(""), advertisemsg(""), worldFile(""),
+          servermsg(""), advertisemsg(""), worldFile(""), worldCache(""),
           pingInterface(""), password(""),
           listServerOverridden(false),
           publicizedTitle(""), publicizedAddress(""), publicizedKey(""),
@@ -82,7 +83,9 @@ struct CmdLineOptions
           filterFilename(""), filterCallsigns(false), filterChat(false), filterSimple(false),
           banTime(300), voteTime(60), vetoTime(2), votesRequired(2),
           votePercentage(50.1f), voteRepeatTime(300),
-          autoTeam(false), citySize(5), cacheURL(""), cacheOut(""), tkAnnounce(false), wallSides(4)
+          autoTeam(false), citySize(5), cacheURL(""), cacheOut(""), httpDir(""), httpWorld(false), spawnBench(0), tkAnnounce(false), wallSides(4),
+          pollerBackend(NetPoller::EpollBackend),
+          sendQueueLow(4 * 1024), sendQueueHigh(8 * 1024), sendQueueMax(16 * 1024)
     {
         int i;
         for (FlagTypeMap::iterator it = FlagType::getFlagMap().begin();
@@ -113,6 +116,7 @@ struct CmdLineOptions
     std::string   servermsg;
     std::string   advertisemsg;
     std::string   worldFile;
+    std::string   worldCache;
     std::string   pingInterface;
     std::string   password;
 
@@ -211,10 +215,22 @@ struct CmdLineOptions
 
     std::string       cacheURL;
     std::string       cacheOut;
+    std::string       httpDir;
+    bool          httpWorld;
+    std::string       parseBench;
+    int           spawnBench;
 
     bool          tkAnnounce;
     int           wallSides;
 
+    /* socket readiness backend for the main loop */
+    NetPoller::Backend    pollerBackend;
+
+    /* per player send queue water marks and limit, in bytes */
+    int           sendQueueLow;
+    int           sendQueueHigh;
+    int           sendQueueMax;
+
     // plugins
     typedef struct
     {
@@ -36,6 +36,10 @@ public:
     {
         return false;
     }
+    virtual bool usesDatabase()
+    {
+        return true;
+    }
 
 protected:
     std::string from;
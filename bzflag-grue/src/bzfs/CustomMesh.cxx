@@ -21,6 +21,7 @@
 #include "PhysicsDriver.h"
 #include "ObstacleMgr.h"
 #include "MeshDrawInfo.h"
+#include "BZWSource.h"
 
 
 CustomMesh::CustomMesh()
@@ -99,7 +100,7 @@ bool CustomMesh::read(const char *cmd, std::istream& input)
     else if (strcasecmp(cmd, "inside") == 0)
     {
         cfvec3 inside;
-        if (!(input >> inside[0] >> inside[1] >> inside[2]))
+        if (!BZWSource::readFloats(input, inside.data, 3))
             return false;
         checkTypes.push_back(MeshObstacle::CheckInside);
         checkPoints.push_back(inside);
@@ -107,7 +108,7 @@ bool CustomMesh::read(const char *cmd, std::istream& input)
     else if (strcasecmp(cmd, "outside") == 0)
     {
         cfvec3 outside;
-        if (!(input >> outside[0] >> outside[1] >> outside[2]))
+        if (!BZWSource::readFloats(input, outside.data, 3))
             return false;
         checkTypes.push_back(MeshObstacle::CheckOutside);
         checkPoints.push_back(outside);
@@ -115,21 +116,21 @@ bool CustomMesh::read(const char *cmd, std::istream& input)
     else if (strcasecmp(cmd, "vertex") == 0)
     {
         cfvec3 vertex;
-        if (!(input >> vertex[0] >> vertex[1] >> vertex[2]))
+        if (!BZWSource::readFloats(input, vertex.data, 3))
             return false;
         vertices.push_back(vertex);
     }
     else if (strcasecmp(cmd, "normal") == 0)
     {
         cfvec3 normal;
-        if (!(input >> normal[0] >> normal[1] >> normal[2]))
+        if (!BZWSource::readFloats(input, normal.data, 3))
             return false;
         normals.push_back(normal);
     }
     else if (strcasecmp(cmd, "texcoord") == 0)
     {
         cfvec2 texcoord;
-        if (!(input >> texcoord[0] >> texcoord[1]))
+        if (!BZWSource::readFloats(input, texcoord.data, 2))
             return false;
         texcoords.push_back(texcoord);
     }
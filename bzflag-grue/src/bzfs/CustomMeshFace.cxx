@@ -20,6 +20,7 @@
 
 /* common implementation headers */
 #include "PhysicsDriver.h"
+#include "BZWSource.h"
 
 /* system headers */
 #include <sstream>
@@ -46,6 +47,10 @@ static void getIntList (std::istream& input, std::vector<int>& list)
     std::string args;
     int value;
 
+    // plain lists of numbers are read in place
+    if (BZWSource::readIntLine(input, list))
+        return;
+
     list.clear();
     std::getline(input, args);
     std::istringstream parms(args);
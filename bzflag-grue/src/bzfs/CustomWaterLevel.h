@@ -30,6 +30,10 @@ public:
     {
         return false;
     }
+    virtual bool usesDatabase()
+    {
+        return true;
+    }
 private:
     float height;
     bool modedMaterial;
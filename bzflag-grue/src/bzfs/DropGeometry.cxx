@@ -34,16 +34,22 @@
 //
 // Datatype Definitions
 //
+struct RayHit
+{
+    const Obstacle* obs;
+    float time; // where the ray hits it, negative for a miss
+};
+
 class HoldingList
 {
 public:
     HoldingList();
     ~HoldingList();
-    void copy(const ObsList* list);
+    void copy(const ObsList* list, const float* times);
 public:
     int size;
     int count;
-    Obstacle** list;
+    RayHit* list;
 };
 
 static HoldingList rayList; // ray intersection list
@@ -84,6 +90,84 @@ bool DropGeometry::dropPlayer(float pos[3], float minZ, float maxZ)
 }
 
 
+void DropGeometry::findPlayerLandings(float x, float y, float minZ, float maxZ,
+                                      std::vector<Landing>& landings)
+{
+    // the same clearance as dropPlayer()
+    const float fudge = 0.001f;
+    const float radius = BZDBCache::tankRadius;
+    const float height = BZDBCache::tankHeight + fudge;
+
+    landings.clear();
+
+    const float maxHeight = COLLISIONMGR.getWorldExtents().maxs[2];
+    const float dir[3] = {0.0f, 0.0f, -1.0f};
+    const float org[3] = {x, y, maxHeight + 1.0f};
+    Ray ray(org, dir);
+
+    const float* times;
+    const ObsList* olist = COLLISIONMGR.rayTestTimes(&ray, MAXFLOAT, times);
+    rayList.copy(olist, times);
+    qsort(rayList.list, rayList.count, sizeof(RayHit), compareDescending);
+
+    float pos[3] = {x, y, 0.0f};
+    for (int i = 0; i < rayList.count; i++)
+    {
+        const Obstacle* obs = rayList.list[i].obs;
+        const float zTop = obs->getExtents().maxs[2];
+        if (zTop > maxZ)
+            continue;
+        if (zTop < minZ)
+            break;
+        if ((rayList.list[i].time < 0.0f) || !isValidLanding(obs))
+            continue;
+        if (!landings.empty() && (landings.back().z == zTop))
+            continue;
+        pos[2] = zTop;
+        if (isValidClearance(pos, radius, height, -1))
+        {
+            Landing landing = { zTop, obs };
+            landings.push_back(landing);
+        }
+    }
+
+    if (minZ <= 0.0f)
+    {
+        pos[2] = 0.0f;
+        if (isValidClearance(pos, radius, height, -1))
+        {
+            Landing landing = { 0.0f, NULL };
+            landings.push_back(landing);
+        }
+    }
+
+    return;
+}
+
+
+bool DropGeometry::landPlayer(float pos[3], const Obstacle* landing)
+{
+    const float fudge = 0.001f;
+    const float tankHeight = BZDBCache::tankHeight + fudge;
+
+    // the landing has to be under the middle of the tank, as in dropIt()
+    if (landing != NULL)
+    {
+        const float maxHeight = COLLISIONMGR.getWorldExtents().maxs[2];
+        const float dir[3] = {0.0f, 0.0f, -1.0f};
+        const float org[3] = {pos[0], pos[1], maxHeight + 1.0f};
+        Ray ray(org, dir);
+        if (landing->intersect(ray) < 0.0f)
+            return false;
+    }
+
+    if (!isValidClearance(pos, BZDBCache::tankRadius, tankHeight, -1))
+        return false;
+    pos[2] += fudge;
+    return true;
+}
+
+
 bool DropGeometry::dropFlag(float pos[3], float minZ, float maxZ)
 {
     const float flagHeight = BZDB.eval(StateDatabase::BZDB_FLAGHEIGHT);
@@ -186,8 +270,8 @@ static bool isValidClearance(const float pos[3], float radius,
 
 static int compareAscending(const void* a, const void* b)
 {
-    const Obstacle* obsA = *((const Obstacle* const *)a);
-    const Obstacle* obsB = *((const Obstacle* const *)b);
+    const Obstacle* obsA = ((const RayHit*)a)->obs;
+    const Obstacle* obsB = ((const RayHit*)b)->obs;
     const float topA = obsA->getExtents().maxs[2];
     const float topB = obsB->getExtents().maxs[2];
     if (topA < topB)
@@ -201,8 +285,8 @@ static int compareAscending(const void* a, const void* b)
 
 static int compareDescending(const void* a, const void* b)
 {
-    const Obstacle* obsA = *((const Obstacle* const *)a);
-    const Obstacle* obsB = *((const Obstacle* const *)b);
+    const Obstacle* obsA = ((const RayHit*)a)->obs;
+    const Obstacle* obsB = ((const RayHit*)b)->obs;
     const float topA = obsA->getExtents().maxs[2];
     const float topB = obsB->getExtents().maxs[2];
     if (topA < topB)
@@ -242,8 +326,9 @@ static bool dropIt(float pos[3], float minZ, float maxZ,
     Ray ray(org, dir);
 
     // list of  possible landings
-    const ObsList* olist = COLLISIONMGR.rayTest(&ray, MAXFLOAT);
-    rayList.copy(olist); // copy the list, so that COLLISIONMGR can be re-used
+    const float* times;
+    const ObsList* olist = COLLISIONMGR.rayTestTimes(&ray, MAXFLOAT, times);
+    rayList.copy(olist, times); // copy the list, so that COLLISIONMGR can be re-used
 
     const float startZ = pos[2];
 
@@ -251,11 +336,11 @@ static bool dropIt(float pos[3], float minZ, float maxZ,
     if (isValidClearance(pos, radius, height, team))
     {
         // sort from highest to lowest
-        qsort(rayList.list, rayList.count, sizeof(Obstacle*), compareDescending);
+        qsort(rayList.list, rayList.count, sizeof(RayHit), compareDescending);
         // no interference, try dropping
         for (i = 0; i < rayList.count; i++)
         {
-            const Obstacle* obs = rayList.list[i];
+            const Obstacle* obs = rayList.list[i].obs;
             const float zTop = obs->getExtents().maxs[2];
             // make sure that it's within the limits
             if ((zTop > startZ) || (zTop > maxZ))
@@ -264,7 +349,7 @@ static bool dropIt(float pos[3], float minZ, float maxZ,
                 break;
             pos[2] = zTop;
 
-            if (obs->intersect(ray) >= 0.0f)
+            if (rayList.list[i].time >= 0.0f)
             {
                 if (isValidLanding(obs) &&
                         isValidClearance(pos, radius, height, team))
@@ -288,11 +373,11 @@ static bool dropIt(float pos[3], float minZ, float maxZ,
     else
     {
         // sort from lowest to highest
-        qsort(rayList.list, rayList.count, sizeof(Obstacle*), compareAscending);
+        qsort(rayList.list, rayList.count, sizeof(RayHit), compareAscending);
         // we're blocked, try climbing
         for (i = 0; i < rayList.count; i++)
         {
-            const Obstacle* obs = rayList.list[i];
+            const Obstacle* obs = rayList.list[i].obs;
             const float zTop = obs->getExtents().maxs[2];
             // make sure that it's within the limits
             if ((zTop < startZ) || (zTop < minZ))
@@ -302,7 +387,7 @@ static bool dropIt(float pos[3], float minZ, float maxZ,
             pos[2] = zTop;
 
             if (isValidLanding(obs) &&
-                    (obs->intersect(ray) >= 0.0f) &&
+                    (rayList.list[i].time >= 0.0f) &&
                     isValidClearance(pos, radius, height, team))
                 return true;
         }
@@ -327,17 +412,21 @@ HoldingList::~HoldingList()
     return;
 }
 
-void HoldingList::copy(const ObsList* olist)
+void HoldingList::copy(const ObsList* olist, const float* times)
 {
     if (olist->count > size)
     {
         // increase the list size
         delete[] list;
         size = olist->count;
-        list = new Obstacle*[size];
+        list = new RayHit[size];
     }
     count = olist->count;
-    memcpy(list, olist->list, count * sizeof(Obstacle*));
+    for (int i = 0; i < count; i++)
+    {
+        list[i].obs = olist->list[i];
+        list[i].time = times[i];
+    }
     return;
 }
 
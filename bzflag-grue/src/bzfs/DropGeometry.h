@@ -13,11 +13,11 @@
 #ifndef __DROP_GEOMETRY_H__
 #define __DROP_GEOMETRY_H__
 
+// system headers
+#include <vector>
 
 class WorldInfo;
-
-static bool isValidClearance(const float pos[3], float radius,
-                             float height, int team);
+class Obstacle;
 
 namespace DropGeometry
 {
@@ -26,6 +26,19 @@ bool dropFlag (float pos[3], float minZ, float maxZ);
 bool dropPlayer (float pos[3], float minZ, float maxZ);
 bool dropTeamFlag (float pos[3], float minZ, float maxZ, int team);
 bool isValidSpawn(const float pos[3], float radius, float height);
+
+struct Landing
+{
+    float z;
+    const Obstacle* obs; // NULL for the ground
+};
+// everywhere between minZ and maxZ that dropPlayer() could put a
+// player down at x, y, from the top down
+void findPlayerLandings(float x, float y, float minZ, float maxZ,
+                        std::vector<Landing>& landings);
+// what dropPlayer() does for a landing found by findPlayerLandings()
+// at pos, without looking for it again
+bool landPlayer(float pos[3], const Obstacle* landing);
 }
 
 
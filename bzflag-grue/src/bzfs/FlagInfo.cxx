@@ -20,6 +20,8 @@
 
 // implementation-specific bzflag headers
 #include "BZDBCache.h"
+#include "Scheduler.h"
+#include "bzfs.h"
 
 /* private */
 
@@ -34,7 +36,7 @@ int         FlagInfo::numExtraFlags = 0;
 int         FlagInfo::numFlags      = 0;
 int         FlagInfo::numFlagsInAir;
 
-FlagInfo::FlagInfo(): numShots(0), flagIndex(0)
+FlagInfo::FlagInfo(): numShots(0), flagIndex(0), landingTimer(0)
 {
     // prep flag
     flag.type       = Flags::Null;
@@ -58,6 +60,11 @@ FlagInfo::FlagInfo(): numShots(0), flagIndex(0)
     required        = false;
 }
 
+FlagInfo::~FlagInfo()
+{
+    scheduler.cancel(landingTimer);
+}
+
 void FlagInfo::setSize(int _numFlags)
 {
     // sanity check
@@ -119,6 +126,7 @@ void FlagInfo::addFlag()
     flag.initialVelocity   = -0.5f * gravity * flightTime;
     dropDone         = TimeKeeper::getCurrent();
     dropDone        += flightTime;
+    scheduleLanding();
 
     if (flag.type == Flags::Null)
         // pick a random flag
@@ -153,7 +161,10 @@ void *FlagInfo::pack(void *buf, bool hide)
 
 void FlagInfo::dropFlag(float pos[3], float landingPos[3], bool vanish)
 {
-    numFlagsInAir++;
+    // a flag already in flight is only sent somewhere else
+    if ((flag.status != FlagInAir) && (flag.status != FlagComing) &&
+            (flag.status != FlagGoing))
+        numFlagsInAir++;
     flag.status        = vanish ? FlagGoing : FlagInAir;
 
     flag.landingPosition[0] = landingPos[0];
@@ -183,6 +194,7 @@ void FlagInfo::dropFlag(float pos[3], float landingPos[3], bool vanish)
     flag.flightTime      = 0.0f;
     flag.flightEnd       = flightTime;
     flag.initialVelocity = -gravity * upTime;
+    scheduleLanding();
 }
 
 void FlagInfo::resetFlag(float position[3], bool teamIsEmpty)
@@ -230,23 +242,26 @@ int FlagInfo::getIndex() const
     return flagIndex;
 }
 
-float FlagInfo::getNextDrop(TimeKeeper &tm)
+void FlagInfo::scheduleLanding()
 {
-    // find timeout when next flag would hit ground
-    float waitTime = 3.0f;
-    if (numFlagsInAir > 0)
+    scheduler.cancel(landingTimer);
+    landingTimer = scheduler.addAt(dropDone, &FlagInfo::landingCallback, this);
+}
+
+double FlagInfo::landingCallback(void *data)
+{
+    FlagInfo *info = (FlagInfo*)data;
+    info->landingTimer = 0;
+
+    // resetting the flag may send it flying again with a new timer
+    if (info->landing(TimeKeeper::getCurrent()))
     {
-        for (int i = 0; i < numFlags; i++)
-        {
-            FlagInfo &flag = flagList[i];
-            if (flag.flag.status != FlagNoExist &&
-                    flag.flag.status != FlagOnTank &&
-                    flag.flag.status != FlagOnGround &&
-                    flag.dropDone - tm < waitTime)
-                waitTime = float(flag.dropDone - tm);
-        }
+        if (info->flag.status == FlagOnGround)
+            ::sendFlagUpdate(*info);
+        else
+            ::resetFlag(*info);
     }
-    return waitTime;
+    return -1.0;
 }
 
 bool FlagInfo::landing(const TimeKeeper &tm)
@@ -30,6 +30,7 @@ class FlagInfo
 public:
 
     FlagInfo();
+    ~FlagInfo();
 
     void setRequiredFlag(FlagType *desc);
     void addFlag();
@@ -48,7 +49,6 @@ public:
     static void setAllowed(std::vector<FlagType*> allowed);
     static void setExtra(int extra);
     static int  lookupFirstTeamFlag(int teamindex);
-    static float getNextDrop(TimeKeeper &tm);
     static void  setNoFlagInAir();
 
     // flag info
@@ -72,6 +72,10 @@ private:
 
     // time flag will land
     TimeKeeper            dropDone;
+    unsigned int      landingTimer;
+
+    void scheduleLanding();
+    static double landingCallback(void *data);
 };
 #else
 class FlagInfo;
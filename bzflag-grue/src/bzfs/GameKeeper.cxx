@@ -20,6 +20,9 @@
 /* common headers */
 #include "GameTime.h"
 
+/* bzfs implementation headers */
+#include "Scheduler.h"
+
 GameKeeper::Player* GameKeeper::Player::playerList[PlayerSlot] = {0}; // this is suspect...
 bool GameKeeper::Player::allNeedHostbanChecked = false;
 
@@ -37,7 +40,8 @@ GameKeeper::Player::Player(int _playerIndex,
       player(_playerIndex), netHandler(new NetHandler(&player, clientAddr, _playerIndex, fd)),
       lagInfo(&player),
       stateTimeStamp(0.0f), serverTimeStamp(0.0),
-      gameTimeRate(GameTime::startRate), gameTimeNext(TimeKeeper::getCurrent()),
+      gameTimeRate(GameTime::startRate), gameTimeTimer(0),
+      worldSent(0), worldCredit(0),
       isParting(false), hasEntered(false),
       playerHandler(0),
       addWasDelayed(false), hadEnter(false), addDelayStartTime(0.0),
@@ -58,7 +62,8 @@ GameKeeper::Player::Player(int _playerIndex,
       player(_playerIndex), netHandler(handler),
       lagInfo(&player),
       stateTimeStamp(0.0f), serverTimeStamp(0.0),
-      gameTimeRate(GameTime::startRate), gameTimeNext(TimeKeeper::getCurrent()),
+      gameTimeRate(GameTime::startRate), gameTimeTimer(0),
+      worldSent(0), worldCredit(0),
       isParting(false), hasEntered(false),
       playerHandler(0),
       addWasDelayed(false), hadEnter(false), addDelayStartTime(0.0),
@@ -79,7 +84,8 @@ GameKeeper::Player::Player(int _playerIndex, bz_ServerSidePlayerHandler* handler
       player(_playerIndex), netHandler(0),
       lagInfo(&player),
       stateTimeStamp(0.0f), serverTimeStamp(0.0),
-      gameTimeRate(GameTime::startRate), gameTimeNext(TimeKeeper::getCurrent()),
+      gameTimeRate(GameTime::startRate), gameTimeTimer(0),
+      worldSent(0), worldCredit(0),
       isParting(false), hasEntered(false),
       playerHandler(handler),
       addWasDelayed(false), hadEnter(false), addDelayStartTime(0.0),
@@ -95,6 +101,7 @@ GameKeeper::Player::Player(int _playerIndex, bz_ServerSidePlayerHandler* handler
 
 GameKeeper::Player::~Player()
 {
+    scheduler.cancel(gameTimeTimer);
     flagHistory.clear();
     delete netHandler;
     playerList[playerIndex] = 0;
@@ -185,7 +192,7 @@ int GameKeeper::Player::anointRabbit(int oldRabbit)
     return rabbitIndex;
 }
 
-void GameKeeper::Player::updateNextGameTime()
+void GameKeeper::Player::updateGameTimeRate()
 {
     if (gameTimeRate < GameTime::startRate)
         gameTimeRate = GameTime::startRate;
@@ -193,8 +200,6 @@ void GameKeeper::Player::updateNextGameTime()
         gameTimeRate = gameTimeRate * 1.25f;
     else
         gameTimeRate = GameTime::finalRate;
-    gameTimeNext = TimeKeeper::getCurrent();
-    gameTimeNext += gameTimeRate;
     return;
 }
 
@@ -367,14 +372,12 @@ int GameKeeper::Player::getFreeIndex(int min, int max)
     return max;
 }
 
-void GameKeeper::Player::handleTcpPacket(fd_set* set)
+RxStatus GameKeeper::Player::handleTcpPacket()
 {
-    if (netHandler->isFdSet(set))
-    {
-        RxStatus const e(netHandler->tcpReceive());
-        if (e == ReadPart) return;
+    RxStatus const e(netHandler->tcpReceive());
+    if (e != ReadPart)
         clientCallback(*netHandler, playerIndex, e);
-    }
+    return e;
 }
 
 void GameKeeper::Player::setPlayerState(float pos[3], float azimuth)
@@ -96,7 +96,7 @@ public:
         void       signingOn(bool ctf);
         void       close();
         static bool    clean();
-        void       handleTcpPacket(fd_set *set);
+        RxStatus   handleTcpPacket();
 
         // For hostban checking, to avoid check and check again
         static void    setAllNeedHostbanChecked(bool set);
@@ -111,9 +111,8 @@ public:
         void       setBzIdentifier(const std::string& id);
         const std::string& getBzIdentifier() const;
 
-        // When is the player's next GameTime?
-        const TimeKeeper&   getNextGameTime() const;
-        void        updateNextGameTime();
+        // GameTime updates come quickly at first, then slow down
+        void        updateGameTimeRate();
 
         // To handle Identify
         void       setLastIdFlag(int _idFlag);
@@ -153,7 +152,10 @@ public:
         float         serverTimeStamp;
         // GameTime update
         float         gameTimeRate;
-        TimeKeeper        gameTimeNext;
+        unsigned int      gameTimeTimer;
+        // world download, chunks are sent ahead up to worldCredit
+        uint32_t      worldSent;
+        uint32_t      worldCredit;
         // FlagHistory
         FlagHistory       flagHistory;
         // Score
@@ -246,12 +248,6 @@ inline const std::string& GameKeeper::Player::getBzIdentifier() const
 }
 
 
-inline const TimeKeeper& GameKeeper::Player::getNextGameTime() const
-{
-    return gameTimeNext;
-}
-
-
 #endif
 
 // Local Variables: ***
@@ -0,0 +1,516 @@
+/* bzflag
+ * Copyright (c) 1993-2021 Tim Riker
+ *
+ * This package is free software;  you can redistribute it and/or
+ * modify it under the terms of the license found in the file
+ * named COPYING that should have accompanied this file.
+ *
+ * THIS PACKAGE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+/* interface header */
+#include "HTTPFileServer.h"
+
+/* system implementation headers */
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <vector>
+#if defined(__linux__)
+#  define HAVE_SENDFILE 1
+#  include <sys/sendfile.h>
+#endif
+
+/* common implementation headers */
+#include "bzfio.h"
+#include "network.h"
+#include "TextUtils.h"
+#include "TimeKeeper.h"
+#include "version.h"
+
+/* local implementation headers */
+#include "bzfs.h"
+
+// how much of one transfer goes out per pass of the main loop, a transfer
+// that uses it all makes the next pass come without waiting
+static const size_t sliceSize = 64 * 1024;
+// requests don't get bigger than this, just the headers count
+static const size_t maxRequestSize = 8 * 1024;
+
+static const char *dayNames[] =
+{
+    "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"
+};
+static const char *monthNames[] =
+{
+    "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+    "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+};
+
+
+// an RFC 1123 date, as HTTP wants it
+static std::string formatDate(time_t t)
+{
+    struct tm *tm = gmtime(&t);
+    if (!tm)
+        return std::string();
+    return TextUtils::format("%s, %02d %s %04d %02d:%02d:%02d GMT",
+                             dayNames[tm->tm_wday], tm->tm_mday, monthNames[tm->tm_mon],
+                             tm->tm_year + 1900, tm->tm_hour, tm->tm_min, tm->tm_sec);
+}
+
+
+static bool parseDate(const std::string& text, time_t& t)
+{
+    int day, year, hour, minute, second;
+    char month[4];
+    if (sscanf(text.c_str(), "%*[^,], %d %3s %d %d:%d:%d",
+               &day, month, &year, &hour, &minute, &second) != 6)
+        return false;
+    int m = 0;
+    while (m < 12 && strcmp(month, monthNames[m]) != 0)
+        m++;
+    if (m == 12)
+        return false;
+
+    // days since the epoch of the proleptic gregorian date
+    const int y = (m < 2) ? year - 1 : year;
+    const int era = (y >= 0 ? y : y - 399) / 400;
+    const int yoe = y - era * 400;
+    const int doy = (153 * (m < 2 ? m + 10 : m - 2) + 2) / 5 + day - 1;
+    const int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    const long days = era * 146097L + doe - 719468L;
+    t = (time_t)(days * 86400L + hour * 3600L + minute * 60L + second);
+    return true;
+}
+
+
+static const char *getMimeType(const std::string& name)
+{
+    const size_t dot = name.find_last_of('.');
+    if (dot == std::string::npos)
+        return "application/octet-stream";
+    const std::string ext = TextUtils::tolower(name.substr(dot + 1));
+    if (ext == "png")
+        return "image/png";
+    if ((ext == "jpg") || (ext == "jpeg"))
+        return "image/jpeg";
+    if (ext == "gif")
+        return "image/gif";
+    if (ext == "bmp")
+        return "image/bmp";
+    if (ext == "tga")
+        return "image/x-tga";
+    if (ext == "wav")
+        return "audio/wav";
+    if (ext == "ogg")
+        return "audio/ogg";
+    if ((ext == "bzw") || (ext == "txt"))
+        return "text/plain";
+    return "application/octet-stream";
+}
+
+
+// a single "bytes=" range, anything else means the whole thing
+enum RangeResult { NoRange, GoodRange, BadRange };
+
+static RangeResult parseRange(const std::string& value, off_t size,
+                              off_t& first, off_t& last)
+{
+    if ((value.compare(0, 6, "bytes=") != 0) ||
+            (value.find(',') != std::string::npos))
+        return NoRange;
+    const std::string spec = TextUtils::trim(value.substr(6));
+    const size_t dash = spec.find('-');
+    if ((dash == std::string::npos) || (spec.find_first_not_of("0123456789-") != std::string::npos))
+        return NoRange;
+
+    const std::string from = spec.substr(0, dash);
+    const std::string to = spec.substr(dash + 1);
+    if (from.empty())
+    {
+        // the last so many bytes
+        const long long count = strtoll(to.c_str(), NULL, 10);
+        if (to.empty() || (count <= 0) || (size == 0))
+            return BadRange;
+        first = (count < (long long)size) ? size - (off_t)count : 0;
+        last = size - 1;
+        return GoodRange;
+    }
+
+    const long long start = strtoll(from.c_str(), NULL, 10);
+    long long stop = to.empty() ? (long long)size - 1 : strtoll(to.c_str(), NULL, 10);
+    if (!to.empty() && (stop < start))
+        return NoRange;
+    if (start >= (long long)size)
+        return BadRange;
+    if (stop >= (long long)size)
+        stop = (long long)size - 1;
+    first = (off_t)start;
+    last = (off_t)stop;
+    return GoodRange;
+}
+
+
+HTTPFileServer::Transfer::Transfer() : responding(false), failed(false),
+    headerSent(0), data(NULL), file(NULL), offset(0), end(0), world(false),
+    sliceUsed(false)
+{
+}
+
+
+HTTPFileServer::HTTPFileServer()
+{
+}
+
+
+HTTPFileServer::~HTTPFileServer()
+{
+    for (std::map<int, Transfer>::iterator it = transfers.begin(); it != transfers.end(); ++it)
+        close(it->second);
+}
+
+
+void HTTPFileServer::setWorld(const char *data, size_t size, const std::string& digest)
+{
+    for (std::map<int, Transfer>::iterator it = transfers.begin(); it != transfers.end(); ++it)
+    {
+        if (it->second.world)
+            it->second.failed = true;
+    }
+    world.assign(data, size);
+    worldDigest = digest;
+}
+
+
+void HTTPFileServer::setDirectory(const std::string& _directory)
+{
+    directory = _directory;
+    while ((directory.size() > 1) && (directory[directory.size() - 1] == '/'))
+        directory.resize(directory.size() - 1);
+}
+
+
+std::string HTTPFileServer::getWorldURL(const std::string& hostPort) const
+{
+    return "http://" + hostPort + "/world/" + worldDigest;
+}
+
+
+bool HTTPFileServer::accept(int connectionID, NetConnectedPeer& peer)
+{
+    const std::string& input = peer.bufferedInput;
+    size_t start;
+    if (input.compare(0, 4, "GET ") == 0)
+        start = 4;
+    else if (input.compare(0, 5, "HEAD ") == 0)
+        start = 5;
+    else
+        return false;
+
+    // the rest goes to the plugins
+    const bool forWorld = hasWorld() && (input.compare(start, 7, "/world/") == 0);
+    const bool forFiles = !directory.empty() && (input.compare(start, 7, "/files/") == 0);
+    if (!forWorld && !forFiles)
+        return false;
+
+    peer.apiHandler = this;
+    Transfer& t = transfers[connectionID];
+    close(t);
+    t = Transfer();
+    received(t, input.data(), input.size());
+    return true;
+}
+
+
+void HTTPFileServer::pending(int connectionID, void *data, unsigned int size)
+{
+    std::map<int, Transfer>::iterator it = transfers.find(connectionID);
+    if ((it == transfers.end()) || it->second.responding)
+        return;
+
+    received(it->second, (const char*)data, size);
+}
+
+
+void HTTPFileServer::received(Transfer& t, const char *data, size_t size)
+{
+    t.request.append(data, size);
+    if (t.request.find("\r\n\r\n") != std::string::npos)
+        respond(t);
+    else if (t.request.size() > maxRequestSize)
+        t.failed = true;
+}
+
+
+bool HTTPFileServer::wantsWrite(int connectionID) const
+{
+    std::map<int, Transfer>::const_iterator it = transfers.find(connectionID);
+    return (it != transfers.end()) && it->second.responding && !it->second.failed;
+}
+
+
+bool HTTPFileServer::canSendMore(int connectionID) const
+{
+    std::map<int, Transfer>::const_iterator it = transfers.find(connectionID);
+    return (it != transfers.end()) && it->second.sliceUsed;
+}
+
+
+void HTTPFileServer::disconnect(int connectionID)
+{
+    remove(connectionID);
+}
+
+
+void HTTPFileServer::remove(int connectionID)
+{
+    std::map<int, Transfer>::iterator it = transfers.find(connectionID);
+    if (it == transfers.end())
+        return;
+    close(it->second);
+    transfers.erase(it);
+}
+
+
+void HTTPFileServer::close(Transfer& t)
+{
+    if (t.file)
+        fclose(t.file);
+    t.file = NULL;
+    t.data = NULL;
+}
+
+
+void HTTPFileServer::respond(Transfer& t)
+{
+    t.responding = true;
+
+    // request line, then headers, names are case insensitive
+    std::vector<std::string> lines = TextUtils::tokenize(t.request.substr(0, t.request.find("\r\n\r\n")), "\r\n");
+    std::vector<std::string> request = TextUtils::tokenize(lines.empty() ? "" : lines[0], " ");
+    if (request.size() < 2)
+    {
+        t.failed = true;
+        return;
+    }
+    const bool head = (request[0] == "HEAD");
+    std::string path = request[1];
+    if (path.find('?') != std::string::npos)
+        path.resize(path.find('?'));
+
+    std::map<std::string, std::string> headers;
+    for (size_t i = 1; i < lines.size(); i++)
+    {
+        const size_t colon = lines[i].find(':');
+        if (colon != std::string::npos)
+            headers[TextUtils::tolower(lines[i].substr(0, colon))] = TextUtils::trim(lines[i].substr(colon + 1));
+    }
+
+    int status = 200;
+    off_t size = 0;
+    time_t modified = 0;
+    std::string etag, type;
+
+    if (path.compare(0, 7, "/world/") == 0)
+    {
+        if (!world.empty() && (path.substr(7) == worldDigest))
+        {
+            t.data = world.data();
+            t.world = true;
+            size = (off_t)world.size();
+            etag = "\"" + worldDigest + "\"";
+            type = "application/octet-stream";
+        }
+        else
+            status = 404;
+    }
+    else
+    {
+        const std::string name = TextUtils::url_decode(path.substr(7));
+        struct stat st;
+        if (directory.empty() || name.empty() || (name[0] == '/') ||
+                (name.find("..") != std::string::npos) ||
+                (name.find_first_of("\\:") != std::string::npos) ||
+                ((t.file = fopen((directory + "/" + name).c_str(), "rb")) == NULL))
+            status = 404;
+        else if ((fstat(fileno(t.file), &st) != 0) || ((st.st_mode & S_IFMT) != S_IFREG))
+        {
+            close(t);
+            status = 404;
+        }
+        else
+        {
+            size = (off_t)st.st_size;
+            modified = st.st_mtime;
+            etag = TextUtils::format("\"%lx-%lx\"", (unsigned long)st.st_size,
+                                     (unsigned long)st.st_mtime);
+            type = getMimeType(name);
+        }
+    }
+
+    off_t first = 0, last = size - 1;
+    if (status == 200)
+    {
+        // the client may already have it
+        time_t since;
+        if (headers.count("if-none-match"))
+        {
+            const std::string& match = headers["if-none-match"];
+            if ((match == "*") || (match.find(etag) != std::string::npos))
+                status = 304;
+        }
+        else if (modified && headers.count("if-modified-since") &&
+                 parseDate(headers["if-modified-since"], since) && (modified <= since))
+            status = 304;
+
+        // or just want a part of it, if it's still the same thing
+        if ((status == 200) && headers.count("range") &&
+                (!headers.count("if-range") || (headers["if-range"] == etag)))
+        {
+            const RangeResult range = parseRange(headers["range"], size, first, last);
+            if (range == GoodRange)
+                status = 206;
+            else if (range == BadRange)
+                status = 416;
+        }
+    }
+
+    const char *reason = "OK";
+    switch (status)
+    {
+    case 206:
+        reason = "Partial Content";
+        break;
+    case 304:
+        reason = "Not Modified";
+        break;
+    case 404:
+        reason = "Not Found";
+        break;
+    case 416:
+        reason = "Range Not Satisfiable";
+        break;
+    }
+
+    t.header = TextUtils::format("HTTP/1.1 %d %s\r\n", status, reason);
+    t.header += std::string("Server: ") + getServerVersion() + "\r\n";
+    t.header += "Date: " + formatDate(time(NULL)) + "\r\n";
+    t.header += "Connection: close\r\n";
+    if (!etag.empty())
+    {
+        t.header += "ETag: " + etag + "\r\n";
+        if (modified)
+            t.header += "Last-Modified: " + formatDate(modified) + "\r\n";
+    }
+
+    if ((status == 200) || (status == 206))
+    {
+        t.header += "Content-Type: " + type + "\r\n";
+        t.header += "Accept-Ranges: bytes\r\n";
+        t.header += TextUtils::format("Content-Length: %lld\r\n", (long long)(last - first + 1));
+        if (status == 206)
+            t.header += TextUtils::format("Content-Range: bytes %lld-%lld/%lld\r\n",
+                                          (long long)first, (long long)last, (long long)size);
+        t.offset = first;
+        t.end = head ? first : last + 1;
+    }
+    else if (status != 304)
+    {
+        if (status == 416)
+            t.header += TextUtils::format("Content-Range: bytes */%lld\r\n", (long long)size);
+        t.header += "Content-Length: 0\r\n";
+    }
+    t.header += "\r\n";
+
+    if (t.offset == t.end)
+        close(t);
+
+    logDebugMessage(3,"HTTP %s %s: %d\n", request[0].c_str(), request[1].c_str(), status);
+}
+
+
+bool HTTPFileServer::transfer(int connectionID, NetConnectedPeer& peer)
+{
+    std::map<int, Transfer>::iterator it = transfers.find(connectionID);
+    if (it == transfers.end())
+        return true;
+
+    Transfer& t = it->second;
+    if (t.failed)
+        return true;
+    if (!t.responding)
+        return false;
+
+    t.sliceUsed = false;
+    size_t budget = sliceSize;
+    while (budget > 0)
+    {
+        int n;
+        if (t.headerSent < t.header.size())
+        {
+            const size_t length = std::min(budget, t.header.size() - t.headerSent);
+            n = ::send(connectionID, t.header.data() + t.headerSent, (int)length, 0);
+            if (n > 0)
+                t.headerSent += n;
+        }
+        else if (t.offset < t.end)
+        {
+            size_t length = std::min(budget, (size_t)(t.end - t.offset));
+            if (t.data)
+                n = ::send(connectionID, t.data + t.offset, (int)length, 0);
+            else
+            {
+#ifdef HAVE_SENDFILE
+                off_t offset = t.offset;
+                n = (int)sendfile(connectionID, fileno(t.file), &offset, length);
+#else
+                char buffer[16 * 1024];
+                length = std::min(length, sizeof(buffer));
+                if ((fseek(t.file, (long)t.offset, SEEK_SET) != 0) ||
+                        (fread(buffer, 1, length, t.file) != length))
+                    return true;
+                n = ::send(connectionID, buffer, (int)length, 0);
+#endif
+                // the file got shorter
+                if (n == 0)
+                    return true;
+            }
+            if (n > 0)
+                t.offset += n;
+        }
+        else
+            break;
+
+        if (n < 0)
+        {
+            const int err = getErrno();
+            return (err != EAGAIN) && (err != EWOULDBLOCK) && (err != EINTR);
+        }
+        if (n == 0)
+            break;
+        budget -= std::min(budget, (size_t)n);
+        peer.lastActivity = TimeKeeper::getCurrent();
+    }
+
+    const bool finished = (t.headerSent == t.header.size()) && (t.offset >= t.end);
+    if (finished)
+        close(t);
+    else
+        t.sliceUsed = (budget == 0);
+    return finished;
+}
+
+
+// Local Variables: ***
+// mode: C++ ***
+// tab-width: 4 ***
+// c-basic-offset: 4 ***
+// indent-tabs-mode: nil ***
+// End: ***
+// ex: shiftwidth=4 tabstop=4
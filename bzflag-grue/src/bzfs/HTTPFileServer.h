@@ -0,0 +1,116 @@
+/* bzflag
+ * Copyright (c) 1993-2021 Tim Riker
+ *
+ * This package is free software;  you can redistribute it and/or
+ * modify it under the terms of the license found in the file
+ * named COPYING that should have accompanied this file.
+ *
+ * THIS PACKAGE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef __HTTPFILESERVER_H__
+#define __HTTPFILESERVER_H__
+
+#include "common.h"
+
+/* system interface headers */
+#include <stdio.h>
+#include <sys/types.h>
+#include <map>
+#include <string>
+
+/* common interface headers */
+#include "bzfsAPI.h"
+
+struct NetConnectedPeer;
+
+/** HTTPFileServer answers plain HTTP requests that come in on the game
+    port for the world database and for the files in one directory,
+    usually the textures of the map, so that neither needs a separate
+    web host and neither goes through the player's game connection.
+
+    The world is at /world/<digest>, the files at /files/<name>.  Only
+    GET and HEAD are handled, with a single byte range, and with
+    If-None-Match and If-Modified-Since answered by a 304.  Files go out
+    with sendfile() where there is one, and each transfer only gets a
+    slice of the socket per pass of the main loop.
+*/
+class HTTPFileServer : public bz_NonPlayerConnectionHandler
+{
+public:
+    HTTPFileServer();
+    ~HTTPFileServer();
+
+    /// serve a copy of the world database, transfers of an older one
+    /// are dropped
+    void      setWorld(const char *data, size_t size, const std::string& digest);
+    void      setDirectory(const std::string& directory);
+
+    bool      hasWorld() const
+    {
+        return !world.empty();
+    }
+    /// the world's URL on the server at hostPort
+    std::string   getWorldURL(const std::string& hostPort) const;
+
+    /// take the connection when the request is one for us
+    bool      accept(int connectionID, NetConnectedPeer& peer);
+    /// send what the socket takes now, true when the response is out
+    /// and the connection can be closed
+    bool      transfer(int connectionID, NetConnectedPeer& peer);
+    /// whether the connection has something to send
+    bool      wantsWrite(int connectionID) const;
+    /// the socket took a whole slice, an edge triggered poller won't say
+    /// so again, transfer() should be called again without waiting
+    bool      canSendMore(int connectionID) const;
+    /// forget about a connection that is going away
+    void      remove(int connectionID);
+
+    virtual void  pending(int connectionID, void *data, unsigned int size);
+    virtual void  disconnect(int connectionID);
+
+private:
+    struct Transfer
+    {
+        Transfer();
+
+        std::string   request;
+        bool      responding;
+        bool      failed;
+
+        std::string   header;
+        size_t    headerSent;
+
+        // the body comes from memory or from the file, offset up to end
+        const char    *data;
+        FILE      *file;
+        off_t     offset;
+        off_t     end;
+        bool      world;
+
+        // the last transfer() stopped at the slice, not at a full socket
+        bool      sliceUsed;
+    };
+
+    void      received(Transfer& t, const char *data, size_t size);
+    void      respond(Transfer& t);
+    void      close(Transfer& t);
+
+    std::string   world;
+    std::string   worldDigest;
+    std::string   directory;
+
+    std::map<int, Transfer> transfers;
+};
+
+#endif
+
+// Local Variables: ***
+// mode: C++ ***
+// tab-width: 4 ***
+// c-basic-offset: 4 ***
+// indent-tabs-mode: nil ***
+// End: ***
+// ex: shiftwidth=4 tabstop=4
@@ -23,6 +23,7 @@
 /* server headers */
 #include "bzfs.h"
 #include "DropGeometry.h"
+#include "SpawnSurfaces.h"
 
 
 RandomSpawnPolicy::RandomSpawnPolicy()
@@ -75,6 +76,17 @@ void RandomSpawnPolicy::getPosition(float pos[3], int playerId, bool onGroundOnl
         const float size = BZDBCache::worldSize;
         const float maxHeight = world->getMaxWorldHeight();
 
+        const SpawnSurfaces& surfaces = world->getSpawnSurfaces();
+        const int baseTeam = ((t >= RedTeam) && (t <= PurpleTeam)) ? (int)t : -1;
+
+        const float waterLevel = world->getWaterLevel();
+        float minZ = 0.0f;
+        if (waterLevel > minZ)
+            minZ = waterLevel;
+        float maxZ = maxHeight;
+        if (onGroundOnly)
+            maxZ = 0.0f;
+
         // keep track of how much time we spend searching for a location
         TimeKeeper start = TimeKeeper::getCurrent();
 
@@ -82,25 +94,19 @@ void RandomSpawnPolicy::getPosition(float pos[3], int playerId, bool onGroundOnl
         bool foundspot = false;
         while (!foundspot)
         {
-            if (!world->getPlayerSpawnPoint(&pi, pos))
+            if (world->getPlayerSpawnPoint(&pi, pos))
+                foundspot = DropGeometry::dropPlayer(pos, minZ, maxZ);
+            else if (surfaces.getRandomPosition(pos, onGroundOnly, false, baseTeam))
+                foundspot = true;
+            else
             {
                 pos[0] = ((float)bzfrand() - 0.5f) * size;
                 pos[1] = ((float)bzfrand() - 0.5f) * size;
                 pos[2] = onGroundOnly ? 0.0f : ((float)bzfrand() * maxHeight);
+                foundspot = DropGeometry::dropPlayer(pos, minZ, maxZ);
             }
             tries++;
 
-            const float waterLevel = world->getWaterLevel();
-            float minZ = 0.0f;
-            if (waterLevel > minZ)
-                minZ = waterLevel;
-            float maxZ = maxHeight;
-            if (onGroundOnly)
-                maxZ = 0.0f;
-
-            if (DropGeometry::dropPlayer(pos, minZ, maxZ))
-                foundspot = true;
-
             // check every now and then if we have already used up 10ms of time
             if (tries >= 50)
             {
@@ -0,0 +1,182 @@
+/* bzflag
+ * Copyright (c) 1993-2021 Tim Riker
+ *
+ * This package is free software;  you can redistribute it and/or
+ * modify it under the terms of the license found in the file
+ * named COPYING that should have accompanied this file.
+ *
+ * THIS PACKAGE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+/* interface header */
+#include "RecordBuffer.h"
+
+/* system implementation headers */
+#include <string.h>
+
+
+// packets start on this boundary, so their headers can be used in place
+static const u32 Alignment = 8;
+
+static inline u32 alignUp(u32 size)
+{
+    return (size + (Alignment - 1)) & ~(Alignment - 1);
+}
+
+
+RecordBuffer::RecordBuffer()
+{
+    clear();
+}
+
+
+void RecordBuffer::clear()
+{
+    std::vector<char>().swap(arena);
+    head = tail = wrapEnd = newest = 0;
+    wrapped = false;
+    byteCount = 0;
+    packetCount = 0;
+}
+
+
+void RecordBuffer::setSize(u32 bytes)
+{
+    bytes = bytes & ~(Alignment - 1);
+    if (bytes == arena.size())
+        return;
+
+    RecordBuffer old;
+    old.arena.swap(arena);
+    old.head = head;
+    old.tail = tail;
+    old.wrapEnd = wrapEnd;
+    old.wrapped = wrapped;
+    old.newest = newest;
+    old.packetCount = packetCount;
+
+    clear();
+    arena.resize(bytes);
+
+    if (old.empty())
+        return;
+    u32 pos = old.first();
+    do
+    {
+        const Header *h = old.header(pos);
+        add(h->mode, h->code, h->len, h + 1, h->timestamp);
+    }
+    while (old.next(pos));
+}
+
+
+bool RecordBuffer::add(u16 mode, u16 code, u32 len, const void *data,
+                       RRtime timestamp)
+{
+    const u32 size = alignUp(sizeof(Header) + len);
+    if (size > arena.size())
+        return false;
+
+    bool dropped = false;
+    while (true)
+    {
+        if (packetCount == 0)
+        {
+            head = tail = 0;
+            wrapped = false;
+        }
+
+        if (!wrapped)
+        {
+            if ((arena.size() - head) >= size)
+                break;
+            if (tail >= size)
+            {
+                // start again from the front
+                wrapEnd = head;
+                wrapped = true;
+                head = 0;
+                break;
+            }
+        }
+        else if ((tail - head) >= size)
+            break;
+
+        dropOldest();
+        dropped = true;
+    }
+
+    Header *h = (Header *)&arena[head];
+    h->timestamp = timestamp;
+    h->len = len;
+    h->mode = mode;
+    h->code = code;
+    if (len > 0)
+        memcpy(h + 1, data, len);
+
+    newest = head;
+    head += size;
+    byteCount += size;
+    packetCount++;
+
+    // a buffer that doesn't start with a state update can't be replayed
+    if (dropped)
+    {
+        while ((tail != newest) && (header(tail)->mode != UpdatePacket))
+            dropOldest();
+    }
+
+    return true;
+}
+
+
+void RecordBuffer::dropOldest()
+{
+    const u32 size = alignUp(sizeof(Header) + header(tail)->len);
+    tail += size;
+    byteCount -= size;
+    packetCount--;
+
+    if (wrapped && (tail == wrapEnd))
+    {
+        tail = 0;
+        wrapped = false;
+    }
+}
+
+
+bool RecordBuffer::next(u32& pos) const
+{
+    if (pos == newest)
+        return false;
+    pos += alignUp(sizeof(Header) + header(pos)->len);
+    if (wrapped && (pos == wrapEnd))
+        pos = 0;
+    return true;
+}
+
+
+void RecordBuffer::read(u32 pos, RRpacket *p) const
+{
+    const Header *h = header(pos);
+    p->next = NULL;
+    p->prev = NULL;
+    p->mode = h->mode;
+    p->code = h->code;
+    p->len = h->len;
+    p->nextFilePos = 0;
+    p->prevFilePos = 0;
+    p->timestamp = h->timestamp;
+    p->data = (h->len == 0) ? NULL : (const char *)(h + 1);
+}
+
+
+// Local Variables: ***
+// mode: C++ ***
+// tab-width: 4 ***
+// c-basic-offset: 4 ***
+// indent-tabs-mode: nil ***
+// End: ***
+// ex: shiftwidth=4 tabstop=4
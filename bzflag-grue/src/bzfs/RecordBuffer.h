@@ -0,0 +1,121 @@
+/* bzflag
+ * Copyright (c) 1993-2021 Tim Riker
+ *
+ * This package is free software;  you can redistribute it and/or
+ * modify it under the terms of the license found in the file
+ * named COPYING that should have accompanied this file.
+ *
+ * THIS PACKAGE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef __RECORDBUFFER_H__
+#define __RECORDBUFFER_H__
+
+#include "common.h"
+
+/* system interface headers */
+#include <vector>
+
+/* bzfs interface headers */
+#include "RecordReplay.h"
+
+/** RecordBuffer keeps the latest packets of a buffered recording in
+    one block of memory of a fixed size, used as a ring.  Each packet is
+    a small header followed by its data, and never wraps around the end
+    of the block.
+
+    When a packet does not fit, the oldest ones make room, and then the
+    ones after them up to the next UpdatePacket, so that the buffer
+    always starts with a state update.  Adding never allocates.
+
+    A packet is found by its position in the block, starting from
+    first() and going on with next().
+*/
+class RecordBuffer
+{
+public:
+    RecordBuffer();
+
+    /// allocate bytes, keeping the newest packets that fit
+    void      setSize(u32 bytes);
+    /// drop the packets and the memory
+    void      clear();
+
+    /// false if the packet is bigger than the whole buffer
+    bool      add(u16 mode, u16 code, u32 len, const void *data,
+                  RRtime timestamp);
+
+    u32       getSize() const
+    {
+        return (u32)arena.size();
+    }
+    /// bytes taken by the packets and their headers
+    u32       getByteCount() const
+    {
+        return byteCount;
+    }
+    u32       getPacketCount() const
+    {
+        return packetCount;
+    }
+    bool      empty() const
+    {
+        return packetCount == 0;
+    }
+
+    /// the oldest packet, if not empty()
+    u32       first() const
+    {
+        return tail;
+    }
+    /// the newest packet, if not empty()
+    u32       last() const
+    {
+        return newest;
+    }
+    /// move on to the packet after pos, false after the newest one
+    bool      next(u32& pos) const;
+    /// the packet at pos, its data points into the buffer
+    void      read(u32 pos, RRpacket *p) const;
+
+private:
+    struct Header
+    {
+        RRtime    timestamp;
+        u32       len;
+        u16       mode;
+        u16       code;
+    };
+
+    void      dropOldest();
+    const Header  *header(u32 pos) const
+    {
+        return (const Header *)&arena[pos];
+    }
+
+    std::vector<char> arena;
+
+    // packets are in [tail, head), or [tail, wrapEnd) and [0, head)
+    // once the newer ones have wrapped around
+    u32       head;
+    u32       tail;
+    u32       wrapEnd;
+    bool      wrapped;
+    u32       newest;
+
+    u32       byteCount;
+    u32       packetCount;
+};
+
+
+#endif  /* __RECORDBUFFER_H__ */
+
+// Local Variables: ***
+// mode: C++ ***
+// tab-width: 4 ***
+// c-basic-offset: 4 ***
+// indent-tabs-mode: nil ***
+// End: ***
+// ex: shiftwidth=4 tabstop=4
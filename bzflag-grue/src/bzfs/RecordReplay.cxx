@@ -11,11 +11,8 @@
  */
 
 // TODO
-// - convert to packet lists to  STL lists ?
-// - compression (piped and/or inline)
 // - modify bzflag client to search for highest PlayerID first
 //   for name matching (so that messages aren't sent to ghosts)
-// - improve skipping
 
 // interface header
 #include "RecordReplay.h"
@@ -54,20 +51,14 @@
 
 // bzfs specific headers
 #include "bzfs.h"
+#include "RecordBuffer.h"
+#include "RecordWriter.h"
+#include "ReplayReader.h"
 
 
 // Type Definitions
 // ----------------
 
-typedef struct
-{
-    u32 byteCount;
-    u32 packetCount;
-    // into the head, out of the tail
-    RRpacket *head; // last packet in
-    RRpacket *tail; // first packet in
-} RRbuffer;
-
 typedef struct
 {
     std::string file;
@@ -109,17 +100,20 @@ static RRtime ReplayStartTime = 0;
 static RRtime ReplayOffset = 0;
 static long ReplayFileStart = 0;
 static RRpacket *ReplayPos = NULL;
+static RRpacket ReplayPacket; // what ReplayPos points to
 
 static TimeKeeper StartTime;
 
-static RRbuffer ReplayBuf = {0, 0, NULL, NULL}; // for replaying
-static RRbuffer RecordBuf = {0, 0, NULL, NULL};  // for recording
+static RecordBuffer RecordBuf; // for recording
 
 static FILE *ReplayFile = NULL;
+static ReplayReader ReplayData;
 static std::string ReplayFilename = "";
 
 static FILE *RecordFile = NULL;
 static std::string RecordFilename = "";
+static RecordWriter RecordOut; // writes RecordFile when straight to file
+static std::vector<ReplayReader::IndexEntry> RecordIndex; // its updates
 
 
 // Local Function Prototypes
@@ -142,18 +136,16 @@ static void rewind();
 // saves straight to a file, or into the buffer
 static bool routePacket(u16 code, int len, const void *data, u16 mode);
 
+static RRpacket *firstPacket();
 static RRpacket *nextPacket();
-static RRpacket *prevPacket();
-static RRpacket *nextFilePacket();
-static RRpacket *prevFilePacket();
-static RRpacket *nextStatePacket();
-static RRpacket *prevStatePacket();
 
+static void *packPacketHeader(RRpacket *p, void *buf);
+static void countPacket(RRpacket *p);
 static bool savePacket(RRpacket *p, FILE *f);
-static RRpacket *loadPacket(FILE *f);       // makes a new packet
 
-static bool saveHeader(int playerIndex, RRtime filetime, FILE *f);
+static bool saveHeader(int playerIndex, RRtime filetime, u32 version, FILE *f);
 static bool loadHeader(ReplayHeader *h, FILE *f);
+static bool saveIndex(FILE *f);
 static bool saveFileTime(RRtime filetime, FILE *f);
 static bool loadFileTime(RRtime *filetime, FILE *f);
 static bool replaceFlagTypes(ReplayHeader *h);
@@ -169,12 +161,6 @@ static bool badFilename(const char *name);
 static bool makeDirExist(const char *dirname);
 static bool makeDirExistMsg(const char *dirname, int playerIndex);
 
-static RRpacket *newPacket(u16 mode, u16 code, int len, const void *data);
-static void addHeadPacket(RRbuffer *b, RRpacket *p); // add to the head
-static void addTailPacket(RRbuffer *b, RRpacket *p); // add to the tail
-static RRpacket *delTailPacket(RRbuffer *b);     // delete from the tail
-static RRpacket *delHeadPacket(RRbuffer *b);     // delete from the head
-static void freeBuffer(RRbuffer *buf);         // clean it out
 static void initPacket(u16 mode, u16 code, int len, const void *data,
                        RRpacket *p);        // copy params into packet
 
@@ -198,6 +184,8 @@ static bool recordReset()
         // replace the elapsed time placeholder
         if (RecordMode == StraightToFile)
         {
+            RecordOut.stop();
+            saveIndex(RecordFile);
             RRtime filetime = getRRtime() - RecordStartTime;
             saveFileTime(filetime, RecordFile);
         }
@@ -205,13 +193,14 @@ static bool recordReset()
         RecordFile = NULL;
     }
     RecordFilename = "";
-    freeBuffer(&RecordBuf);
+    RecordBuf.clear();
 
     Recording = false;
     RecordMode = BufferedRecord;
     RecordFileBytes = 0;
     RecordFilePackets = 0;
     RecordFilePrevPos = 0;
+    RecordIndex.clear();
     RecordStartTime = 0;
     RecordUpdateTime = 0;
 
@@ -245,6 +234,7 @@ bool Record::start(int playerIndex)
     }
     if (!makeDirExistMsg(RecordDir.c_str(), playerIndex))
         return false;
+    RecordBuf.setSize(RecordMaxBytes);
     Recording = true;
     saveStates();
     sendMessage(ServerPlayer, playerIndex, "Recording started");
@@ -299,6 +289,8 @@ bool Record::setSize(int playerIndex, int Mbytes)
     if (Mbytes <= 0)
         Mbytes = 1;
     RecordMaxBytes = Mbytes * (1024) * (1024);
+    if (Recording && (RecordMode == BufferedRecord))
+        RecordBuf.setSize(RecordMaxBytes);
     snprintf(buffer, MessageLen, "Record size set to %i", Mbytes);
     sendMessage(ServerPlayer, playerIndex, buffer);
     return true;
@@ -332,14 +324,17 @@ bool Record::sendStats(int playerIndex)
 
     if (RecordMode == BufferedRecord)
     {
-        if ((RecordBuf.tail != NULL) && (RecordBuf.head != NULL))
+        if (!RecordBuf.empty())
         {
-            RRtime diff = RecordBuf.head->timestamp - RecordBuf.tail->timestamp;
+            RRpacket first, last;
+            RecordBuf.read(RecordBuf.first(), &first);
+            RecordBuf.read(RecordBuf.last(), &last);
+            RRtime diff = last.timestamp - first.timestamp;
             saveTime = (float)diff / 1000000.0f;
         }
         snprintf(buffer, MessageLen,
                  "Buffered:  %i bytes / %i packets / %.1f seconds",
-                 RecordBuf.byteCount, RecordBuf.packetCount, saveTime);
+                 RecordBuf.getByteCount(), RecordBuf.getPacketCount(), saveTime);
         sendMessage(ServerPlayer, playerIndex, buffer);
     }
     else
@@ -353,6 +348,12 @@ bool Record::sendStats(int playerIndex)
                  "   saved:  %i bytes / %i packets / %.1f seconds",
                  RecordFileBytes, RecordFilePackets, saveTime);
         sendMessage(ServerPlayer, playerIndex, buffer);
+        snprintf(buffer, MessageLen,
+                 "  packed:  %u bytes written / %u packets dropped",
+                 RecordOut.getFileBytes(), RecordOut.getDroppedPackets());
+        sendMessage(ServerPlayer, playerIndex, buffer);
+        if (RecordOut.failed())
+            sendMessage(ServerPlayer, playerIndex, "Could not write to the file");
     }
 
     return true;
@@ -398,7 +399,8 @@ bool Record::saveFile(int playerIndex, const char *filename)
         return false;
     }
 
-    if (!saveHeader(playerIndex, 0 /* placeholder */, RecordFile))
+    if (!saveHeader(playerIndex, 0 /* placeholder */, ReplayBlockVersion,
+                    RecordFile))
     {
         recordReset();
         snprintf(buffer, MessageLen, "Could not save header: %s", name.c_str());
@@ -406,6 +408,9 @@ bool Record::saveFile(int playerIndex, const char *filename)
         return false;
     }
 
+    // the packets are written in blocks from here on
+    RecordOut.start(RecordFile, true);
+
     if (!saveStates())
     {
         recordReset();
@@ -427,7 +432,6 @@ bool Record::saveFile(int playerIndex, const char *filename)
 
 bool Record::saveBuffer(int playerIndex, const char *filename, int seconds)
 {
-    RRpacket *p = (RRpacket *)NULL;
     char buffer[MessageLen];
     std::string name = RecordDir;
     name += filename;
@@ -438,7 +442,7 @@ bool Record::saveBuffer(int playerIndex, const char *filename, int seconds)
         return false;
     }
 
-    if (!Recording || (RecordMode != BufferedRecord))
+    if (!Recording || (RecordMode != BufferedRecord) || RecordBuf.empty())
     {
         sendMessage(ServerPlayer, playerIndex, "No buffer to save");
         return false;
@@ -452,41 +456,41 @@ bool Record::saveBuffer(int playerIndex, const char *filename, int seconds)
     }
 
 
-    // setup the beginning position for the recording
+    // setup the beginning position for the recording, the last
+    // update that happened at least 'seconds' ago, or the first one
+    RRpacket p, last;
+    RecordBuf.read(RecordBuf.last(), &last);
+    RRtime usecs = (RRtime)seconds * (RRtime)1000000;
     if (seconds != 0)
-    {
         logDebugMessage(3,"Record: saving %i seconds to %s\n", seconds, name.c_str());
-        // start the first update that happened at least 'seconds' ago
-        p = RecordBuf.head;
-        RRtime usecs = (RRtime)seconds * (RRtime)1000000;
-        while (p != NULL)
+
+    bool found = false;
+    u32 start = 0;
+    u32 pos = RecordBuf.first();
+    do
+    {
+        RecordBuf.read(pos, &p);
+        if (p.mode != UpdatePacket)
+            continue;
+        if (!found || ((seconds != 0) && ((last.timestamp - p.timestamp) >= usecs)))
         {
-            if (p->mode == UpdatePacket)
-            {
-                RRtime diff = RecordBuf.head->timestamp - p->timestamp;
-                if (diff >= usecs)
-                    break;
-            }
-            p = p->prev;
+            start = pos;
+            found = true;
         }
+        if ((seconds == 0) || ((last.timestamp - p.timestamp) < usecs))
+            break;
     }
+    while (RecordBuf.next(pos));
 
-    if ((seconds == 0) || (p == NULL))
+    if (!found)
     {
-        // save the whole buffer from the first update
-        p = RecordBuf.tail;
-        while (p->mode != UpdatePacket)
-            p = p->next;
-
-        if (p == NULL)
-        {
-            sendMessage(ServerPlayer, playerIndex, "No buffer to save");
-            return false;
-        }
+        sendMessage(ServerPlayer, playerIndex, "No buffer to save");
+        return false;
     }
 
     // setup the elapsed file time
-    RRtime filetime = RecordBuf.head->timestamp - p->timestamp;
+    RecordBuf.read(start, &p);
+    RRtime filetime = last.timestamp - p.timestamp;
 
     RecordFile = openWriteFile(playerIndex, filename);
     if (RecordFile == NULL)
@@ -496,7 +500,7 @@ bool Record::saveBuffer(int playerIndex, const char *filename, int seconds)
         return false;
     }
 
-    if (!saveHeader(playerIndex, filetime, RecordFile))
+    if (!saveHeader(playerIndex, filetime, ReplayVersion, RecordFile))
     {
         fclose(RecordFile);
         RecordFile = NULL;
@@ -505,12 +509,14 @@ bool Record::saveBuffer(int playerIndex, const char *filename, int seconds)
         return false;
     }
 
-    // Save the packets
-    while (p != NULL)
+    // Save the packets, straight from the buffer
+    pos = start;
+    do
     {
-        savePacket(p, RecordFile);
-        p = p->next;
+        RecordBuf.read(pos, &p);
+        savePacket(&p, RecordFile);
     }
+    while (RecordBuf.next(pos));
 
     fclose(RecordFile);
     RecordFile = NULL;
@@ -560,29 +566,31 @@ static bool routePacket(u16 code, int len, const void * data, u16 mode)
 
     if (RecordMode == BufferedRecord)
     {
-        RRpacket *p = newPacket(mode, code, len, data);
-        p->timestamp = getRRtime();
-        addHeadPacket(&RecordBuf, p);
+        // the oldest packets make room, up to the next State Update
+        RecordBuf.add(mode, code, len, data, getRRtime());
         logDebugMessage(4,"routeRRpacket(): mode = %i, len = %4i, code = %s, data = %p\n",
-                        (int)p->mode, p->len, msgString(p->code), p->data);
-
-        if (RecordBuf.byteCount > RecordMaxBytes)
-        {
-            logDebugMessage(4,"routePacket: deleting until State Update\n");
-            while (((p = delTailPacket(&RecordBuf)) != NULL) &&
-                    (p->mode != UpdatePacket))
-            {
-                delete[] p->data;
-                delete p;
-            }
-        }
+                        (int)mode, len, msgString(code), data);
     }
     else
     {
         RRpacket p;
         p.timestamp = getRRtime();
         initPacket(mode, code, len, data, &p);
-        savePacket(&p, RecordFile);
+        // only copied here, the writer thread does the rest
+        char hdr[RRpacketHdrSize];
+        packPacketHeader(&p, hdr);
+        if (RecordOut.add(hdr, RRpacketHdrSize, p.data, p.len))
+        {
+            countPacket(&p);
+            if ((p.mode == UpdatePacket) && (RecordIndex.empty() ||
+                                             (p.timestamp >= RecordIndex.back().timestamp)))
+            {
+                ReplayReader::IndexEntry entry;
+                entry.filePos = RecordFilePrevPos;
+                entry.timestamp = p.timestamp;
+                RecordIndex.push_back(entry);
+            }
+        }
         logDebugMessage(4, "routeRRpacket(): mode = %i, len = %4i, code = %s, data = %p\n",
                         (int)p.mode, p.len, msgString(p.code), p.data);
     }
@@ -649,7 +657,7 @@ static bool replayReset()
         ReplayFile = NULL;
     }
     ReplayFilename = "";
-    freeBuffer(&ReplayBuf);
+    ReplayData.close();
 
     ReplayMode = true;
     Replaying = false;
@@ -689,21 +697,22 @@ bool Replay::kill()
 
 static bool preloadVariables()
 {
-    RRpacket *p = ReplayBuf.tail;
+    RRpacket p;
+    bool found = ReplayData.readPacket(ReplayData.getFirstPos(), &p);
 
     // find the first BZDB update packet in the first state update block
-    while ((p != NULL) && (p->mode != RealPacket) && (p->code != MsgSetVar))
-        p = p->next;
-    if ((p == NULL) || (p->mode != StatePacket) || (p->code != MsgSetVar))
+    while (found && (p.mode != RealPacket) && (p.code != MsgSetVar))
+        found = ReplayData.readPacket(p.nextFilePos, &p);
+    if (!found || (p.mode != StatePacket) || (p.code != MsgSetVar))
         return false;
 
     // load the variables into BZDB
     do
     {
-        setVariables(p->data);
-        p = p->next;
+        setVariables(p.data);
+        found = ReplayData.readPacket(p.nextFilePos, &p);
     }
-    while ((p != NULL) && (p->mode == StatePacket) && (p->code == MsgSetVar));
+    while (found && (p.mode == StatePacket) && (p.code == MsgSetVar));
 
     return true;
 }
@@ -743,7 +752,6 @@ bool Replay::loadFile(int playerIndex, const char *filename)
     }
 
     ReplayHeader header;
-    RRpacket *p;
     char buffer[MessageLen];
     std::string name = RecordDir;
     name += filename;
@@ -777,17 +785,21 @@ bool Replay::loadFile(int playerIndex, const char *filename)
         return false;
     }
 
-    // preload the buffer
-    while (ReplayBuf.byteCount < RecordMaxBytes)
+    // the index goes next to the file, where openFile() finds it
+    std::string indexName = RecordDir;
+    indexName += DirectorySeparator;
+    indexName += filename;
+    indexName += ".idx";
+    if (!ReplayData.open(ReplayFile, header.version, (u32)ReplayFileStart,
+                         indexName))
     {
-        p = loadPacket(ReplayFile);
-        if (p == NULL)
-            break;
-        else
-            addHeadPacket(&ReplayBuf, p);
+        snprintf(buffer, MessageLen, "Could not read packets: %s", name.c_str());
+        sendMessage(ServerPlayer, playerIndex, buffer);
+        replayReset();
+        return false;
     }
 
-    if (ReplayBuf.tail == NULL)
+    if (firstPacket() == NULL)
     {
         snprintf(buffer, MessageLen, "No valid data: %s", name.c_str());
         sendMessage(ServerPlayer, playerIndex, buffer);
@@ -795,7 +807,6 @@ bool Replay::loadFile(int playerIndex, const char *filename)
         return false;
     }
 
-    ReplayPos = ReplayBuf.tail; // setup the initial position
     ReplayFileTime = header.filetime;
     ReplayStartTime = ReplayPos->timestamp;
 
@@ -1172,28 +1183,30 @@ bool Replay::skip(int playerIndex, int seconds)
 
     if (seconds != 0)
     {
-        RRpacket *p = ReplayPos;
         RRtime target = nowtime + ((RRtime)seconds * (RRtime)1000000);
+        const u32 here = ReplayPos->nextFilePos - RRpacketHdrSize - ReplayPos->len;
 
+        // the nearest state update on the way, from the index
         if (seconds > 0)
         {
-            do
+            u32 pos = ReplayData.nextUpdate(here, target);
+            if (pos == 0)
             {
-                p = nextStatePacket();
-            }
-            while ((p != NULL) && (p->timestamp < target));
-            if (p == NULL)
+                pos = ReplayData.getLastPos();
                 sendMessage(playerIndex, AllPlayers, REPLAY_LABEL "skipped to the end");
+            }
+            ReplayData.readPacket(pos, &ReplayPacket);
         }
         else
         {
-            do
+            u32 pos = ReplayData.prevUpdate(here, target);
+            if (pos == 0)
             {
-                p = prevStatePacket();
-            }
-            while ((p != NULL) && (p->timestamp > target));
-            if (p == NULL)
+                firstPacket();
                 sendMessage(playerIndex, AllPlayers, REPLAY_LABEL "skipped to the beginning");
+            }
+            else
+                ReplayData.readPacket(pos, &ReplayPacket);
         }
 
         // reset the replay observers' view of state
@@ -1245,7 +1258,7 @@ bool Replay::sendPackets()
             // this is a safety, it shouldn't happen
             resetStates();
             Replaying = false;
-            ReplayPos = ReplayBuf.tail;
+            firstPacket();
             sendMessage(ServerPlayer, AllPlayers, "Replay Finished!!!");
             return false;
         }
@@ -1324,15 +1337,16 @@ bool Replay::sendPackets()
         {
             resetStates();
             Replaying = false;
-            ReplayPos = ReplayBuf.tail;
+            firstPacket();
             sendMessage(ServerPlayer, AllPlayers, "Replay Finished");
             return false;
         }
     }
 
-    if (sent && (ReplayPos->prev != NULL))
+    RRpacket prev;
+    if (sent && ReplayData.readPacket(ReplayPos->prevFilePos, &prev))
     {
-        RRtime diff = (ReplayPos->timestamp - ReplayPos->prev->timestamp);
+        RRtime diff = (ReplayPos->timestamp - prev.timestamp);
         if (diff > (10 * 1000000))
         {
             char buffer[MessageLen];
@@ -1384,12 +1398,7 @@ void Replay::sendHelp(int playerIndex)
 
 static void rewind()
 {
-    RRpacket* p;
-    do
-    {
-        p = prevStatePacket();
-    }
-    while (p != NULL);
+    firstPacket();
 
     // setup the new time offset
     ReplayOffset = getRRtime() - ReplayPos->timestamp;
@@ -1430,120 +1439,32 @@ static bool setVariables(const void *data)
 }
 
 
-static RRpacket *nextPacket()
+static RRpacket *firstPacket()
 {
-    if (ReplayPos == NULL)
+    if (!ReplayData.readPacket(ReplayData.getFirstPos(), &ReplayPacket))
     {
-        ReplayPos = ReplayBuf.head;
+        ReplayPos = NULL;
         return NULL;
     }
-    else if (ReplayPos->next != NULL)
-    {
-        ReplayPos = ReplayPos->next;
-        return ReplayPos;
-    }
-    else
-        return nextFilePacket();
+    ReplayPos = &ReplayPacket;
+    return ReplayPos;
 }
 
 
-static RRpacket *prevPacket()
+// ReplayPos stays on the last packet when there is no other
+
+static RRpacket *nextPacket()
 {
     if (ReplayPos == NULL)
-    {
-        ReplayPos = ReplayBuf.tail;
         return NULL;
-    }
-    else if (ReplayPos->prev != NULL)
-    {
-        ReplayPos = ReplayPos->prev;
-        return ReplayPos;
-    }
-    else
-        return prevFilePacket();
-}
 
-
-static RRpacket *nextFilePacket()
-{
-    RRpacket *p = NULL;
-
-    // set the file position
+    RRpacket p;
     if ((ReplayPos->nextFilePos == 0) ||
-            (fseek(ReplayFile, ReplayPos->nextFilePos, SEEK_SET) < 0))
-    {
-    }
-    else
-    {
-        p = loadPacket(ReplayFile);
-
-        if (p != NULL)
-        {
-            RRpacket *tail = delTailPacket(&ReplayBuf);
-            if (tail != NULL)
-            {
-                delete[] tail->data;
-                delete tail;
-            }
-            addHeadPacket(&ReplayBuf, p);
-        }
-    }
-
-    ReplayPos = ReplayBuf.head;
-    return p;
-}
-
-
-static RRpacket *prevFilePacket()
-{
-    RRpacket *p = NULL;
-
-    // set the file position
-    if ((ReplayPos->prevFilePos <= 0) ||
-            (fseek(ReplayFile, ReplayPos->prevFilePos, SEEK_SET) < 0))
-    {
-    }
-    else
-    {
-        p = loadPacket(ReplayFile);
-
-        if (p != NULL)
-        {
-            RRpacket *head = delHeadPacket(&ReplayBuf);
-            if (head != NULL)
-            {
-                delete[] head->data;
-                delete head;
-            }
-            addTailPacket(&ReplayBuf, p);
-        }
-    }
-
-    ReplayPos = ReplayBuf.tail;
-    return p;
-}
-
-
-static RRpacket *nextStatePacket()
-{
-
-    RRpacket *p = nextPacket();
-
-    while ((p != NULL) && (p->mode != UpdatePacket))
-        p = nextPacket();
-
-    return p;
-}
-
-
-static RRpacket *prevStatePacket()
-{
-    RRpacket *p = prevPacket();
-
-    while ((p != NULL) && (p->mode != UpdatePacket))
-        p = prevPacket();
+            !ReplayData.readPacket(ReplayPos->nextFilePos, &p))
+        return NULL;
 
-    return p;
+    ReplayPacket = p;
+    return ReplayPos;
 }
 
 
@@ -1852,88 +1773,51 @@ static bool resetStates()
 // The replay files should work on different machine
 // types, so everything is saved in network byte order.
 
-static bool savePacket(RRpacket *p, FILE *f)
-{
-    char bufStart[RRpacketHdrSize];
-    void *buf;
-
-    if (f == NULL)
-        return false;
+// The file positions are counted in RecordFileBytes, so that they
+// are the same whether the packets are written in blocks or not.
 
+static void *packPacketHeader(RRpacket *p, void *buf)
+{
     // file pointer to the next packet location
-    u32 thisFilePos = ftell(f);
-    u32 nextFilePos = ftell(f) + RRpacketHdrSize + p->len;
+    u32 nextFilePos = RecordFileBytes + RRpacketHdrSize + p->len;
 
-    buf = nboPackUShort(bufStart, p->mode);
+    buf = nboPackUShort(buf, p->mode);
     buf = nboPackUShort(buf, p->code);
     buf = nboPackUInt(buf, p->len);
     buf = nboPackUInt(buf, nextFilePos);
     buf = nboPackUInt(buf, RecordFilePrevPos);
     buf = nboPackRRtime(buf, p->timestamp);
 
-    if (fwrite(bufStart, RRpacketHdrSize, 1, f) != 1)
-        return false;
+    return buf;
+}
 
-    if ((p->len != 0) && (fwrite(p->data, p->len, 1, f) != 1))
-        return false;
 
+static void countPacket(RRpacket *p)
+{
+    RecordFilePrevPos = RecordFileBytes;
     RecordFileBytes += p->len + RRpacketHdrSize;
     RecordFilePackets++;
-    RecordFilePrevPos = thisFilePos;
-
-    return true;
 }
 
 
-static RRpacket *loadPacket(FILE *f)
+static bool savePacket(RRpacket *p, FILE *f)
 {
-    RRpacket *p;
     char bufStart[RRpacketHdrSize];
-    const void *buf;
 
     if (f == NULL)
-        return NULL;
+        return false;
 
-    p = new RRpacket;
+    packPacketHeader(p, bufStart);
 
-    if (fread(bufStart, RRpacketHdrSize, 1, f) != 1)
-    {
-        delete p;
-        return NULL;
-    }
-    buf = nboUnpackUShort(bufStart, p->mode);
-    buf = nboUnpackUShort(buf, p->code);
-    buf = nboUnpackUInt(buf, p->len);
-    buf = nboUnpackUInt(buf, p->nextFilePos);
-    buf = nboUnpackUInt(buf, p->prevFilePos);
-    buf = nboUnpackRRtime(buf, p->timestamp);
-
-    if (p->len > (MaxPacketLen - ((int)sizeof(u16) * 2)))
-    {
-        fprintf(stderr, "loadRRpacket: ERROR, packtlen = %i\n", p->len);
-        delete p;
-        replayReset();
-        return NULL;
-    }
+    if (fwrite(bufStart, RRpacketHdrSize, 1, f) != 1)
+        return false;
 
-    if (p->len == 0)
-        p->data = NULL;
-    else
-    {
-        char *d = new char [p->len];
-        if (fread(d, p->len, 1, f) != 1)
-        {
-            delete[] d;
-            delete p;
-            return NULL;
-        }
-        p->data = d;
-    }
+    if ((p->len != 0) && (fwrite(p->data, p->len, 1, f) != 1))
+        return false;
 
-    logDebugMessage(4,"loadRRpacket(): mode = %i, len = %4i, code = %s, data = %p\n",
-                    (int)p->mode, p->len, msgString(p->code), p->data);
+    countPacket(p);
 
-    return p;
+    return true;
 }
 
 
@@ -2037,7 +1921,7 @@ static bool badFilename(const char *name)
 }
 
 
-static bool saveHeader(int p, RRtime filetime, FILE *f)
+static bool saveHeader(int p, RRtime filetime, u32 version, FILE *f)
 {
     char buffer[ReplayHeaderSize];
     char flagsBuf[MaxPacketLen]; // for the FlagType's
@@ -2077,7 +1961,7 @@ static bool saveHeader(int p, RRtime filetime, FILE *f)
 
     // pack the data
     buf = nboPackUInt(buffer, ReplayMagic);
-    buf = nboPackUInt(buf, ReplayVersion);
+    buf = nboPackUInt(buf, version);
     buf = nboPackUInt(buf, totalSize);
     buf = nboPackRRtime(buf, filetime); // placeholder when saving to file
     buf = nboPackUInt(buf, p); // player index
@@ -2233,6 +2117,26 @@ static bool loadHeader(ReplayHeader *h, FILE *f)
 }
 
 
+// The index block goes after the last packet block of a recording
+// straight to file.
+
+static bool saveIndex(FILE *f)
+{
+    std::vector<char> index;
+    ReplayReader::packIndex(RecordIndex, RecordFilePrevPos, index);
+
+    char hdr[RRblockHdrSize];
+    void *buf = nboPackUInt(hdr, (u32)index.size());
+    buf = nboPackUInt(buf, (u32)index.size());
+    nboPackUInt(buf, IndexBlock);
+
+    if ((fwrite(hdr, RRblockHdrSize, 1, f) != 1) ||
+            (fwrite(&index[0], index.size(), 1, f) != 1))
+        return false;
+    return true;
+}
+
+
 static bool saveFileTime(RRtime filetime, FILE *f)
 {
     rewind(f);
@@ -2412,128 +2316,6 @@ static void initPacket(u16 mode, u16 code, int len, const void *data, RRpacket *
 }
 
 
-static RRpacket *newPacket(u16 mode, u16 code, int len, const void *data)
-{
-    RRpacket *p = new RRpacket;
-
-    p->next = NULL;
-    p->prev = NULL;
-
-    char *d = new char [len];
-    if (d != NULL)
-        memcpy(d, data, len);
-    p->data = d;
-    initPacket(mode, code, len, p->data, p);
-
-    return p;
-}
-
-
-static void addHeadPacket(RRbuffer *b, RRpacket *p)
-{
-    if (b->head != NULL)
-        b->head->next = p;
-    else
-        b->tail = p;
-    p->prev = b->head;
-    p->next = NULL;
-    b->head = p;
-
-    b->byteCount = b->byteCount + (p->len + RRpacketHdrSize);
-    b->packetCount++;
-
-    return;
-}
-
-
-static void addTailPacket(RRbuffer *b, RRpacket *p)
-{
-    if (b->tail != NULL)
-        b->tail->prev = p;
-    else
-        b->head = p;
-    p->next = b->tail;
-    p->prev = NULL;
-    b->tail = p;
-
-    b->byteCount = b->byteCount + (p->len + RRpacketHdrSize);
-    b->packetCount++;
-
-    return;
-}
-
-
-static RRpacket *delTailPacket(RRbuffer *b)
-{
-    RRpacket *p = b->tail;
-
-    if (p == NULL)
-        return NULL;
-
-    b->byteCount = b->byteCount - (p->len + RRpacketHdrSize);
-    b->packetCount--;
-
-    b->tail = p->next;
-
-    if (p->next != NULL)
-        p->next->prev = NULL;
-    else
-    {
-        b->head = NULL;
-        b->tail = NULL;
-    }
-
-    return p;
-}
-
-
-static RRpacket *delHeadPacket(RRbuffer *b)
-{
-    RRpacket *p = b->head;
-
-    if (p == NULL)
-        return NULL;
-
-    b->byteCount = b->byteCount - (p->len + RRpacketHdrSize);
-    b->packetCount--;
-
-    b->head = p->prev;
-
-    if (p->prev != NULL)
-        p->prev->next = NULL;
-    else
-    {
-        b->tail = NULL;
-        b->head = NULL;
-    }
-
-    return p;
-}
-
-
-static void freeBuffer(RRbuffer *b)
-{
-    RRpacket *p, *ptmp;
-
-    p = b->tail;
-
-    while (p != NULL)
-    {
-        ptmp = p->next;
-        delete[] p->data;
-        delete p;
-        p = ptmp;
-    }
-
-    b->tail = NULL;
-    b->head = NULL;
-    b->byteCount = 0;
-    b->packetCount = 0;
-
-    return;
-}
-
-
 /******************************************************************************/
 
 // Timing Functions
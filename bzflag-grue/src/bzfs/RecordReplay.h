@@ -121,6 +121,24 @@ static const unsigned int RRpacketHdrSize =
     PACKET_SIZE_STUFFING +
     (2 * sizeof(u16)) + (3 * sizeof(u32)) + sizeof(RRtime);
 
+// Files of version ReplayBlockVersion, recorded straight to file, keep
+// the packets in blocks.  Each block starts with the number of packet
+// bytes in it, the number of bytes that follow, and the RRblockCoding
+// of those.  Put together after the header, the packet bytes are the
+// same as in a version 1 file, down to the file positions.
+//
+// A finished recording ends with an IndexBlock, stored as it is, that
+// lists the file positions and times of the UpdatePackets (see
+// ReplayReader).  It is not part of the packet bytes.
+static const u32 ReplayBlockVersion = 0x0002;
+static const unsigned int RRblockHdrSize = 3 * sizeof(u32);
+enum RRblockCoding
+{
+    StoredBlock = 0,
+    ZlibBlock   = 1,
+    IndexBlock  = 2
+};
+
 typedef struct
 {
     u32 magic;            // record file type identifier
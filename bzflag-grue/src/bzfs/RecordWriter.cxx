@@ -0,0 +1,264 @@
+/* bzflag
+ * Copyright (c) 1993-2021 Tim Riker
+ *
+ * This package is free software;  you can redistribute it and/or
+ * modify it under the terms of the license found in the file
+ * named COPYING that should have accompanied this file.
+ *
+ * THIS PACKAGE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+/* interface header */
+#include "RecordWriter.h"
+
+/* system implementation headers */
+#include <string.h>
+#include <chrono>
+#include <zlib.h>
+#ifndef _WIN32
+#  include <unistd.h>
+#else
+#  include <io.h>
+#endif
+
+/* common implementation headers */
+#include "bzfio.h"
+#include "Pack.h"
+
+/* bzfs implementation headers */
+#include "RecordReplay.h"
+
+
+// TimeKeeper is not for other threads
+typedef std::chrono::steady_clock Clock;
+
+// a block that is not full is written after this long
+static const Clock::duration blockDelay = std::chrono::seconds(1);
+// and the file is synced to the disk this often
+static const Clock::duration syncDelay = std::chrono::seconds(5);
+
+
+RecordWriter::RecordWriter() : file(NULL), compress(true), head(0), tail(0),
+    stopping(false), fileBytes(0), writeFailed(false),
+    droppedPackets(0), droppedBytes(0)
+{
+}
+
+RecordWriter::~RecordWriter()
+{
+    stop();
+}
+
+bool RecordWriter::start(FILE *_file, bool _compress)
+{
+    stop();
+    if (_file == NULL)
+        return false;
+
+    file = _file;
+    compress = _compress;
+    ring.resize(RingSize);
+    head = 0;
+    tail = 0;
+    stopping = false;
+    fileBytes = 0;
+    writeFailed = false;
+    droppedPackets = 0;
+    droppedBytes = 0;
+
+    writer = std::thread(&RecordWriter::writerLoop, this);
+    return true;
+}
+
+void RecordWriter::stop()
+{
+    if (file == NULL)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        stopping = true;
+    }
+    wake.notify_one();
+    writer.join();
+
+    if (droppedPackets > 0)
+        logDebugMessage(1,"Record: dropped %u packets (%u bytes) the disk could not keep up with\n",
+                        droppedPackets, droppedBytes);
+    if (writeFailed)
+        logDebugMessage(1,"Record: could not write the whole recording\n");
+
+    file = NULL;
+    std::vector<char>().swap(ring);
+    std::vector<unsigned char>().swap(packed);
+}
+
+bool RecordWriter::add(const void *header, unsigned int headerLen,
+                       const void *data, unsigned int dataLen)
+{
+    const unsigned int len = headerLen + dataLen;
+    const size_t h = head.load(std::memory_order_relaxed);
+    const size_t used = h - tail.load(std::memory_order_acquire);
+    if ((file == NULL) || (used + len > RingSize))
+    {
+        droppedPackets++;
+        droppedBytes += len;
+        return false;
+    }
+
+    // copy in, wrapping around the end of the ring
+    const void *parts[2] = { header, data };
+    const unsigned int lens[2] = { headerLen, dataLen };
+    size_t pos = h;
+    for (int i = 0; i < 2; i++)
+    {
+        const char *src = (const char *)parts[i];
+        unsigned int left = lens[i];
+        while (left > 0)
+        {
+            const size_t offset = pos % RingSize;
+            unsigned int chunk = (unsigned int)(RingSize - offset);
+            if (chunk > left)
+                chunk = left;
+            memcpy(&ring[offset], src, chunk);
+            src += chunk;
+            left -= chunk;
+            pos += chunk;
+        }
+    }
+    head.store(pos, std::memory_order_release);
+
+    // the writer looks in now and then anyway, only hurry it along
+    // when the ring is filling up
+    if (used + len > RingSize / 2)
+        wake.notify_one();
+
+    return true;
+}
+
+unsigned int RecordWriter::takeBytes(char *dst, unsigned int maxLen)
+{
+    const size_t t = tail.load(std::memory_order_relaxed);
+    size_t avail = head.load(std::memory_order_acquire) - t;
+    if (avail > maxLen)
+        avail = maxLen;
+
+    size_t pos = t;
+    size_t left = avail;
+    while (left > 0)
+    {
+        const size_t offset = pos % RingSize;
+        size_t chunk = RingSize - offset;
+        if (chunk > left)
+            chunk = left;
+        memcpy(dst, &ring[offset], chunk);
+        dst += chunk;
+        left -= chunk;
+        pos += chunk;
+    }
+    tail.store(pos, std::memory_order_release);
+
+    return (unsigned int)avail;
+}
+
+bool RecordWriter::writeBlock(const char *raw, unsigned int rawLen)
+{
+    u32 coding = StoredBlock;
+    const char *bytes = raw;
+    uLongf packedLen = rawLen;
+
+    if (compress)
+    {
+        packed.resize(compressBound(rawLen));
+        packedLen = (uLongf)packed.size();
+        if ((compress2(&packed[0], &packedLen, (const Bytef *)raw, rawLen,
+                       Z_DEFAULT_COMPRESSION) == Z_OK) && (packedLen < rawLen))
+        {
+            coding = ZlibBlock;
+            bytes = (const char *)&packed[0];
+        }
+        else
+            packedLen = rawLen;
+    }
+
+    char hdr[RRblockHdrSize];
+    void *buf = nboPackUInt(hdr, rawLen);
+    buf = nboPackUInt(buf, (u32)packedLen);
+    nboPackUInt(buf, coding);
+
+    if ((fwrite(hdr, RRblockHdrSize, 1, file) != 1) ||
+            (fwrite(bytes, packedLen, 1, file) != 1))
+        return false;
+
+    fileBytes.fetch_add(RRblockHdrSize + (unsigned int)packedLen,
+                        std::memory_order_relaxed);
+    return true;
+}
+
+void RecordWriter::syncFile()
+{
+    fflush(file);
+#ifndef _WIN32
+    fsync(fileno(file));
+#else
+    _commit(_fileno(file));
+#endif
+}
+
+void RecordWriter::writerLoop()
+{
+    std::vector<char> block(BlockSize);
+    unsigned int blockLen = 0;
+    Clock::time_point blockStart = Clock::now();
+    Clock::time_point lastSync = blockStart;
+    bool unsynced = false;
+
+    while (true)
+    {
+        if (blockLen == 0)
+            blockStart = Clock::now();
+        blockLen += takeBytes(&block[blockLen], BlockSize - blockLen);
+
+        const bool done = stopping.load(std::memory_order_acquire) &&
+                          (head.load(std::memory_order_acquire) ==
+                           tail.load(std::memory_order_relaxed));
+        const Clock::time_point now = Clock::now();
+
+        if ((blockLen == BlockSize) || ((blockLen > 0) &&
+                                        (done || ((now - blockStart) >= blockDelay))))
+        {
+            if (!writeFailed && !writeBlock(&block[0], blockLen))
+                writeFailed = true;
+            blockLen = 0;
+            unsynced = true;
+            // there may be more waiting already
+            if (!done)
+                continue;
+        }
+
+        if (unsynced && (done || ((now - lastSync) >= syncDelay)))
+        {
+            syncFile();
+            lastSync = now;
+            unsynced = false;
+        }
+
+        if (done)
+            break;
+
+        std::unique_lock<std::mutex> lock(wakeMutex);
+        if (!stopping)
+            wake.wait_for(lock, std::chrono::milliseconds(100));
+    }
+}
+
+
+// Local Variables: ***
+// mode: C++ ***
+// tab-width: 4 ***
+// c-basic-offset: 4 ***
+// indent-tabs-mode: nil ***
+// End: ***
+// ex: shiftwidth=4 tabstop=4
@@ -0,0 +1,117 @@
+/* bzflag
+ * Copyright (c) 1993-2021 Tim Riker
+ *
+ * This package is free software;  you can redistribute it and/or
+ * modify it under the terms of the license found in the file
+ * named COPYING that should have accompanied this file.
+ *
+ * THIS PACKAGE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef __RECORDWRITER_H__
+#define __RECORDWRITER_H__
+
+#include "common.h"
+
+/* system interface headers */
+#include <stdio.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/** RecordWriter writes the packets of a straight to file recording on
+    a thread of its own, so that a slow disk does not hold up the game.
+
+    The main thread copies each packet into a ring that only it adds to
+    and only the writer thread takes from.  The writer gathers the bytes
+    into blocks, compresses them, and writes them after the header of
+    the file (see RRblockHdrSize).  The data is flushed to the disk now
+    and then.
+
+    The ring has a fixed size.  A packet that does not fit is dropped
+    and counted, but the recording goes on.
+
+    start(), add() and stop() are for the main thread only.
+*/
+class RecordWriter
+{
+public:
+    RecordWriter();
+    ~RecordWriter();
+
+    /// write to file from where it is now, the file is not closed
+    bool      start(FILE *file, bool compress);
+    /// write out everything added so far and stop the thread
+    void      stop();
+    bool      running() const
+    {
+        return file != NULL;
+    }
+
+    /// false, and nothing is written, if the ring has no room for the
+    /// header and the data together
+    bool      add(const void *header, unsigned int headerLen,
+                  const void *data, unsigned int dataLen);
+
+    unsigned int getDroppedPackets() const
+    {
+        return droppedPackets;
+    }
+    unsigned int getDroppedBytes() const
+    {
+        return droppedBytes;
+    }
+    /// bytes in the file after the header, from the writer thread
+    unsigned int getFileBytes() const
+    {
+        return fileBytes.load(std::memory_order_relaxed);
+    }
+    bool      failed() const
+    {
+        return writeFailed.load(std::memory_order_relaxed);
+    }
+
+    static const unsigned int RingSize = (4 * 1024 * 1024);
+    static const unsigned int BlockSize = (64 * 1024);
+
+private:
+    void      writerLoop();
+    unsigned int takeBytes(char *dst, unsigned int maxLen);
+    bool      writeBlock(const char *raw, unsigned int rawLen);
+    void      syncFile();
+
+    FILE      *file;
+    bool      compress;
+    std::thread   writer;
+
+    // the producer owns head, the consumer owns tail, both only grow
+    std::vector<char> ring;
+    std::atomic<size_t> head;
+    std::atomic<size_t> tail;
+
+    std::mutex    wakeMutex;
+    std::condition_variable wake;
+    std::atomic<bool> stopping;
+
+    std::vector<unsigned char> packed;
+    std::atomic<unsigned int> fileBytes;
+    std::atomic<bool> writeFailed;
+
+    unsigned int  droppedPackets;
+    unsigned int  droppedBytes;
+};
+
+
+#endif  /* __RECORDWRITER_H__ */
+
+// Local Variables: ***
+// mode: C++ ***
+// tab-width: 4 ***
+// c-basic-offset: 4 ***
+// indent-tabs-mode: nil ***
+// End: ***
+// ex: shiftwidth=4 tabstop=4
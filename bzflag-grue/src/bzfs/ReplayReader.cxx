@@ -0,0 +1,493 @@
+/* bzflag
+ * Copyright (c) 1993-2021 Tim Riker
+ *
+ * This package is free software;  you can redistribute it and/or
+ * modify it under the terms of the license found in the file
+ * named COPYING that should have accompanied this file.
+ *
+ * THIS PACKAGE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+/* interface header */
+#include "ReplayReader.h"
+
+/* system implementation headers */
+#include <algorithm>
+#include <zlib.h>
+#ifndef _WIN32
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#endif
+
+/* common implementation headers */
+#include "bzfio.h"
+#include "Pack.h"
+
+/* bzfs implementation headers */
+#include "RecordWriter.h"
+
+
+// the sidecar index of a recording without one of its own
+static const u32 IndexMagic   = 0x72724249; // "rrBI"
+static const u32 IndexVersion = 0x0001;
+static const unsigned int IndexHdrSize = 3 * sizeof(u32);
+
+// an index is its entry count and the last packet, then the entries
+static const unsigned int IndexEntrySize = sizeof(u32) + sizeof(RRtime);
+
+
+static void *nboPackRRtime(void *buf, RRtime value)
+{
+    buf = nboPackUInt(buf, (u32) (value >> 32));       // msb's
+    buf = nboPackUInt(buf, (u32) (value & 0xFFFFFFFF)); // lsb's
+    return buf;
+}
+
+
+static const void *nboUnpackRRtime(const void *buf, RRtime& value)
+{
+    u32 msb, lsb;
+    buf = nboUnpackUInt(buf, msb);
+    buf = nboUnpackUInt(buf, lsb);
+    value = ((RRtime)msb << 32) + (RRtime)lsb;
+    return buf;
+}
+
+
+// the length of the file, -1 if it can't be had.  ftell() returns a
+// long, which is 32 bits on some systems.
+static long long getFileLength(FILE *file)
+{
+#ifdef _WIN32
+    if (_fseeki64(file, 0, SEEK_END) != 0)
+        return -1;
+    return _ftelli64(file);
+#else
+    if (fseeko(file, 0, SEEK_END) != 0)
+        return -1;
+    return (long long)ftello(file);
+#endif
+}
+
+
+ReplayReader::ReplayReader() : data(NULL), size(0), dataStart(0), lastPos(0),
+    mapping(NULL), unpacked(NULL)
+{
+}
+
+
+ReplayReader::~ReplayReader()
+{
+    close();
+}
+
+
+bool ReplayReader::open(FILE *file, u32 version, u32 _dataStart,
+                        const std::string& indexName)
+{
+    close();
+    dataStart = _dataStart;
+
+    if (version >= ReplayBlockVersion)
+    {
+        if (!unpackBlocks(file))
+        {
+            close();
+            return false;
+        }
+        file = unpacked;
+    }
+    if (!mapFile(file) || (size < dataStart))
+    {
+        close();
+        return false;
+    }
+
+    if (!index.empty() || (lastPos != 0))
+    {
+        if (checkIndex())
+            return true;
+        logDebugMessage(1,"Replay: the index of the file does not fit its packets\n");
+    }
+    if (loadIndexFile(indexName))
+        return true;
+
+    makeIndex();
+    saveIndexFile(indexName);
+    return true;
+}
+
+
+void ReplayReader::close()
+{
+#ifndef _WIN32
+    if (mapping != NULL)
+        munmap(mapping, size);
+#endif
+    mapping = NULL;
+    std::vector<char>().swap(storage);
+    if (unpacked != NULL)
+        fclose(unpacked);
+    unpacked = NULL;
+
+    data = NULL;
+    size = 0;
+    dataStart = 0;
+    lastPos = 0;
+    index.clear();
+}
+
+
+bool ReplayReader::readPacket(u32 filePos, RRpacket *p) const
+{
+    if ((filePos < dataStart) || (filePos > size) ||
+            ((size - filePos) < RRpacketHdrSize))
+        return false;
+
+    const void *buf = data + filePos;
+    buf = nboUnpackUShort(buf, p->mode);
+    buf = nboUnpackUShort(buf, p->code);
+    buf = nboUnpackUInt(buf, p->len);
+    buf = nboUnpackUInt(buf, p->nextFilePos);
+    buf = nboUnpackUInt(buf, p->prevFilePos);
+    nboUnpackRRtime(buf, p->timestamp);
+
+    if ((p->len > (MaxPacketLen - ((int)sizeof(u16) * 2))) ||
+            (p->len > (size - filePos - RRpacketHdrSize)))
+        return false;
+
+    p->data = (p->len == 0) ? NULL : (data + filePos + RRpacketHdrSize);
+    p->next = NULL;
+    p->prev = NULL;
+
+    return true;
+}
+
+
+static bool timeBefore(const ReplayReader::IndexEntry& e, RRtime timestamp)
+{
+    return e.timestamp < timestamp;
+}
+
+
+static bool timeAfter(RRtime timestamp, const ReplayReader::IndexEntry& e)
+{
+    return timestamp < e.timestamp;
+}
+
+
+u32 ReplayReader::nextUpdate(u32 filePos, RRtime timestamp) const
+{
+    std::vector<IndexEntry>::const_iterator it =
+        std::lower_bound(index.begin(), index.end(), timestamp, timeBefore);
+    while ((it != index.end()) && (it->filePos <= filePos))
+        ++it;
+    return (it == index.end()) ? 0 : it->filePos;
+}
+
+
+u32 ReplayReader::prevUpdate(u32 filePos, RRtime timestamp) const
+{
+    std::vector<IndexEntry>::const_iterator it =
+        std::upper_bound(index.begin(), index.end(), timestamp, timeAfter);
+    while (it != index.begin())
+    {
+        --it;
+        if (it->filePos < filePos)
+            return it->filePos;
+    }
+    return 0;
+}
+
+
+void ReplayReader::packIndex(const std::vector<IndexEntry>& entries,
+                             u32 lastPacketPos, std::vector<char>& buf)
+{
+    buf.resize(2 * sizeof(u32) + entries.size() * IndexEntrySize);
+    void *b = nboPackUInt(&buf[0], (u32)entries.size());
+    b = nboPackUInt(b, lastPacketPos);
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        b = nboPackUInt(b, entries[i].filePos);
+        b = nboPackRRtime(b, entries[i].timestamp);
+    }
+}
+
+
+bool ReplayReader::unpackIndex(const char *buf, u32 len)
+{
+    index.clear();
+    lastPos = 0;
+    if (len < (2 * sizeof(u32)))
+        return false;
+
+    u32 count;
+    const void *b = nboUnpackUInt(buf, count);
+    b = nboUnpackUInt(b, lastPos);
+    if (((len - 2 * sizeof(u32)) / IndexEntrySize) < count)
+    {
+        lastPos = 0;
+        return false;
+    }
+
+    index.resize(count);
+    for (u32 i = 0; i < count; i++)
+    {
+        b = nboUnpackUInt(b, index[i].filePos);
+        b = nboUnpackRRtime(b, index[i].timestamp);
+    }
+    return true;
+}
+
+
+bool ReplayReader::checkIndex() const
+{
+    RRpacket p;
+    if (!readPacket(lastPos, &p))
+        return false;
+    for (size_t i = 0; i < index.size(); i++)
+    {
+        if ((index[i].filePos < dataStart) || (index[i].filePos > lastPos))
+            return false;
+        if ((i > 0) && ((index[i].filePos <= index[i - 1].filePos) ||
+                        (index[i].timestamp < index[i - 1].timestamp)))
+            return false;
+        if (!readPacket(index[i].filePos, &p) || (p.mode != UpdatePacket) ||
+                (p.timestamp != index[i].timestamp))
+            return false;
+    }
+    return true;
+}
+
+
+void ReplayReader::makeIndex()
+{
+    index.clear();
+    lastPos = 0;
+
+    RRpacket p;
+    u32 pos = dataStart;
+    while (readPacket(pos, &p))
+    {
+        if (p.mode == UpdatePacket)
+        {
+            // skipping looks for times in order, a clock going back
+            // just makes the update before it harder to reach
+            if (index.empty() || (p.timestamp >= index.back().timestamp))
+            {
+                IndexEntry entry;
+                entry.filePos = pos;
+                entry.timestamp = p.timestamp;
+                index.push_back(entry);
+            }
+        }
+        lastPos = pos;
+        if (p.nextFilePos <= pos)
+            break;
+        pos = p.nextFilePos;
+    }
+
+    logDebugMessage(2,"Replay: indexed %i updates\n", (int)index.size());
+}
+
+
+bool ReplayReader::loadIndexFile(const std::string& name)
+{
+    FILE *f = fopen(name.c_str(), "rb");
+    if (f == NULL)
+        return false;
+
+    std::vector<char> buf;
+    char hdr[IndexHdrSize];
+    u32 magic = 0, version = 0, fileSize = 0;
+    if (fread(hdr, IndexHdrSize, 1, f) == 1)
+    {
+        const void *b = nboUnpackUInt(hdr, magic);
+        b = nboUnpackUInt(b, version);
+        nboUnpackUInt(b, fileSize);
+    }
+    if ((magic == IndexMagic) && (version == IndexVersion) && (fileSize == size))
+    {
+        char chunk[4096];
+        size_t got;
+        while ((got = fread(chunk, 1, sizeof(chunk), f)) > 0)
+            buf.insert(buf.end(), chunk, chunk + got);
+    }
+    fclose(f);
+
+    if (buf.empty() || !unpackIndex(&buf[0], (u32)buf.size()) || !checkIndex())
+    {
+        index.clear();
+        lastPos = 0;
+        return false;
+    }
+    return true;
+}
+
+
+void ReplayReader::saveIndexFile(const std::string& name) const
+{
+    std::vector<char> buf;
+    packIndex(index, lastPos, buf);
+
+    char hdr[IndexHdrSize];
+    void *b = nboPackUInt(hdr, IndexMagic);
+    b = nboPackUInt(b, IndexVersion);
+    nboPackUInt(b, size);
+
+    FILE *f = fopen(name.c_str(), "wb");
+    bool saved = (f != NULL) &&
+                 (fwrite(hdr, IndexHdrSize, 1, f) == 1) &&
+                 (fwrite(&buf[0], buf.size(), 1, f) == 1);
+    if (f != NULL)
+        saved = (fclose(f) == 0) && saved;
+    if (!saved)
+        logDebugMessage(2,"Replay: could not save the index %s\n", name.c_str());
+}
+
+
+bool ReplayReader::mapFile(FILE *file)
+{
+    fflush(file);
+
+#ifndef _WIN32
+    struct stat st;
+    if ((fstat(fileno(file), &st) == 0) && S_ISREG(st.st_mode) &&
+            (st.st_size > 0) && (st.st_size <= (off_t)0xFFFFFFFF))
+    {
+        void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE,
+                         fileno(file), 0);
+        if (map != MAP_FAILED)
+        {
+            mapping = map;
+            data = (const char *)map;
+            size = (u32)st.st_size;
+            return true;
+        }
+    }
+#endif
+
+    // no mapping, read it all in.  packets are found by 32 bit file
+    // positions, there's no use for anything past those.
+    const long long length = getFileLength(file);
+    if ((length <= 0) || (length > 0xFFFFFFFFLL) || (fseek(file, 0, SEEK_SET) < 0))
+        return false;
+    storage.resize((size_t)length);
+    if (fread(&storage[0], (size_t)length, 1, file) != 1)
+    {
+        std::vector<char>().swap(storage);
+        return false;
+    }
+    data = &storage[0];
+    size = (u32)length;
+    return true;
+}
+
+
+// The blocks after the header go to a temporary file laid out like a
+// version 1 file, so the file positions in the packets work.  A block
+// cut short, as when the server died while recording, ends the packets.
+// So does one bigger than RecordWriter makes them, before anything is
+// allocated for it.
+
+bool ReplayReader::unpackBlocks(FILE *file)
+{
+    const long long fileLength = getFileLength(file);
+    if (fileLength < (long long)dataStart)
+        return false;
+    unpacked = tmpfile();
+    if (unpacked == NULL)
+        return false;
+
+    // the header is copied as it is
+    std::vector<char> raw(dataStart);
+    if ((fseek(file, 0, SEEK_SET) < 0) ||
+            (fread(&raw[0], dataStart, 1, file) != 1) ||
+            (fwrite(&raw[0], dataStart, 1, unpacked) != 1))
+        return false;
+
+    const uLong maxPackedLen = compressBound(RecordWriter::BlockSize);
+    long long filePos = dataStart;
+    std::vector<char> packed;
+    char hdr[RRblockHdrSize];
+    while (fread(hdr, RRblockHdrSize, 1, file) == 1)
+    {
+        u32 rawLen, packedLen, coding;
+        const void *buf = nboUnpackUInt(hdr, rawLen);
+        buf = nboUnpackUInt(buf, packedLen);
+        nboUnpackUInt(buf, coding);
+        filePos += RRblockHdrSize;
+        if ((rawLen == 0) || (packedLen == 0))
+            break;
+
+        if (coding == IndexBlock)
+        {
+            // it can't be longer than the rest of the file
+            if (packedLen > (fileLength - filePos))
+            {
+                logDebugMessage(1,"Replay: the index block is cut short\n");
+                break;
+            }
+        }
+        else if ((rawLen > RecordWriter::BlockSize) || (packedLen > maxPackedLen))
+        {
+            logDebugMessage(1,"Replay: a block of %u bytes, %u packed, is too big\n",
+                            rawLen, packedLen);
+            break;
+        }
+
+        packed.resize(packedLen);
+        if (fread(&packed[0], packedLen, 1, file) != 1)
+        {
+            logDebugMessage(1,"Replay: the last block is cut short\n");
+            break;
+        }
+        filePos += packedLen;
+
+        if (coding == IndexBlock)
+        {
+            // the last one
+            if (!unpackIndex(&packed[0], packedLen))
+                logDebugMessage(1,"Replay: could not read the index block\n");
+            break;
+        }
+        else if (coding == StoredBlock)
+        {
+            if (packedLen != rawLen)
+                break;
+            raw.swap(packed);
+        }
+        else if (coding == ZlibBlock)
+        {
+            raw.resize(rawLen);
+            uLongf len = rawLen;
+            if ((uncompress((Bytef *)&raw[0], &len, (const Bytef *)&packed[0],
+                            packedLen) != Z_OK) || (len != rawLen))
+            {
+                logDebugMessage(1,"Replay: could not unpack a block\n");
+                break;
+            }
+        }
+        else
+        {
+            logDebugMessage(1,"Replay: unknown block coding %u\n", coding);
+            break;
+        }
+
+        if (fwrite(&raw[0], rawLen, 1, unpacked) != 1)
+            return false;
+    }
+
+    return true;
+}
+
+
+// Local Variables: ***
+// mode: C++ ***
+// tab-width: 4 ***
+// c-basic-offset: 4 ***
+// indent-tabs-mode: nil ***
+// End: ***
+// ex: shiftwidth=4 tabstop=4
@@ -0,0 +1,114 @@
+/* bzflag
+ * Copyright (c) 1993-2021 Tim Riker
+ *
+ * This package is free software;  you can redistribute it and/or
+ * modify it under the terms of the license found in the file
+ * named COPYING that should have accompanied this file.
+ *
+ * THIS PACKAGE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef __REPLAYREADER_H__
+#define __REPLAYREADER_H__
+
+#include "common.h"
+
+/* system interface headers */
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+/* bzfs interface headers */
+#include "RecordReplay.h"
+
+/** ReplayReader holds the packets of a loaded recording in memory, so
+    that any of them can be read by its file position without reading
+    the file again or allocating.  Files are mapped where the platform
+    allows, the blocks of version 2 files are unpacked to a temporary
+    file first.
+
+    The file positions and times of the UpdatePackets are kept in an
+    index, which is what skipping searches.  It comes from the end of a
+    version 2 file, from the sidecar file next to an older one, or is
+    made by going through the packets once and then saved as the
+    sidecar.
+*/
+class ReplayReader
+{
+public:
+    struct IndexEntry
+    {
+        u32       filePos;
+        RRtime    timestamp;
+    };
+
+    ReplayReader();
+    ~ReplayReader();
+
+    /// file is the recording, the packets start at dataStart, the
+    /// sidecar index goes by indexName
+    bool      open(FILE *file, u32 version, u32 dataStart,
+                   const std::string& indexName);
+    void      close();
+    bool      isOpen() const
+    {
+        return data != NULL;
+    }
+
+    /// the packet at filePos, its data points into the recording
+    bool      readPacket(u32 filePos, RRpacket *p) const;
+
+    u32       getFirstPos() const
+    {
+        return dataStart;
+    }
+    u32       getLastPos() const
+    {
+        return lastPos;
+    }
+    size_t    getUpdateCount() const
+    {
+        return index.size();
+    }
+    /// the first UpdatePacket after filePos from the time on, 0 if none
+    u32       nextUpdate(u32 filePos, RRtime timestamp) const;
+    /// the last UpdatePacket before filePos up to the time, 0 if none
+    u32       prevUpdate(u32 filePos, RRtime timestamp) const;
+
+    /// the contents of an IndexBlock
+    static void   packIndex(const std::vector<IndexEntry>& entries,
+                            u32 lastPacketPos, std::vector<char>& buf);
+
+private:
+    bool      mapFile(FILE *file);
+    bool      unpackBlocks(FILE *file);
+    bool      unpackIndex(const char *buf, u32 len);
+    bool      checkIndex() const;
+    void      makeIndex();
+    bool      loadIndexFile(const std::string& name);
+    void      saveIndexFile(const std::string& name) const;
+
+    const char    *data;
+    u32       size;
+    u32       dataStart;
+    u32       lastPos;
+
+    void      *mapping;
+    std::vector<char> storage;
+    FILE      *unpacked;
+
+    std::vector<IndexEntry> index;
+};
+
+
+#endif  /* __REPLAYREADER_H__ */
+
+// Local Variables: ***
+// mode: C++ ***
+// tab-width: 4 ***
+// c-basic-offset: 4 ***
+// indent-tabs-mode: nil ***
+// End: ***
+// ex: shiftwidth=4 tabstop=4
@@ -0,0 +1,134 @@
+/* bzflag
+ * Copyright (c) 1993-2021 Tim Riker
+ *
+ * This package is free software;  you can redistribute it and/or
+ * modify it under the terms of the license found in the file
+ * named COPYING that should have accompanied this file.
+ *
+ * THIS PACKAGE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+/* interface header */
+#include "Scheduler.h"
+
+Scheduler scheduler;
+
+Scheduler::Scheduler() : lastID(0)
+{
+}
+
+unsigned int Scheduler::add(double delay, Callback callback, void *userData)
+{
+    TimeKeeper when = TimeKeeper::getCurrent();
+    when += delay;
+    return addAt(when, callback, userData);
+}
+
+unsigned int Scheduler::addAt(const TimeKeeper &when, Callback callback, void *userData)
+{
+    if (!callback)
+        return 0;
+
+    // zero means no timer
+    do
+        lastID++;
+    while (lastID == 0 || timers.find(lastID) != timers.end());
+
+    Timer &timer = timers[lastID];
+    timer.callback = callback;
+    timer.userData = userData;
+    push(lastID, when.getSeconds());
+    return lastID;
+}
+
+bool Scheduler::cancel(unsigned int id)
+{
+    // the deadline stays queued, it's dropped once it comes up
+    return timers.erase(id) > 0;
+}
+
+bool Scheduler::isScheduled(unsigned int id) const
+{
+    return timers.find(id) != timers.end();
+}
+
+void Scheduler::push(unsigned int id, double when)
+{
+    timers[id].when = when;
+    Deadline d;
+    d.when = when;
+    d.id   = id;
+    deadlines.push(d);
+}
+
+bool Scheduler::isStale(const Deadline &d) const
+{
+    std::unordered_map<unsigned int, Timer>::const_iterator itr = timers.find(d.id);
+    return itr == timers.end() || itr->second.when != d.when;
+}
+
+float Scheduler::getWaitTime(const TimeKeeper &now, float maxWait)
+{
+    while (!deadlines.empty() && isStale(deadlines.top()))
+        deadlines.pop();
+    if (deadlines.empty())
+        return maxWait;
+
+    const double wait = deadlines.top().when - now.getSeconds();
+    if (wait <= 0.0)
+        return 0.0f;
+    return wait < maxWait ? (float)wait : maxWait;
+}
+
+void Scheduler::run(const TimeKeeper &now)
+{
+    const double nowSeconds = now.getSeconds();
+
+    // take everything that's due first, so a timer that asks to run again
+    // right away waits for the next loop instead of spinning here
+    due.clear();
+    while (!deadlines.empty() && deadlines.top().when <= nowSeconds)
+    {
+        if (!isStale(deadlines.top()))
+            due.push_back(deadlines.top());
+        deadlines.pop();
+    }
+
+    for (size_t i = 0; i < due.size(); i++)
+    {
+        const Deadline &d = due[i];
+
+        // an earlier callback may have canceled this one
+        std::unordered_map<unsigned int, Timer>::iterator itr = timers.find(d.id);
+        if (itr == timers.end() || itr->second.when != d.when)
+            continue;
+
+        const double next = itr->second.callback(itr->second.userData);
+
+        // the callback may have canceled itself or added timers
+        itr = timers.find(d.id);
+        if (itr == timers.end() || itr->second.when != d.when)
+            continue;
+        if (next < 0.0)
+        {
+            timers.erase(itr);
+            continue;
+        }
+
+        // keep the beat, but don't try to make up for a stall
+        double when = d.when + next;
+        if (when < nowSeconds)
+            when = nowSeconds;
+        push(d.id, when);
+    }
+}
+
+// Local Variables: ***
+// mode: C++ ***
+// tab-width: 4 ***
+// c-basic-offset: 4 ***
+// indent-tabs-mode: nil ***
+// End: ***
+// ex: shiftwidth=4 tabstop=4
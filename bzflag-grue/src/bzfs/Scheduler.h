@@ -0,0 +1,99 @@
+/* bzflag
+ * Copyright (c) 1993-2021 Tim Riker
+ *
+ * This package is free software;  you can redistribute it and/or
+ * modify it under the terms of the license found in the file
+ * named COPYING that should have accompanied this file.
+ *
+ * THIS PACKAGE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef __SCHEDULER_H__
+#define __SCHEDULER_H__
+
+#include "common.h"
+
+/* system interface headers */
+#include <queue>
+#include <vector>
+#include <unordered_map>
+
+/* common interface headers */
+#include "TimeKeeper.h"
+
+/** Scheduler holds the deadlines of the things bzfs has to do at a given
+    time, so the main loop can sleep until the earliest one and then run
+    only what is due.
+
+    A callback returns how long after its deadline it wants to run again,
+    or a negative value when it is done.  Repeating timers count from
+    their previous deadline, not from when they actually ran, so a late
+    wakeup does not push every later run back with it.
+*/
+class Scheduler
+{
+public:
+    typedef double (*Callback)(void *userData);
+
+    Scheduler();
+
+    /// run the callback delay seconds from now, returns the id for cancel()
+    unsigned int  add(double delay, Callback callback, void *userData);
+    unsigned int  addAt(const TimeKeeper &when, Callback callback, void *userData);
+
+    /// forget a timer, it's safe to cancel any timer from a callback
+    bool      cancel(unsigned int id);
+    bool      isScheduled(unsigned int id) const;
+
+    /// seconds until the next deadline, never more than maxWait
+    float     getWaitTime(const TimeKeeper &now, float maxWait);
+
+    /// call everything whose deadline has come
+    void      run(const TimeKeeper &now);
+
+    size_t    count() const
+    {
+        return timers.size();
+    }
+
+private:
+    struct Timer
+    {
+        double    when;
+        Callback  callback;
+        void      *userData;
+    };
+    struct Deadline
+    {
+        double    when;
+        unsigned int  id;
+
+        // earliest on top of the queue
+        bool operator<(const Deadline &d) const
+        {
+            return when > d.when;
+        }
+    };
+
+    void      push(unsigned int id, double when);
+    bool      isStale(const Deadline &d) const;
+
+    std::unordered_map<unsigned int, Timer>   timers;
+    std::priority_queue<Deadline> deadlines;
+    std::vector<Deadline>     due;
+    unsigned int  lastID;
+};
+
+extern Scheduler scheduler;
+
+#endif
+
+// Local Variables: ***
+// mode: C++ ***
+// tab-width: 4 ***
+// c-basic-offset: 4 ***
+// indent-tabs-mode: nil ***
+// End: ***
+// ex: shiftwidth=4 tabstop=4
@@ -25,7 +25,6 @@ double Manager::DeadShotCacheTime = 10.0;
 Manager::Manager()
 {
     Logics[std::string("")] = new FlightLogic();
-    LastGUID = INVALID_SHOT_GUID;
 }
 
 Manager::~Manager()
@@ -35,9 +34,11 @@ Manager::~Manager()
 
     Logics.clear();
 
-    LiveShots.clear();
+    for (size_t i = 0; i < Slots.size(); i++)
+        delete(Slots[i].Item);
 
-    RecentlyDeadShots.clear();
+    Slots.clear();
+    FreeSlots.clear();
 }
 
 void Manager::Init()
@@ -68,14 +69,24 @@ uint32_t Manager::AddShot( const FiringInfo &info, PlayerId UNUSED(shooter) )
     if (!logic)
         logic = Logics[""];
 
-    ShotRef shot(new Shot(NewGUID(),info,*logic));
+    const uint32_t guid = NewGUID();
+    if (guid == INVALID_SHOT_GUID)
+        return INVALID_SHOT_GUID;
+
+    Shot *shot = new Shot(guid,info,*logic);
+
+    Slot &slot = Slots[guid & SlotMask];
+    slot.Item = shot;
+    slot.Live = true;
 
     shot->LastUpdateTime = shot->StartTime = Now();
     logic->Setup(*shot);
     shot->Update(); // to get the initial position
     shot->StartPosition = shot->LastUpdatePosition;
 
-    LiveShots.push_back(shot);
+    Link(LiveShots, shot, &Shot::ListIndex);
+    Link(LivePlayerShots[shot->GetPlayerID()], shot, &Shot::PlayerListIndex);
+    LiveByLocalID[LocalKey(shot->GetPlayerID(), shot->Info.shot.id)] = guid;
 
     if (ShotCreated)
         (*ShotCreated)(*shot);
@@ -84,35 +95,39 @@ uint32_t Manager::AddShot( const FiringInfo &info, PlayerId UNUSED(shooter) )
 
 void Manager::RemoveShot (uint32_t shotID)
 {
-    ShotList::iterator itr = LiveShots.begin();
-    while ( itr != LiveShots.end())
-    {
-        if ((*itr)->GetGUID() == shotID)
-        {
-            (*itr)->End();
-            RecentlyDeadShots.push_back((*itr));
-            itr = LiveShots.erase(itr);
-            if (ShotEnded)
-                (*ShotEnded)(*(*itr));
-            return;
-        }
-        else
-            itr++;
-    }
+    Slot *slot = FindSlot(shotID);
+    if (!slot || !slot->Live)
+        return;
+
+    Shot *shot = slot->Item;
+    Kill(shot);
+    if (ShotEnded)
+        (*ShotEnded)(*shot);
 }
 
 void Manager::RemovePlayer( PlayerId player )
 {
-    ShotList::iterator itr = LiveShots.begin();
-    while ( itr != LiveShots.end())
+    // live shots of a leaving player are gone for good, they do not go
+    // to the dead shot cache
+    ShotList &list = LivePlayerShots[player];
+    while (!list.empty())
     {
-        if ((*itr)->GetPlayerID() == player)
-        {
-            (*itr)->End();
-            itr = LiveShots.erase(itr);
-        }
-        else
-            itr++;
+        Shot *shot = list.back();
+        list.pop_back();
+        Unlink(LiveShots, shot, &Shot::ListIndex);
+
+        std::unordered_map<uint32_t, uint32_t>::iterator itr
+            = LiveByLocalID.find(LocalKey(player, shot->Info.shot.id));
+        if (itr != LiveByLocalID.end() && itr->second == shot->GetGUID())
+            LiveByLocalID.erase(itr);
+
+        shot->End();
+
+        Slot &slot = Slots[shot->GetGUID() & SlotMask];
+        slot.Item = NULL;
+        slot.Live = false;
+        FreeSlots.push_back(shot->GetGUID() & SlotMask);
+        delete(shot);
     }
 }
 
@@ -125,46 +140,124 @@ void Manager::SetShotTarget( uint32_t shotID, PlayerId target )
 
 uint32_t Manager::FindShotGUID (PlayerId shooter, uint16_t localShotID)
 {
-    for (ShotList::iterator itr = LiveShots.begin(); itr != LiveShots.end(); itr++)
+    const uint32_t key = LocalKey(shooter, localShotID);
+
+    std::unordered_map<uint32_t, uint32_t>::iterator itr = LiveByLocalID.find(key);
+    if (itr != LiveByLocalID.end())
+        return itr->second;
+
+    itr = DeadByLocalID.find(key);
+    if (itr != DeadByLocalID.end())
+        return itr->second;
+
+    return 0;
+}
+
+uint32_t Manager::NewGUID()
+{
+    uint32_t index;
+    if (!FreeSlots.empty())
     {
-        if ((*itr)->GetPlayerID() == shooter && (*itr)->Info.shot.id == localShotID)
-            return (*itr)->GetGUID();
+        index = FreeSlots.back();
+        FreeSlots.pop_back();
     }
-
-    for (ShotList::iterator itr = RecentlyDeadShots.begin(); itr != RecentlyDeadShots.end(); itr++)
+    else
     {
-        if ((*itr)->GetPlayerID() == shooter && (*itr)->Info.shot.id == localShotID)
-            return (*itr)->GetGUID();
+        index = (uint32_t)Slots.size();
+        if (index > SlotMask)
+        {
+            logDebugMessage(1,"Too many shots in flight, dropping new shot\n");
+            return INVALID_SHOT_GUID;
+        }
+        Slot slot;
+        slot.Item = NULL;
+        slot.Generation = 0;
+        slot.Live = false;
+        Slots.push_back(slot);
     }
 
-    return 0;
+    // generation 0 is skipped so no GUID is ever INVALID_SHOT_GUID
+    Slot &slot = Slots[index];
+    slot.Generation = (slot.Generation + 1) & (0xffffffff >> SlotBits);
+    if (slot.Generation == 0)
+        slot.Generation = 1;
+
+    return (slot.Generation << SlotBits) | index;
 }
 
-uint32_t Manager::NewGUID()
+Manager::Slot* Manager::FindSlot (uint32_t shotID)
 {
-    LastGUID++;
+    const uint32_t index = shotID & SlotMask;
+    if (index >= Slots.size())
+        return NULL;
 
-    if (LastGUID == INVALID_SHOT_GUID) // handle the rollover
-        LastGUID = INVALID_SHOT_GUID + 1;
+    Slot &slot = Slots[index];
+    if (!slot.Item || slot.Generation != shotID >> SlotBits)
+        return NULL;
 
-    return LastGUID;
+    return &slot;
 }
 
 ShotRef Manager::FindByID (uint32_t shotID)
 {
-    for (ShotList::iterator itr = LiveShots.begin(); itr != LiveShots.end(); itr++)
-    {
-        if ((*itr)->GetGUID() == shotID)
-            return *itr;
-    }
+    Slot *slot = FindSlot(shotID);
+    return slot ? slot->Item : NULL;
+}
 
-    for (ShotList::iterator itr = RecentlyDeadShots.begin(); itr != RecentlyDeadShots.end(); itr++)
-    {
-        if ((*itr)->GetGUID() == shotID)
-            return *itr;
-    }
+void Manager::Link(ShotList& list, Shot* shot, size_t Shot::*index)
+{
+    shot->*index = list.size();
+    list.push_back(shot);
+}
+
+void Manager::Unlink(ShotList& list, Shot* shot, size_t Shot::*index)
+{
+    // the order of the lists does not matter, move the last one in
+    const size_t i = shot->*index;
+    Shot *last = list.back();
+    list[i] = last;
+    last->*index = i;
+    list.pop_back();
+}
+
+void Manager::Kill(Shot* shot)
+{
+    const uint32_t guid = shot->GetGUID();
+    const PlayerId player = shot->GetPlayerID();
+    const uint32_t key = LocalKey(player, shot->Info.shot.id);
+
+    Unlink(LiveShots, shot, &Shot::ListIndex);
+    Unlink(LivePlayerShots[player], shot, &Shot::PlayerListIndex);
+    std::unordered_map<uint32_t, uint32_t>::iterator itr = LiveByLocalID.find(key);
+    if (itr != LiveByLocalID.end() && itr->second == guid)
+        LiveByLocalID.erase(itr);
+    Slots[guid & SlotMask].Live = false;
+
+    shot->End();
+
+    Link(DeadPlayerShots[player], shot, &Shot::PlayerListIndex);
+    DeadByLocalID[key] = guid;
 
-    return ShotRef();
+    DeadShot dead;
+    dead.Died = shot->GetLastUpdateTime();
+    dead.GUID = guid;
+    DeadShotExpiry.push(dead);
+}
+
+void Manager::Free(Shot* shot)
+{
+    const uint32_t guid = shot->GetGUID();
+    const PlayerId player = shot->GetPlayerID();
+
+    Unlink(DeadPlayerShots[player], shot, &Shot::PlayerListIndex);
+    std::unordered_map<uint32_t, uint32_t>::iterator itr
+        = DeadByLocalID.find(LocalKey(player, shot->Info.shot.id));
+    if (itr != DeadByLocalID.end() && itr->second == guid)
+        DeadByLocalID.erase(itr);
+
+    Slots[guid & SlotMask].Item = NULL;
+    FreeSlots.push_back(guid & SlotMask);
+    delete(shot);
 }
 
 double Manager::Now()
@@ -176,62 +269,90 @@ void Manager::Update()
 {
     double now = Now();
 
-    ShotList::iterator itr = LiveShots.begin();
-    while ( itr != LiveShots.end())
+    size_t i = 0;
+    while (i < LiveShots.size())
     {
-        (*itr)->LastUpdateTime = now;
-        if ((*itr)->Update())
-        {
-            ShotRef shot = *itr;
-            itr = LiveShots.erase(itr);
-            shot->End();
-            RecentlyDeadShots.push_back(shot);
-        }
+        Shot *shot = LiveShots[i];
+        shot->LastUpdateTime = now;
+        if (shot->Update())
+            Kill(shot); // moves another shot into i
         else
-            itr++;
+            i++;
     }
 
-    itr = RecentlyDeadShots.begin();
-
-    while ( itr != RecentlyDeadShots.end())
+    // shots die in order, so the oldest dead one is always on top
+    while (!DeadShotExpiry.empty()
+            && now - DeadShotExpiry.top().Died >= Manager::DeadShotCacheTime)
     {
-        if (now - (*itr)->GetLastUpdateTime() >= Manager::DeadShotCacheTime)
-            itr = RecentlyDeadShots.erase(itr);
-        else
-            itr++;
+        Slot *slot = FindSlot(DeadShotExpiry.top().GUID);
+        DeadShotExpiry.pop();
+        if (slot && !slot->Live)
+            Free(slot->Item);
     }
 }
 
 ShotList Manager::LiveShotsForPlayer( PlayerId player )
 {
-    ShotList list;
+    return LivePlayerShots[player];
+}
+
+ShotList Manager::DeadShotsForPlayer( PlayerId player )
+{
+    return DeadPlayerShots[player];
+}
 
-    for (ShotList::iterator itr = LiveShots.begin(); itr != LiveShots.end(); itr++)
-    {
-        if ((*itr)->GetPlayerID() == player)
-            list.push_back(*itr);
-    }
+//----------------Shot
+
+// freed shots are kept for the next ones, busy servers go through
+// thousands of them
+static const size_t MaxPooledShots = 4096;
 
-    return list;
+static std::vector<void*>& ShotPool()
+{
+    // never destroyed, the manager may free shots during static destruction
+    static std::vector<void*> *pool = new std::vector<void*>;
+    return *pool;
 }
 
-ShotList Manager::DeadShotsForPlayer( PlayerId player )
+void* Shot::operator new(size_t size)
 {
-    ShotList list;
+    std::vector<void*> &pool = ShotPool();
+    if (size != sizeof(Shot) || pool.empty())
+        return ::operator new(size);
 
-    for (ShotList::iterator itr = RecentlyDeadShots.begin(); itr != RecentlyDeadShots.end(); itr++)
-    {
-        if ((*itr)->GetPlayerID() == player)
-            list.push_back(*itr);
-    }
+    void *ptr = pool.back();
+    pool.pop_back();
+    return ptr;
+}
 
-    return list;
+void Shot::operator delete(void *ptr)
+{
+    std::vector<void*> &pool = ShotPool();
+    if (pool.size() >= MaxPooledShots)
+        ::operator delete(ptr);
+    else
+        pool.push_back(ptr);
 }
 
-//----------------Shot
+// metadata names are interned, a shot only keeps the number
+static uint32_t InternMetaDataKey(const std::string& name, bool add)
+{
+    static std::unordered_map<std::string, uint32_t> *keys
+        = new std::unordered_map<std::string, uint32_t>;
+
+    std::unordered_map<std::string, uint32_t>::iterator itr = keys->find(name);
+    if (itr != keys->end())
+        return itr->second;
+    if (!add)
+        return 0;
 
-Shot::Shot(uint32_t guid, const FiringInfo &info, FlightLogic& logic): GUID(guid), Logic(logic), LastUpdateTime(-1.0),
-    Info(info), Pimple(NULL)
+    const uint32_t key = (uint32_t)keys->size() + 1;
+    (*keys)[name] = key;
+    return key;
+}
+
+Shot::Shot(uint32_t guid, const FiringInfo &info, FlightLogic& logic): GUID(guid), Logic(logic),
+    ListIndex(0), PlayerListIndex(0), LastUpdateTime(-1.0), Info(info), Pimple(NULL)
 {
     StartTime = -1;
     LifeTime = info.lifetime;
@@ -242,35 +363,58 @@ Shot::~Shot()
 {
 }
 
+Shot::MetaDataItem* Shot::FindMetaData(const std::string& name)
+{
+    const uint32_t key = InternMetaDataKey(name, false);
+    if (!key)
+        return NULL;
+
+    for (size_t i = 0; i < MetaData.size(); i++)
+    {
+        if (MetaData[i].Key == key)
+            return &MetaData[i];
+    }
+    return NULL;
+}
+
+Shot::MetaDataItem& Shot::AddMetaData(const std::string& name)
+{
+    MetaDataItem *item = FindMetaData(name);
+    if (item)
+        return *item;
+
+    MetaData.push_back(MetaDataItem());
+    item = &MetaData.back();
+    item->Key = InternMetaDataKey(name, true);
+    item->DataI = 0;
+    return *item;
+}
+
 void Shot::SetMetaData(const std::string& name, const char* data)
 {
-    if (MetaData.find(name) == MetaData.end())
-        MetaData[name] = MetaDataItem();
-    MetaData[name].DataS = data;
+    AddMetaData(name).DataS = data;
 }
 
 void Shot::SetMetaData(const std::string& name, uint32_t data)
 {
-    if (MetaData.find(name) == MetaData.end())
-        MetaData[name] = MetaDataItem();
-    MetaData[name].DataI = data;
+    AddMetaData(name).DataI = data;
 }
 
 bool Shot::HasMetaData(const std::string& name)
 {
-    return MetaData.find(name) != MetaData.end();
+    return FindMetaData(name) != NULL;
 }
 
 const char * Shot::GetMetaDataS(const std::string& name)
 {
-    auto itr = MetaData.find(name);
-    return itr == MetaData.end() ? nullptr : itr->second.DataS.c_str();
+    MetaDataItem *item = FindMetaData(name);
+    return item ? item->DataS.c_str() : nullptr;
 }
 
 uint32_t Shot::GetMetaDataI(const std::string& name)
 {
-    auto itr = MetaData.find(name);
-    return itr == MetaData.end() ? 0 : itr->second.DataI;
+    MetaDataItem *item = FindMetaData(name);
+    return item ? item->DataI : 0;
 }
 
 bool Shot::Update()
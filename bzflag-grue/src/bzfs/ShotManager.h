@@ -23,6 +23,8 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <queue>
+#include <unordered_map>
 #ifdef USE_TR1
 #include <tr1/memory>
 #include <tr1/functional>
@@ -72,6 +74,8 @@ typedef std::map<std::string, FlightLogic*> FlightLogicMap;
 class Shot
 {
 protected:
+    friend class Manager;
+
     uint32_t GUID;
     FlightLogic &Logic;
 
@@ -80,12 +84,20 @@ protected:
     class MetaDataItem
     {
     public:
-        std::string Name;
+        uint32_t    Key;    // interned name, see InternMetaDataKey()
         std::string DataS;
         uint32_t    DataI;
     };
 
-    std::map<std::string, MetaDataItem> MetaData;
+    // shots rarely carry more than a couple of items, a scan beats a map
+    std::vector<MetaDataItem> MetaData;
+
+    MetaDataItem* FindMetaData(const std::string& name);
+    MetaDataItem& AddMetaData(const std::string& name);
+
+    // positions in the manager's lists, for removal without searching
+    size_t  ListIndex;
+    size_t  PlayerListIndex;
 
 public:
     fvec3       StartPosition;
@@ -102,6 +114,10 @@ public:
     Shot(uint32_t guid, const FiringInfo &info, FlightLogic& logic);
     virtual ~Shot();
 
+    // shots come from a pool owned by the manager
+    static void* operator new(size_t size);
+    static void operator delete(void *ptr);
+
     bool Update();
     void End();
     void Retarget(PlayerId target);
@@ -160,8 +176,10 @@ public:
 
 };
 
-typedef std::shared_ptr<Shot>   ShotRef;
-typedef std::vector<std::shared_ptr<Shot>> ShotList;
+// shots are owned by the manager, a reference is good until the shot
+// expires from the dead shot cache
+typedef Shot*   ShotRef;
+typedef std::vector<Shot*> ShotList;
 typedef std::shared_ptr<std::function <void (Shot&)> > ShotEvent;
 
 #ifdef USE_TR1
@@ -206,17 +224,62 @@ public:
     ShotEvent ShotEnded;
 
 private:
+    // a GUID is a slot index in the low bits and the slot's generation
+    // in the high bits, so stale GUIDs of reused slots do not match
+    static const int        SlotBits = 20;
+    static const uint32_t   SlotMask = (1 << SlotBits) - 1;
+
+    class Slot
+    {
+    public:
+        Shot        *Item;
+        uint32_t    Generation;
+        bool        Live;
+    };
+
+    class DeadShot
+    {
+    public:
+        double      Died;
+        uint32_t    GUID;
+
+        bool operator < (const DeadShot& other) const
+        {
+            // earliest first out of the priority queue
+            return Died > other.Died;
+        }
+    };
+
     uint32_t NewGUID();
     ShotRef FindByID(uint32_t shotID);
+    Slot* FindSlot(uint32_t shotID);
+
+    static uint32_t LocalKey(PlayerId player, uint16_t localShotID)
+    {
+        return ((uint32_t)player << 16) | localShotID;
+    }
+
+    void Link(ShotList& list, Shot* shot, size_t Shot::*index);
+    void Unlink(ShotList& list, Shot* shot, size_t Shot::*index);
+    void Kill(Shot* shot);
+    void Free(Shot* shot);
 
     double Now();
 
+    std::vector<Slot>       Slots;
+    std::vector<uint32_t>   FreeSlots;
+
     ShotList    LiveShots;
-    ShotList    RecentlyDeadShots;
+    ShotList    LivePlayerShots[256];
+    ShotList    DeadPlayerShots[256];
 
-    FlightLogicMap Logics;
+    // (player, local shot id) to the newest shot that used it
+    std::unordered_map<uint32_t, uint32_t>  LiveByLocalID;
+    std::unordered_map<uint32_t, uint32_t>  DeadByLocalID;
 
-    uint32_t    LastGUID;
+    std::priority_queue<DeadShot>   DeadShotExpiry;
+
+    FlightLogicMap Logics;
 
 };
 
@@ -23,9 +23,14 @@
 /* server headers */
 #include "bzfs.h"
 #include "DropGeometry.h"
+#include "SpawnSurfaces.h"
 
 
-SpawnPolicy::SpawnPolicy(): testPos(), safeSWRadius(0.0), safeSRRadius(0.0), safeDistance(0.0)
+/* the number of player buckets, a power of two */
+static const int playerBuckets = 64;
+
+
+SpawnPolicy::SpawnPolicy(): testPos(), squareSize(1.0), safeSWRadius(0.0), safeSRRadius(0.0), safeDistance(0.0)
 {
 }
 
@@ -47,6 +52,7 @@ void SpawnPolicy::getPosition(float pos[3], int playerId, bool onGroundOnly, boo
 
     const PlayerInfo& pi = playerData->player;
     team = pi.getTeam();
+    gatherPlayers();
 
     if (!BZDB.isTrue("freeCtfSpawns") &&
             playerData->player.shouldRestartAtBase() &&
@@ -87,6 +93,17 @@ void SpawnPolicy::getPosition(float pos[3], int playerId, bool onGroundOnly, boo
         const float size = BZDBCache::worldSize;
         const float maxHeight = world->getMaxWorldHeight();
 
+        const SpawnSurfaces& surfaces = world->getSpawnSurfaces();
+        const int baseTeam = ((team >= RedTeam) && (team <= PurpleTeam)) ? (int)team : -1;
+
+        const float waterLevel = world->getWaterLevel();
+        float minZ = 0.0f;
+        if (waterLevel > minZ)
+            minZ = waterLevel;
+        float maxZ = maxHeight;
+        if (onGroundOnly)
+            maxZ = 0.0f;
+
         // keep track of how much time we spend searching for a location
         TimeKeeper start = TimeKeeper::getCurrent();
 
@@ -96,7 +113,15 @@ void SpawnPolicy::getPosition(float pos[3], int playerId, bool onGroundOnly, boo
         bool foundspot = false;
         while (!foundspot)
         {
-            if (!world->getPlayerSpawnPoint(&pi, testPos))
+            if (world->getPlayerSpawnPoint(&pi, testPos))
+                foundspot = DropGeometry::dropPlayer(testPos, minZ, maxZ);
+            else if (surfaces.getRandomPosition(testPos, onGroundOnly,
+                                                notNearEdges, baseTeam))
+            {
+                // already dropped onto a surface that was mapped out
+                foundspot = true;
+            }
+            else
             {
                 if (notNearEdges)
                 {
@@ -110,20 +135,10 @@ void SpawnPolicy::getPosition(float pos[3], int playerId, bool onGroundOnly, boo
                     testPos[1] = ((float)bzfrand() - 0.5f) * (size - 2.0f * tankRadius);
                 }
                 testPos[2] = onGroundOnly ? 0.0f : ((float)bzfrand() * maxHeight);
+                foundspot = DropGeometry::dropPlayer(testPos, minZ, maxZ);
             }
             tries++;
 
-            const float waterLevel = world->getWaterLevel();
-            float minZ = 0.0f;
-            if (waterLevel > minZ)
-                minZ = waterLevel;
-            float maxZ = maxHeight;
-            if (onGroundOnly)
-                maxZ = 0.0f;
-
-            if (DropGeometry::dropPlayer(testPos, minZ, maxZ))
-                foundspot = true;
-
             // check every now and then if we have already used up 10ms of time
             if (tries >= 50)
             {
@@ -207,54 +222,124 @@ bool SpawnPolicy::isFacing(const float *enemyPos, const float enemyAzimuth,
 }
 
 
-bool SpawnPolicy::isImminentlyDangerous() const
+void SpawnPolicy::gatherPlayers()
 {
+    players.clear();
+    lasers.clear();
+    bucketHeads.assign(playerBuckets, -1);
+    bucketNext.clear();
+
+    // about the reach of a normal shot that is still dangerous
+    squareSize = BZDBCache::tankRadius * BZDB.eval("_spawnSafeRadMod");
+    if (squareSize < BZDBCache::tankRadius)
+        squareSize = BZDBCache::tankRadius;
+
     GameKeeper::Player *playerData;
-    float twentyDegrees = (float)(M_PI / 9.0); /* +- 10 degrees, i.e. 20 degree arc */
     int curmax = getCurMaxPlayers();
     for (int i = 0; i < curmax; i++)
     {
         playerData = GameKeeper::Player::getPlayerByIndex(i);
         if (!playerData)
             continue;
-        if (playerData->player.isAlive())
+        if (!playerData->player.isAlive())
+            continue;
+
+        LivePlayer live;
+        live.index   = i;
+        live.team    = playerData->player.getTeam();
+        live.flag    = NULL;
+        memcpy(live.pos, playerData->lastState.pos, sizeof(live.pos));
+        live.azimuth = playerData->lastState.azimuth;
+        if (playerData->player.getFlag() >= 0)
+        {
+            const FlagInfo *finfo = FlagInfo::get(playerData->player.getFlag());
+            live.flag = finfo->flag.type;
+        }
+
+        const int index = (int)players.size();
+        players.push_back(live);
+        if (live.flag == Flags::Laser)
+            lasers.push_back(index);
+
+        const int bucket = getBucket((int)floorf(live.pos[0] / squareSize),
+                                     (int)floorf(live.pos[1] / squareSize));
+        bucketNext.push_back(bucketHeads[bucket]);
+        bucketHeads[bucket] = index;
+    }
+}
+
+
+int SpawnPolicy::getBucket(int x, int y) const
+{
+    const unsigned int hash = ((unsigned int)x * 73856093u) ^ ((unsigned int)y * 19349663u);
+    return (int)(hash & (playerBuckets - 1));
+}
+
+
+bool SpawnPolicy::getCells(float radius, int cells[4]) const
+{
+    // the squares around testPos, false when there are so many of
+    // them that going through all of the players is quicker
+    cells[0] = (int)floorf((testPos[0] - radius) / squareSize);
+    cells[1] = (int)floorf((testPos[1] - radius) / squareSize);
+    cells[2] = (int)floorf((testPos[0] + radius) / squareSize);
+    cells[3] = (int)floorf((testPos[1] + radius) / squareSize);
+    const int count = (cells[2] - cells[0] + 1) * (cells[3] - cells[1] + 1);
+    return (count > 0) && (count < playerBuckets);
+}
+
+
+bool SpawnPolicy::isImminentlyDangerous() const
+{
+    float twentyDegrees = (float)(M_PI / 9.0); /* +- 10 degrees, i.e. 20 degree arc */
+
+    // don't spawn in the line of sight of an L, however far away
+    for (size_t l = 0; l < lasers.size(); l++)
+    {
+        const LivePlayer& enemy = players[lasers[l]];
+        if (isFacing(enemy.pos, enemy.azimuth, twentyDegrees))   // he's looking within 20 degrees of spawn point
+            return true;    // eek, don't spawn here
+    }
+
+    // everything else only reaches so far
+    float radius = safeDistance;
+    if (radius < safeSWRadius)
+        radius = safeSWRadius;
+    if (radius < safeSRRadius)
+        radius = safeSRRadius;
+
+    int cells[4];
+    const bool nearby = getCells(radius, cells);
+    const int lastX = nearby ? cells[2] : cells[0];
+    const int lastY = nearby ? cells[3] : cells[1];
+    for (int x = cells[0]; x <= lastX; x++)
+    {
+        for (int y = cells[1]; y <= lastY; y++)
         {
-            float *enemyPos   = playerData->lastState.pos;
-            float  enemyAngle = playerData->lastState.azimuth;
-            if (playerData->player.getFlag() >= 0)
+            int p = nearby ? bucketHeads[getBucket(x, y)] : 0;
+            for (; nearby ? (p >= 0) : (p < (int)players.size());
+                    p = nearby ? bucketNext[p] : (p + 1))
             {
-                // check for dangerous flags
-                const FlagInfo *finfo = FlagInfo::get(playerData->player.getFlag());
-                const FlagType *ftype = finfo->flag.type;
-                // FIXME: any more?
-                if (ftype == Flags::Laser)    // don't spawn in the line of sight of an L
+                const LivePlayer& enemy = players[p];
+                const FlagType *ftype = enemy.flag;
+                if (ftype == Flags::ShockWave)      // don't spawn next to a SW
                 {
-                    if (isFacing(enemyPos, enemyAngle, twentyDegrees))   // he's looking within 20 degrees of spawn point
-                    {
+                    if (distanceFrom(enemy.pos) < safeSWRadius)   // too close to SW
                         return true;    // eek, don't spawn here
-                    }
                 }
-                else if (ftype == Flags::ShockWave)      // don't spawn next to a SW
+                else if (ftype == Flags::Steamroller || ftype == Flags::Burrow)     // don't spawn if you'll squish or be squished
                 {
-                    if (distanceFrom(enemyPos) < safeSWRadius)   // too close to SW
-                    {
+                    if (distanceFrom(enemy.pos) < safeSRRadius)   // too close to SR or BU
                         return true;    // eek, don't spawn here
-                    }
                 }
-                else if (ftype == Flags::Steamroller || ftype == Flags::Burrow)     // don't spawn if you'll squish or be squished
+                // don't spawn in the line of sight of a normal-shot tank within a certain distance
+                if ((ftype != Flags::Laser) &&
+                        (distanceFrom(enemy.pos) < safeDistance))   // within danger zone?
                 {
-                    if (distanceFrom(enemyPos) < safeSRRadius)   // too close to SR or BU
-                    {
-                        return true;    // eek, don't spawn here
-                    }
+                    if (isFacing(enemy.pos, enemy.azimuth, twentyDegrees))   //and he's looking at me
+                        return true;
                 }
             }
-            // don't spawn in the line of sight of a normal-shot tank within a certain distance
-            if (distanceFrom(enemyPos) < safeDistance)   // within danger zone?
-            {
-                if (isFacing(enemyPos, enemyAngle, twentyDegrees))   //and he's looking at me
-                    return true;
-            }
         }
     }
 
@@ -266,34 +351,53 @@ bool SpawnPolicy::isImminentlyDangerous() const
 
 float SpawnPolicy::enemyProximityCheck(float &enemyAngle) const
 {
-    GameKeeper::Player *playerData;
     float worstDist = 1e12f; // huge number
-    bool noEnemy    = true;
-    int curmax = getCurMaxPlayers();
-    for (int i = 0; i < curmax; i++)
+    int   worstIndex = -1;
+
+    // look in a growing square around testPos, until the closest
+    // enemy in it is closer than the square's edge
+    float radius = squareSize;
+    while (true)
     {
-        playerData = GameKeeper::Player::getPlayerByIndex(i);
-        if (!playerData)
-            continue;
-        if (playerData->player.isAlive()
-                && areFoes(playerData->player.getTeam(), team))
+        int cells[4];
+        const bool nearby = getCells(radius, cells);
+        const int lastX = nearby ? cells[2] : cells[0];
+        const int lastY = nearby ? cells[3] : cells[1];
+        for (int x = cells[0]; x <= lastX; x++)
         {
-            float *enemyPos = playerData->lastState.pos;
-            if (fabs(enemyPos[2] - testPos[2]) < 1.0f)
+            for (int y = cells[1]; y <= lastY; y++)
             {
-                float x = enemyPos[0] - testPos[0];
-                float y = enemyPos[1] - testPos[1];
-                float distSq = x * x + y * y;
-                if (distSq < worstDist)
+                int p = nearby ? bucketHeads[getBucket(x, y)] : 0;
+                for (; nearby ? (p >= 0) : (p < (int)players.size());
+                        p = nearby ? bucketNext[p] : (p + 1))
                 {
-                    worstDist  = distSq;
-                    enemyAngle = playerData->lastState.azimuth;
-                    noEnemy    = false;
+                    const LivePlayer& enemy = players[p];
+                    if (!areFoes(enemy.team, team))
+                        continue;
+                    if (fabs(enemy.pos[2] - testPos[2]) >= 1.0f)
+                        continue;
+                    float dx = enemy.pos[0] - testPos[0];
+                    float dy = enemy.pos[1] - testPos[1];
+                    float distSq = dx * dx + dy * dy;
+                    // the same one as going through them in order would find
+                    if ((distSq < worstDist) ||
+                            ((distSq == worstDist) && (worstIndex >= 0) &&
+                             (enemy.index < players[worstIndex].index)))
+                    {
+                        worstDist  = distSq;
+                        worstIndex = p;
+                    }
                 }
             }
         }
+        if (!nearby || ((worstIndex >= 0) && (worstDist <= radius * radius)))
+            break;
+        radius *= 2.0f;
     }
-    if (noEnemy)
+
+    if (worstIndex >= 0)
+        enemyAngle = players[worstIndex].azimuth;
+    else
         enemyAngle = (float)(bzfrand() * 2.0 * M_PI);
     return sqrtf(worstDist);
 }
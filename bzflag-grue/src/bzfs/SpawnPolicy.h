@@ -15,9 +15,14 @@
 
 #include "common.h"
 
+/* system interface headers */
+#include <vector>
+
 /* common interface headers */
 #include "global.h"  /* for TeamColor */
 
+class FlagType;
+
 
 /** a SpawnPolicy is used to determine a new SpawnPosition.  Policies
  *  are defined to describe various spawning behaviors such as purely
@@ -43,10 +48,32 @@ private:
     float distanceFrom(const float *farPos) const;
     bool  isFacing(const float *enemyPos, const float enemyAzimuth, const float deviation) const;
 
+    void  gatherPlayers();
+    int   getBucket(int x, int y) const;
+    bool  getCells(float radius, int cells[4]) const;
+
     /* temp, internal use */
     TeamColor   team;
     float       testPos[3];
 
+    /* the live players, gathered for each spawn.  they are hashed
+     * into buckets by the square of the world they are in, so that
+     * the ones around testPos are found without going through all.
+     */
+    struct LivePlayer
+    {
+        int         index;
+        TeamColor   team;
+        const FlagType* flag;
+        float       pos[3];
+        float       azimuth;
+    };
+    std::vector<LivePlayer> players;
+    std::vector<int>        lasers;      /* dangerous from anywhere */
+    std::vector<int>        bucketHeads; /* first player in a bucket, or -1 */
+    std::vector<int>        bucketNext;  /* next player in the same bucket */
+    float       squareSize;
+
     float safeSWRadius;
     float safeSRRadius;
     float safeDistance;
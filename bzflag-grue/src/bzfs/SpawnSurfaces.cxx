@@ -0,0 +1,285 @@
+/* bzflag
+ * Copyright (c) 1993-2021 Tim Riker
+ *
+ * This package is free software;  you can redistribute it and/or
+ * modify it under the terms of the license found in the file
+ * named COPYING that should have accompanied this file.
+ *
+ * THIS PACKAGE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+/* interface header */
+#include "SpawnSurfaces.h"
+
+/* system implementation headers */
+#include <math.h>
+
+/* common implementation headers */
+#include "BZDBCache.h"
+#include "StateDatabase.h"
+#include "Obstacle.h"
+#include "BaseBuilding.h"
+
+/* bzfs implementation headers */
+#include "DropGeometry.h"
+#include "Scheduler.h"
+
+
+// the most columns along a side of the world
+static const int maxColumns = 256;
+
+// how long the map may hold up one pass of the main loop
+static const double sliceTime = 0.005;
+
+// jittered positions tried before settling for the center of a spot
+static const int maxTries = 8;
+
+// what the map depends on, besides the world itself
+static const std::string* const bzdbNames[] =
+{
+    &StateDatabase::BZDB_TANKRADIUS,
+    &StateDatabase::BZDB_TANKHEIGHT,
+    &StateDatabase::BZDB_WORLDSIZE
+};
+
+
+SpawnSurfaces::SpawnSurfaces()
+{
+    waterLevel = -1.0f;
+    maxHeight = 0.0f;
+    restart = false;
+    timer = 0;
+    passes = 0;
+    clear();
+
+    for (size_t n = 0; n < bzcountof(bzdbNames); n++)
+        BZDB.addCallback(*bzdbNames[n], bzdbCallback, this);
+}
+
+
+SpawnSurfaces::~SpawnSurfaces()
+{
+    for (size_t n = 0; n < bzcountof(bzdbNames); n++)
+        BZDB.removeCallback(*bzdbNames[n], bzdbCallback, this);
+    if (scheduler.isScheduled(timer))
+        scheduler.cancel(timer);
+}
+
+
+void SpawnSurfaces::clear()
+{
+    cellSize = 0.0f;
+    tankRadius = 0.0f;
+    tankHeight = 0.0f;
+    worldSize = 0.0f;
+    columns = 0;
+    nextColumn = 0;
+
+    spots.clear();
+    for (int g = 0; g < 2; g++)
+    {
+        for (int e = 0; e < 2; e++)
+            lists[g][e].clear();
+    }
+}
+
+
+void SpawnSurfaces::build(float _waterLevel, float _maxHeight)
+{
+    waterLevel = _waterLevel;
+    maxHeight = _maxHeight;
+    restart = false;
+    start();
+
+    if (!scheduler.isScheduled(timer))
+        timer = scheduler.add(0.0, workCallback, this);
+    return;
+}
+
+
+void SpawnSurfaces::start()
+{
+    clear();
+
+    tankRadius = BZDBCache::tankRadius;
+    tankHeight = BZDBCache::tankHeight;
+    worldSize = BZDBCache::worldSize;
+
+    cellSize = worldSize / (float)maxColumns;
+    if (cellSize < tankRadius)
+        cellSize = tankRadius;
+    columns = (int)ceilf(worldSize / cellSize);
+
+    startTime = TimeKeeper::getCurrent();
+    passes = 0;
+    return;
+}
+
+
+bool SpawnSurfaces::work(double maxSeconds)
+{
+    if (restart)
+    {
+        // BZDB tells of every set, not only of changes
+        restart = false;
+        if ((nextColumn < columns * columns) ||
+                (tankRadius != BZDBCache::tankRadius) ||
+                (tankHeight != BZDBCache::tankHeight) ||
+                (worldSize != BZDBCache::worldSize))
+            start();
+    }
+
+    const int total = columns * columns;
+    if (nextColumn >= total)
+        return true;
+
+    passes++;
+    const TimeKeeper sliceStart = TimeKeeper::getCurrent();
+    while (nextColumn < total)
+    {
+        mapColumn(nextColumn / columns, nextColumn % columns);
+        nextColumn++;
+        if ((TimeKeeper::getCurrent() - sliceStart) >= maxSeconds)
+            break;
+    }
+    if (nextColumn < total)
+        return false;
+
+    logDebugMessage(2,"Spawn surfaces: %i spots in %i columns of %.2f, %.3f seconds over %i passes\n",
+                    (int)spots.size(), total, cellSize,
+                    (float)(TimeKeeper::getCurrent() - startTime), passes);
+    return true;
+}
+
+
+void SpawnSurfaces::mapColumn(int i, int j)
+{
+    // the same limits as the spawn policies use
+    const float edgeLimit = 0.5f * (worldSize - 2.0f * tankRadius);
+    const float innerLimit = 0.3f * worldSize;
+    const float minZ = (waterLevel > 0.0f) ? waterLevel : 0.0f;
+
+    const float x = -0.5f * worldSize + ((float)i + 0.5f) * cellSize;
+    const float y = -0.5f * worldSize + ((float)j + 0.5f) * cellSize;
+    if ((fabsf(x) > edgeLimit) || (fabsf(y) > edgeLimit))
+        return;
+    const bool inner = (fabsf(x) <= innerLimit) && (fabsf(y) <= innerLimit);
+
+    // the ground counts for ground only spawns even under water
+    std::vector<DropGeometry::Landing> landings;
+    DropGeometry::findPlayerLandings(x, y, 0.0f, maxHeight, landings);
+    for (size_t l = 0; l < landings.size(); l++)
+    {
+        const DropGeometry::Landing& landing = landings[l];
+        Spot spot;
+        spot.x = x;
+        spot.y = y;
+        spot.z = landing.z;
+        spot.landing = landing.obs;
+        spot.team = -1;
+        const Obstacle* obs = landing.obs;
+        if ((obs != NULL) &&
+                (obs->getType() == BaseBuilding::getClassName()))
+            spot.team = ((const BaseBuilding*)obs)->getTeam();
+
+        const int index = (int)spots.size();
+        spots.push_back(spot);
+        if (spot.z >= minZ)
+        {
+            lists[0][0].push_back(index);
+            if (inner)
+                lists[0][1].push_back(index);
+        }
+        if (spot.z == 0.0f)
+        {
+            lists[1][0].push_back(index);
+            if (inner)
+                lists[1][1].push_back(index);
+        }
+    }
+    return;
+}
+
+
+double SpawnSurfaces::workCallback(void* userData)
+{
+    SpawnSurfaces* surfaces = (SpawnSurfaces*)userData;
+    if (!surfaces->work(sliceTime))
+        return 0.0;
+    surfaces->timer = 0;
+    return -1.0;
+}
+
+
+void SpawnSurfaces::bzdbCallback(const std::string&, void* userData)
+{
+    // BZDBCache may not have the new value yet, so it is looked at
+    // when the next slice runs
+    SpawnSurfaces* surfaces = (SpawnSurfaces*)userData;
+    if (surfaces->columns == 0)
+        return;
+    surfaces->restart = true;
+    if (!scheduler.isScheduled(surfaces->timer))
+        surfaces->timer = scheduler.add(0.0, workCallback, surfaces);
+    return;
+}
+
+
+bool SpawnSurfaces::getRandomPosition(float pos[3], bool onGroundOnly,
+                                      bool notNearEdges, int team) const
+{
+    if (!isReady())
+        return false;
+    const std::vector<int>& list = lists[onGroundOnly ? 1 : 0][notNearEdges ? 1 : 0];
+    if (list.empty())
+        return false;
+
+    const float limit = notNearEdges ? (0.3f * worldSize)
+                        : (0.5f * (worldSize - 2.0f * tankRadius));
+
+    // the whole column was not checked, only its center, so a
+    // position off the center still has to be on the landing and clear
+    const Spot* center = NULL;
+    for (int tries = 0; tries < maxTries; tries++)
+    {
+        int pick = (int)(bzfrand() * (double)list.size());
+        if (pick >= (int)list.size())
+            pick = (int)list.size() - 1;
+        const Spot& spot = spots[list[pick]];
+        if ((spot.team >= 0) && (team >= 0) && (spot.team != team))
+            continue;
+        center = &spot;
+
+        for (int a = 0; a < 2; a++)
+        {
+            const float middle = (a == 0) ? spot.x : spot.y;
+            float p = middle + ((float)bzfrand() - 0.5f) * cellSize;
+            if (p < -limit)
+                p = -limit;
+            else if (p > limit)
+                p = limit;
+            pos[a] = p;
+        }
+        pos[2] = spot.z;
+        if (DropGeometry::landPlayer(pos, spot.landing))
+            return true;
+    }
+
+    if (center == NULL)
+        return false;
+    pos[0] = center->x;
+    pos[1] = center->y;
+    pos[2] = center->z;
+    return DropGeometry::landPlayer(pos, center->landing);
+}
+
+
+// Local Variables: ***
+// mode: C++ ***
+// tab-width: 4 ***
+// c-basic-offset: 4 ***
+// indent-tabs-mode: nil ***
+// End: ***
+// ex: shiftwidth=4 tabstop=4
@@ -0,0 +1,127 @@
+/* bzflag
+ * Copyright (c) 1993-2021 Tim Riker
+ *
+ * This package is free software;  you can redistribute it and/or
+ * modify it under the terms of the license found in the file
+ * named COPYING that should have accompanied this file.
+ *
+ * THIS PACKAGE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef __SPAWNSURFACES_H__
+#define __SPAWNSURFACES_H__
+
+#include "common.h"
+
+/* system interface headers */
+#include <string>
+#include <vector>
+
+/* common interface headers */
+#include "TimeKeeper.h"
+
+class Obstacle;
+
+/** SpawnSurfaces is a map of everywhere a tank can be put down in the
+ *  world, so that the spawn policies do not have to guess random
+ *  positions until one of them works out.
+ *
+ *  The world is cut into square columns, 256 to a side, or fewer when
+ *  that would make them narrower than a tank radius.  Each level of a
+ *  column that DropGeometry::dropPlayer() would land on, with room for
+ *  the tank and not on a death face or under water, is a spot.  The
+ *  columns are all the same size, so a spot picked at random is a
+ *  position picked at random by area.  Spots on a team's base are
+ *  marked with the team.
+ *
+ *  Mapping a big world takes about a second, so it is done a few
+ *  milliseconds at a time from the scheduler, over as many passes of
+ *  the main loop as it needs.  It starts when the world is loaded and
+ *  again when the tank or world size is set.  Until it is done there
+ *  are no spots, and the spawn policies guess as they did before.
+ */
+class SpawnSurfaces
+{
+public:
+    SpawnSurfaces();
+    ~SpawnSurfaces();
+
+    void clear();
+    /// start mapping the world as the collision manager has it
+    void build(float waterLevel, float maxHeight);
+    /// map more of the world, for about maxSeconds at most,
+    /// true when the map is done
+    bool work(double maxSeconds);
+    bool isReady() const;
+
+    int getSpotCount() const;
+
+    /// a random position on a random spot that dropPlayer() would give,
+    /// on the ground only, or away from the edges of the world like
+    /// the CTF spawns, and not on the base of a team other than team.
+    /// false when there is no such spot, or the map is not done
+    bool getRandomPosition(float pos[3], bool onGroundOnly,
+                           bool notNearEdges, int team) const;
+
+private:
+    SpawnSurfaces(const SpawnSurfaces&);
+    SpawnSurfaces& operator=(const SpawnSurfaces&);
+
+    void start();
+    void mapColumn(int i, int j);
+
+    static double workCallback(void* userData);
+    static void bzdbCallback(const std::string& name, void* userData);
+
+    struct Spot
+    {
+        float x, y, z;  // the center of the column at the surface
+        const Obstacle* landing; // NULL for the ground
+        int team;       // the team whose base it is on, or -1
+    };
+
+    float cellSize;
+    float tankRadius;
+    float tankHeight;
+    float worldSize;
+    float waterLevel;
+    float maxHeight;
+
+    // the columns along a side, and the next one to map, row by row;
+    // the map is done when nextColumn reaches columns * columns
+    int columns;
+    int nextColumn;
+    // the tank or world size was set since the map was started
+    bool restart;
+    unsigned int timer;
+    TimeKeeper startTime;
+    int passes;
+
+    std::vector<Spot> spots;
+    // the spots for [onGroundOnly][notNearEdges]
+    std::vector<int> lists[2][2];
+};
+
+
+inline bool SpawnSurfaces::isReady() const
+{
+    return !restart && (columns > 0) && (nextColumn >= columns * columns);
+}
+
+inline int SpawnSurfaces::getSpotCount() const
+{
+    return (int)spots.size();
+}
+
+
+#endif  /*__SPAWNSURFACES_H__ */
+
+// Local Variables: ***
+// mode: C++ ***
+// tab-width: 4 ***
+// c-basic-offset: 4 ***
+// indent-tabs-mode: nil ***
+// End: ***
+// ex: shiftwidth=4 tabstop=4
@@ -0,0 +1,281 @@
+/* bzflag
+ * Copyright (c) 1993-2021 Tim Riker
+ *
+ * This package is free software;  you can redistribute it and/or
+ * modify it under the terms of the license found in the file
+ * named COPYING that should have accompanied this file.
+ *
+ * THIS PACKAGE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+/* interface header */
+#include "WorldCache.h"
+
+/* system implementation headers */
+#include <stdio.h>
+#include <string.h>
+
+/* common implementation headers */
+#include "bzfio.h"
+#include "md5.h"
+#include "Pack.h"
+#include "Protocol.h"
+#include "StateDatabase.h"
+#include "TextUtils.h"
+#include "TimeKeeper.h"
+#include "version.h"
+
+/* local implementation headers */
+#include "BZWReader.h"
+#include "BZWSource.h"
+#include "WorldInfo.h"
+
+/* compression library header */
+#include <zlib.h>
+
+// bump this whenever the layout below, or what goes into the packed
+// database on the server side, changes
+static const char cacheMagic[4] = { 'B', 'Z', 'W', 'C' };
+static const uint32_t cacheVersion = 1;
+static const unsigned int keySize = 32;
+
+//
+// layout, all in network byte order:
+//
+//   magic, version, mapVersion, key
+//   count of BZDB variables the world sets, their names
+//   digest of the network database
+//   text of the objects that aren't fully packed
+//   uncompressed database
+//   network database
+//
+
+
+WorldCache::WorldCache(const std::string& _fileName) : fileName(_fileName)
+{
+}
+
+
+void WorldCache::addVar(const std::string& name, void *userData)
+{
+    VarMap& vars = *((VarMap*)userData);
+    vars[name] = BZDB.get(name);
+}
+
+
+void WorldCache::getVars(VarMap& vars)
+{
+    vars.clear();
+    BZDB.iterate(addVar, &vars);
+}
+
+
+std::string WorldCache::makeKey(const VarMap& vars,
+                                const std::vector<std::string>& worldVars) const
+{
+    MD5 md5;
+    std::string line = TextUtils::format("%u %s %s\n", cacheVersion,
+                                         getAppVersion(), sourceDigest.c_str());
+    md5.update((const unsigned char*)line.data(), line.size());
+
+    for (VarMap::const_iterator it = vars.begin(); it != vars.end(); ++it)
+    {
+        bool skip = false;
+        for (size_t i = 0; i < worldVars.size() && !skip; i++)
+            skip = (worldVars[i] == it->first);
+        if (skip)
+            continue;
+        line = it->first + "=" + it->second + "\n";
+        md5.update((const unsigned char*)line.data(), line.size());
+    }
+
+    md5.finalize();
+    return md5.hexdigest();
+}
+
+
+WorldInfo* WorldCache::load(BZWReader& reader)
+{
+    TimeKeeper startTime = TimeKeeper::getCurrent();
+
+    sourceDigest = reader.getDigest();
+    getVars(startVars);
+    database.clear();
+    digest = "";
+
+    BZWSource cache;
+    if (!cache.openFile(fileName))
+    {
+        logDebugMessage(2,"no world cache in %s\n", fileName.c_str());
+        return NULL;
+    }
+
+    const void *buf = cache.getData();
+    nboUseErrorChecking(true);
+    nboSetBufferLength(cache.getSize());
+    nboClearBufferError();
+
+    char magic[sizeof(cacheMagic)];
+    uint32_t version;
+    uint16_t cacheMapVersion;
+    char key[keySize + 1];
+    buf = nboUnpackString(buf, magic, sizeof(magic));
+    buf = nboUnpackUInt(buf, version);
+    buf = nboUnpackUShort(buf, cacheMapVersion);
+    buf = nboUnpackString(buf, key, keySize);
+    key[keySize] = 0;
+
+    uint32_t i, count = 0;
+    std::vector<std::string> worldVars;
+    if (!nboGetBufferError() && (memcmp(magic, cacheMagic, sizeof(magic)) == 0) &&
+            (version == cacheVersion) && (cacheMapVersion == mapVersion))
+    {
+        buf = nboUnpackUInt(buf, count);
+        if (count > nboGetBufferLength())
+            count = 0;
+        for (i = 0; i < count; i++)
+        {
+            std::string name;
+            buf = nboUnpackStdString(buf, name);
+            worldVars.push_back(name);
+        }
+    }
+    else
+        key[0] = 0;
+
+    if (nboGetBufferError() || (makeKey(startVars, worldVars) != key))
+    {
+        nboUseErrorChecking(false);
+        logDebugMessage(1,"world cache %s is out of date\n", fileName.c_str());
+        return NULL;
+    }
+
+    std::string objects;
+    uint32_t packedSize, networkSize = 0;
+    buf = nboUnpackStdString(buf, digest);
+    buf = nboUnpackStdStringRaw(buf, objects);
+    buf = nboUnpackUInt(buf, packedSize);
+    const void *packed = buf;
+    if (packedSize <= nboGetBufferLength())
+    {
+        nboSetBufferLength(nboGetBufferLength() - packedSize);
+        buf = (const char*)buf + packedSize;
+        buf = nboUnpackUInt(buf, networkSize);
+        if (networkSize == nboGetBufferLength())
+            database.assign((const char*)buf, (const char*)buf + networkSize);
+    }
+    const bool good = !nboGetBufferError() && !database.empty();
+    nboUseErrorChecking(false);
+    if (!good)
+    {
+        logDebugMessage(1,"world cache %s is damaged\n", fileName.c_str());
+        database.clear();
+        return NULL;
+    }
+
+    WorldInfo *world = reader.defineWorldFromDatabase(packed, packedSize, objects);
+    if (world == NULL)
+    {
+        logDebugMessage(1,"world cache %s could not be unpacked\n", fileName.c_str());
+        database.clear();
+        return NULL;
+    }
+
+    logDebugMessage(1,"loaded world from cache %s in %.3f seconds\n",
+                    fileName.c_str(), TimeKeeper::getCurrent() - startTime);
+    return world;
+}
+
+
+bool WorldCache::save(const BZWReader& reader, const char *worldDatabase,
+                      unsigned int worldDatabaseSize, const std::string& hexDigest)
+{
+    if (!reader.isCacheable())
+    {
+        logDebugMessage(1,"world uses includes or plugin objects, not caching it\n");
+        return false;
+    }
+
+    // the variables set while reading the world are set again when the
+    // cache is loaded, so they don't count
+    VarMap vars;
+    getVars(vars);
+    std::vector<std::string> worldVars;
+    for (VarMap::const_iterator it = vars.begin(); it != vars.end(); ++it)
+    {
+        VarMap::const_iterator old = startVars.find(it->first);
+        if ((old == startVars.end()) || (old->second != it->second))
+            worldVars.push_back(it->first);
+    }
+    const std::string key = makeKey(startVars, worldVars);
+
+    // the clients get it compressed, the server wants it as it was packed
+    const void *buf = worldDatabase;
+    uint16_t len, code, netMapVersion;
+    uint32_t uncompressedSize, compressedSize;
+    buf = nboUnpackUShort(buf, len);
+    buf = nboUnpackUShort(buf, code);
+    buf = nboUnpackUShort(buf, netMapVersion);
+    buf = nboUnpackUInt(buf, uncompressedSize);
+    buf = nboUnpackUInt(buf, compressedSize);
+    uLongf packedSize = uncompressedSize;
+    std::vector<char> packed(uncompressedSize);
+    if (uncompress((Bytef*)&packed[0], &packedSize, (const Bytef*)buf,
+                   compressedSize) != Z_OK)
+        return false;
+
+    const std::string& objects = reader.getServerObjects();
+    unsigned int size = sizeof(cacheMagic) + sizeof(uint32_t) + sizeof(uint16_t) + keySize;
+    size += sizeof(uint32_t);
+    for (size_t i = 0; i < worldVars.size(); i++)
+        size += nboStdStringPackSize(worldVars[i]);
+    size += nboStdStringPackSize(hexDigest) + nboStdStringPackSize(objects);
+    size += sizeof(uint32_t) + packedSize + sizeof(uint32_t) + worldDatabaseSize;
+
+    std::vector<char> data(size);
+    void *out = &data[0];
+    out = nboPackString(out, cacheMagic, sizeof(cacheMagic));
+    out = nboPackUInt(out, cacheVersion);
+    out = nboPackUShort(out, mapVersion);
+    out = nboPackString(out, key.data(), keySize);
+    out = nboPackUInt(out, worldVars.size());
+    for (size_t i = 0; i < worldVars.size(); i++)
+        out = nboPackStdString(out, worldVars[i]);
+    out = nboPackStdString(out, hexDigest);
+    out = nboPackStdString(out, objects);
+    out = nboPackUInt(out, packedSize);
+    out = nboPackString(out, &packed[0], packedSize);
+    out = nboPackUInt(out, worldDatabaseSize);
+    out = nboPackString(out, worldDatabase, worldDatabaseSize);
+
+    // a server starting at the same time must never see half of it
+    const std::string tempName = fileName + ".tmp";
+    FILE *file = fopen(tempName.c_str(), "wb");
+    if (file == NULL)
+        return false;
+    const size_t written = fwrite(&data[0], 1, size, file);
+#ifdef _WIN32
+    remove(fileName.c_str());
+#endif
+    if ((fclose(file) != 0) || (written != size) ||
+            (rename(tempName.c_str(), fileName.c_str()) != 0))
+    {
+        remove(tempName.c_str());
+        logDebugMessage(1,"could not write world cache %s\n", fileName.c_str());
+        return false;
+    }
+
+    logDebugMessage(1,"saved world cache %s (%u bytes)\n", fileName.c_str(), size);
+    return true;
+}
+
+
+// Local Variables: ***
+// mode: C++ ***
+// tab-width: 4 ***
+// c-basic-offset: 4 ***
+// indent-tabs-mode: nil ***
+// End: ***
+// ex: shiftwidth=4 tabstop=4
@@ -0,0 +1,90 @@
+/* bzflag
+ * Copyright (c) 1993-2021 Tim Riker
+ *
+ * This package is free software;  you can redistribute it and/or
+ * modify it under the terms of the license found in the file
+ * named COPYING that should have accompanied this file.
+ *
+ * THIS PACKAGE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef __WORLDCACHE_H__
+#define __WORLDCACHE_H__
+
+#include "common.h"
+
+/* system interface headers */
+#include <map>
+#include <string>
+#include <vector>
+
+class BZWReader;
+class WorldInfo;
+
+/** WorldCache keeps a precompiled copy of a world file, so that the
+    next start with the same file can skip parsing, compressing and
+    hashing it.
+
+    The cache holds the uncompressed world database, which is unpacked
+    the way the client does it, and the database as it is sent to the
+    clients, along with its MD5.  Zones, weapons and the world block do
+    more on the server than what is packed for the client, so their text
+    is kept and read again.
+
+    A cache is only used when it was made from the same text, by the
+    same format and map version, with the same BZDB settings.  The BZDB
+    variables the world file sets itself are left out of that
+    comparison, they are set again when the world block is read.
+*/
+class WorldCache
+{
+public:
+    WorldCache(const std::string& fileName);
+
+    /// the world from the cache, or NULL when it doesn't match the text
+    /// of the reader.  either way, the reader's text is hashed and the
+    /// BZDB settings are noted for a save() after parsing it.
+    WorldInfo*    load(BZWReader& reader);
+
+    /// the database sent to clients and its digest, after a load()
+    const std::vector<char>&  getDatabase() const
+    {
+        return database;
+    }
+    const std::string&    getDigest() const
+    {
+        return digest;
+    }
+
+    /// store the world just parsed by the reader and packed into
+    /// worldDatabase, nothing is written when the reader can't be cached
+    bool      save(const BZWReader& reader, const char *worldDatabase,
+                   unsigned int worldDatabaseSize, const std::string& hexDigest);
+
+private:
+    typedef std::map<std::string, std::string> VarMap;
+
+    static void   addVar(const std::string& name, void *userData);
+    static void   getVars(VarMap& vars);
+    std::string   makeKey(const VarMap& vars,
+                          const std::vector<std::string>& worldVars) const;
+
+    std::string   fileName;
+    std::string   sourceDigest;
+    VarMap    startVars;
+
+    std::vector<char> database;
+    std::string   digest;
+};
+
+#endif
+
+// Local Variables: ***
+// mode: C++ ***
+// tab-width: 4 ***
+// c-basic-offset: 4 ***
+// indent-tabs-mode: nil ***
+// End: ***
+// ex: shiftwidth=4 tabstop=4
@@ -18,6 +18,8 @@
 
 #include "WorldEventManager.h"
 
+#include "TimeKeeper.h"
+
 std::map<bz_Plugin*,bz_EventHandler*> HandlerMap;
 
 
@@ -25,6 +27,7 @@ std::map<bz_Plugin*,bz_EventHandler*> HandlerMap;
 WorldEventManager::WorldEventManager()
 {
     callignEvents = false;
+    dispatchChanged = false;
 }
 
 WorldEventManager::~WorldEventManager()
@@ -44,11 +47,15 @@ void WorldEventManager::addEvent ( bz_eEventType eventType, bz_EventHandler* the
     theEvent->AddEvent(eventType);
 
     if (callignEvents)
+    {
         pendingAdds.push_back(theEvent);
+        dispatchChanged = true;
+    }
     else
     {
         if (std::find(eventList.begin(),eventList.end(),theEvent) == eventList.end())
             eventList.push_back(theEvent);
+        updateDispatch();
     }
 }
 
@@ -57,7 +64,13 @@ void WorldEventManager::removeEvent ( bz_eEventType eventType, bz_EventHandler*
     if (!theEvent)
         return;
 
+    // the handler stops getting the event right away, even while calling
     theEvent->RemoveEvent(eventType);
+
+    if (callignEvents)
+        dispatchChanged = true;
+    else
+        updateDispatch();
 }
 
 bool WorldEventManager::removeHandler(bz_EventHandler* theEvent)
@@ -72,26 +85,78 @@ bool WorldEventManager::removeHandler(bz_EventHandler* theEvent)
     if (itr != eventList.end())
     {
         eventList.erase(itr);
+        updateDispatch();
         return true;
     }
 
     return false;
 }
 
+void WorldEventManager::updateDispatch()
+{
+    for (int i = 0; i < bz_eLastEvent; i++)
+        dispatchTable[i].clear();
+
+    for (size_t i = 0; i < eventList.size(); i++)
+    {
+        const std::vector<bz_eEventType> &handled = eventList[i]->HandledEvents;
+        for (size_t j = 0; j < handled.size(); j++)
+        {
+            if (handled[j] >= 0 && handled[j] < bz_eLastEvent)
+                dispatchTable[handled[j]].push_back(eventList[i]);
+        }
+    }
+    dispatchChanged = false;
+}
+
 void WorldEventManager::callEvents ( bz_eEventType eventType, bz_EventData  *eventData )
 {
     if (!eventData)
         return;
+
+    // events outside of the table can only be found the slow way
+    if (eventType < 0 || eventType >= bz_eLastEvent)
+    {
+        bool callState = callignEvents;
+        callignEvents = true;
+        eventData->eventType = eventType;
+
+        for (size_t i = 0; i < eventList.size(); i++)
+        {
+            if (eventList[i]->HasEvent(eventType))
+                eventList[i]->process(eventData);
+        }
+
+        callignEvents = callState;
+        if (!callState)
+            processPending();
+        return;
+    }
+
+    const tvEventList &handlers = dispatchTable[eventType];
+    if (handlers.empty())
+        return;
+
     bool callState = callignEvents;
     callignEvents = true;
     eventData->eventType = eventType;
 
-//  tvEventList::iterator itr = eventList.begin();
-//  while (itr != eventList.end())
-    for (size_t i = 0; i < eventList.size(); i++)
+    // the table is only rebuilt once nobody is calling, so it stays put
+    for (size_t i = 0; i < handlers.size(); i++)
     {
-        if (eventList[i]->HasEvent(eventType))
-            eventList[i]->process(eventData);
+        bz_EventHandler *handler = handlers[i];
+        if (!handler->HasEvent(eventType))
+            continue;
+
+        TimeKeeper start = TimeKeeper::getCurrent();
+        handler->process(eventData);
+        const double elapsed = TimeKeeper::getCurrent() - start;
+
+        bz_EventHandler::EventStats &stats = handler->stats[eventType];
+        stats.calls++;
+        stats.seconds += elapsed;
+        if (elapsed > stats.maxSeconds)
+            stats.maxSeconds = elapsed;
     }
 
     callignEvents = callState;
@@ -117,6 +182,100 @@ void WorldEventManager::processPending()
         removeHandler(pendingRemovals[i]);
 
     pendingRemovals.clear();
+
+    if (dispatchChanged)
+        updateDispatch();
+}
+
+void WorldEventManager::resetStats()
+{
+    for (size_t i = 0; i < eventList.size(); i++)
+    {
+        for (int j = 0; j < bz_eLastEvent; j++)
+            eventList[i]->stats[j] = bz_EventHandler::EventStats();
+    }
+}
+
+const char* WorldEventManager::getEventName ( bz_eEventType eventType )
+{
+    static const char *names[bz_eLastEvent] =
+    {
+        "NullEvent",
+        "CaptureEvent",
+        "PlayerDieEvent",
+        "PlayerSpawnEvent",
+        "ZoneEntryEvent",
+        "ZoneExitEvent",
+        "PlayerJoinEvent",
+        "PlayerPartEvent",
+        "RawChatMessageEvent",
+        "FilteredChatMessageEvent",
+        "UnknownSlashCommand",
+        "GetPlayerSpawnPosEvent",
+        "GetAutoTeamEvent",
+        "AllowPlayer",
+        "TickEvent",
+        "GetWorldEvent",
+        "GetPlayerInfoEvent",
+        "AllowSpawn",
+        "ListServerUpdateEvent",
+        "BanEvent",
+        "HostBanModifyEvent",
+        "KickEvent",
+        "KillEvent",
+        "PlayerPausedEvent",
+        "MessageFilteredEvent",
+        "GamePauseEvent",
+        "GameResumeEvent",
+        "GameStartEvent",
+        "GameEndEvent",
+        "SlashCommandEvent",
+        "PlayerAuthEvent",
+        "ServerMsgEvent",
+        "ShotFiredEvent",
+        "PlayerUpdateEvent",
+        "NetDataSendEvent",
+        "NetDataReceiveEvent",
+        "LoggingEvent",
+        "ShotEndedEvent",
+        "FlagTransferredEvent",
+        "FlagGrabbedEvent",
+        "FlagDroppedEvent",
+        "AllowCTFCaptureEvent",
+        "MsgDebugEvent",
+        "NewNonPlayerConnection",
+        "PluginLoaded",
+        "PluginUnloaded",
+        "PlayerScoreChanged",
+        "TeamScoreChanged",
+        "WorldFinalized",
+        "ReportFiledEvent",
+        "BZDBChange",
+        "GetPlayerMotto",
+        "AllowConnection",
+        "AllowFlagGrab",
+        "AuthenticatonComplete",
+        "ServerAddPlayer",
+        "AllowPollEvent",
+        "PollStartEvent",
+        "PollVoteEvent",
+        "PollVetoEvent",
+        "PollEndEvent",
+        "ComputeHandicapEvent",
+        "BeginHandicapRefreshEvent",
+        "EndHandicapRefreshEvent",
+        "AutoPilotEvent",
+        "MuteEvent",
+        "UnmuteEvent",
+        "ServerShotFiredEvent",
+        "PermissionModificationEvent",
+        "AllowServerShotFiredEvent",
+        "PlayerDeathFinalizedEvent"
+    };
+
+    if (eventType < 0 || eventType >= bz_eLastEvent)
+        return "CustomEvent";
+    return names[eventType];
 }
 
 bool RegisterEvent ( bz_eEventType eventType, bz_Plugin* plugin )
@@ -159,6 +318,8 @@ bool FlushEvents(bz_Plugin* plugin)
         return false;
 
     bz_EventHandler *handler = HandlerMap[plugin];
+    // the plugin may be on its way out, don't call it for what is in flight
+    handler->ClearEvents();
     worldEventManager.removeHandler(handler);
 
     return true;
@@ -41,6 +41,11 @@ public:
     {
         return true;
     }
+    // everything writeToWorld() adds goes into the packed world database
+    virtual bool usesDatabase()
+    {
+        return false;
+    }
     virtual void writeToWorld(WorldInfo*) const;
     virtual void writeToManager() const;
     virtual void writeToGroupDef(GroupDefinition*) const;
@@ -201,6 +201,11 @@ EntryZones& WorldInfo::getEntryZones()
     return entryZones;
 }
 
+const SpawnSurfaces& WorldInfo::getSpawnSurfaces() const
+{
+    return spawnSurfaces;
+}
+
 
 void            WorldInfo::loadCollisionManager()
 {
@@ -459,6 +464,12 @@ void WorldInfo::finishWorld()
 
     links.doLinking();
 
+    // materials with the same content were folded together as they
+    // were added, so the obstacles already share them
+    logDebugMessage(2,"Materials: %i added, %i kept, %i bytes folded\n",
+                    MATERIALMGR.getAddCount(), MATERIALMGR.getCount(),
+                    MATERIALMGR.getFoldedSize());
+
     maxHeight = COLLISIONMGR.getWorldExtents().maxs[2];
     const float wallHeight = BZDB.eval(StateDatabase::BZDB_WALLHEIGHT);
     if (maxHeight < wallHeight)
@@ -466,6 +477,8 @@ void WorldInfo::finishWorld()
     if (maxHeight < 0.0f)
         maxHeight = 0.0f;
 
+    spawnSurfaces.build(waterLevel, maxHeight);
+
     finished = true;
 
     return;
@@ -561,6 +574,48 @@ int WorldInfo::packDatabase()
     return 1;
 }
 
+bool WorldInfo::unpackDatabase(const void *buf, int length)
+{
+    // the same as the client does it, except for the weapons and entry
+    // zones at the end, which the server needs more of than is packed
+    nboUseErrorChecking(true);
+    nboSetBufferLength(length);
+    nboClearBufferError();
+
+    DYNCOLORMGR.clear();
+    buf = DYNCOLORMGR.unpack(buf);
+    TEXMATRIXMGR.clear();
+    buf = TEXMATRIXMGR.unpack(buf);
+    MATERIALMGR.clear();
+    buf = MATERIALMGR.unpack(buf);
+    PHYDRVMGR.clear();
+    buf = PHYDRVMGR.unpack(buf);
+    TRANSFORMMGR.clear();
+    buf = TRANSFORMMGR.unpack(buf);
+    OBSTACLEMGR.clear();
+    MeshObstacle::setServerUnpack(true);
+    buf = OBSTACLEMGR.unpack(buf);
+    MeshObstacle::setServerUnpack(false);
+    links.clear();
+    buf = links.unpack(buf);
+
+    buf = nboUnpackFloat(buf, waterLevel);
+    if (waterLevel >= 0.0f)
+    {
+        int32_t matindex;
+        buf = nboUnpackInt(buf, matindex);
+        waterMatRef = MATERIALMGR.getMaterial(matindex);
+    }
+
+    nboUseErrorChecking(false);
+    if (nboGetBufferError())
+    {
+        logDebugMessage(1,"WorldInfo::unpackDatabase() overrun\n");
+        return false;
+    }
+    return true;
+}
+
 void *WorldInfo::getDatabase() const
 {
     return database;
@@ -24,6 +24,7 @@
 #include "WorldWeapons.h"
 #include "TeamBases.h"
 #include "LinkManager.h"
+#include "SpawnSurfaces.h"
 
 /* common implementation headers */
 
@@ -107,9 +108,14 @@ public:
 
     WorldWeapons& getWorldWeapons();
     EntryZones& getEntryZones();
+    /// where tanks can spawn, up to date with the tank size
+    const SpawnSurfaces& getSpawnSurfaces() const;
 
     void finishWorld();
     int packDatabase();
+    /// load the obstacles and everything they need from the uncompressed
+    /// database, the reverse of packDatabase() up to the weapons
+    bool unpackDatabase(const void *buf, int length);
 
     bool isFinisihed()
     {
@@ -181,6 +187,7 @@ private:
     const BzMaterial* waterMatRef;
 
     EntryZones entryZones;
+    SpawnSurfaces spawnSurfaces;
     LinkManager links;
     WorldWeapons worldWeapons;
 
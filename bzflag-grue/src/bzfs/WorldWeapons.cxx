@@ -28,6 +28,7 @@
 // bzfs specific headers
 #include "bzfs.h"
 #include "ShotManager.h"
+#include "Scheduler.h"
 
 
 
@@ -236,52 +237,34 @@ void WorldWeapons::clear(void)
             it != weapons.end(); ++it)
     {
         Weapon *w = *it;
+        scheduler.cancel(w->timer);
         delete w;
     }
     weapons.clear();
 }
 
 
-float WorldWeapons::nextTime ()
+double WorldWeapons::fire(void *data)
 {
-    TimeKeeper nextShot = TimeKeeper::getSunExplodeTime();
-    for (std::vector<Weapon*>::iterator it = weapons.begin();
-            it != weapons.end(); ++it)
-    {
-        Weapon *w = *it;
-        if (w->nextTime <= nextShot)
-            nextShot = w->nextTime;
-    }
-    return (float)(nextShot - TimeKeeper::getCurrent());
-}
+    Weapon *w = (Weapon*)data;
+    TimeKeeper nowTime = TimeKeeper::getCurrent();
 
+    FlagType type = *(w->type);   // non-const copy
 
-void WorldWeapons::fire()
-{
-    TimeKeeper nowTime = TimeKeeper::getCurrent();
+    float vec[3] = { 0,0,0 };
+    bz_vectorFromRotations(w->tilt, w->direction, vec);
+    w->owner->fireShot(&type, w->origin, vec, nullptr, w->teamColor);
 
-    for (std::vector<Weapon*>::iterator it = weapons.begin();
-            it != weapons.end(); ++it)
+    //Set up timer for next shot, and eat any shots that have been missed
+    const TimeKeeper lastTime = w->nextTime;
+    while (w->nextTime <= nowTime)
     {
-        Weapon *w = *it;
-        if (w->nextTime <= nowTime)
-        {
-            FlagType type = *(w->type);   // non-const copy
-
-            float vec[3] = { 0,0,0 };
-            bz_vectorFromRotations(w->tilt, w->direction, vec);
-            fireShot(&type, w->origin, vec, nullptr, w->teamColor);
-
-            //Set up timer for next shot, and eat any shots that have been missed
-            while (w->nextTime <= nowTime)
-            {
-                w->nextTime += w->delay[w->nextDelay];
-                w->nextDelay++;
-                if (w->nextDelay == (int)w->delay.size())
-                    w->nextDelay = 0;
-            }
-        }
+        w->nextTime += w->delay[w->nextDelay];
+        w->nextDelay++;
+        if (w->nextDelay == (int)w->delay.size())
+            w->nextDelay = 0;
     }
+    return w->nextTime - lastTime;
 }
 
 
@@ -301,6 +284,8 @@ void WorldWeapons::add(const FlagType *type, const float *origin,
     w->initDelay = initdelay;
     w->nextDelay = 0;
     w->delay = delay;
+    w->owner = this;
+    w->timer = scheduler.addAt(w->nextTime, &WorldWeapons::fire, w);
 
     weapons.push_back(w);
 }
@@ -35,12 +35,10 @@ class WorldWeapons
 public:
     WorldWeapons();
     ~WorldWeapons();
-    void fire();
     void add(const FlagType *type, const float *origin,
              float direction, float tilt, TeamColor teamColor,
              float initdelay, const std::vector<float> &delay,
              TimeKeeper &sync);
-    float nextTime();
     void clear();
     unsigned int count(); // returns the number of world weapons
     int packSize() const;
@@ -64,8 +62,12 @@ private:
         std::vector<float>  delay;
         TimeKeeper      nextTime;
         int         nextDelay;
+        WorldWeapons    *owner;
+        unsigned int    timer;
     };
 
+    static double fire(void *data);
+
     std::vector<Weapon*> weapons;
     int worldShotId;
 
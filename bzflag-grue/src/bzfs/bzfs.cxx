@@ -32,6 +32,10 @@
 #include "BZDBCache.h"
 #include "ShotUpdate.h"
 #include "PhysicsDriver.h"
+#include "BzMaterial.h"
+#include "TextureMatrix.h"
+#include "DynamicColor.h"
+#include "MeshTransform.h"
 #include "CommandManager.h"
 #include "ConfigFileManager.h"
 #include "bzsignal.h"
@@ -42,6 +46,8 @@
 #include "WorldInfo.h"
 #include "WorldWeapons.h"
 #include "BZWReader.h"
+#include "WorldCache.h"
+#include "HTTPFileServer.h"
 #include "PackVars.h"
 #include "SpawnPosition.h"
 #include "DropGeometry.h"
@@ -50,6 +56,8 @@
 #include "Filter.h"
 #include "WorldEventManager.h"
 #include "WorldGenerators.h"
+#include "Scheduler.h"
+#include "AsyncWork.h"
 
 
 // common implementation headers
@@ -99,8 +107,8 @@ static Address serverAddress;
 static int wksSocket;
 bool handlePings = true;
 static PingPacket pingReply;
-// highest fd used
-static int maxFileDescriptor;
+// socket readiness for the main loop
+NetPoller *netPoller = NULL;
 // team info
 TeamInfo team[NumTeams];
 // num flags in flag list
@@ -120,6 +128,35 @@ int debugLevel = 0;
 static float maxWorldHeight = 0.0f;
 static bool disableHeightChecks = false;
 
+// BZDB entries read for every player update and shot
+static struct
+{
+    StateDatabase::Handle agilityAdVel;
+    StateDatabase::Handle burrowDepth;
+    StateDatabase::Handle burrowSpeedAd;
+    StateDatabase::Handle handicapShotAd;
+    StateDatabase::Handle handicapVelAd;
+    StateDatabase::Handle muzzleFront;
+    StateDatabase::Handle muzzleHeight;
+    StateDatabase::Handle obeseFactor;
+    StateDatabase::Handle reloadTime;
+    StateDatabase::Handle shotSpeed;
+    StateDatabase::Handle speedChecksLogOnly;
+    StateDatabase::Handle thiefVelAd;
+    StateDatabase::Handle velocityAd;
+} bzdbHandles;
+
+static StateDatabase::Handle requireHandle(const std::string &name)
+{
+    StateDatabase::Handle handle = BZDB.findHandle(name);
+    if (!handle.isValid())
+    {
+        logDebugMessage(0, "internal error: BZDB variable %s is unknown\n", name.c_str());
+        exit(1);
+    }
+    return handle;
+}
+
 std::string hexDigest;
 
 TimeKeeper gameStartTime;
@@ -160,6 +197,7 @@ static RejoinList rejoinList;
 
 static TimeKeeper lastWorldParmChange;
 static bool       playerHadWorld = false;
+static HTTPFileServer fileServer;
 
 bool          publiclyDisconnected = false;
 
@@ -180,6 +218,11 @@ public:
 
         worldEventManager.callEvents(bz_eLoggingEvent,&data);
     }
+
+    bool wants ( int )
+    {
+        return worldEventManager.hasHandlers(bz_eLoggingEvent);
+    }
 };
 
 APILoggingCallback apiLoggingCallback;
@@ -201,12 +244,12 @@ public:
     {
         // let any listeners know we got net data
         NetHandler *h = (NetHandler*)param;
+        const bz_eEventType eventType = send ? bz_eNetDataSendEvent : bz_eNetDataReceiveEvent;
+        if (!worldEventManager.hasHandlers(eventType))
+            return;
 
         bz_NetTransferEventData_V1 eventData;
-        if (send)
-            eventData.eventType = bz_eNetDataSendEvent;
-        else
-            eventData.eventType = bz_eNetDataReceiveEvent;
+        eventData.eventType = eventType;
         eventData.send = send;
         eventData.udp = udp;
         eventData.iSize = size;
@@ -252,6 +295,17 @@ static int pwrite(GameKeeper::Player &playerData, const void *b, int l)
     return result;
 }
 
+static int pwrite(GameKeeper::Player &playerData, NetMessage *msg)
+{
+    if (!playerData.netHandler)
+        return (int)msg->getSize();
+
+    int result = playerData.netHandler->pwrite(msg);
+    if (result == -1)
+        removePlayer(playerData.getIndex(), "ECONNRESET/EPIPE", false);
+    return result;
+}
+
 static char sMsgBuf[MaxPacketLen];
 char *getDirectMessageBuffer()
 {
@@ -287,12 +341,16 @@ void directMessage(int playerIndex, uint16_t code, int len, void *msg)
 
 void broadcastMessage(uint16_t code, int len, void *msg)
 {
+    // pack it once, everyone gets a reference
+    NetMessage *shared = NetMessage::create(code, uint16_t(len), msg);
+
     // send message to everyone
     for (int i = 0; i < curMaxPlayers; i++)
     {
         if (realPlayerWithNet(i))
-            directMessage(i, code, len, msg);
+            pwrite(*GameKeeper::Player::getPlayerByIndex(i), shared);
     }
+    shared->unref();
 
     // record the packet
     if (Record::enabled())
@@ -364,24 +422,6 @@ void sendFlagUpdate(FlagInfo &flag)
     broadcastMessage(MsgFlagUpdate, (char*)buf - (char*)bufStart, bufStart);
 }
 
-static float nextGameTime()
-{
-    float nextTime = +MAXFLOAT;
-    const TimeKeeper nowTime = TimeKeeper::getCurrent();
-    for (int i = 0; i < curMaxPlayers; i++)
-    {
-        GameKeeper::Player *gkPlayer = GameKeeper::Player::getPlayerByIndex(i);
-        if ((gkPlayer != NULL) && gkPlayer->player.isHuman())
-        {
-            const TimeKeeper& pTime = gkPlayer->getNextGameTime();
-            const float pNextTime = (float)(pTime - nowTime);
-            if (pNextTime < nextTime)
-                nextTime = pNextTime;
-        }
-    }
-    return nextTime;
-}
-
 static int makeGameTime(void* bufStart, float lag)
 {
     void *buf = bufStart;
@@ -389,6 +429,8 @@ static int makeGameTime(void* bufStart, float lag)
     return ((char*)buf - (char*)bufStart);
 }
 
+static double gameTimeCallback(void *data);
+
 static void sendGameTime(GameKeeper::Player* gkPlayer)
 {
     if (Replay::enabled())
@@ -399,23 +441,23 @@ static void sendGameTime(GameKeeper::Player* gkPlayer)
         const float lag = gkPlayer->lagInfo.getLagAvg();
         const int length = makeGameTime(buf, lag);
         directMessage(*gkPlayer, MsgGameTime, length, buf);
-        gkPlayer->updateNextGameTime();
+        gkPlayer->updateGameTimeRate();
+
+        if (!scheduler.isScheduled(gkPlayer->gameTimeTimer))
+            gkPlayer->gameTimeTimer = scheduler.add(gkPlayer->gameTimeRate, gameTimeCallback, gkPlayer);
     }
     return;
 }
 
-static void sendPendingGameTime()
+static double gameTimeCallback(void *data)
 {
-    const TimeKeeper nowTime = TimeKeeper::getCurrent();
-    for (int i = 0; i < curMaxPlayers; i++)
-    {
-        GameKeeper::Player *gkPlayer = GameKeeper::Player::getPlayerByIndex(i);
-        if ((gkPlayer != NULL)
-                && gkPlayer->player.isHuman()
-                && (gkPlayer->getNextGameTime() - nowTime) < 0.0f)
-            sendGameTime(gkPlayer);
-    }
-    return;
+    // the player's destructor cancels the timer
+    GameKeeper::Player *gkPlayer = (GameKeeper::Player*)data;
+    if (Replay::enabled() || !gkPlayer->player.isHuman())
+        return -1.0;
+
+    sendGameTime(gkPlayer);
+    return gkPlayer->gameTimeRate;
 }
 
 
@@ -954,7 +996,6 @@ static bool serverStart()
     int opt;
 #endif
 #endif
-    maxFileDescriptor = 0;
 
     // init addr:port structure
     struct sockaddr_in addr;
@@ -996,12 +1037,25 @@ static bool serverStart()
     }
 
     addr.sin_port = htons(clOptions->wksPort);
+    NetHandler::setQueueLimits(clOptions->sendQueueLow, clOptions->sendQueueHigh,
+                               clOptions->sendQueueMax);
+    if (clOptions->httpDir != "")
+        fileServer.setDirectory(clOptions->httpDir);
     if (!NetHandler::initHandlers(addr))
     {
         close(wksSocket);
         return false;
     }
 
+    // register the long lived sockets once, the main loop only sees what is ready
+    netPoller = NetPoller::create(clOptions->pollerBackend);
+    netPoller->add(wksSocket);
+    NetHandler::setPoller(netPoller);
+    const int asyncFD = asyncWork.init();
+    if (asyncFD != -1)
+        netPoller->add(asyncFD);
+    logDebugMessage(2,"Using %s for socket polling\n", netPoller->getName());
+
     listServerLinksCount = 0;
     publicize();
     return true;
@@ -1025,6 +1079,11 @@ static void serverStop()
 
     // close connections
     NetHandler::destroyHandlers();
+
+    asyncWork.stop();
+    NetHandler::setPoller(NULL);
+    delete netPoller;
+    netPoller = NULL;
 }
 
 
@@ -1033,6 +1092,8 @@ static void relayPlayerPacket(int index, uint16_t len, const void *rawbuf, uint1
     if (Record::enabled())
         Record::addPacket(code, len, (const char*)rawbuf + 4);
 
+    NetMessage *shared = NetMessage::create(code, len, (const char*)rawbuf + 4);
+
     // relay packet to all players except origin
     for (int i = 0; i < curMaxPlayers; i++)
     {
@@ -1042,8 +1103,9 @@ static void relayPlayerPacket(int index, uint16_t len, const void *rawbuf, uint1
         PlayerInfo& pi = playerData->player;
 
         if (i != index && pi.isPlaying())
-            pwrite(*playerData, rawbuf, len + 4);
+            pwrite(*playerData, shared);
     }
+    shared->unref();
 }
 
 void makeWalls ( void )
@@ -1089,6 +1151,44 @@ void makeWalls ( void )
 }
 
 
+static bool packWorldDatabase()
+{
+    // package up world
+    world->packDatabase();
+
+    // now get world packaged for network transmission
+    worldDatabaseSize = 4 + WorldCodeHeaderSize +
+                        world->getDatabaseSize() + 4 + WorldCodeEndSize;
+
+    worldDatabase = new char[worldDatabaseSize];
+    // this should NOT happen but it does sometimes
+    if (!worldDatabase)
+        return false;
+    memset(worldDatabase, 0, worldDatabaseSize);
+
+    void *buf = worldDatabase;
+    buf = nboPackUShort(buf, WorldCodeHeaderSize);
+    buf = nboPackUShort(buf, WorldCodeHeader);
+    buf = nboPackUShort(buf, mapVersion);
+    buf = nboPackUInt(buf, world->getUncompressedSize());
+    buf = nboPackUInt(buf, world->getDatabaseSize());
+    buf = nboPackString(buf, world->getDatabase(), world->getDatabaseSize());
+    buf = nboPackUShort(buf, WorldCodeEndSize);
+    buf = nboPackUShort(buf, WorldCodeEnd);
+
+    TimeKeeper startTime = TimeKeeper::getCurrent();
+    MD5 md5;
+    md5.update((unsigned char *)worldDatabase, worldDatabaseSize);
+    md5.finalize();
+    hexDigest = (clOptions->worldFile == "") ? 't' : 'p';
+    hexDigest += md5.hexdigest();
+    TimeKeeper endTime = TimeKeeper::getCurrent();
+    logDebugMessage(3,"MD5 generation: %.3f seconds\n", endTime - startTime);
+    logDebugMessage(3,"MD5 = %s\n", hexDigest.c_str()+1);
+    return true;
+}
+
+
 bool defineWorld ( void )
 {
     // clean up old database
@@ -1122,11 +1222,21 @@ bool defineWorld ( void )
     }
 
     // make world and add buildings
+    BZWReader* reader = NULL;
+    WorldCache* cache = NULL;
+    bool fromCache = false;
     if (worldData.worldFile.size())
     {
-        BZWReader* reader = new BZWReader(std::string(worldData.worldFile.c_str()));
-        world = reader->defineWorldFromFile();
-        delete reader;
+        reader = new BZWReader(std::string(worldData.worldFile.c_str()));
+        world = NULL;
+        if (clOptions->worldCache != "")
+        {
+            cache = new WorldCache(clOptions->worldCache);
+            world = cache->load(*reader);
+            fromCache = (world != NULL);
+        }
+        if (!fromCache)
+            world = reader->defineWorldFromFile();
 
         if (clOptions->gameType == ClassicCTF)
         {
@@ -1137,6 +1247,8 @@ bool defineWorld ( void )
                     std::cerr << "base was not defined for "
                               << Team::getName((TeamColor)i)
                               << std::endl;
+                    delete cache;
+                    delete reader;
                     return false;
                 }
             }
@@ -1165,42 +1277,39 @@ bool defineWorld ( void )
     }
 
     if (world == NULL)
+    {
+        delete cache;
+        delete reader;
         return false;
+    }
 
     maxWorldHeight = world->getMaxWorldHeight();
 
-    // package up world
-    world->packDatabase();
-
-    // now get world packaged for network transmission
-    worldDatabaseSize = 4 + WorldCodeHeaderSize +
-                        world->getDatabaseSize() + 4 + WorldCodeEndSize;
-
-    worldDatabase = new char[worldDatabaseSize];
-    // this should NOT happen but it does sometimes
-    if (!worldDatabase)
-        return false;
-    memset(worldDatabase, 0, worldDatabaseSize);
-
-    void *buf = worldDatabase;
-    buf = nboPackUShort(buf, WorldCodeHeaderSize);
-    buf = nboPackUShort(buf, WorldCodeHeader);
-    buf = nboPackUShort(buf, mapVersion);
-    buf = nboPackUInt(buf, world->getUncompressedSize());
-    buf = nboPackUInt(buf, world->getDatabaseSize());
-    buf = nboPackString(buf, world->getDatabase(), world->getDatabaseSize());
-    buf = nboPackUShort(buf, WorldCodeEndSize);
-    buf = nboPackUShort(buf, WorldCodeEnd);
+    if (fromCache)
+    {
+        // already packed, compressed and hashed
+        const std::vector<char>& cached = cache->getDatabase();
+        worldDatabaseSize = cached.size();
+        worldDatabase = new char[worldDatabaseSize];
+        memcpy(worldDatabase, &cached[0], worldDatabaseSize);
+        hexDigest = cache->getDigest();
+    }
+    else
+    {
+        if (!packWorldDatabase())
+        {
+            delete cache;
+            delete reader;
+            return false;
+        }
+        if (cache)
+            cache->save(*reader, worldDatabase, worldDatabaseSize, hexDigest);
+    }
+    delete cache;
+    delete reader;
 
-    TimeKeeper startTime = TimeKeeper::getCurrent();
-    MD5 md5;
-    md5.update((unsigned char *)worldDatabase, worldDatabaseSize);
-    md5.finalize();
-    hexDigest = (clOptions->worldFile == "") ? 't' : 'p';
-    hexDigest += md5.hexdigest();
-    TimeKeeper endTime = TimeKeeper::getCurrent();
-    logDebugMessage(3,"MD5 generation: %.3f seconds\n", endTime - startTime);
-    logDebugMessage(3,"MD5 = %s\n", hexDigest.c_str()+1);
+    if (clOptions->httpWorld)
+        fileServer.setWorld(worldDatabase, worldDatabaseSize, hexDigest.substr(1));
 
     // water levels probably require flags on buildings
     const float waterLevel = world->getWaterLevel();
@@ -1249,6 +1358,197 @@ bool saveWorldCache( const char* fileName )
     return true;
 }
 
+static int parseBench( const std::string& fileName )
+{
+    // the first run also pays for reading the file from disk
+    const int runs = 5;
+    const char* stageNames[4] = { "load", "parse", "build", "pack" };
+    double best[4], total[4];
+    for (int s = 0; s < 4; s++)
+    {
+        best[s] = MAXFLOAT;
+        total[s] = 0.0;
+    }
+
+    size_t packedSize = 0;
+    for (int run = 0; run < runs; run++)
+    {
+        BZWReader reader(fileName);
+        WorldInfo *benchWorld = reader.defineWorldFromFile();
+        if (benchWorld == NULL)
+            return 1;
+
+        TimeKeeper startTime = TimeKeeper::getCurrent();
+        benchWorld->packDatabase();
+        const double packTime = TimeKeeper::getCurrent() - startTime;
+        packedSize = benchWorld->getDatabaseSize();
+
+        const BZWReader::StageTimes& times = reader.getStageTimes();
+        const double stages[4] = { times.load, times.parse, times.build, packTime };
+        for (int s = 0; s < 4; s++)
+        {
+            best[s] = std::min(best[s], stages[s]);
+            total[s] += stages[s];
+        }
+
+        // start the next run from nothing
+        delete benchWorld;
+        bases.clear();
+        MATERIALMGR.clear();
+        TEXMATRIXMGR.clear();
+        DYNCOLORMGR.clear();
+        PHYDRVMGR.clear();
+        TRANSFORMMGR.clear();
+    }
+
+    std::cout << TextUtils::format("%s: %d runs, %u bytes packed", fileName.c_str(),
+                                   runs, (unsigned int)packedSize) << std::endl;
+    for (int s = 0; s < 4; s++)
+    {
+        std::cout << TextUtils::format("  %-6s best %9.2f ms  average %9.2f ms",
+                                       stageNames[s], best[s] * 1000.0,
+                                       total[s] * 1000.0 / runs) << std::endl;
+    }
+    return 0;
+}
+
+// the spawn times of one stage of spawnBench(), and what went with them
+struct SpawnStage
+{
+    std::vector<double> spawns; // microseconds
+    int invalid;
+    int slices;
+    double longestSlice;        // seconds
+    double mapTime;
+};
+
+// player 0 spawns as the main loop would have it, once a pass, while
+// the spawn map is made or until count spawns are done when it is
+static void runSpawnStage(const char* name, int count, SpawnStage& stage)
+{
+    const SpawnSurfaces& surfaces = world->getSpawnSurfaces();
+    stage.spawns.clear();
+    stage.invalid = 0;
+    stage.slices = 0;
+    stage.longestSlice = 0.0;
+    stage.mapTime = 0.0;
+
+    const TimeKeeper stageStart = TimeKeeper::getCurrent();
+    const bool wasReady = surfaces.isReady();
+    bool mapping = true;
+    while (mapping || ((int)stage.spawns.size() < count))
+    {
+        if (mapping)
+        {
+            const TimeKeeper start = TimeKeeper::getCurrent();
+            scheduler.run(start);
+            const double slice = TimeKeeper::getCurrent() - start;
+            stage.slices++;
+            stage.longestSlice = std::max(stage.longestSlice, slice);
+            if (surfaces.isReady())
+            {
+                mapping = false;
+                stage.mapTime = TimeKeeper::getCurrent() - stageStart;
+            }
+        }
+
+        const TimeKeeper start = TimeKeeper::getCurrent();
+        SpawnPosition spawn(0, false, false);
+        stage.spawns.push_back((TimeKeeper::getCurrent() - start) * 1.0e6);
+        const float pos[3] = { spawn.getX(), spawn.getY(), spawn.getZ() };
+        if (!DropGeometry::isValidSpawn(pos, BZDBCache::tankRadius,
+                                        BZDBCache::tankHeight))
+            stage.invalid++;
+    }
+
+    std::vector<double>& spawns = stage.spawns;
+    double total = 0.0;
+    for (size_t i = 0; i < spawns.size(); i++)
+        total += spawns[i];
+    std::sort(spawns.begin(), spawns.end());
+    const size_t n = spawns.size();
+    std::cout << TextUtils::format("  %-20s %7d %8.1f %8.1f %8.1f %8.1f %7d",
+                                   name, (int)n, spawns[n / 2],
+                                   spawns[(n * 9) / 10], spawns[(n * 99) / 100],
+                                   total / n, stage.invalid);
+    if (!wasReady)
+    {
+        std::cout << TextUtils::format(" %7d %8.2f %8.3f", stage.slices,
+                                       stage.longestSlice * 1000.0,
+                                       stage.mapTime);
+    }
+    std::cout << std::endl;
+}
+
+static int spawnBench(int count)
+{
+    const SpawnSurfaces& surfaces = world->getSpawnSurfaces();
+    const float size = BZDBCache::worldSize;
+    const float maxHeight = world->getMaxWorldHeight();
+
+    // a red tank spawning among 20 green ones spread over the world
+    const int enemies = 20;
+    const uint16_t savedMaxPlayers = curMaxPlayers;
+    std::vector<GameKeeper::Player*> benchPlayers;
+    for (int i = 0; i <= enemies; i++)
+    {
+        GameKeeper::Player* playerData = new GameKeeper::Player(i, NULL);
+        benchPlayers.push_back(playerData);
+        PlayerInfo& player = playerData->player;
+        if (i == 0)
+        {
+            player.setTeam(RedTeam);
+            player.setRestartOnBase(false);
+            continue;
+        }
+        player.setTeam(GreenTeam);
+        player.setAlive();
+        float* pos = playerData->lastState.pos;
+        do
+        {
+            pos[0] = ((float)bzfrand() - 0.5f) * size;
+            pos[1] = ((float)bzfrand() - 0.5f) * size;
+            pos[2] = (float)bzfrand() * maxHeight;
+        }
+        while (!DropGeometry::dropPlayer(pos, 0.0f, maxHeight));
+        playerData->lastState.azimuth = (float)(bzfrand() * 2.0 * M_PI);
+    }
+    curMaxPlayers = enemies + 1;
+
+    std::cout << TextUtils::format("%d obstacles, %d spawns a stage, %d enemies",
+                                   COLLISIONMGR.getObstacleCount(), count,
+                                   enemies) << std::endl;
+    std::cout << TextUtils::format("  %-20s %7s %8s %8s %8s %8s %7s %7s %8s %8s",
+                                   "stage", "spawns", "p50 us", "p90 us",
+                                   "p99 us", "mean us", "invalid", "passes",
+                                   "most ms", "map s") << std::endl;
+
+    SpawnStage stage;
+    runSpawnStage("map at load", 1, stage);
+    const int spots = surfaces.getSpotCount();
+    runSpawnStage("mapped", count, stage);
+
+    // BZDB tells of a set even when nothing changed
+    const std::string tankHeight = BZDB.get(StateDatabase::BZDB_TANKHEIGHT);
+    BZDB.set(StateDatabase::BZDB_TANKHEIGHT, tankHeight);
+    runSpawnStage("same _tankHeight", count, stage);
+
+    BZDB.setFloat(StateDatabase::BZDB_TANKHEIGHT,
+                  BZDB.eval(StateDatabase::BZDB_TANKHEIGHT) * 1.5f);
+    runSpawnStage("_tankHeight x 1.5", 1, stage);
+    runSpawnStage("mapped again", count, stage);
+    BZDB.set(StateDatabase::BZDB_TANKHEIGHT, tankHeight);
+    runSpawnStage("_tankHeight back", 1, stage);
+
+    std::cout << TextUtils::format("%d spots; passes, the longest of them and the whole map are while mapping",
+                                   spots) << std::endl;
+
+    for (size_t i = 0; i < benchPlayers.size(); i++)
+        delete benchPlayers[i];
+    curMaxPlayers = savedMaxPlayers;
+    return 0;
+}
+
 float getMaxWorldHeight( void )
 {
     float heightFudge = 1.10f; /* 10% */
@@ -1355,6 +1655,7 @@ static void acceptClient()
     peer.lastSend = TimeKeeper::getCurrent();
     peer.startTime = TimeKeeper::getCurrent();
     peer.deleteWhenDoneSending = false;
+    peer.readReady = false;
     peer.inactivityTimeout = 30;
 
     netConnectedPeers[fd] = peer;
@@ -1429,6 +1730,39 @@ static bool MakePlayer ( NetHandler *handler )
     return true;
 }
 
+static TimeKeeper nextSuperFlagInsertion;
+static unsigned int superFlagTimer = 0;
+
+static double superFlagCallback(void *)
+{
+    // the timer starts again with the next game
+    if (gameOver)
+    {
+        superFlagTimer = 0;
+        return -1.0;
+    }
+
+    // randomly choose next flag respawn time; halflife distribution
+    static const float flagExp = -logf(0.5f) / FlagHalfLife;
+    float r = float(bzfrand() + 0.01); // small offset, we do not want to wait forever
+    nextSuperFlagInsertion += -logf(r) / flagExp;
+    for (int i = numFlags - clOptions->numExtraFlags; i < numFlags; i++)
+    {
+        FlagInfo &flag = *FlagInfo::get(i);
+        if (flag.flag.type == Flags::Null)
+        {
+            // flag in now entering game
+            flag.addFlag();
+            sendFlagUpdate(flag);
+            break;
+        }
+    }
+
+    // insertions missed while there was no game are made up one at a time
+    const double next = nextSuperFlagInsertion - TimeKeeper::getCurrent();
+    return (next > 0.0) ? next : 0.0;
+}
+
 void checkGameOn()
 {
     // if game was over and this is the first player then game is on
@@ -1439,6 +1773,8 @@ void checkGameOn()
         {
             gameOver = false;
             gameStartTime = TimeKeeper::getCurrent();
+            if ((clOptions->numExtraFlags > 0) && !scheduler.isScheduled(superFlagTimer))
+                superFlagTimer = scheduler.add(0.0, superFlagCallback, NULL);
             if (clOptions->timeLimit > 0.0f && !clOptions->timeManualStart)
             {
                 clOptions->timeElapsed = 0.0f;
@@ -2057,6 +2393,41 @@ static std::string evaluateString(const std::string &raw)
     return eval;
 }
 
+
+static double advertCallback(void *)
+{
+    char message[MessageLen];
+    if (clOptions->advertisemsg != "")
+    {
+        const std::string admsg = evaluateString(clOptions->advertisemsg);
+        // split the admsg into several lines if it contains '\n'
+        const char* c = admsg.c_str();
+        const char* j;
+        while ((j = strstr(c, "\\n")) != NULL)
+        {
+            int l = j - c < MessageLen - 1 ? j - c : MessageLen - 1;
+            strncpy(message, c, l);
+            message[l] = '\0';
+            sendMessage(ServerPlayer, AllPlayers, message);
+            c = j + 2;
+        }
+        strncpy(message, c, MessageLen - 1);
+        message[strlen(c) < MessageLen - 1 ? strlen(c) : MessageLen -1] = '\0';
+        sendMessage(ServerPlayer, AllPlayers, message);
+    }
+    // multi line from file advert
+    const std::vector<std::string>* adLines = clOptions->textChunker.getTextChunk("admsg");
+    if (adLines != NULL)
+    {
+        for (int j = 0; j < (int)adLines->size(); j++)
+        {
+            const std::string admsg = evaluateString((*adLines)[j]);
+            sendMessage(ServerPlayer, AllPlayers, admsg.c_str());
+        }
+    }
+    return 900.0;
+}
+
 static bool handicapAllowed( void )
 {
     return (clOptions->gameOptions & short(HandicapGameStyle)) != 0;
@@ -3035,7 +3406,7 @@ bool areFoes(TeamColor team1, TeamColor team2)
 }
 
 
-static void sendWorld(int playerIndex, uint32_t ptr)
+static uint32_t sendWorld(int playerIndex, uint32_t ptr)
 {
     playerHadWorld = true;
     // send another small chunk of the world database
@@ -3056,6 +3427,44 @@ static void sendWorld(int playerIndex, uint32_t ptr)
     buf = nboPackUInt(bufStart, uint32_t(left));
     buf = nboPackString(buf, (char*)worldDatabase + ptr, size);
     directMessage(playerIndex, MsgGetWorld, (char*)buf - (char*)bufStart, bufStart);
+    return ptr + size;
+}
+
+
+// where the client on handler reached us, for URLs handed to it
+static std::string getServerAddress(NetHandler *handler)
+{
+    const std::string& publicAddress = clOptions->publicizedAddress;
+    if (!publicAddress.empty() && (publicAddress[0] != ':'))
+    {
+        if (publicAddress.find(':') == std::string::npos)
+            return TextUtils::format("%s:%d", publicAddress.c_str(), ServerPort);
+        return publicAddress;
+    }
+
+    struct sockaddr_in addr;
+    AddrLen addrLen = sizeof(addr);
+    if (getsockname(handler->getFD(), (struct sockaddr*)&addr, &addrLen) != 0)
+        return TextUtils::format("localhost:%d", clOptions->wksPort);
+    return TextUtils::format("%s:%d", inet_ntoa(addr.sin_addr), ntohs(addr.sin_port));
+}
+
+
+// keep sending chunks up to the client's credit, but leave the rest in
+// the database while the player's send queue is backing up
+static void pumpWorld(int playerIndex)
+{
+    GameKeeper::Player *playerData;
+    while ((playerData = GameKeeper::Player::getPlayerByIndex(playerIndex)) != NULL)
+    {
+        if (!playerData->netHandler || playerData->isParting ||
+                playerData->netHandler->isCongested())
+            break;
+        const uint32_t credit = std::min(playerData->worldCredit, worldDatabaseSize);
+        if (playerData->worldSent >= credit)
+            break;
+        playerData->worldSent = sendWorld(playerIndex, playerData->worldSent);
+    }
 }
 
 
@@ -3730,6 +4139,33 @@ void grabFlag(int playerIndex, FlagInfo &flag, bool checkPos)
 }
 
 
+static unsigned int teamFlagTimers[NumTeams];
+
+static double teamFlagTimeoutCallback(void *data)
+{
+    const int i = int((TeamInfo*)data - team);
+    teamFlagTimers[i] = 0;
+
+    if ((clOptions->gameType != ClassicCTF) || (team[i].team.size != 0))
+        return -1.0;
+
+    int flagid = FlagInfo::lookupFirstTeamFlag(i);
+    if (flagid >= 0)
+    {
+        for (int n = 0; n < clOptions->numTeamFlags[i]; n++)
+        {
+            FlagInfo &flag = *FlagInfo::get(flagid + n);
+            if (flag.exist() && flag.player == -1)
+            {
+                logDebugMessage(1,"Flag timeout for team %d\n", i);
+                zapFlag(flag);
+            }
+        }
+    }
+    return -1.0;
+}
+
+
 void dropFlag(FlagInfo& drpFlag, const float dropPos[3])
 {
     assert(world != NULL);
@@ -3826,8 +4262,11 @@ void dropFlag(FlagInfo& drpFlag, const float dropPos[3])
 
             if (startTimeout)
             {
-                team[flagIndex + 1].flagTimeout = TimeKeeper::getCurrent();
-                team[flagIndex + 1].flagTimeout += (float)clOptions->teamFlagTimeout;
+                team[flagTeam].flagTimeout = TimeKeeper::getCurrent();
+                team[flagTeam].flagTimeout += (float)clOptions->teamFlagTimeout;
+                scheduler.cancel(teamFlagTimers[flagTeam]);
+                teamFlagTimers[flagTeam] = scheduler.addAt(team[flagTeam].flagTimeout,
+                                           teamFlagTimeoutCallback, &team[flagTeam]);
             }
         }
     }
@@ -4090,7 +4529,7 @@ static void shotFired(int playerIndex, void *buf, int len)
         repack = true;
     }
 
-    float shotSpeed = BZDB.eval(StateDatabase::BZDB_SHOTSPEED);
+    float shotSpeed = BZDB.eval(bzdbHandles.shotSpeed);
     FlagInfo &fInfo = *FlagInfo::get(shooter.getFlag());
     // verify player flag
     if ((firingInfo.flagType != Flags::Null)
@@ -4131,13 +4570,13 @@ static void shotFired(int playerIndex, void *buf, int len)
         return;
 
     const float maxTankSpeed  = BZDBCache::tankSpeed;
-    const float tankSpeedMult = BZDB.eval(StateDatabase::BZDB_VELOCITYAD);
+    const float tankSpeedMult = BZDB.eval(bzdbHandles.velocityAd);
     float tankSpeed       = maxTankSpeed;
-    float lifetime        = BZDB.eval(StateDatabase::BZDB_RELOADTIME);
+    float lifetime        = BZDB.eval(bzdbHandles.reloadTime);
     if (handicapAllowed())
     {
-        tankSpeed *= BZDB.eval(StateDatabase::BZDB_HANDICAPVELAD);
-        shotSpeed *= BZDB.eval(StateDatabase::BZDB_HANDICAPSHOTAD);
+        tankSpeed *= BZDB.eval(bzdbHandles.handicapVelAd);
+        shotSpeed *= BZDB.eval(bzdbHandles.handicapShotAd);
     }
     if (firingInfo.flagType == Flags::ShockWave)
     {
@@ -4147,17 +4586,17 @@ static void shotFired(int playerIndex, void *buf, int len)
     else if (firingInfo.flagType == Flags::Velocity)
         tankSpeed *= tankSpeedMult;
     else if (firingInfo.flagType == Flags::Thief)
-        tankSpeed *= BZDB.eval(StateDatabase::BZDB_THIEFVELAD);
+        tankSpeed *= BZDB.eval(bzdbHandles.thiefVelAd);
     else if ((firingInfo.flagType == Flags::Burrow)
-             && (firingInfo.shot.pos[2] < BZDB.eval(StateDatabase::BZDB_MUZZLEHEIGHT)))
-        tankSpeed *= BZDB.eval(StateDatabase::BZDB_BURROWSPEEDAD);
+             && (firingInfo.shot.pos[2] < BZDB.eval(bzdbHandles.muzzleHeight)))
+        tankSpeed *= BZDB.eval(bzdbHandles.burrowSpeedAd);
     else if (firingInfo.flagType == Flags::Agility)
-        tankSpeed *= BZDB.eval(StateDatabase::BZDB_AGILITYADVEL);
+        tankSpeed *= BZDB.eval(bzdbHandles.agilityAdVel);
     else
     {
         //If shot is different height than player, can't be sure they didn't drop V in air
         if (playerData->lastState.pos[2]
-                != (shot.pos[2]-BZDB.eval(StateDatabase::BZDB_MUZZLEHEIGHT)))
+                != (shot.pos[2]-BZDB.eval(bzdbHandles.muzzleHeight)))
             tankSpeed *= tankSpeedMult;
     }
 
@@ -4185,10 +4624,10 @@ static void shotFired(int playerIndex, void *buf, int len)
         }
 
         // verify position
-        float muzzleFront = BZDB.eval(StateDatabase::BZDB_MUZZLEFRONT);
-        float muzzleHeight = BZDB.eval(StateDatabase::BZDB_MUZZLEHEIGHT);
+        float muzzleFront = BZDB.eval(bzdbHandles.muzzleFront);
+        float muzzleHeight = BZDB.eval(bzdbHandles.muzzleHeight);
         if (firingInfo.flagType == Flags::Obesity)
-            muzzleFront *= BZDB.eval(StateDatabase::BZDB_OBESEFACTOR);
+            muzzleFront *= BZDB.eval(bzdbHandles.obeseFactor);
         const PlayerState &last = playerData->lastState;
         float dx = last.pos[0] - shot.pos[0];
         float dy = last.pos[1] - shot.pos[1];
@@ -4799,10 +5238,29 @@ static void handleCommand(int t, void *rawbuf, bool udp)
     // player wants more of world database
     case MsgGetWorld:
     {
-        // data: count (bytes read so far)
+        // data: count (bytes read so far)[, window]
         uint32_t ptr;
         buf = nboUnpackUInt(buf, ptr);
-        sendWorld(t, ptr);
+        if (len < 2 * sizeof(uint32_t))
+        {
+            // one chunk per request
+            playerData->worldCredit = 0;
+            sendWorld(t, ptr);
+            break;
+        }
+
+        // the client can take up to window bytes past what it has read
+        uint32_t window;
+        buf = nboUnpackUInt(buf, window);
+        ptr = std::min(ptr, worldDatabaseSize);
+        if (ptr == 0)
+            playerData->worldCredit = 0;
+        if ((ptr == 0) || (ptr > playerData->worldSent))
+            playerData->worldSent = ptr;
+        window = std::min(window, uint32_t(MaxWorldWindow));
+        playerData->worldCredit = std::max(playerData->worldCredit,
+                                           std::min(ptr + window, worldDatabaseSize));
+        pumpWorld(t);
         break;
     }
 
@@ -4815,13 +5273,16 @@ static void handleCommand(int t, void *rawbuf, bool udp)
     case MsgWantWHash:
     {
         void *obuf, *obufStart = getDirectMessageBuffer();
-        if (clOptions->cacheURL.size() > 0)
+        std::string cacheURL = clOptions->cacheURL;
+        if (cacheURL.empty() && fileServer.hasWorld())
+            cacheURL = fileServer.getWorldURL(getServerAddress(handler));
+        if (cacheURL.size() > 0)
         {
-            obuf = nboPackString(obufStart, clOptions->cacheURL.c_str(),
-                                 clOptions->cacheURL.size() + 1);
+            obuf = nboPackString(obufStart, cacheURL.c_str(), cacheURL.size() + 1);
             directMessage(t, MsgCacheURL, (char*)obuf-(char*)obufStart, obufStart);
         }
         obuf = nboPackString(obufStart, hexDigest.c_str(), hexDigest.size() + 1);
+        obuf = nboPackUInt(obuf, MaxWorldWindow);
         directMessage(t, MsgWantWHash, (char*)obuf-(char*)obufStart, obufStart);
         break;
     }
@@ -5294,9 +5755,6 @@ static void handleCommand(int t, void *rawbuf, bool udp)
             break;
         }
 
-        bz_PlayerUpdateEventData_V1 puEventData;
-        playerStateToAPIState(puEventData.lastState,state);
-
         // observer updates are not relayed
         if (playerData->player.isObserver())
         {
@@ -5305,11 +5763,15 @@ static void handleCommand(int t, void *rawbuf, bool udp)
             break;
         }
         // tell the API that they moved.
-
-        playerStateToAPIState(puEventData.state,state);
-        puEventData.stateTime = TimeKeeper::getCurrent().getSeconds();
-        puEventData.playerID = playerData->getIndex();
-        worldEventManager.callEvents(bz_ePlayerUpdateEvent,&puEventData);
+        if (worldEventManager.hasHandlers(bz_ePlayerUpdateEvent))
+        {
+            bz_PlayerUpdateEventData_V1 puEventData;
+            playerStateToAPIState(puEventData.lastState,state);
+            playerStateToAPIState(puEventData.state,state);
+            puEventData.stateTime = TimeKeeper::getCurrent().getSeconds();
+            puEventData.playerID = playerData->getIndex();
+            worldEventManager.callEvents(bz_ePlayerUpdateEvent,&puEventData);
+        }
 
         // silently drop old packet
         if (state.order <= playerData->lastState.order)
@@ -5355,10 +5817,10 @@ static void handleCommand(int t, void *rawbuf, bool udp)
             }
 
             static const float burrowFudge = 1.0f; /* linear distance */
-            if (state.pos[2]<BZDB.eval(StateDatabase::BZDB_BURROWDEPTH) - burrowFudge)
+            if (state.pos[2]<BZDB.eval(bzdbHandles.burrowDepth) - burrowFudge)
             {
                 logDebugMessage(2,"Player %s [%d] z depth %.2f is less than burrow depth (%.2f + %.2f)\n",
-                                playerData->player.getCallSign(), t, state.pos[2], BZDB.eval(StateDatabase::BZDB_BURROWDEPTH), burrowFudge);
+                                playerData->player.getCallSign(), t, state.pos[2], BZDB.eval(bzdbHandles.burrowDepth), burrowFudge);
                 InBounds = false;
             }
 
@@ -5391,7 +5853,7 @@ static void handleCommand(int t, void *rawbuf, bool udp)
                     float maxPlanarSpeed = BZDBCache::tankSpeed;
 
                     bool logOnly = false;
-                    if (BZDB.isTrue("_speedChecksLogOnly"))
+                    if (BZDB.isTrue(bzdbHandles.speedChecksLogOnly))
                         logOnly = true;
 
                     // if tank is not driving cannot be sure it didn't toss
@@ -5403,19 +5865,19 @@ static void handleCommand(int t, void *rawbuf, bool udp)
                     {
                         FlagInfo &flag = *FlagInfo::get(pFlag);
                         if (flag.flag.type == Flags::Velocity)
-                            maxPlanarSpeed *= BZDB.eval(StateDatabase::BZDB_VELOCITYAD);
+                            maxPlanarSpeed *= BZDB.eval(bzdbHandles.velocityAd);
                         else if (flag.flag.type == Flags::Thief)
-                            maxPlanarSpeed *= BZDB.eval(StateDatabase::BZDB_THIEFVELAD);
+                            maxPlanarSpeed *= BZDB.eval(bzdbHandles.thiefVelAd);
                         else if (flag.flag.type == Flags::Agility)
-                            maxPlanarSpeed *= BZDB.eval(StateDatabase::BZDB_AGILITYADVEL);
+                            maxPlanarSpeed *= BZDB.eval(bzdbHandles.agilityAdVel);
                         else if ((flag.flag.type == Flags::Burrow) &&
                                  (playerData->lastState.pos[2] == state.pos[2]) &&
                                  (playerData->lastState.velocity[2] == state.velocity[2]) &&
-                                 (state.pos[2] <= BZDB.eval(StateDatabase::BZDB_BURROWDEPTH)))
+                                 (state.pos[2] <= BZDB.eval(bzdbHandles.burrowDepth)))
                             // if we have burrow and are not actively burrowing
                             // You may have burrow and still be above ground. Must
                             // check z in ground!!
-                            maxPlanarSpeed *= BZDB.eval(StateDatabase::BZDB_BURROWSPEEDAD);
+                            maxPlanarSpeed *= BZDB.eval(bzdbHandles.burrowSpeedAd);
                     }
                     float maxPlanarSpeedSqr = maxPlanarSpeed * maxPlanarSpeed;
 
@@ -6017,7 +6479,7 @@ std::string getIPFromHandler (NetHandler* netHandler)
     return strRet;
 }
 
-static void processConnectedPeer(NetConnectedPeer& peer, int sockFD, fd_set& read_set, fd_set& UNUSED(write_set))
+static void processConnectedPeer(NetConnectedPeer& peer, int sockFD)
 {
     const double connectionTimeout = 2.5; // timeout in seconds
 
@@ -6100,7 +6562,11 @@ static void processConnectedPeer(NetConnectedPeer& peer, int sockFD, fd_set& rea
                     if (!MakePlayer(netHandler))
                         peer.deleteMe = true;
                     else
+                    {
                         peer.player = netHandler->getPlayerID();
+                        // whatever followed the header is for the player now
+                        netPoller->setPending(sockFD);
+                    }
 
                     return;
                 }
@@ -6139,6 +6605,10 @@ static void processConnectedPeer(NetConnectedPeer& peer, int sockFD, fd_set& rea
                         peer.deleteMe = true;
                     }
 
+                    // the world and the -httpdir files are served right here
+                    if (!peer.deleteMe && fileServer.accept(sockFD, peer))
+                        return;
+
                     // call an event to let people know we got a new connect
                     bz_NewNonPlayerConnectionEventData_V1 eventData;
 
@@ -6169,8 +6639,10 @@ static void processConnectedPeer(NetConnectedPeer& peer, int sockFD, fd_set& rea
     }
 
     // we like them see if they have gotten new data
-    if (peer.apiHandler && peer.player < 0 && netHandler->isFdSet(&read_set))
+    if (peer.apiHandler && peer.player < 0 && peer.readReady)
     {
+        peer.readReady = false;
+
         in_addr IP = netHandler->getIPAddress();
         BanInfo info(IP);
         if (!clOptions->acl.validate(IP, &info))
@@ -6206,6 +6678,10 @@ static void processConnectedPeer(NetConnectedPeer& peer, int sockFD, fd_set& rea
                 peer.lastActivity = TimeKeeper::getCurrent();
                 peer.apiHandler->pending(peer.socket,netHandler->getTcpBuffer(),netHandler->getTcpReadSize());
                 netHandler->flushData();
+
+                // a full buffer means there may be more waiting
+                if (e == ReadAll)
+                    netPoller->setPending(peer.socket);
             }
             else
             {
@@ -6216,6 +6692,14 @@ static void processConnectedPeer(NetConnectedPeer& peer, int sockFD, fd_set& rea
         }
     }
 
+    if (peer.apiHandler == &fileServer && !peer.deleteMe)
+    {
+        if (fileServer.transfer(sockFD, peer))
+            peer.deleteMe = true;
+        else
+            netPoller->setWantWrite(sockFD, fileServer.wantsWrite(sockFD));
+    }
+
     if (peer.player < 0) // only send data if he's not a player, there may be disco data
         sendBufferedNetDataForPeer(peer);
 }
@@ -6597,6 +7081,20 @@ int main(int argc, char **argv)
 
     BZDBCache::init();
 
+    bzdbHandles.agilityAdVel       = requireHandle(StateDatabase::BZDB_AGILITYADVEL);
+    bzdbHandles.burrowDepth        = requireHandle(StateDatabase::BZDB_BURROWDEPTH);
+    bzdbHandles.burrowSpeedAd      = requireHandle(StateDatabase::BZDB_BURROWSPEEDAD);
+    bzdbHandles.handicapShotAd     = requireHandle(StateDatabase::BZDB_HANDICAPSHOTAD);
+    bzdbHandles.handicapVelAd      = requireHandle(StateDatabase::BZDB_HANDICAPVELAD);
+    bzdbHandles.muzzleFront        = requireHandle(StateDatabase::BZDB_MUZZLEFRONT);
+    bzdbHandles.muzzleHeight       = requireHandle(StateDatabase::BZDB_MUZZLEHEIGHT);
+    bzdbHandles.obeseFactor        = requireHandle(StateDatabase::BZDB_OBESEFACTOR);
+    bzdbHandles.reloadTime         = requireHandle(StateDatabase::BZDB_RELOADTIME);
+    bzdbHandles.shotSpeed          = requireHandle(StateDatabase::BZDB_SHOTSPEED);
+    bzdbHandles.speedChecksLogOnly = requireHandle(StateDatabase::BZDB_SPEEDCHECKSLOGONLY);
+    bzdbHandles.thiefVelAd         = requireHandle(StateDatabase::BZDB_THIEFVELAD);
+    bzdbHandles.velocityAd         = requireHandle(StateDatabase::BZDB_VELOCITYAD);
+
     // any set in parse this is a default value
     BZDB.setSaveDefault(true);
 
@@ -6617,6 +7115,9 @@ int main(int argc, char **argv)
             logDebugMessage(1,"WARNING: unable to load the variable file\n");
     }
 
+    if (clOptions->parseBench != "")
+        return parseBench(clOptions->parseBench);
+
     if (clOptions->publicizeServer && clOptions->publicizedKey.empty())
     {
         logDebugMessage(0,
@@ -6853,12 +7354,19 @@ int main(int argc, char **argv)
     // setup the game settings
     makeGameSettings();
 
+    if (clOptions->spawnBench > 0)
+        return spawnBench(clOptions->spawnBench);
+
     // no original world weapons in replay mode
     if (Replay::enabled())
         world->getWorldWeapons().clear();
 
-    TimeKeeper nextSuperFlagInsertion = TimeKeeper::getCurrent();
-    const float flagExp = -logf(0.5f) / FlagHalfLife;
+    nextSuperFlagInsertion = TimeKeeper::getCurrent();
+
+    // every 15 minutes
+    if ((clOptions->advertisemsg != "") ||
+            (clOptions->textChunker.getTextChunk("admsg") != NULL))
+        scheduler.add(900.0, advertCallback, NULL);
 
     // load up the access permissions & stuff
     initGroups();
@@ -6898,28 +7406,25 @@ int main(int argc, char **argv)
      * substantially (about x10)
      **/
 
-    int i;
     while (!done)
     {
 
         // see if the octree needs to be reloaded
         world->checkCollisionManager();
 
-        maxFileDescriptor = 0;
-        // prepare select set
+        // player and listen sockets stay registered with the poller, only
+        // the resolvers and cURL have to tell what they are waiting for
         fd_set read_set, write_set;
         FD_ZERO(&read_set);
         FD_ZERO(&write_set);
-        NetHandler::setFd(&read_set, &write_set, maxFileDescriptor);
-        // always listen for connections
-        FD_SET((unsigned int)wksSocket, &read_set);
-        if (wksSocket > maxFileDescriptor)
-            maxFileDescriptor = wksSocket;
+        int maxFileDescriptor = -1;
+        NetHandler::setDNSFd(&read_set, &write_set, maxFileDescriptor);
 
         // Check for cURL needed activity
         int cURLmaxFile = cURLManager::fdset(read_set, write_set);
         if (cURLmaxFile > maxFileDescriptor)
             maxFileDescriptor = cURLmaxFile;
+        netPoller->setTransient(read_set, write_set, maxFileDescriptor);
 
         // find timeout when next flag would hit ground
         TimeKeeper tm = TimeKeeper::getCurrent();
@@ -6934,39 +7439,13 @@ int main(int argc, char **argv)
         else if (countdownActive && clOptions->timeLimit > 0.0f)
             waitTime = 1.0f;
 
-        // get time for next flag drop
-        float dropTime;
-        while ((dropTime = FlagInfo::getNextDrop(tm)) <= 0.0f)
-        {
-            // if any flags were in the air, see if they've landed
-            for (i = 0; i < numFlags; i++)
-            {
-                FlagInfo *flag = FlagInfo::get(i);
-                if (!flag)
-                    continue;
-                if (flag->landing(tm))
-                {
-                    if (flag->flag.status == FlagOnGround)
-                        sendFlagUpdate(*flag);
-                    else
-                        resetFlag(*flag);
-                }
-            }
-        }
-        if (dropTime < waitTime)
-            waitTime = dropTime;
+        // flags landing, world weapons, game time updates and plugin timers
+        waitTime = scheduler.getWaitTime(tm, waitTime);
+        waitTime = asyncWork.getWaitTime(waitTime);
 
         // get time for next Player internal action
         GameKeeper::Player::updateLatency(waitTime);
 
-        // get time for the next world weapons shot
-        if (world->getWorldWeapons().count() > 0)
-        {
-            float nextTime = world->getWorldWeapons().nextTime ();
-            if (nextTime < waitTime)
-                waitTime = nextTime;
-        }
-
         // get time for the next replay packet (if active)
         if (Replay::enabled())
         {
@@ -6974,13 +7453,6 @@ int main(int argc, char **argv)
             if (nextTime < waitTime)
                 waitTime = nextTime;
         }
-        else
-        {
-            // game time updates
-            const float nextGT = nextGameTime();
-            if (nextGT < waitTime)
-                waitTime = nextGT;
-        }
 
         // minmal waitTime
         if (waitTime < 0.0f)
@@ -7003,7 +7475,7 @@ int main(int argc, char **argv)
             while (itr != netConnectedPeers.end())
             {
                 // don't wait if we have data to send out
-                if (itr->second.sendChunks.size())
+                if (itr->second.sendChunks.size() || fileServer.canSendMore(itr->first))
                 {
                     waitTime = 0;
                     break;
@@ -7022,33 +7494,26 @@ int main(int argc, char **argv)
         }
 
         /**************
-         *  SELECT()  *
+         *   POLL()   *
          **************/
 
         // wait for an incoming communication, a flag to hit the ground,
         // a game countdown to end, a world weapon needed to be fired,
         // or a replay packet waiting to be sent.
-        struct timeval timeout;
-        timeout.tv_sec = long(floorf(waitTime));
-        timeout.tv_usec = long(1.0e+6f * (waitTime - floorf(waitTime)));
-        nfound = select(maxFileDescriptor+1, (fd_set*)&read_set, (fd_set*)&write_set, 0, &timeout);
-        //if (nfound)
-        //  logDebugMessage(1,"nfound,read,write %i,%08lx,%08lx\n", nfound, read_set, write_set);
+        nfound = netPoller->wait(waitTime);
 
         // send replay packets
-        // (this check and response should follow immediately after the select() call)
+        // (this check and response should follow immediately after the poll)
         if (Replay::playing())
             Replay::sendPackets ();
 
-        // game time updates
-        if (!Replay::enabled())
-            sendPendingGameTime();
-
-
         // synchronize PlayerInfo
         tm = TimeKeeper::getCurrent();
         PlayerInfo::setCurrentTime(tm);
 
+        // run whatever timers are due
+        scheduler.run(tm);
+
         // players see a countdown
         if (countdownDelay >= 0)
         {
@@ -7544,89 +8009,6 @@ int main(int argc, char **argv)
         } // voting is allowed and an arbiter exists
 
 
-        // periodic advertising broadcast
-        static const std::vector<std::string>* adLines = clOptions->textChunker.getTextChunk("admsg");
-        if ((clOptions->advertisemsg != "") || adLines != NULL)
-        {
-            static TimeKeeper lastbroadcast = tm;
-            if (tm - lastbroadcast > 900)
-            {
-                // every 15 minutes
-                char message[MessageLen];
-                if (clOptions->advertisemsg != "")
-                {
-                    const std::string admsg = evaluateString(clOptions->advertisemsg);
-                    // split the admsg into several lines if it contains '\n'
-                    const char* c = admsg.c_str();
-                    const char* j;
-                    while ((j = strstr(c, "\\n")) != NULL)
-                    {
-                        int l = j - c < MessageLen - 1 ? j - c : MessageLen - 1;
-                        strncpy(message, c, l);
-                        message[l] = '\0';
-                        sendMessage(ServerPlayer, AllPlayers, message);
-                        c = j + 2;
-                    }
-                    strncpy(message, c, MessageLen - 1);
-                    message[strlen(c) < MessageLen - 1 ? strlen(c) : MessageLen -1] = '\0';
-                    sendMessage(ServerPlayer, AllPlayers, message);
-                }
-                // multi line from file advert
-                if (adLines != NULL)
-                {
-                    for (int j = 0; j < (int)adLines->size(); j++)
-                    {
-                        const std::string admsg = evaluateString((*adLines)[j]);
-                        sendMessage(ServerPlayer, AllPlayers, admsg.c_str());
-                    }
-                }
-                lastbroadcast = tm;
-            }
-        }
-
-        // check team flag timeouts
-        if (clOptions->gameType == ClassicCTF)
-        {
-            for (i = RedTeam; i < CtfTeams; ++i)
-            {
-                if (team[i].flagTimeout - tm < 0 && team[i].team.size == 0)
-                {
-                    int flagid = FlagInfo::lookupFirstTeamFlag(i);
-                    if (flagid >= 0)
-                    {
-                        for (int n = 0; n < clOptions->numTeamFlags[i]; n++)
-                        {
-                            FlagInfo &flag = *FlagInfo::get(flagid + n);
-                            if (flag.exist() && flag.player == -1)
-                            {
-                                logDebugMessage(1,"Flag timeout for team %d\n", i);
-                                zapFlag(flag);
-                            }
-                        }
-                    }
-                }
-            }
-        }
-
-        // maybe add a super flag (only if game isn't over)
-        if (!gameOver && clOptions->numExtraFlags > 0 && nextSuperFlagInsertion<=tm)
-        {
-            // randomly choose next flag respawn time; halflife distribution
-            float r = float(bzfrand() + 0.01); // small offset, we do not want to wait forever
-            nextSuperFlagInsertion += -logf(r) / flagExp;
-            for (i = numFlags - clOptions->numExtraFlags; i < numFlags; i++)
-            {
-                FlagInfo &flag = *FlagInfo::get(i);
-                if (flag.flag.type == Flags::Null)
-                {
-                    // flag in now entering game
-                    flag.addFlag();
-                    sendFlagUpdate(flag);
-                    break;
-                }
-            }
-        }
-
         // occasionally add ourselves to the list again (in case we were
         // dropped for some reason).
         if (clOptions->publicizeServer)
@@ -7651,22 +8033,35 @@ int main(int argc, char **argv)
         // check messages
         if (nfound > 0)
         {
-            //logDebugMessage(1,"chkmsg nfound,read,write %i,%08lx,%08lx\n", nfound, read_set, write_set);
+            const std::vector<NetPoller::Event> &events = netPoller->getEvents();
+            const int udpSocket = NetHandler::getUdpSocket();
+            bool wksReady = false;
+            bool udpReady = false;
+            for (size_t k = 0; k < events.size(); k++)
+            {
+                if (events[k].fd == wksSocket)
+                    wksReady = true;
+                else if (events[k].fd == udpSocket)
+                    udpReady = true;
+                else if (events[k].fd == asyncWork.getWakeFD())
+                    asyncWork.clearWakeup();
+            }
+
             // first check initial contacts
-            if (FD_ISSET(wksSocket, &read_set))
+            if (wksReady)
                 acceptClient();
 
             // check if we have any UDP packets pending
-            if (NetHandler::isUdpFdSet(&read_set))
+            if (udpReady)
             {
                 TimeKeeper receiveTime = TimeKeeper::getCurrent();
                 while (true)
                 {
                     struct sockaddr_in uaddr;
-                    unsigned char ubuf[MaxPacketLen];
+                    char     *ubuf;
                     bool     udpLinkRequest;
                     // interface to the UDP Receive routines
-                    int id = NetHandler::udpReceive((char *) ubuf, &uaddr,
+                    int id = NetHandler::udpReceive(ubuf, &uaddr,
                                                     udpLinkRequest);
                     if (id == -1)
                         break;
@@ -7694,6 +8089,9 @@ int main(int argc, char **argv)
                         if (TimeKeeper::getCurrent() - receiveTime > 0.25f)
                         {
                             logDebugMessage(2,"Too much UDP traffic, will hope to catch up later\n");
+                            // whatever was already read is not in the socket anymore
+                            if (NetHandler::hasBufferedUDP())
+                                netPoller->setPending(udpSocket);
                             break;
                         }
                     }
@@ -7701,24 +8099,44 @@ int main(int argc, char **argv)
             }
 
             // process eventual resolver requests
-            NetHandler::checkDNS(&read_set, &write_set);
+            NetHandler::checkDNS(netPoller->getTransientReadSet(),
+                                 netPoller->getTransientWriteSet());
 
-            // now check messages from connected players and send queued messages
-            GameKeeper::Player *playerData;
-            NetHandler* netPlayer(0);
-            for (int j = 0; j < curMaxPlayers; j++)
+            // now check messages from the sockets that are ready and send queued messages
+            for (size_t k = 0; k < events.size(); k++)
             {
-                playerData = GameKeeper::Player::getPlayerByIndex(j);
-                if (!playerData || !playerData->netHandler)
+                const NetPoller::Event &event = events[k];
+                NetHandler *netPlayer = NetHandler::getHandlerByFD(event.fd);
+                if (!netPlayer)
                     continue;
-                netPlayer = playerData->netHandler;
+
+                const int j = netPlayer->getPlayerID();
+                GameKeeper::Player *playerData = GameKeeper::Player::getPlayerByIndex(j);
+                if (!playerData || playerData->netHandler != netPlayer)
+                {
+                    // not a player yet, processConnectedPeer() will deal with it
+                    std::map<int,NetConnectedPeer>::iterator peerItr = netConnectedPeers.find(event.fd);
+                    if (peerItr != netConnectedPeers.end() && event.readable)
+                        peerItr->second.readReady = true;
+                    continue;
+                }
+
                 // send whatever we have ... if any
-                if (netPlayer->pflush(&write_set) == -1)
+                if (event.writable && netPlayer->pflush() == -1)
                 {
                     removePlayer(j, "ECONNRESET/EPIPE", false);
                     continue;
                 }
-                playerData->handleTcpPacket(&read_set);
+                // the queue may have drained enough for more of the world
+                if (event.writable && playerData->worldSent < playerData->worldCredit)
+                    pumpWorld(j);
+                if (!event.readable)
+                    continue;
+
+                // a complete message may not have been the last one, have
+                // another look next time around
+                if (playerData->handleTcpPacket() == ReadAll)
+                    netPoller->setPending(event.fd);
             }
         }
         else if (nfound < 0)
@@ -7736,6 +8154,9 @@ int main(int argc, char **argv)
         }
 
 
+        // hand back whatever the worker threads are done with
+        asyncWork.processCompleted();
+
         // check net connected peers
         // see if we have any thing from people won arn't players yet
         std::map<int,NetConnectedPeer>::iterator peerItr;
@@ -7758,6 +8179,7 @@ int main(int argc, char **argv)
             if (netConnectedPeers.find(toKill[j]) != netConnectedPeers.end())
             {
                 NetConnectedPeer &peer = netConnectedPeers[toKill[j]];
+                fileServer.remove(toKill[j]);
                 if (peer.netHandler)
                     delete(peer.netHandler);
                 peer.netHandler = NULL;
@@ -7767,7 +8189,7 @@ int main(int argc, char **argv)
 
         // process the connections
         for (peerItr = netConnectedPeers.begin(); peerItr != netConnectedPeers.end(); ++peerItr)
-            processConnectedPeer(peerItr->second, peerItr->first, read_set, write_set);
+            processConnectedPeer(peerItr->second, peerItr->first);
 
         // remove anyone that became a player since they will be handled by the rest of the code
         // there net handler was transfered to the player class
@@ -7798,6 +8220,7 @@ int main(int argc, char **argv)
         for (unsigned int j = 0; j < toKill.size(); j++)
         {
             NetConnectedPeer &peer = netConnectedPeers[toKill[j]];
+            fileServer.remove(toKill[j]);
             if (peer.netHandler)
                 delete(peer.netHandler);
             peer.netHandler = NULL;
@@ -7805,9 +8228,6 @@ int main(int argc, char **argv)
         }
 
 
-        // Fire world weapons
-        world->getWorldWeapons().fire();
-
         // update all the shots we have tracked
         ShotManager.Update();
 
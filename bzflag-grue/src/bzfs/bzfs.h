@@ -162,6 +162,8 @@ extern Shots::Manager   ShotManager;
 
 extern VotingArbiter    *votingarbiter;
 
+extern NetPoller    *netPoller;
+
 bool captureFlag(int playerIndex, TeamColor teamCaptured, TeamColor teamCapped = NoTeam, bool checkCheat = true);
 
 void resetTeamScores(void);
@@ -206,6 +208,7 @@ struct NetConnectedPeer
     bool   sent;
     bool   deleteMe;
     bool   deleteWhenDoneSending;
+    bool   readReady;
 };
 
 extern std::map<int, NetConnectedPeer> netConnectedPeers;
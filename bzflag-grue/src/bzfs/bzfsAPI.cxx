@@ -16,6 +16,8 @@
 // implementation wrappers for all the bzf_ API functions
 #include "bzfsAPI.h"
 
+#include <limits>
+
 #include "bzfs.h"
 #include "WorldWeapons.h"
 #include "WorldEventManager.h"
@@ -34,6 +36,8 @@
 #include "md5.h"
 #include "version.h"
 #include "DropGeometry.h"
+#include "Scheduler.h"
+#include "AsyncWork.h"
 
 
 TimeKeeper synct = TimeKeeper::getCurrent();
@@ -1297,6 +1301,42 @@ BZF_API float bz_getPlayerPacketloss( int playerId )
     return (float)GameKeeper::Player::getPlayerByIndex(playerId)->lagInfo.getLoss();
 }
 
+BZF_API int bz_getPlayerSendQueue( int playerId )
+{
+    GameKeeper::Player *player = GameKeeper::Player::getPlayerByIndex(playerId);
+    if (!player || !player->netHandler)
+        return 0;
+
+    return player->netHandler->getQueuedBytes();
+}
+
+BZF_API int bz_getPlayerSendQueuePeak( int playerId )
+{
+    GameKeeper::Player *player = GameKeeper::Player::getPlayerByIndex(playerId);
+    if (!player || !player->netHandler)
+        return 0;
+
+    return player->netHandler->getPeakQueuedBytes();
+}
+
+BZF_API unsigned int bz_getPlayerBytesDropped( int playerId )
+{
+    GameKeeper::Player *player = GameKeeper::Player::getPlayerByIndex(playerId);
+    if (!player || !player->netHandler)
+        return 0;
+
+    return (unsigned int)player->netHandler->getBytesDropped();
+}
+
+BZF_API float bz_getPlayerTimeAboveWatermark( int playerId )
+{
+    GameKeeper::Player *player = GameKeeper::Player::getPlayerByIndex(playerId);
+    if (!player || !player->netHandler)
+        return 0.0f;
+
+    return player->netHandler->getTimeAboveWatermark();
+}
+
 
 BZF_API unsigned int bz_getTeamPlayerLimit (bz_eTeamType _team)
 {
@@ -1941,12 +1981,21 @@ BZF_API void bz_getUTCtime ( bz_Time    *ts )
 }
 
 // info
+// one lookup for the name, the value comes precompiled from the handle
+static float evalBZDB(const char* variable)
+{
+    StateDatabase::Handle handle = BZDB.findHandle(std::string(variable));
+    if (!handle.isValid())
+        return std::numeric_limits<float>::quiet_NaN();
+    return BZDB.eval(handle);
+}
+
 BZF_API double bz_getBZDBDouble ( const char* variable )
 {
     if (!variable)
         return 0.0;
 
-    return BZDB.eval(std::string(variable));
+    return evalBZDB(variable);
 }
 
 BZF_API bz_ApiString bz_getBZDBString( const char* variable )
@@ -1954,7 +2003,10 @@ BZF_API bz_ApiString bz_getBZDBString( const char* variable )
     if (!variable)
         return bz_ApiString("");
 
-    return bz_ApiString(BZDB.get(std::string(variable)));
+    StateDatabase::Handle handle = BZDB.findHandle(std::string(variable));
+    if (!handle.isValid())
+        return bz_ApiString("");
+    return bz_ApiString(BZDB.get(handle));
 }
 
 BZF_API bool bz_getBZDBBool( const char* variable )
@@ -1962,12 +2014,15 @@ BZF_API bool bz_getBZDBBool( const char* variable )
     if (!variable)
         return false;
 
-    return BZDB.eval(std::string(variable)) > 0.0;
+    return evalBZDB(variable) > 0.0;
 }
 
 BZF_API int bz_getBZDBInt( const char* variable )
 {
-    return (int)BZDB.eval(std::string(variable));
+    if (!variable)
+        return 0;
+
+    return (int)evalBZDB(variable);
 }
 
 BZF_API int bz_getBZDBItemPerms( const char* variable )
@@ -2700,6 +2755,102 @@ BZF_API bool bz_removeCustomSlashCommand ( const char* command )
     return true;
 }
 
+static double scheduledCallback(void *data)
+{
+    return ((bz_ScheduledCallback*)data)->Call();
+}
+
+BZF_API int bz_scheduleCallback ( float delay, bz_ScheduledCallback *callback )
+{
+    if (!callback)
+        return 0;
+
+    return (int)scheduler.add(delay < 0.0f ? 0.0f : delay, scheduledCallback, callback);
+}
+
+BZF_API bool bz_cancelScheduledCallback ( int timerID )
+{
+    return scheduler.cancel((unsigned int)timerID);
+}
+
+class MainThreadCallbackTask : public AsyncWork::Task
+{
+public:
+    MainThreadCallbackTask(bz_MainThreadCallback *c, bz_Plugin *plugin) :
+        AsyncWork::Task(plugin), callback(c) {}
+    ~MainThreadCallbackTask()
+    {
+        delete callback;
+    }
+
+    virtual void done()
+    {
+        callback->Run();
+    }
+
+    // the callback wasn't taken, it stays the caller's
+    void release()
+    {
+        callback = NULL;
+    }
+
+private:
+    bz_MainThreadCallback *callback;
+};
+
+class AsyncJobTask : public AsyncWork::Task
+{
+public:
+    AsyncJobTask(bz_AsyncJob *j, bz_Plugin *plugin) : AsyncWork::Task(plugin), job(j) {}
+    ~AsyncJobTask()
+    {
+        delete job;
+    }
+
+    virtual void work()
+    {
+        job->Work();
+    }
+    virtual void done()
+    {
+        job->Done();
+    }
+
+    void release()
+    {
+        job = NULL;
+    }
+
+private:
+    bz_AsyncJob *job;
+};
+
+BZF_API bool bz_postToMainThread ( bz_MainThreadCallback *callback, bz_Plugin *plugin )
+{
+    if (!callback)
+        return false;
+
+    MainThreadCallbackTask *task = new MainThreadCallbackTask(callback, plugin);
+    if (asyncWork.post(task))
+        return true;
+    task->release();
+    delete task;
+    return false;
+}
+
+BZF_API bool bz_runAsync ( bz_AsyncJob *job, bz_Plugin *plugin )
+{
+    if (!job)
+        return false;
+
+    AsyncJobTask *task = new AsyncJobTask(job, plugin);
+    if (asyncWork.run(task))
+        return true;
+    task->release();
+    delete task;
+    return false;
+}
+
 BZF_API bool bz_getStandardSpawn ( int playerID, float pos[3], float *rot )
 {
     GameKeeper::Player *player = GameKeeper::Player::getPlayerByIndex(playerID);
@@ -27,6 +27,7 @@
 #include "bzfsPlugins.h"
 
 #include "WorldEventManager.h"
+#include "AsyncWork.h"
 
 #include "TextUtils.h"
 
@@ -142,6 +143,9 @@ std::vector<trPluginRecord> vPluginList;
 
 void unload1Plugin ( int iPluginID );
 
+// how long unloading waits for a plugin's async jobs
+static const float pluginJobTimeout = 5.0f;
+
 bool PluginExists ( const char* n )
 {
     std::string name = n;
@@ -261,6 +265,10 @@ void unload1Plugin ( int iPluginID )
 
     trPluginRecord &plugin = vPluginList[iPluginID];
 
+    // the plugin's code may still be running on a worker thread, and its
+    // threads may still post; they are turned away until it's gone
+    const bool idle = asyncWork.finish(plugin.plugin, pluginJobTimeout);
+
     bz_PluginLoadUnloadEventData_V1 evt;
     evt.plugin = plugin.plugin;
     evt.eventType = bz_ePluginUnloaded;
@@ -276,7 +284,11 @@ void unload1Plugin ( int iPluginID )
     else
         logDebugMessage(1,"Plugin: bz_FreePlugin method not used by number %d. Leaking memory.\n",iPluginID);
 
-    FreeLibrary(plugin.handle);
+    if (idle)
+        FreeLibrary(plugin.handle);
+    else
+        logDebugMessage(1,"Plugin: %s still has jobs running, leaving it in memory\n",plugin.name.c_str());
+    asyncWork.forget(plugin.plugin);
     plugin.handle = NULL;
     plugin.plugin = NULL;
 }
@@ -370,6 +382,10 @@ void unload1Plugin ( int iPluginID )
     void (*lpProc)(bz_Plugin*);
     trPluginRecord &plugin = vPluginList[iPluginID];
 
+    // the plugin's code may still be running on a worker thread, and its
+    // threads may still post; they are turned away until it's gone
+    const bool idle = asyncWork.finish(plugin.plugin, pluginJobTimeout);
+
     bz_PluginLoadUnloadEventData_V1 evt;
     evt.plugin = plugin.plugin;
     evt.eventType = bz_ePluginUnloaded;
@@ -386,7 +402,11 @@ void unload1Plugin ( int iPluginID )
         logDebugMessage(1,"Plugin: bz_FreePlugin method not used by number %d, error %s. Leaking memory.\n",iPluginID,
                         dlerror());
 
-    dlclose(plugin.handle);
+    if (idle)
+        dlclose(plugin.handle);
+    else
+        logDebugMessage(1,"Plugin: %s still has jobs running, leaving it in memory\n",plugin.name.c_str());
+    asyncWork.forget(plugin.plugin);
     plugin.handle = NULL;
     plugin.plugin = NULL;
 }
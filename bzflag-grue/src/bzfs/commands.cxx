@@ -18,6 +18,7 @@
 
 // system implementation headers
 #include <vector>
+#include <map>
 #include <string>
 #include <sstream>
 #ifdef HAVE_CSTDIO
@@ -207,6 +208,24 @@ public:
                              GameKeeper::Player *playerData);
 };
 
+class NetStatsCommand : ServerCommand
+{
+public:
+    NetStatsCommand();
+
+    virtual bool operator() (const char    *commandLine,
+                             GameKeeper::Player *playerData);
+};
+
+class PluginStatsCommand : ServerCommand
+{
+public:
+    PluginStatsCommand();
+
+    virtual bool operator() (const char    *commandLine,
+                             GameKeeper::Player *playerData);
+};
+
 class IdleStatCommand : ServerCommand
 {
 public:
@@ -531,6 +550,8 @@ static JitterDropCommand  jitterDropCommand;
 static PacketLossWarnCommand  packetLossWarnCommand;
 static PacketLossDropCommand  packetLossDropCommand;
 static LagStatCommand     lagStatCommand;
+static NetStatsCommand    netStatsCommand;
+static PluginStatsCommand pluginStatsCommand;
 static IdleStatCommand    idleStatCommand;
 static IdleTimeCommand    idleTimeCommand;
 static HandicapCommand    handicapCommand;
@@ -606,6 +627,10 @@ PacketLossDropCommand::PacketLossDropCommand()   : ServerCommand("/packetlossdro
             "<count> - display or set the number of packetloss warnings before a player is kicked") {}
 LagStatCommand::LagStatCommand()     : ServerCommand("/lagstats",
             "- list network delays, jitter and number of lost resp. out of order packets by player") {}
+NetStatsCommand::NetStatsCommand()   : ServerCommand("/netstats",
+            "[reset] - show main loop and network statistics, or start counting anew") {}
+PluginStatsCommand::PluginStatsCommand() : ServerCommand("/pluginstats",
+            "[reset] - show the time spent in each plugin by event, or start counting anew") {}
 IdleStatCommand::IdleStatCommand()       : ServerCommand("/idlestats",
             "- display the idle time in seconds for each player") {}
 IdleTimeCommand::IdleTimeCommand()       : ServerCommand("/idletime",
@@ -1427,11 +1452,16 @@ bool FlagCommand::operator() (const char     *message,
         for (int i = 0; i < numFlags; i++)
         {
             FlagInfo &flag = *FlagInfo::get(i);
-            if (flag.flag.type->flagTeam == ::NoTeam)
+            if ((flag.flag.type->flagTeam == ::NoTeam) && flag.exist())
             {
+                float pos[3];
+                memcpy(pos, flag.flag.position, sizeof(pos));
                 if (flag.flag.status == FlagOnTank)
                 {
                     int player = flag.player;
+                    GameKeeper::Player *carrier = GameKeeper::Player::getPlayerByIndex(player);
+                    if (carrier)
+                        memcpy(pos, carrier->lastState.pos, sizeof(pos));
 
                     sendDrop(flag);
 
@@ -1444,7 +1474,8 @@ bool FlagCommand::operator() (const char     *message,
 
                     worldEventManager.callEvents(bz_eFlagDroppedEvent,&data);
                 }
-                flag.flag.status = FlagGoing;
+                // fly away from where it is, landing resets it
+                flag.dropFlag(pos, pos, true);
                 if (!flag.required)
                     flag.flag.type = Flags::Null;
                 sendFlagUpdate(flag);
@@ -1987,6 +2018,143 @@ bool LagStatCommand::operator() (const char  *,
 }
 
 
+bool NetStatsCommand::operator() (const char    *message,
+                                  GameKeeper::Player *playerData)
+{
+    int t = playerData->getIndex();
+    if (!playerData->accessInfo.hasPerm(PlayerAccessInfo::lagStats))
+    {
+        sendMessage(ServerPlayer, t, "You do not have permission to run the netstats command");
+        return true;
+    }
+    if (!netPoller)
+        return true;
+
+    static TimeKeeper statsStart = TimeKeeper::getStartTime();
+    static clock_t    statsCPU = 0;
+
+    std::vector<std::string> args = TextUtils::tokenize(message, " \t");
+    if (args.size() > 1 && TextUtils::compare_nocase(args[1], "reset") == 0)
+    {
+        statsStart = TimeKeeper::getCurrent();
+        statsCPU = clock();
+        netPoller->resetStats();
+        NetHandler::resetReceivedCount();
+        NetHandler::resetUdpStats();
+        for (int i = 0; i < curMaxPlayers; i++)
+        {
+            GameKeeper::Player *p = GameKeeper::Player::getPlayerByIndex(i);
+            if (p && p->netHandler)
+                p->netHandler->resetQueueStats();
+        }
+        sendMessage(ServerPlayer, t, "Network statistics reset");
+        return true;
+    }
+
+    const double elapsed = TimeKeeper::getCurrent() - statsStart;
+    const double cpu = double(clock() - statsCPU) / CLOCKS_PER_SEC;
+    const unsigned long wakeups = netPoller->getWakeups();
+    const unsigned long packets = NetHandler::getReceivedCount();
+
+    sendMessage(ServerPlayer, t,
+                TextUtils::format("Poller: %s, %d sockets registered",
+                                  netPoller->getName(), netPoller->getRegisteredCount()).c_str());
+    sendMessage(ServerPlayer, t,
+                TextUtils::format("Loop: %lu wakeups in %.1fs (%.1f/s), %.2f ready sockets per wakeup",
+                                  wakeups, elapsed, elapsed > 0.0 ? wakeups / elapsed : 0.0,
+                                  wakeups ? double(netPoller->getEventCount()) / wakeups : 0.0).c_str());
+    sendMessage(ServerPlayer, t,
+                TextUtils::format("Packets: %lu received (%.1f/s), %.1fus CPU per packet",
+                                  packets, elapsed > 0.0 ? packets / elapsed : 0.0,
+                                  packets ? cpu * 1.0e6 / packets : 0.0).c_str());
+
+    const NetHandler::UdpStats &udp = NetHandler::getUdpStats();
+    sendMessage(ServerPlayer, t,
+                TextUtils::format("UDP: %lu in with %lu reads (%.2f per datagram), %lu out with %lu writes (%.2f per datagram)",
+                                  udp.datagramsIn, udp.recvCalls,
+                                  udp.datagramsIn ? double(udp.recvCalls) / udp.datagramsIn : 0.0,
+                                  udp.datagramsOut, udp.sendCalls,
+                                  udp.datagramsOut ? double(udp.sendCalls) / udp.datagramsOut : 0.0).c_str());
+
+    // only players whose send queue ever backed up are interesting
+    bool anyQueued = false;
+    for (int i = 0; i < curMaxPlayers; i++)
+    {
+        GameKeeper::Player *p = GameKeeper::Player::getPlayerByIndex(i);
+        if (!p || !p->netHandler)
+            continue;
+        NetHandler *handler = p->netHandler;
+        if (!handler->getPeakQueuedBytes() && !handler->getBytesDropped())
+            continue;
+        if (!anyQueued)
+            sendMessage(ServerPlayer, t, "Send queues:");
+        anyQueued = true;
+        sendMessage(ServerPlayer, t,
+                    TextUtils::format("  %s [%d]: %d bytes (peak %d), %lu dropped, %.1fs above watermark%s",
+                                      p->player.getCallSign(), i,
+                                      handler->getQueuedBytes(), handler->getPeakQueuedBytes(),
+                                      handler->getBytesDropped(), handler->getTimeAboveWatermark(),
+                                      handler->isCongested() ? ", congested" : "").c_str());
+    }
+    if (!anyQueued)
+        sendMessage(ServerPlayer, t, "Send queues: none backed up");
+    return true;
+}
+
+
+bool PluginStatsCommand::operator() (const char   *message,
+                                     GameKeeper::Player *playerData)
+{
+    int t = playerData->getIndex();
+    if (!playerData->accessInfo.hasPerm(PlayerAccessInfo::listPlugins))
+    {
+        sendMessage(ServerPlayer, t, "You do not have permission to run the pluginstats command");
+        return true;
+    }
+
+    static TimeKeeper statsStart = TimeKeeper::getStartTime();
+
+    std::vector<std::string> args = TextUtils::tokenize(message, " \t");
+    if (args.size() > 1 && TextUtils::compare_nocase(args[1], "reset") == 0)
+    {
+        statsStart = TimeKeeper::getCurrent();
+        worldEventManager.resetStats();
+        sendMessage(ServerPlayer, t, "Plugin statistics reset");
+        return true;
+    }
+
+    // most expensive first
+    std::multimap<double, std::string> lines;
+    const tvEventList &handlers = worldEventManager.getHandlers();
+    for (size_t i = 0; i < handlers.size(); i++)
+    {
+        const bz_EventHandler *handler = handlers[i];
+        const char *name = handler->plugin ? handler->plugin->Name() : "(server)";
+        for (int e = 0; e < bz_eLastEvent; e++)
+        {
+            const bz_EventHandler::EventStats &stats = handler->stats[e];
+            if (!stats.calls)
+                continue;
+            lines.insert(std::make_pair(-stats.seconds,
+                                        TextUtils::format("  %s: %s, %lu calls, %.1fms total, %.1fus avg, %.1fus max",
+                                                name, WorldEventManager::getEventName((bz_eEventType)e),
+                                                stats.calls, stats.seconds * 1.0e3,
+                                                stats.seconds * 1.0e6 / stats.calls,
+                                                stats.maxSeconds * 1.0e6)));
+        }
+    }
+
+    sendMessage(ServerPlayer, t,
+                TextUtils::format("Event handlers, last %.1fs:",
+                                  TimeKeeper::getCurrent() - statsStart).c_str());
+    if (lines.empty())
+        sendMessage(ServerPlayer, t, "  no events handled");
+    for (std::multimap<double, std::string>::const_iterator itr = lines.begin(); itr != lines.end(); ++itr)
+        sendMessage(ServerPlayer, t, itr->second.c_str());
+    return true;
+}
+
+
 bool IdleStatCommand::operator() (const char     *,
                                   GameKeeper::Player *playerData)
 {
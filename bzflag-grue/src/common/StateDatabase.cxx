@@ -14,10 +14,10 @@
 #include "StateDatabase.h"
 
 // system headers
+#include <algorithm>
 #include <assert.h>
 #include <ctype.h>
 #include <stack>
-#include <set>
 #include <iostream>
 #include <math.h>
 #include <string>
@@ -218,7 +218,11 @@ StateDatabase::Item::Item() : value(),
     isSet(false),
     isTrue(false),
     save(true), // FIXME -- false by default?
-    permission(ReadWrite)
+    permission(ReadWrite),
+    evalValid(false),
+    evalValue(0.0f),
+    evaluating(false),
+    compiled(false)
 {
     // do nothing
 }
@@ -411,41 +415,57 @@ void *      StateDatabase::getPointer(const std::string& name) const
 
 float           StateDatabase::eval(const std::string& name)
 {
-    typedef std::set<std::string> VariableSet;
     debugLookups(name);
+    Map::iterator index = items.find(name);
+    if (index == items.end())
+    {
+        // ugly hack, since gcc 2.95 doesn't have <limits>
+        float NaN;
+        memset(&NaN, 0xff, sizeof(float));
+        return NaN;
+    }
+    return eval(Handle(&index->second));
+}
 
-    EvalMap::const_iterator cit = evalCache.find(name);
-    if (cit != evalCache.end())
-        return cit->second;
+StateDatabase::Handle StateDatabase::getHandle(const std::string& name)
+{
+    Handle handle = findHandle(name);
+    // a typo should not quietly add a variable
+    assert(handle.isValid());
+    return handle;
+}
 
-    //this is to catch recursive definitions
-    static VariableSet variables;
+StateDatabase::Handle StateDatabase::findHandle(const std::string& name)
+{
+    debugLookups(name);
+    Map::iterator index = items.find(name);
+    if (index == items.end())
+        return Handle();
+    return Handle(&index->second);
+}
+
+float           StateDatabase::evalItem(Item& item)
+{
     // ugly hack, since gcc 2.95 doesn't have <limits>
     float NaN;
     memset(&NaN, 0xff, sizeof(float));
 
-    if (variables.find(name) != variables.end())
+    // catch recursive definitions
+    if (item.evaluating)
         return NaN;
 
-    VariableSet::iterator ins_it = variables.insert(name).first;
-
-    Map::const_iterator index = items.find(name);
-    if (index == items.end() || !index->second.isSet || index->second.value.empty())
+    float retn = NaN;
+    if (item.isSet && !item.value.empty())
     {
-        variables.erase(ins_it);
-        return NaN;
+        if (!item.compiled)
+            compile(item);
+        item.evaluating = true;
+        retn = execute(item.program);
+        item.evaluating = false;
     }
-    Expression pre, inf;
-    std::string value = index->second.value;
-    if (!value.size())
-        return NaN;
-    value >> inf;
-    pre = infixToPrefix(inf);
-    float retn = evaluate(pre);
-    variables.erase(ins_it);
 
-    if (retn != NaN)
-        evalCache[name] = retn;
+    item.evalValue = retn;
+    item.evalValid = true;
     return retn;
 }
 
@@ -523,18 +543,28 @@ StateDatabase::lookup(const std::string& name)
     if (index == items.end())
     {
         Item tmp;
-        return items.insert(std::make_pair(name, tmp)).first;
+        index = items.insert(std::make_pair(name, tmp)).first;
+
+        // expressions that read this name before it existed read it now
+        std::vector<Item*> readers;
+        readers.swap(unresolvedReaders);
+        for (size_t i = 0; i < readers.size(); i++)
+        {
+            uncompile(*readers[i]);
+            invalidate(*readers[i]);
+        }
     }
-    else
-        return index;
+    return index;
 }
 
 void            StateDatabase::notify(Map::iterator index)
 {
     const std::string& name = index->first;
-    const Item& item = index->second;
+    Item& item = index->second;
 
-    evalCache.erase(index->first);
+    // the value may have changed, compile it again when it's needed
+    uncompile(item);
+    invalidate(item);
 
     void* namePtr = const_cast<void*>(static_cast<const void*>(&name));
     globalCallbacks.iterate(&onCallback, namePtr);
@@ -975,31 +1005,119 @@ StateDatabase::Expression StateDatabase::infixToPrefix(const Expression &infix)
     return prefix;
 }
 
-float StateDatabase::evaluate(Expression e) const
+void StateDatabase::compile(Item& item)
 {
-    std::stack<ExpressionToken> evaluationStack;
-    ExpressionToken tok, lvalue, rvalue;
-    bool unary;
+    Expression pre, inf;
+    std::string value = item.value;
+    value >> inf;
+    pre = infixToPrefix(inf);
 
-    for (Expression::reverse_iterator i = e.rbegin(); i != e.rend(); ++i)
+    // the program runs the prefix expression backwards, store it that way
+    bool unresolved = false;
+    item.program.clear();
+    item.program.reserve(pre.size());
+    for (Expression::reverse_iterator i = pre.rbegin(); i != pre.rend(); ++i)
     {
-        unary = false;
+        Instruction inst;
+        inst.oper     = ExpressionToken::none;
+        inst.number   = 0.0;
+        inst.variable = NULL;
         switch (i->getTokenType())
         {
         case ExpressionToken::Number:
-            evaluationStack.push(*i);
+            inst.code   = Instruction::Number;
+            inst.number = i->getNumber();
             break;
         case ExpressionToken::Variable:
+        {
             // strip off '$'?
-            tok.setNumber(BZDB.eval(i->getVariable()));
-            evaluationStack.push(tok);
+            inst.code = Instruction::Variable;
+            Map::iterator index = items.find(i->getVariable());
+            if (index == items.end())
+            {
+                unresolved = true;
+                break;
+            }
+            Item *var = &index->second;
+            inst.variable = var;
+            if (std::find(item.readsFrom.begin(), item.readsFrom.end(), var) == item.readsFrom.end())
+            {
+                item.readsFrom.push_back(var);
+                var->readBy.push_back(&item);
+            }
             break;
+        }
         case ExpressionToken::Oper:
             if ((i->getOperator() == ExpressionToken::lparen) ||
                     (i->getOperator() == ExpressionToken::rparen))
             {
-                break;  // should not have any parens here, skip them
+                continue;  // should not have any parens here, skip them
+            }
+            inst.code = Instruction::Oper;
+            inst.oper = i->getOperator();
+            break;
+        }
+        item.program.push_back(inst);
+    }
+    if (unresolved)
+        unresolvedReaders.push_back(&item);
+    item.compiled = true;
+}
+
+void StateDatabase::uncompile(Item& item)
+{
+    for (size_t i = 0; i < item.readsFrom.size(); i++)
+    {
+        std::vector<Item*>& readBy = item.readsFrom[i]->readBy;
+        readBy.erase(std::find(readBy.begin(), readBy.end(), &item));
+    }
+    item.readsFrom.clear();
+    std::vector<Item*>::iterator unresolved =
+        std::find(unresolvedReaders.begin(), unresolvedReaders.end(), &item);
+    if (unresolved != unresolvedReaders.end())
+        unresolvedReaders.erase(unresolved);
+    item.program.clear();
+    item.compiled = false;
+}
+
+void StateDatabase::invalidate(Item& item)
+{
+    item.evalValid = false;
+    for (size_t i = 0; i < item.readBy.size(); i++)
+    {
+        // an invalid entry has no valid readers, this also stops cycles
+        if (item.readBy[i]->evalValid)
+            invalidate(*item.readBy[i]);
+    }
+}
+
+float StateDatabase::execute(const Program& program)
+{
+    std::vector<double> evaluationStack;
+    evaluationStack.reserve(program.size());
+    double lvalue = 0.0, rvalue;
+    bool unary;
+
+    for (Program::const_iterator i = program.begin(); i != program.end(); ++i)
+    {
+        unary = false;
+        switch (i->code)
+        {
+        case Instruction::Number:
+            evaluationStack.push_back(i->number);
+            break;
+        case Instruction::Variable:
+            if (i->variable)
+                evaluationStack.push_back(eval(Handle(i->variable)));
+            else
+            {
+                // ugly hack, since gcc 2.95 doesn't have <limits>
+                float NaN;
+                memset(&NaN, 0xff, sizeof(NaN));
+                evaluationStack.push_back(NaN);
             }
+            break;
+        case Instruction::Oper:
             if (evaluationStack.empty())
             {
                 // syntax error
@@ -1009,41 +1127,36 @@ float StateDatabase::evaluate(Expression e) const
                 return NaN;
             }
             // rvalue and lvalue are switched, since we're reversed
-            rvalue = evaluationStack.top();
-            evaluationStack.pop();
+            rvalue = evaluationStack.back();
+            evaluationStack.pop_back();
             if (evaluationStack.empty())
             {
                 unary = true; // syntax error or unary operator
             }
             if (!unary)
             {
-                lvalue = evaluationStack.top();
-                evaluationStack.pop();
+                lvalue = evaluationStack.back();
+                evaluationStack.pop_back();
             }
-            switch (i->getOperator())
+            switch (i->oper)
             {
             case ExpressionToken::add:
-                tok.setNumber(lvalue.getNumber() + rvalue.getNumber());
-                evaluationStack.push(tok);
+                evaluationStack.push_back(lvalue + rvalue);
                 break;
             case ExpressionToken::subtract:
                 if (unary)
-                    tok.setNumber(-rvalue.getNumber());
+                    evaluationStack.push_back(-rvalue);
                 else
-                    tok.setNumber(lvalue.getNumber() - rvalue.getNumber());
-                evaluationStack.push(tok);
+                    evaluationStack.push_back(lvalue - rvalue);
                 break;
             case ExpressionToken::multiply:
-                tok.setNumber(lvalue.getNumber() * rvalue.getNumber());
-                evaluationStack.push(tok);
+                evaluationStack.push_back(lvalue * rvalue);
                 break;
             case ExpressionToken::divide:
-                tok.setNumber(lvalue.getNumber() / rvalue.getNumber());
-                evaluationStack.push(tok);
+                evaluationStack.push_back(lvalue / rvalue);
                 break;
             case ExpressionToken::power:
-                tok.setNumber(pow(lvalue.getNumber(), rvalue.getNumber()));
-                evaluationStack.push(tok);
+                evaluationStack.push_back(pow(lvalue, rvalue));
                 break;
             default:
                 // lparen and rparen should have been stripped out
@@ -1056,10 +1169,9 @@ float StateDatabase::evaluate(Expression e) const
     if (evaluationStack.empty())
         return 0; // yeah we are screwed. TODO, don't let us get this far
 
-    return (float)evaluationStack.top().getNumber();
+    return (float)evaluationStack.back();
 }
 
-
 // Local Variables: ***
 // mode: C++ ***
 // tab-width: 4 ***
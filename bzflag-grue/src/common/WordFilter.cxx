@@ -73,15 +73,8 @@ bool WordFilter::simpleFilter(char *input) const
 
 bool WordFilter::aggressiveFilter(char *input) const
 {
-#if  !defined(HAVE_REGEX_H)
-
-    std::cerr << "Regular expressions are not available (using the simple filter)" << std::endl;
-    return simpleFilter(input);
-
-#else /* HAVE_REGEX_H */
-
     bool filtered = false;
-    regmatch_t match[1];
+    int matchStart, matchEnd;
     if (input == NULL) return false;
     int inputLength = strlen(input);
 
@@ -137,16 +130,16 @@ bool WordFilter::aggressiveFilter(char *input) const
      */
     for (ExpCompareSet::const_iterator i = prefixes.begin(); i != prefixes.end(); ++i)
     {
-        if (regexec(i->compiled, sInput.c_str(), 1, match, 0) == 0)
+        if (findMatch(i->word, sInput, matchStart, matchEnd))
         {
-            if ( (match[0].rm_eo < inputLength) && isalpha(sInput[match[0].rm_eo]) )
+            if ( (matchEnd < inputLength) && isalpha(sInput[matchEnd]) )
             {
                 /* do not forget to make sure this is a true prefix */
-                if ( (match[0].rm_so > 0) && isalpha(sInput[match[0].rm_so - 1]) )
+                if ( (matchStart > 0) && isalpha(sInput[matchStart - 1]) )
                     continue;
 
                 /* we found a prefix -- add the letter that follows */
-                appendUniqueChar(wordIndices, tolower(sInput[match[0].rm_eo]));
+                appendUniqueChar(wordIndices, tolower(sInput[matchEnd]));
             }
         }
     }
@@ -156,8 +149,15 @@ bool WordFilter::aggressiveFilter(char *input) const
     // now we have a record of all potential word boundary positions
 
 
+    /* find all of the words that match somewhere in one go.  only those
+     * need to be looked for one at a time below.  filling in a match with
+     * 'W's can make a word with a 'w' match where it did not before.
+     */
+    std::vector<bool> found(matchWords, false);
+    findWords(sInput, found);
+    bool filled = false;
+
     /* iterate over the filter words for each unique initial word character */
-    int regCode;
     for (unsigned int j = 0; j < wordIndices.size(); j++)
     {
 
@@ -167,6 +167,9 @@ bool WordFilter::aggressiveFilter(char *input) const
         for (ExpCompareSet::const_iterator i = filters[firstchar].begin();
                 i != filters[firstchar].end(); ++i)
         {
+            if (!found[i->index] &&
+                    !(filled && (i->word.find_first_of("wW") != std::string::npos)))
+                continue;
 
             /* the big kahuna burger processing goes on here */
             bool matched = true;
@@ -174,14 +177,12 @@ bool WordFilter::aggressiveFilter(char *input) const
             {
                 matched = false;
 
-                regCode = regexec(i->compiled, sInput.c_str(), 1, match, 0);
-
 //std::cout << "input is [" << sInput << "]" << std::endl;
 
-                if ( regCode == 0 )
+                if (findMatch(i->word, sInput, matchStart, matchEnd))
                 {
-                    int startOffset = match[0].rm_so;
-                    int endOffset = match[0].rm_eo;
+                    int startOffset = matchStart;
+                    int endOffset = matchEnd;
 
 //std::cout << "We matched ... ";
 
@@ -196,22 +197,22 @@ bool WordFilter::aggressiveFilter(char *input) const
                         for (ExpCompareSet::const_iterator k = prefixes.begin();
                                 k != prefixes.end(); ++k)
                         {
-                            if (regexec(k->compiled, sInput.c_str(), 1, match, 0) == 0)
+                            if (findMatch(k->word, sInput, matchStart, matchEnd))
                             {
 
 //std::cout << "checking prefix: " << k->word << std::endl;
 
-                                if ( (match[0].rm_so > 1) && (isalpha(sInput[match[0].rm_so - 1])) )
+                                if ( (matchStart > 1) && (isalpha(sInput[matchStart - 1])) )
                                 {
                                     /* we matched, but we are still in the middle of a word */
                                     continue;
                                 }
 
 //std::cout << "matched a prefix! " << k->word << std::endl;
-                                if (match[0].rm_eo == startOffset)
+                                if (matchEnd == startOffset)
                                 {
                                     /* perfect prefix match */
-                                    startOffset = match[0].rm_so;
+                                    startOffset = matchStart;
                                     foundit = true;
                                     break;
                                 }
@@ -239,28 +240,27 @@ bool WordFilter::aggressiveFilter(char *input) const
                         {
 //std::cout << "checking " << k->word << " against [" << input + endOffset << "]" << std::endl;
 
-                            if (regexec(k->compiled, sInput.c_str() + endOffset, 1, match, 0) == 0)
+                            /* only a suffix right at the end of the match will do */
+                            matchEnd = findMatchEnd(k->word, sInput, endOffset);
+                            if (matchEnd >= 0)
                             {
 
-//std::cout << "is " << match[0].rm_eo << " less than " << inputLength - endOffset << std::endl;
-//std::cout << "is alpha =?= " << input[endOffset + match[0].rm_eo + 1] << std::endl;
+//std::cout << "is " << matchEnd << " less than " << inputLength << std::endl;
+//std::cout << "is alpha =?= " << input[matchEnd] << std::endl;
 
                                 /* again, make sure we are now at a word end */
-                                if ( (match[0].rm_eo < inputLength - endOffset) &&
-                                        (isalpha(sInput[endOffset + match[0].rm_eo])) )
+                                if ( (matchEnd < inputLength) &&
+                                        (isalpha(sInput[matchEnd])) )
                                 {
                                     /* we matched, but we are still in the middle of a word */
                                     continue;
                                 }
 
 //std::cout << "matched a suffix! " << k->word << std::endl;
-                                if (match[0].rm_so == 0)
-                                {
-                                    /* push the end forward a little since we matched */
-                                    endOffset += match[0].rm_eo;
-                                    foundit = true;
-                                    break;
-                                }
+                                /* push the end forward a little since we matched */
+                                endOffset = matchEnd;
+                                foundit = true;
+                                break;
                             }
                         }
                         if (!foundit)
@@ -297,6 +297,7 @@ bool WordFilter::aggressiveFilter(char *input) const
                     matchPair[(matchCount * 2) + 1] = matchLength; /* length */
                     matchCount++;
                     filtered = true;
+                    filled = true;
                     matched = true;
                     // zappo! .. erase stuff that has been filtered to speed up future checks
                     // fill with some non-whitespace alpha that is not the start/end of a suffix to prevent rematch
@@ -304,22 +305,9 @@ bool WordFilter::aggressiveFilter(char *input) const
                     filler.assign(matchLength, 'W');
                     sInput.replace(startOffset, matchLength, filler);
 
-                }
-                else if ( regCode == REG_NOMATCH )
-                {
-                    // do nothing
-                    continue;
+                } /* end if match */
 
-                }
-                else
-                {
-                    char errorBuffer[256];
-                    regerror(regCode, i->compiled, errorBuffer, 256);
-                    std::cout << errorBuffer << std::endl;
-
-                } /* end if regcode */
-
-            } /* end regexec-ing */
+            } /* end matching */
 
         } /* iterate over words in a particular character bin */
 
@@ -346,41 +334,223 @@ bool WordFilter::aggressiveFilter(char *input) const
 
     return filtered;
 
-#endif /* HAVE_REGEX_H */
 } // end aggressiveFilter
 
 
-// provides a pointer to a fresh compiled expression for some given expression
-#if !defined(HAVE_REGEX_H)
-regex_t *WordFilter::getCompiledExpression(const std::string &) const
+/* the letters of the filter words are always matched in lowercase */
+static inline char symbolFromCharacter(const char c)
 {
-    return (regex_t *)NULL;
+    return (char)tolower((unsigned char)c);
 }
-#else /* HAVE_REGEX_H */
-regex_t *WordFilter::getCompiledExpression(const std::string &word) const
+
+/* the node after a letter in a list of following letters, or 0 */
+static inline int nextMatchNode(const std::vector<std::pair<char, int> > &next,
+                                const char symbol)
+{
+    int low = 0;
+    int high = (int)next.size();
+    while (low < high)
+    {
+        const int middle = (low + high) / 2;
+        if ((unsigned char)next[middle].first < (unsigned char)symbol)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    if ((low < (int)next.size()) && (next[low].first == symbol))
+        return next[low].second;
+    return 0;
+}
+
+/* active states are few, so a list is quicker than a set */
+static inline void addMatchState(std::vector<int> &states, const int state)
+{
+    if (std::find(states.begin(), states.end(), state) == states.end())
+        states.push_back(state);
+}
+
+
+void WordFilter::makeSymbolTable(void)
 {
-    regex_t *compiledReg;
+    symbolsFor.assign(256, std::string());
+    symbolMatches.assign(256 * 256, false);
 
-    /* XXX need to convert this to use new/delete */
-    if ( (compiledReg = (regex_t *)calloc(1, sizeof(regex_t))) == NULL )
+    for (int i = 1; i < 256; i++)
     {
+        const char symbol = (char)i;
+        if (symbolFromCharacter(symbol) != symbol)
+            continue;
+
+        /* the expressions were case-insensitive */
+        const std::string set = symbolSetFromCharacter(symbol);
+        std::string matches;
+        for (unsigned int j = 0; j < set.size(); j++)
+        {
+            appendUniqueChar(matches, set[j]);
+            if (isalpha((unsigned char)set[j]))
+            {
+                appendUniqueChar(matches, tolower((unsigned char)set[j]));
+                appendUniqueChar(matches, toupper((unsigned char)set[j]));
+            }
+        }
+        for (unsigned int j = 0; j < matches.size(); j++)
+        {
+            symbolMatches[(i << 8) | (unsigned char)matches[j]] = true;
+            symbolsFor[(unsigned char)matches[j]] += symbol;
+        }
+    }
+}
+
+
+void WordFilter::addToMatchTree(const std::string &word, int index)
+{
+    int node = 0;
+    for (unsigned int i = 0; i < word.size(); i++)
+    {
+        const char symbol = symbolFromCharacter(word[i]);
+        int child = nextMatchNode(matchTree[node].next, symbol);
+        if (child == 0)
+        {
+            child = (int)matchTree.size();
+            MatchNode letter;
+            letter.symbol = symbol;
+            letter.word = -1;
+            matchTree.push_back(letter);
+
+            std::vector<std::pair<char, int> > &next = matchTree[node].next;
+            std::vector<std::pair<char, int> >::iterator at = next.begin();
+            while ((at != next.end()) &&
+                    ((unsigned char)at->first < (unsigned char)symbol))
+                ++at;
+            next.insert(at, std::make_pair(symbol, child));
+        }
+        node = child;
+    }
+    matchTree[node].word = index;
+}
+
+
+/* this walks the tree of filter words over the input once, the way
+ * the expressions from expressionFromString() would match.  each state
+ * is a node of the tree and how far into the run of that letter the
+ * input is (see stayStates()), packed as node * 4 + state.  a character
+ * may stand for several letters, and may be punctuation at the same time,
+ * so there is a list of states rather than one.
+ */
+void WordFilter::findWords(const std::string &input, std::vector<bool> &found) const
+{
+    std::vector<int> states, nextStates;
+
+    for (unsigned int i = 0; i < input.size(); i++)
+    {
+        const char c = input[i];
+        const std::string &symbols = symbolsFor[(unsigned char)c];
+        nextStates.clear();
+
+        for (unsigned int j = 0; j < states.size(); j++)
+        {
+            const MatchNode &node = matchTree[states[j] >> 2];
+            unsigned int stay = stayStates(node.symbol, states[j] & 3, c);
+            if (node.next.empty())
+                stay &= (1 << 0) | (1 << 2); // no letters to go on to
+            for (int k = 0; k < 4; k++)
+            {
+                if (stay & (1 << k))
+                    addMatchState(nextStates, (states[j] & ~3) | k);
+            }
+            if (node.next.empty())
+                continue;
+            for (unsigned int k = 0; k < symbols.size(); k++)
+            {
+                const int child = nextMatchNode(node.next, symbols[k]);
+                if (child != 0)
+                    addMatchState(nextStates, child << 2);
+            }
+        }
 
-        perror("calloc failed");
-        std::cerr << "Warning: unable to allocate memory for compiled regular expression";
-        return (regex_t *)NULL;
+        // any character may start a word
+        for (unsigned int k = 0; k < symbols.size(); k++)
+        {
+            const int child = nextMatchNode(matchTree[0].next, symbols[k]);
+            if (child != 0)
+                addMatchState(nextStates, child << 2);
+        }
 
+        for (unsigned int j = 0; j < nextStates.size(); j++)
+        {
+            const MatchNode &node = matchTree[nextStates[j] >> 2];
+            const int state = nextStates[j] & 3;
+            if ((node.word >= 0) &&
+                    ((state == 0) || ((state == 2) && (node.symbol == 'f'))))
+                found[node.word] = true;
+        }
+        states.swap(nextStates);
     }
+}
+
 
-    if ( regcomp(compiledReg, word.c_str(), REG_EXTENDED | REG_ICASE) != 0 )
+int WordFilter::findMatchEnd(const std::string &word, const std::string &input, int start) const
+{
+    const int length = (int)word.size();
+    const int inputLength = (int)input.size();
+    if ((length == 0) || (start >= inputLength) ||
+            !symbolMatch(symbolFromCharacter(word[0]), input[start]))
+        return -1;
+
+    /* as in findWords(), with the position in the word for the node */
+    std::vector<int> states(1, 0), nextStates;
+    int end = -1;
+    for (int i = start; ; )
     {
-        std::cerr << "Warning: unable to compile regular expression for [" << word << "]" << std::endl;
-        free(compiledReg);
-        return (regex_t *)NULL;
+        for (unsigned int j = 0; j < states.size(); j++)
+        {
+            const int state = states[j] & 3;
+            if (((states[j] >> 2) == length - 1) &&
+                    ((state == 0) ||
+                     ((state == 2) && (symbolFromCharacter(word[length - 1]) == 'f'))))
+                end = i + 1;
+        }
+
+        if (++i >= inputLength)
+            break;
+        const char c = input[i];
+        nextStates.clear();
+        for (unsigned int j = 0; j < states.size(); j++)
+        {
+            const int letter = states[j] >> 2;
+            unsigned int stay = stayStates(symbolFromCharacter(word[letter]), states[j] & 3, c);
+            if (letter == length - 1)
+                stay &= (1 << 0) | (1 << 2);
+            for (int k = 0; k < 4; k++)
+            {
+                if (stay & (1 << k))
+                    addMatchState(nextStates, (states[j] & ~3) | k);
+            }
+            if ((letter + 1 < length) &&
+                    symbolMatch(symbolFromCharacter(word[letter + 1]), c))
+                addMatchState(nextStates, (letter + 1) << 2);
+        }
+        if (nextStates.empty())
+            break;
+        states.swap(nextStates);
     }
-    return compiledReg;
+    return end;
+}
+
 
+bool WordFilter::findMatch(const std::string &word, const std::string &input, int &start, int &end) const
+{
+    for (int i = 0; i < (int)input.size(); i++)
+    {
+        end = findMatchEnd(word, input, i);
+        if (end >= 0)
+        {
+            start = i;
+            return true;
+        }
+    }
+    return false;
 }
-#endif /* HAVE_REGEX_H */
 
 
 std::string WordFilter::l33tspeakSetFromCharacter(const char c) const
@@ -454,6 +624,15 @@ std::string WordFilter::l33tspeakSetFromCharacter(const char c) const
 }
 
 
+std::string WordFilter::symbolSetFromCharacter(const char c) const
+{
+    /* 'f' also stands for the 'p' of "ph" */
+    if (c == 'f')
+        return "fp";
+    return l33tspeakSetFromCharacter(c);
+}
+
+
 std::string WordFilter::alphabeticSetFromCharacter(const char c) const
 {
     std::string set = " ";
@@ -591,6 +770,14 @@ WordFilter::WordFilter()
     /* filter characters randomly used to replace filtered text */
     filterChars = "!@#$%^&*";
 
+    /* the root of the match tree */
+    MatchNode root;
+    root.symbol = 0;
+    root.word = -1;
+    matchTree.push_back(root);
+    matchWords = 0;
+    makeSymbolTable();
+
     /* SUFFIXES */
 
 #if 1
@@ -675,7 +862,11 @@ WordFilter::WordFilter(const WordFilter& _filter)
     : alphabet(_filter.alphabet),
       filterChars(_filter.filterChars),
       suffixes(_filter.suffixes),
-      prefixes(_filter.prefixes)
+      prefixes(_filter.prefixes),
+      matchTree(_filter.matchTree),
+      matchWords(_filter.matchWords),
+      symbolsFor(_filter.symbolsFor),
+      symbolMatches(_filter.symbolMatches)
 {
     for (int i=0; i < MAX_FILTER_SETS; i++)
         filters[i] = _filter.filters[i];
@@ -683,48 +874,8 @@ WordFilter::WordFilter(const WordFilter& _filter)
 
 
 
-/** destructor releases the compiled bad words */
 WordFilter::~WordFilter(void)
 {
-    ExpCompareSet::iterator i;
-
-    // delete compiled words
-    for (int j = 0; j < MAX_FILTER_SETS; j++)
-    {
-        for (i = filters[j].begin();
-                i != filters[j].end();
-                ++i)
-        {
-            if (i->compiled)
-            {
-                regfree(i->compiled);
-                free(i->compiled);
-            }
-        }
-    }
-    // delete compiled prefixes
-    for (i = prefixes.begin();
-            i != prefixes.end();
-            ++i)
-    {
-        if (i->compiled)
-        {
-            regfree(i->compiled);
-            free(i->compiled);
-        }
-    }
-    // delete compiled suffixes
-    for (i = suffixes.begin();
-            i != suffixes.end();
-            ++i)
-    {
-        if (i->compiled)
-        {
-            regfree(i->compiled);
-            free(i->compiled);
-        }
-    }
-
     return;
 }
 
@@ -748,23 +899,24 @@ bool WordFilter::addToFilter(const std::string &word, const std::string &express
     }
     else
     {
-        /* base case */
+        /* base case.  the expression only says what the word matches,
+         * which is what the match tree does.
+         */
         filter_t newFilter;
 
         newFilter.word = word;
-        newFilter.compiled = getCompiledExpression(expression);
+        newFilter.index = matchWords;
 
         unsigned int firstchar = (unsigned char)tolower(word[0]);
         /* check if the word is already added */
         if (filters[firstchar].find(newFilter) != \
                 filters[firstchar].end())
-        {
-            regfree(newFilter.compiled);
-            free(newFilter.compiled);
             return false;
-        }
         else
+        {
             filters[firstchar].insert(newFilter);
+            addToMatchTree(word, matchWords++);
+        }
         return true;
     }
 } // end addToFilter
@@ -939,6 +1091,10 @@ void WordFilter::clear(void)
 
     suffixes.clear();
     prefixes.clear();
+
+    matchTree.resize(1);
+    matchTree[0].next.clear();
+    matchWords = 0;
 }
 
 // Local Variables: ***
@@ -77,14 +77,20 @@ static char *timestamp(char *buf, bool micros, bool utc)
 
 void logDebugMessage(int level, const char* fmt, ...)
 {
-    char buffer[8192] = { 0 };
+    // some messages are logged once per packet, don't format those for nobody
+    const bool show = (debugLevel >= level || level == 0);
+    if (!show && !(loggingCallback && loggingCallback->wants(level)))
+        return;
+
+    char buffer[8192];
     char tsbuf[tsBufferSize] = { 0 };
     va_list args;
+    buffer[0] = '\0';
     va_start(args, fmt);
     vsnprintf(buffer, sizeof(buffer), fmt, args);
     va_end(args);
 
-    if (debugLevel >= level || level == 0)
+    if (show)
     {
 #if defined(_MSC_VER)
         if (doTimestamp)
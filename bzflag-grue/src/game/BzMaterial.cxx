@@ -28,6 +28,8 @@ BzMaterialManager MATERIALMGR;
 
 BzMaterialManager::BzMaterialManager()
 {
+    addCount = 0;
+    foldedSize = 0;
     return;
 }
 
@@ -44,26 +46,61 @@ void BzMaterialManager::clear()
     for (unsigned int i = 0; i < materials.size(); i++)
         delete materials[i];
     materials.clear();
+    contentIndex.clear();
+    nameIndex.clear();
+    materialIndex.clear();
+    addCount = 0;
+    foldedSize = 0;
+    return;
+}
+
+
+void BzMaterialManager::addName(const std::string& name, int index)
+{
+    if (name.size() <= 0)
+        return;
+    // findMaterial() goes by the first material with the name
+    std::map<std::string, int>::iterator it = nameIndex.find(name);
+    if (it == nameIndex.end())
+        nameIndex[name] = index;
+    else if (index < it->second)
+        it->second = index;
     return;
 }
 
 
 const BzMaterial* BzMaterialManager::addMaterial(const BzMaterial* material)
 {
-    for (unsigned int i = 0; i < materials.size(); i++)
+    addCount++;
+
+    // fold it into the first material with the same content
+    const unsigned int hash = material->contentHash();
+    typedef std::multimap<unsigned int, int>::const_iterator ContentIt;
+    std::pair<ContentIt, ContentIt> range = contentIndex.equal_range(hash);
+    for (ContentIt it = range.first; it != range.second; ++it)
     {
-        if (*material == *(materials[i]))
+        BzMaterial* match = materials[it->second];
+        if (*material == *match)
         {
             const std::string& name = material->getName();
             if (name.size() > 0)
-                materials[i]->addAlias(name);
-            return materials[i];
+            {
+                match->addAlias(name);
+                addName(name, it->second);
+            }
+            foldedSize += material->packSize();
+            return match;
         }
     }
+
     BzMaterial* newMat = new BzMaterial(*material);
     if (findMaterial(newMat->getName()) != NULL)
         newMat->setName("");
+    const int index = (int)materials.size();
     materials.push_back(newMat);
+    contentIndex.insert(std::make_pair(hash, index));
+    addName(newMat->getName(), index);
+    materialIndex[newMat] = index;
     return newMat;
 }
 
@@ -82,21 +119,11 @@ const BzMaterial* BzMaterialManager::findMaterial(const std::string& target) con
     }
     else
     {
-        for (unsigned int i = 0; i < materials.size(); i++)
-        {
-            const BzMaterial* mat = materials[i];
-            // check the base name
-            if (target == mat->getName())
-                return mat;
-            // check the aliases
-            const std::vector<std::string>& aliases = mat->getAliases();
-            for (unsigned int j = 0; j < aliases.size(); j++)
-            {
-                if (target == aliases[j])
-                    return mat;
-            }
-        }
-        return NULL;
+        // the base names and the aliases
+        std::map<std::string, int>::const_iterator it = nameIndex.find(target);
+        if (it == nameIndex.end())
+            return NULL;
+        return materials[it->second];
     }
 }
 
@@ -111,12 +138,11 @@ const BzMaterial* BzMaterialManager::getMaterial(int id) const
 
 int BzMaterialManager::getIndex(const BzMaterial* material) const
 {
-    for (unsigned int i = 0; i < materials.size(); i++)
-    {
-        if (material == materials[i])
-            return i;
-    }
-    return -1;
+    std::map<const BzMaterial*, int>::const_iterator it =
+        materialIndex.find(material);
+    if (it == materialIndex.end())
+        return -1;
+    return it->second;
 }
 
 
@@ -139,7 +165,11 @@ const void* BzMaterialManager::unpack(const void* buf)
     {
         BzMaterial* mat = new BzMaterial;
         buf = mat->unpack(buf);
+        const int index = (int)materials.size();
         materials.push_back(mat);
+        contentIndex.insert(std::make_pair(mat->contentHash(), index));
+        addName(mat->getName(), index);
+        materialIndex[mat] = index;
     }
     return buf;
 }
@@ -386,6 +416,84 @@ bool BzMaterial::operator==(const BzMaterial& m) const
 }
 
 
+// FNV-1a
+static unsigned int hashBytes(unsigned int hash, const void* data, size_t size)
+{
+    const unsigned char* bytes = (const unsigned char*)data;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static unsigned int hashInt(unsigned int hash, int value)
+{
+    return hashBytes(hash, &value, sizeof(int));
+}
+
+static unsigned int hashFloat(unsigned int hash, float value)
+{
+    // compared with !=, so -0 has to go with 0
+    if (value == 0.0f)
+        value = 0.0f;
+    return hashBytes(hash, &value, sizeof(float));
+}
+
+static unsigned int hashString(unsigned int hash, const std::string& value)
+{
+    hash = hashBytes(hash, value.data(), value.size());
+    return hashInt(hash, (int)value.size());
+}
+
+
+unsigned int BzMaterial::contentHash() const
+{
+    int i;
+    unsigned int hash = 2166136261u;
+
+    // the colors are compared with memcmp()
+    hash = hashInt(hash, dynamicColor);
+    hash = hashBytes(hash, ambient, sizeof(float[4]));
+    hash = hashBytes(hash, diffuse, sizeof(float[4]));
+    hash = hashBytes(hash, specular, sizeof(float[4]));
+    hash = hashBytes(hash, emission, sizeof(float[4]));
+    hash = hashFloat(hash, shininess);
+    hash = hashFloat(hash, alphaThreshold);
+
+    int modes = 0;
+    if (occluder)   modes |= (1 << 0);
+    if (groupAlpha) modes |= (1 << 1);
+    if (noRadar)    modes |= (1 << 2);
+    if (noShadow)   modes |= (1 << 3);
+    if (noCulling)  modes |= (1 << 4);
+    if (noSorting)  modes |= (1 << 5);
+    if (noLighting) modes |= (1 << 6);
+    hash = hashInt(hash, modes);
+
+    hash = hashInt(hash, textureCount);
+    for (i = 0; i < textureCount; i++)
+    {
+        const TextureInfo& tex = textures[i];
+        hash = hashString(hash, tex.name);
+        hash = hashInt(hash, tex.matrix);
+        hash = hashInt(hash, tex.combineMode);
+        int state = 0;
+        if (tex.useAlpha)     state |= (1 << 0);
+        if (tex.useColor)     state |= (1 << 1);
+        if (tex.useSphereMap) state |= (1 << 2);
+        hash = hashInt(hash, state);
+    }
+
+    hash = hashInt(hash, shaderCount);
+    for (i = 0; i < shaderCount; i++)
+        hash = hashString(hash, shaders[i].name);
+
+    return hash;
+}
+
+
 static void* pack4Float(void *buf, const float values[4])
 {
     int i;
@@ -15,6 +15,7 @@
 
 /* system implementation headers */
 #include <vector>
+#include <algorithm>
 #include <math.h>
 #include <stdlib.h>
 
@@ -26,12 +27,66 @@
 #include "ObstacleMgr.h"
 #include "Obstacle.h"
 #include "MeshObstacle.h"
+#include "MeshFaceBatch.h"
 #include "BoxBuilding.h"
 #include "PyramidBuilding.h"
 #include "BaseBuilding.h"
 #include "Teleporter.h"
 #include "TimeKeeper.h"
 
+// SSE2 is always there on x86-64
+#if defined(__SSE2__) || defined(_M_X64)
+#  define HAVE_SSE2_CELLS 1
+#  include <emmintrin.h>
+#endif
+
+
+// the octree as it is built, CollisionManager::flatten() lays it out
+// for the queries and throws it away
+class ColDetNode
+{
+public:
+    ColDetNode(unsigned char depth, const Extents& exts, ObsList *fullList);
+    ~ColDetNode();
+
+    int getCount() const
+    {
+        return count;
+    }
+    const ObsList* getList() const
+    {
+        return &fullList;
+    }
+    const Extents& getExtents() const
+    {
+        return extents;
+    }
+    int getChildCount() const
+    {
+        return childCount;
+    }
+    ColDetNode* getChild(int i) const
+    {
+        return children[i];
+    }
+
+    // the caller takes over the batch
+    MeshFaceBatch* takeFaceBatch();
+
+private:
+    void makeChildren ();
+    void resizeCell ();
+    void makeFaceBatch ();
+
+    unsigned char depth;
+    int count;
+    Extents extents;
+    unsigned char childCount;
+    ColDetNode* children[8];
+    ObsList fullList;
+    MeshFaceBatch* faceBatch; // the mesh faces of a leaf
+};
+
 
 /* static variables */
 
@@ -48,10 +103,8 @@ static int totalElements = 0;
 
 static ObsList      FullList;  // the complete list of obstacles
 static SplitObsList SplitList; // the complete split list of obstacles
-static ObsList      FullPad;   // for returning a full list of obstacles
-static SplitObsList SplitPad;  // for returning a split list of obstacles
 
-static ColDetNodeList   RayList;   // for returning a list a ray hit nodes
+static std::vector<bool> MeshTouched; // used while building, by collisionIndex
 
 static ObsList      EmptyList = { 0, NULL };
 static ColDetNodeList   EmptyNodeList = { 0, NULL };
@@ -61,26 +114,11 @@ static ColDetNodeList   EmptyNodeList = { 0, NULL };
 
 inline static void addToFullList (Obstacle* obs)
 {
-    obs->collisionState = false;
     FullList.list[FullList.count] = obs;
     FullList.count++;
     return;
 }
 
-inline static void addToFullPadList (Obstacle* obs)
-{
-    FullPad.list[FullPad.count] = obs;
-    FullPad.count++;
-    return;
-}
-
-inline static void addToRayList (const ColDetNode* node)
-{
-    RayList.list[RayList.count] = node;
-    RayList.count++;
-    return;
-}
-
 static void squeezeChildren (ColDetNode** children)
 {
     for (int dst = 0; dst < 8; dst++)
@@ -182,6 +220,100 @@ static int compareObstacles (const void* a, const void* b)
 }
 
 
+//////////////////////////////////////////////////////////////////////////////
+//
+// CollisionQuery
+//
+
+CollisionQuery::CollisionQuery() : generation(0)
+{
+    obsList = EmptyList;
+    nodeList = EmptyNodeList;
+}
+
+
+void CollisionQuery::begin(int obstacleCount)
+{
+    obstacles.clear();
+    times.clear();
+    nodes.clear();
+
+    if ((int)visited.size() < obstacleCount)
+        visited.resize(obstacleCount, 0);
+
+    // stamps left over from earlier queries never match a new generation,
+    // except after the counter wraps around
+    generation++;
+    if (generation == 0)
+    {
+        std::fill(visited.begin(), visited.end(), 0);
+        generation = 1;
+    }
+}
+
+
+inline void CollisionQuery::addObstacle(Obstacle* obs)
+{
+    unsigned int &stamp = visited[obs->collisionIndex];
+    if (stamp != generation)
+    {
+        stamp = generation;
+        obstacles.push_back(obs);
+    }
+}
+
+
+inline void CollisionQuery::addObstacle(Obstacle* obs,
+                                        const Ray* ray, const float* time)
+{
+    unsigned int &stamp = visited[obs->collisionIndex];
+    if (stamp != generation)
+    {
+        stamp = generation;
+        obstacles.push_back(obs);
+        times.push_back((time != NULL) ? *time : obs->intersect(*ray));
+    }
+}
+
+
+inline bool CollisionQuery::isVisited(const Obstacle* obs) const
+{
+    return visited[obs->collisionIndex] == generation;
+}
+
+
+inline void CollisionQuery::addNode(int cell, float inTime, float outTime)
+{
+    ColDetNodeHit hit;
+    hit.cell = cell;
+    hit.inTime = inTime;
+    hit.outTime = outTime;
+    nodes.push_back(hit);
+}
+
+
+const ObsList* CollisionQuery::getObstacles()
+{
+    obsList.count = (int)obstacles.size();
+    obsList.list = obstacles.empty() ? NULL : &obstacles[0];
+    return &obsList;
+}
+
+
+const float* CollisionQuery::getTimes()
+{
+    return times.empty() ? NULL : &times[0];
+}
+
+
+const ColDetNodeList* CollisionQuery::getNodes()
+{
+    nodeList.count = (int)nodes.size();
+    nodeList.list = nodes.empty() ? NULL : &nodes[0];
+    return &nodeList;
+}
+
+
 //////////////////////////////////////////////////////////////////////////////
 //
 // CollisionManager
@@ -189,10 +321,7 @@ static int compareObstacles (const void* a, const void* b)
 
 CollisionManager::CollisionManager ()
 {
-    root = NULL;
-    FullPad.list = NULL;
     FullList.list = NULL;
-    RayList.list = NULL;
     clear();
 }
 
@@ -205,8 +334,12 @@ CollisionManager::~CollisionManager ()
 
 void CollisionManager::clear ()
 {
-    delete root;
-    root = NULL;
+    for (size_t i = 0; i < faceBatches.size(); i++)
+        delete faceBatches[i];
+    faceBatches.clear();
+    cells.clear();
+    cellBounds.clear();
+    cellObstacles.clear();
 
     worldSize = 0.0f;
 
@@ -214,20 +347,12 @@ void CollisionManager::clear ()
     totalNodes = 0;
     totalElements = 0;
 
-    delete[] FullPad.list;
     delete[] FullList.list;
-    delete[] RayList.list;
-    FullPad.list = NULL;
-    FullPad.count = 0;
     FullList.list = NULL;
     FullList.count = 0;
-    RayList.list = NULL;
-    RayList.count = 0;
 
     for (int i = 0; i < 5; i++)
     {
-        SplitPad.array[i].list = NULL;
-        SplitPad.array[i].count = 0;
         SplitList.array[i].list = NULL;
         SplitList.array[i].count = 0;
     }
@@ -249,28 +374,61 @@ bool CollisionManager::needReload () const
 }
 
 
-const ObsList* CollisionManager::axisBoxTest (const Extents& exts)
+const ObsList* CollisionManager::axisBoxTest (const Extents& exts) const
 {
-    if (root == NULL)
+    return axisBoxTest(exts, mainQuery);
+}
+
+
+const ObsList* CollisionManager::axisBoxTest (const Extents& exts,
+        CollisionQuery& query) const
+{
+    if (cells.empty())
         return &EmptyList;
 
-    FullPad.count = 0;
+    query.begin(FullList.count);
 
     // get the list
-    root->axisBoxTest (exts);
-
-    // clear the collisionState on the obstacles
-    for (int i = 0; i < FullPad.count; i++)
-        FullPad.list[i]->collisionState = false;
+    std::vector<int>& stack = query.stack;
+    stack.clear();
+    if (touchingCells(0, 1, exts) != 0)
+        stack.push_back(0);
+    while (!stack.empty())
+    {
+        const int c = stack.back();
+        stack.pop_back();
+        const Cell& cell = cells[c];
+        if (cell.childCount == 0)
+        {
+            addCellObstacles(c, query);
+            continue;
+        }
+        // depth first, the children in order
+        const unsigned int touching =
+            touchingCells(cell.first, cell.childCount, exts);
+        for (int i = cell.childCount - 1; i >= 0; i--)
+        {
+            if (touching & (1u << i))
+                stack.push_back(cell.first + i);
+        }
+    }
 
-    return &FullPad;
+    return query.getObstacles();
 }
 
 
 const ObsList* CollisionManager::cylinderTest (const float *pos,
         float radius, float height) const
 {
-    if (root == NULL)
+    return cylinderTest(pos, radius, height, mainQuery);
+}
+
+
+const ObsList* CollisionManager::cylinderTest (const float *pos,
+        float radius, float height,
+        CollisionQuery& query) const
+{
+    if (cells.empty())
         return &EmptyList;
 
     float tmpMins[3], tmpMaxs[3];
@@ -281,32 +439,40 @@ const ObsList* CollisionManager::cylinderTest (const float *pos,
     tmpMaxs[1] = pos[1] + radius;
     tmpMaxs[2] = pos[2] + height;
 
-    FullPad.count = 0;
-
-    // get the list
     Extents exts;
     exts.set(tmpMins, tmpMaxs);
-    root->axisBoxTest (exts);
+    return axisBoxTest (exts, query);
+}
 
-    // clear the collisionState on the obstacles
-    for (int i = 0; i < FullPad.count; i++)
-        FullPad.list[i]->collisionState = false;
 
-    return &FullPad;
+const ObsList* CollisionManager::boxTest (const float* pos, float angle,
+        float dx, float dy, float dz) const
+{
+    return boxTest(pos, angle, dx, dy, dz, mainQuery);
 }
 
 
 const ObsList* CollisionManager::boxTest (const float* pos, float UNUSED(angle),
-        float dx, float dy, float dz) const
+        float dx, float dy, float dz,
+        CollisionQuery& query) const
 {
     float radius = sqrtf (dx*dx + dy*dy);
-    return cylinderTest (pos, radius, dz);
+    return cylinderTest (pos, radius, dz, query);
+}
+
+
+const ObsList* CollisionManager::movingBoxTest (const float* oldPos, float oldAngle,
+        const float* pos, float angle,
+        float dx, float dy, float dz) const
+{
+    return movingBoxTest(oldPos, oldAngle, pos, angle, dx, dy, dz, mainQuery);
 }
 
 
 const ObsList* CollisionManager::movingBoxTest (const float* oldPos, float UNUSED(oldAngle),
         const float* pos, float UNUSED(angle),
-        float dx, float dy, float dz) const
+        float dx, float dy, float dz,
+        CollisionQuery& query) const
 {
     float newpos[3];
 
@@ -321,52 +487,154 @@ const ObsList* CollisionManager::movingBoxTest (const float* oldPos, float UNUSE
         dz = dz + (oldPos[2] - pos[2]);
 
     float radius = sqrtf (dx*dx + dy*dy);
-    return cylinderTest (newpos, radius, dz);
+    return cylinderTest (newpos, radius, dz, query);
 }
 
 
 const ObsList* CollisionManager::rayTest (const Ray* ray, float timeLeft) const
 {
-    if (root == NULL)
+    return rayTest(ray, timeLeft, mainQuery);
+}
+
+
+const ObsList* CollisionManager::rayTest (const Ray* ray, float timeLeft,
+        CollisionQuery& query) const
+{
+    if (cells.empty())
         return &EmptyList;
 
-    FullPad.count = 0;
-    RayList.count = 0;
+    query.begin(FullList.count);
 
     // get the list
-    root->rayTest (ray, timeLeft + 0.1f);
+    timeLeft += 0.1f;
+    std::vector<int>& stack = query.stack;
+    stack.clear();
+    stack.push_back(0);
+    while (!stack.empty())
+    {
+        const int c = stack.back();
+        stack.pop_back();
+        float inTime;
+        if (!rayHitsCell(c, ray, timeLeft, &inTime, NULL))
+            continue;
+        const Cell& cell = cells[c];
+        if (cell.childCount == 0)
+        {
+            addCellObstacles(c, query);
+            continue;
+        }
+        const unsigned int maybe = rayCells(cell.first, cell.childCount, ray);
+        for (int i = cell.childCount - 1; i >= 0; i--)
+        {
+            if (maybe & (1u << i))
+                stack.push_back(cell.first + i);
+        }
+    }
+
+    return query.getObstacles();
+}
 
-    // clear the collisionState on the obstacles
-    for (int i = 0; i < FullPad.count; i++)
-        FullPad.list[i]->collisionState = false;
 
-    return &FullPad;
+const ObsList* CollisionManager::rayTestTimes (const Ray* ray, float timeLeft,
+        const float*& times) const
+{
+    return rayTestTimes(ray, timeLeft, times, mainQuery);
 }
 
 
-static int compareRayNodes (const void *a, const void *b)
+const ObsList* CollisionManager::rayTestTimes (const Ray* ray, float timeLeft,
+        const float*& times,
+        CollisionQuery& query) const
 {
-    const ColDetNode* nodeA = *((ColDetNode* const *)a);
-    const ColDetNode* nodeB = *((ColDetNode* const *)b);
-    return (nodeA->getInTime() > nodeB->getInTime());
+    times = NULL;
+    if (cells.empty())
+        return &EmptyList;
+
+    query.begin(FullList.count);
+
+    // get the list
+    timeLeft += 0.1f;
+    std::vector<int>& stack = query.stack;
+    stack.clear();
+    stack.push_back(0);
+    while (!stack.empty())
+    {
+        const int c = stack.back();
+        stack.pop_back();
+        float inTime;
+        if (!rayHitsCell(c, ray, timeLeft, &inTime, NULL))
+            continue;
+        const Cell& cell = cells[c];
+        if (cell.childCount == 0)
+        {
+            addCellObstacles(c, ray, query);
+            continue;
+        }
+        const unsigned int maybe = rayCells(cell.first, cell.childCount, ray);
+        for (int i = cell.childCount - 1; i >= 0; i--)
+        {
+            if (maybe & (1u << i))
+                stack.push_back(cell.first + i);
+        }
+    }
+
+    times = query.getTimes();
+    return query.getObstacles();
+}
+
+
+static bool compareRayNodes (const ColDetNodeHit& a, const ColDetNodeHit& b)
+{
+    return a.inTime < b.inTime;
 }
 
 
 const ColDetNodeList* CollisionManager::rayTestNodes (const Ray* ray,
         float timeLeft) const
 {
-    if (root == NULL)
+    return rayTestNodes(ray, timeLeft, mainQuery);
+}
+
+
+const ColDetNodeList* CollisionManager::rayTestNodes (const Ray* ray,
+        float timeLeft,
+        CollisionQuery& query) const
+{
+    if (cells.empty())
         return &EmptyNodeList;
 
-    RayList.count = 0;
+    query.begin(FullList.count);
 
     // get the list
-    root->rayTestNodes (ray, timeLeft + 0.1f);
+    timeLeft += 0.1f;
+    std::vector<int>& stack = query.stack;
+    stack.clear();
+    stack.push_back(0);
+    while (!stack.empty())
+    {
+        const int c = stack.back();
+        stack.pop_back();
+        float inTime, outTime;
+        if (!rayHitsCell(c, ray, timeLeft, &inTime, &outTime))
+            continue;
+        const Cell& cell = cells[c];
+        if (cell.childCount == 0)
+        {
+            query.addNode(c, inTime, outTime);
+            continue;
+        }
+        const unsigned int maybe = rayCells(cell.first, cell.childCount, ray);
+        for (int i = cell.childCount - 1; i >= 0; i--)
+        {
+            if (maybe & (1u << i))
+                stack.push_back(cell.first + i);
+        }
+    }
 
     // sort the list of node
-    qsort (RayList.list, RayList.count, sizeof(ColDetNode*), compareRayNodes);
+    std::sort (query.nodes.begin(), query.nodes.end(), compareRayNodes);
 
-    return &RayList;
+    return query.getNodes();
 }
 
 
@@ -428,8 +696,7 @@ void CollisionManager::load ()
         }
     }
 
-    // get the memory for the full list and the scratch pad
-    FullPad.list = new Obstacle*[fullCount];
+    // get the memory for the full list
     FullList.list = new Obstacle*[fullCount];
     FullList.count = 0;
 
@@ -480,19 +747,19 @@ void CollisionManager::load ()
     // do the type/height sort
     qsort(FullList.list, FullList.count, sizeof(Obstacle*), compareObstacles);
 
+    // the queries keep track of what they have seen by this
+    for (i = 0; i < FullList.count; i++)
+        FullList.list[i]->collisionIndex = i;
+
     // generate the octree
     setExtents (&FullList);
-    root = new ColDetNode (0, gridExtents, &FullList);
-
-    // tally the stats
-    leafNodes = 0;
-    totalNodes = 0;
-    totalElements = 0;
-    root->tallyStats();
+    MeshTouched.assign(FullList.count, false);
+    ColDetNode* root = new ColDetNode (0, gridExtents, &FullList);
+    MeshTouched.clear();
 
-    // setup the ray list
-    RayList.list = new const ColDetNode*[leafNodes];
-    RayList.count = 0;
+    // lay it out for the queries, this also tallies the stats
+    flatten(root);
+    delete root;
 
     // print some statistics
     logDebugMessage(2,"ColDet Octree obstacles = %i\n", FullList.count);
@@ -576,10 +843,319 @@ void CollisionManager::setExtents (ObsList *list)
 }
 
 
+// the floats of a block of cellBounds
+static const int boundsBlock = 6 * 8;
+
+
+void CollisionManager::flatten (ColDetNode* root)
+{
+    // the root has a block of its own
+    cells.resize(1);
+    cells[0].bounds = 0;
+    cellBounds.resize(boundsBlock, 0.0f);
+    setCellExtents(0, root->getExtents());
+
+    flattenCell(root, 0);
+
+    totalNodes = (int)cells.size();
+    totalElements = (int)cellObstacles.size();
+
+    return;
+}
+
+
+void CollisionManager::flattenCell (ColDetNode* node, int c)
+{
+    // depth first, so that the cells and the obstacles are stored
+    // in the order they are visited
+    const int childCount = node->getChildCount();
+    cells[c].count = node->getCount();
+    cells[c].childCount = childCount;
+    cells[c].faceBatch = -1;
+
+    if (childCount == 0)
+    {
+        const ObsList* list = node->getList();
+        cells[c].first = (int)cellObstacles.size();
+        cellObstacles.insert(cellObstacles.end(),
+                             list->list, list->list + list->count);
+        MeshFaceBatch* batch = node->takeFaceBatch();
+        if (batch != NULL)
+        {
+            cells[c].faceBatch = (int)faceBatches.size();
+            faceBatches.push_back(batch);
+        }
+        leafNodes++;
+        return;
+    }
+
+    const int first = (int)cells.size();
+    const int block = (int)cellBounds.size();
+    cells[c].first = first;
+    cells.resize(first + childCount);
+    cellBounds.resize(block + boundsBlock, 0.0f);
+    for (int i = 0; i < childCount; i++)
+    {
+        cells[first + i].bounds = block + i;
+        setCellExtents(first + i, node->getChild(i)->getExtents());
+    }
+    for (int i = 0; i < childCount; i++)
+        flattenCell(node->getChild(i), first + i);
+
+    return;
+}
+
+
+void CollisionManager::setCellExtents (int c, const Extents& exts)
+{
+    float* bounds = &cellBounds[cells[c].bounds];
+    for (int a = 0; a < 3; a++)
+    {
+        bounds[a * 8] = exts.mins[a];
+        bounds[(a + 3) * 8] = exts.maxs[a];
+    }
+}
+
+
+void CollisionManager::getCellExtents (int c, Extents& exts) const
+{
+    const float* bounds = &cellBounds[cells[c].bounds];
+    for (int a = 0; a < 3; a++)
+    {
+        exts.mins[a] = bounds[a * 8];
+        exts.maxs[a] = bounds[(a + 3) * 8];
+    }
+}
+
+
+unsigned int CollisionManager::touchingCells (int first, int count,
+        const Extents& exts) const
+{
+    // the same comparisons as Extents::touches()
+    const float* bounds = &cellBounds[cells[first].bounds];
+    unsigned int touching = 0;
+#ifdef HAVE_SSE2_CELLS
+    for (int i = 0; i < count; i += 4)
+    {
+        __m128 apart = _mm_setzero_ps();
+        for (int a = 0; a < 3; a++)
+        {
+            const __m128 mins = _mm_loadu_ps(&bounds[a * 8 + i]);
+            const __m128 maxs = _mm_loadu_ps(&bounds[(a + 3) * 8 + i]);
+            apart = _mm_or_ps(apart,
+                              _mm_cmpgt_ps(mins, _mm_set1_ps(exts.maxs[a])));
+            apart = _mm_or_ps(apart,
+                              _mm_cmplt_ps(maxs, _mm_set1_ps(exts.mins[a])));
+        }
+        touching |= (unsigned int)(~_mm_movemask_ps(apart) & 0xF) << i;
+    }
+    touching &= (1u << count) - 1;
+#else
+    for (int i = 0; i < count; i++)
+    {
+        bool apart = false;
+        for (int a = 0; a < 3; a++)
+        {
+            if ((bounds[a * 8 + i] > exts.maxs[a]) ||
+                    (bounds[(a + 3) * 8 + i] < exts.mins[a]))
+                apart = true;
+        }
+        if (!apart)
+            touching |= 1u << i;
+    }
+#endif
+    return touching;
+}
+
+
+unsigned int CollisionManager::rayCells (int first, int count,
+        const Ray* ray) const
+{
+    // only drops the cells that testRayHitsAxisBox() turns down
+    // first, those that the ray starts beside and leaves behind
+    const float* o = ray->getOrigin();
+    const float* v = ray->getDirection();
+    const float* bounds = &cellBounds[cells[first].bounds];
+    unsigned int maybe = 0;
+#ifdef HAVE_SSE2_CELLS
+    for (int i = 0; i < count; i += 4)
+    {
+        __m128 away = _mm_setzero_ps();
+        for (int a = 0; a < 3; a++)
+        {
+            const __m128 pos = _mm_set1_ps(o[a]);
+            if (v[a] <= 0.0f)
+            {
+                const __m128 mins = _mm_loadu_ps(&bounds[a * 8 + i]);
+                away = _mm_or_ps(away, _mm_cmplt_ps(pos, mins));
+            }
+            if (v[a] >= 0.0f)
+            {
+                const __m128 maxs = _mm_loadu_ps(&bounds[(a + 3) * 8 + i]);
+                away = _mm_or_ps(away, _mm_cmpgt_ps(pos, maxs));
+            }
+        }
+        maybe |= (unsigned int)(~_mm_movemask_ps(away) & 0xF) << i;
+    }
+    maybe &= (1u << count) - 1;
+#else
+    for (int i = 0; i < count; i++)
+    {
+        bool away = false;
+        for (int a = 0; a < 3; a++)
+        {
+            if (((v[a] <= 0.0f) && (o[a] < bounds[a * 8 + i])) ||
+                    ((v[a] >= 0.0f) && (o[a] > bounds[(a + 3) * 8 + i])))
+                away = true;
+        }
+        if (!away)
+            maybe |= 1u << i;
+    }
+#endif
+    return maybe;
+}
+
+
+bool CollisionManager::rayHitsCell (int cell, const Ray* ray, float timeLeft,
+                                    float* inTime, float* outTime) const
+{
+    Extents exts;
+    getCellExtents(cell, exts);
+    if (outTime == NULL)
+    {
+        if (!testRayHitsAxisBox(ray, exts, inTime))
+            return false;
+    }
+    else if (!testRayHitsAxisBox(ray, exts, inTime, outTime))
+        return false;
+    return (*inTime <= timeLeft);
+}
+
+
+inline void CollisionManager::addCellObstacles (int c,
+        CollisionQuery& query) const
+{
+    const Cell& cell = cells[c];
+    Obstacle* const* list = &cellObstacles[cell.first];
+    for (int i = 0; i < cell.count; i++)
+        query.addObstacle (list[i]);
+}
+
+
+void CollisionManager::addCellObstacles (int c, const Ray* ray,
+        CollisionQuery& query) const
+{
+    const Cell& cell = cells[c];
+    Obstacle* const* list = &cellObstacles[cell.first];
+
+    // the faces' times go into the slots of their list entries,
+    // which come in the order of the list.  large faces are in many
+    // cells, the batch is skipped when they were all seen already.
+    const MeshFaceBatch* faceBatch = NULL;
+    const float* faceTimes = NULL;
+    const int* faceSlots = NULL;
+    int faceCount = 0;
+    if (cell.faceBatch >= 0)
+    {
+        faceBatch = faceBatches[cell.faceBatch];
+        faceSlots = faceBatch->getSlots();
+        for (int f = 0; f < faceBatch->getCount(); f++)
+        {
+            if (!query.isVisited(list[faceSlots[f]]))
+            {
+                faceCount = faceBatch->getCount();
+                break;
+            }
+        }
+    }
+    if (faceCount > 0)
+    {
+        if ((int)query.slotTimes.size() < cell.count)
+            query.slotTimes.resize(cell.count);
+        faceBatch->intersect(*ray, &query.slotTimes[0]);
+        faceTimes = &query.slotTimes[0];
+    }
+    int face = 0;
+    for (int i = 0; i < cell.count; i++)
+    {
+        if ((face < faceCount) && (faceSlots[face] == i))
+        {
+            query.addObstacle (list[i], ray, &faceTimes[i]);
+            face++;
+        }
+        else
+            query.addObstacle (list[i], ray, NULL);
+    }
+}
+
+
+void CollisionManager::getCellList (int c, ObsList& list) const
+{
+    const Cell& cell = cells[c];
+    if (cell.childCount > 0)
+    {
+        list = EmptyList;
+        return;
+    }
+    list.count = cell.count;
+    list.list = (cell.count > 0) ?
+                const_cast<Obstacle**>(&cellObstacles[cell.first]) : NULL;
+}
+
+
 void CollisionManager::draw (DrawLinesFunc drawLinesFunc)
 {
-    if (root != NULL)
-        root->draw (drawLinesFunc);
+    for (int c = 0; c < (int)cells.size(); c++)
+    {
+        int x, y, z, i;
+        float points[5][3];
+        Extents extents;
+        getCellExtents(c, extents);
+        const float* exts[2] = { extents.mins, extents.maxs };
+
+        // pick a color
+        int hasMeshObs = 0;
+        int hasNormalObs = 0;
+        ObsList list;
+        getCellList(c, list);
+        for (x = 0; x < list.count; x++)
+        {
+            if (list.list[x]->getType() == MeshObstacle::getClassName())
+                hasMeshObs = 1;
+            else
+                hasNormalObs = 1;
+        }
+        int color = hasNormalObs + (2 * hasMeshObs);
+
+        // draw Z-normal squares
+        for (z = 0; z < 2; z++)
+        {
+            for (i = 0; i < 4; i++)
+            {
+                x = ((i + 0) % 4) / 2;
+                y = ((i + 1) % 4) / 2;
+                points[i][0] = exts[x][0];
+                points[i][1] = exts[y][1];
+                points[i][2] = exts[z][2];
+            }
+            memcpy (points[4], points[0], sizeof (points[4]));
+            drawLinesFunc (5, points, color);
+        }
+
+        // draw the corner edges
+        for (i = 0; i < 4; i++)
+        {
+            x = ((i + 0) % 4) / 2;
+            y = ((i + 1) % 4) / 2;
+            for (z = 0; z < 2; z++)
+            {
+                points[z][0] = exts[x][0];
+                points[z][1] = exts[y][1];
+                points[z][2] = exts[z][2];
+            }
+            drawLinesFunc (2, points, color);
+        }
+    }
     return;
 }
 
@@ -600,6 +1176,7 @@ ColDetNode::ColDetNode(unsigned char _depth,
     for (i = 0; i < 8; i++)
         children[i] = NULL;
     childCount = 0;
+    faceBatch = NULL;
 
     // alloacte enough room for the incoming list
     const int listBytes = _list->count * sizeof (Obstacle*);
@@ -629,8 +1206,8 @@ ColDetNode::ColDetNode(unsigned char _depth,
     //
     // the mesh obstacles will be the last in the list, so we
     // record whether or not any of their faces have intersected
-    // with cell along the way (in the collisionState variable,
-    // which must be cleared before leaving).
+    // with cell along the way (in MeshTouched, which must be
+    // cleared before leaving).
     //
     fullList.count = 0;
     const char* faceType = MeshFace::getClassName();
@@ -654,18 +1231,18 @@ ColDetNode::ColDetNode(unsigned char _depth,
                         MeshFace* face = (MeshFace*) obs;
                         MeshObstacle* mesh = face->getMesh();
                         if (mesh != NULL)
-                            mesh->collisionState = true;
+                            MeshTouched[mesh->collisionIndex] = true;
                     }
                 }
             }
             else
             {
                 MeshObstacle* mesh = (MeshObstacle*) obs;
-                if (mesh->collisionState)
+                if (MeshTouched[mesh->collisionIndex])
                 {
                     fullList.list[fullList.count] = (Obstacle*) mesh;
                     fullList.count++;
-                    mesh->collisionState = false;
+                    MeshTouched[mesh->collisionIndex] = false;
                 }
                 else if (mesh->containsPointNoOctree (point))
                 {
@@ -688,6 +1265,7 @@ ColDetNode::ColDetNode(unsigned char _depth,
     if (((int)depth >= maxDepth) || (fullList.count <= minElements))
     {
         resizeCell();
+        makeFaceBatch();
         //logDebugMessage(4, ("COLDET LEAF NODE: depth = %d, items = %i\n", depth, count);
         return;
     }
@@ -718,6 +1296,7 @@ ColDetNode::~ColDetNode()
     for (int i = 0; i < 8; i++)
         delete children[i];
     free (fullList.list);
+    delete faceBatch;
     return;
 }
 
@@ -768,228 +1347,70 @@ void ColDetNode::makeChildren ()
 }
 
 
-void ColDetNode::resizeCell ()
+MeshFaceBatch* ColDetNode::takeFaceBatch ()
 {
-    int i;
-    Extents absExts;
-
-    if (childCount > 0)
-    {
-        // use lower children's extents
-        for (i = 0; i < childCount; i++)
-            absExts.expandToBox(children[i]->getExtents());
-    }
-    else
-    {
-        // check all of the obstacles
-        for (i = 0; i < fullList.count; i++)
-        {
-            const Obstacle* obs = fullList.list[i];
-            absExts.expandToBox(obs->getExtents());
-        }
-    }
-
-    for (i = 0; i < 3; i++)
-    {
-        if (absExts.mins[i] > extents.mins[i])
-            extents.mins[i] = absExts.mins[i];
-        if (absExts.maxs[i] < extents.maxs[i])
-            extents.maxs[i] = absExts.maxs[i];
-    }
-
-    return;
+    MeshFaceBatch* batch = faceBatch;
+    faceBatch = NULL;
+    return batch;
 }
 
 
-void ColDetNode::axisBoxTest (const Extents& exts) const
+void ColDetNode::makeFaceBatch ()
 {
-    int i;
-
-    if (!extents.touches(exts))
-        return;
-
-    if (childCount == 0)
-    {
-        for (i = 0; i < fullList.count; i++)
-        {
-            Obstacle* obs = fullList.list[i];
-            if (obs->collisionState == false)
-            {
-                obs->collisionState = true;
-                addToFullPadList (obs);
-            }
-        }
-    }
-    else
-    {
-        for (i = 0; i < childCount; i++)
-            children[i]->axisBoxTest (exts);
-    }
-
-    return;
-}
-
-
-void ColDetNode::boxTest (const float* pos, float angle,
-                          float dx, float dy, float dz) const
-{
-    int i;
-
-    /* FIXME
-      if ((_maxs[0] < mins[0]) || (_mins[0] > maxs[0]) ||
-          (_maxs[1] < mins[1]) || (_mins[1] > maxs[1]) ||
-          (_maxs[2] < mins[2]) || (_mins[2] > maxs[2])) {
-        return;
-      }
-    */
+    // a few faces are tested faster one by one
+    const int minFaces = 16;
 
-    if (childCount == 0)
-    {
-        for (i = 0; i < fullList.count; i++)
-        {
-            Obstacle* obs = fullList.list[i];
-            if (obs->collisionState == false)
-            {
-                obs->collisionState = true;
-                addToFullPadList (obs);
-            }
-        }
-    }
-    else
-    {
-        for (i = 0; i < childCount; i++)
-            children[i]->boxTest (pos, angle, dx, dy, dz);
-    }
-
-    return;
-}
-
-
-void ColDetNode::rayTest (const Ray* ray, float timeLeft) const
-{
-    if (!testRayHitsAxisBox(ray, extents, &inTime) ||
-            (inTime > timeLeft))
-        return;
-
-    if (childCount == 0)
-    {
-        for (int i = 0; i < fullList.count; i++)
-        {
-            Obstacle* obs = fullList.list[i];
-            if (obs->collisionState == false)
-            {
-                obs->collisionState = true;
-                addToFullPadList (obs);
-            }
-        }
-    }
-    else
+    const char* faceType = MeshFace::getClassName();
+    int faces = 0;
+    for (int i = 0; i < fullList.count; i++)
     {
-        for (int i = 0; i < childCount; i++)
-            children[i]->rayTest (ray, timeLeft);
+        if (fullList.list[i]->getType() == faceType)
+            faces++;
     }
-
-    return;
-}
-
-
-void ColDetNode::rayTestNodes (const Ray* ray, float timeLeft) const
-{
-    if (!testRayHitsAxisBox(ray, extents, &inTime, &outTime) ||
-            (inTime > timeLeft))
+    if (faces < minFaces)
         return;
 
-    if (childCount == 0)
-        addToRayList(this);
-    else
+    faceBatch = new MeshFaceBatch;
+    for (int i = 0; i < fullList.count; i++)
     {
-        for (int i = 0; i < childCount; i++)
-            children[i]->rayTestNodes(ray, timeLeft);
+        const Obstacle* obs = fullList.list[i];
+        if (obs->getType() == faceType)
+            faceBatch->addFace((const MeshFace*) obs, i);
     }
-
+    faceBatch->finalize();
     return;
 }
 
 
-/*
-void ColDetNode::boxTestSplit (const float* pos, float angle,
-                   float dx, float dy, float dz) const
-{
-  pos = pos;
-  angle = dx =dy =dz;
-  return;
-}
-*/
-
-
-void ColDetNode::tallyStats()
+void ColDetNode::resizeCell ()
 {
-    totalNodes++;
-    totalElements += fullList.count;
+    int i;
+    Extents absExts;
 
     if (childCount > 0)
     {
-        for (int i = 0; i < childCount; i++)
-            children[i]->tallyStats();
+        // use lower children's extents
+        for (i = 0; i < childCount; i++)
+            absExts.expandToBox(children[i]->getExtents());
     }
     else
-        leafNodes++;
-
-    return;
-}
-
-
-void ColDetNode::draw(DrawLinesFunc drawLinesFunc)
-{
-    int x, y, z, c;
-    float points[5][3];
-    const float* exts[2] = { extents.mins, extents.maxs };
-
-    // pick a color
-    int hasMeshObs = 0;
-    int hasNormalObs = 0;
-    for (x = 0; x < fullList.count; x++)
-    {
-        if (fullList.list[x]->getType() == MeshObstacle::getClassName())
-            hasMeshObs = 1;
-        else
-            hasNormalObs = 1;
-    }
-    int color = hasNormalObs + (2 * hasMeshObs);
-
-    // draw Z-normal squares
-    for (z = 0; z < 2; z++)
     {
-        for (c = 0; c < 4; c++)
+        // check all of the obstacles
+        for (i = 0; i < fullList.count; i++)
         {
-            x = ((c + 0) % 4) / 2;
-            y = ((c + 1) % 4) / 2;
-            points[c][0] = exts[x][0];
-            points[c][1] = exts[y][1];
-            points[c][2] = exts[z][2];
+            const Obstacle* obs = fullList.list[i];
+            absExts.expandToBox(obs->getExtents());
         }
-        memcpy (points[4], points[0], sizeof (points[4]));
-        drawLinesFunc (5, points, color);
     }
 
-    // draw the corner edges
-    for (c = 0; c < 4; c++)
+    for (i = 0; i < 3; i++)
     {
-        x = ((c + 0) % 4) / 2;
-        y = ((c + 1) % 4) / 2;
-        for (z = 0; z < 2; z++)
-        {
-            points[z][0] = exts[x][0];
-            points[z][1] = exts[y][1];
-            points[z][2] = exts[z][2];
-        }
-        drawLinesFunc (2, points, color);
+        if (absExts.mins[i] > extents.mins[i])
+            extents.mins[i] = absExts.mins[i];
+        if (absExts.maxs[i] < extents.maxs[i])
+            extents.maxs[i] = absExts.maxs[i];
     }
 
-    // draw the kids
-    for (c = 0; c < childCount; c++)
-        children[c]->draw (drawLinesFunc);
-
     return;
 }
 
@@ -0,0 +1,445 @@
+/* bzflag
+ * Copyright (c) 1993-2021 Tim Riker
+ *
+ * This package is free software;  you can redistribute it and/or
+ * modify it under the terms of the license found in the file
+ * named COPYING that should have accompanied this file.
+ *
+ * THIS PACKAGE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include "common.h"
+
+// interface header
+#include "MeshFaceBatch.h"
+
+// system headers
+#include <string.h>
+#include <algorithm>
+
+// common headers
+#include "Extents.h"
+#include "MeshFace.h"
+#include "Ray.h"
+
+// SSE2 is always there on x86-64, AVX is looked for at run time
+#if defined(__SSE2__) || defined(_M_X64)
+#  define HAVE_SSE2_KERNEL 1
+#  include <emmintrin.h>
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#  define HAVE_AVX_KERNEL 1
+#  include <immintrin.h>
+#endif
+
+
+//
+// Each block is a row of eight floats for every plane component:
+// the face planes' x, y, z and d, then the same for every edge.
+// Unused lanes have a zero plane, which is never hit, and unused
+// edges have the plane 0x + 0y + 0z - 1, which is never outside.
+//
+// The kernels must do the same float operations in the same order
+// as MeshFace::intersect(), so that the times come out the same.
+// That rules out fused multiply-adds.
+//
+
+static const int blockWidth = 8;
+
+typedef void (*BlockKernel)(const float* block, int edges,
+                            const float* origin, const float* dir,
+                            float* times);
+
+
+static void blockScalar(const float* block, int edges,
+                        const float* origin, const float* dir,
+                        float* times)
+{
+    for (int lane = 0; lane < blockWidth; lane++)
+    {
+        const float* p = block + lane;
+        times[lane] = -1.0f;
+
+        const float linedot = (p[0] * dir[0]) +
+                              (p[8] * dir[1]) +
+                              (p[16] * dir[2]);
+        if (linedot >= -0.001f)
+            continue;
+        const float origindot = (p[0] * origin[0]) +
+                                (p[8] * origin[1]) +
+                                (p[16] * origin[2]);
+        const float hitTime = - (p[24] + origindot) / linedot;
+        if (hitTime < 0.0f)
+            continue;
+
+        float point[3];
+        point[0] = (dir[0] * hitTime) + origin[0];
+        point[1] = (dir[1] * hitTime) + origin[1];
+        point[2] = (dir[2] * hitTime) + origin[2];
+
+        bool inside = true;
+        for (int e = 0; e < edges; e++)
+        {
+            const float* q = p + ((4 + (4 * e)) * blockWidth);
+            const float d = (q[0] * point[0]) +
+                            (q[8] * point[1]) +
+                            (q[16] * point[2]) + q[24];
+            if (d > 0.001f)
+            {
+                inside = false;
+                break;
+            }
+        }
+        if (inside)
+            times[lane] = hitTime;
+    }
+}
+
+
+#ifdef HAVE_SSE2_KERNEL
+static void blockSSE2(const float* block, int edges,
+                      const float* origin, const float* dir,
+                      float* times)
+{
+    const __m128 dx = _mm_set1_ps(dir[0]);
+    const __m128 dy = _mm_set1_ps(dir[1]);
+    const __m128 dz = _mm_set1_ps(dir[2]);
+    const __m128 ox = _mm_set1_ps(origin[0]);
+    const __m128 oy = _mm_set1_ps(origin[1]);
+    const __m128 oz = _mm_set1_ps(origin[2]);
+    const __m128 sign = _mm_set1_ps(-0.0f);
+
+    for (int half = 0; half < blockWidth; half += 4)
+    {
+        const float* p = block + half;
+        const __m128 nx = _mm_loadu_ps(p);
+        const __m128 ny = _mm_loadu_ps(p + 8);
+        const __m128 nz = _mm_loadu_ps(p + 16);
+        const __m128 nd = _mm_loadu_ps(p + 24);
+
+        const __m128 linedot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, dx),
+                                          _mm_mul_ps(ny, dy)),
+                                          _mm_mul_ps(nz, dz));
+        __m128 miss = _mm_cmpge_ps(linedot, _mm_set1_ps(-0.001f));
+        const __m128 origindot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, ox),
+                                            _mm_mul_ps(ny, oy)),
+                                            _mm_mul_ps(nz, oz));
+        const __m128 hitTime = _mm_div_ps(_mm_xor_ps(_mm_add_ps(nd, origindot),
+                                          sign), linedot);
+        miss = _mm_or_ps(miss, _mm_cmplt_ps(hitTime, _mm_setzero_ps()));
+
+        const __m128 px = _mm_add_ps(_mm_mul_ps(dx, hitTime), ox);
+        const __m128 py = _mm_add_ps(_mm_mul_ps(dy, hitTime), oy);
+        const __m128 pz = _mm_add_ps(_mm_mul_ps(dz, hitTime), oz);
+        const __m128 limit = _mm_set1_ps(0.001f);
+        for (int e = 0; e < edges; e++)
+        {
+            if (_mm_movemask_ps(miss) == 0xf)
+                break;
+            const float* q = p + ((4 + (4 * e)) * blockWidth);
+            const __m128 d =
+                _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(q), px),
+                                      _mm_mul_ps(_mm_loadu_ps(q + 8), py)),
+                                      _mm_mul_ps(_mm_loadu_ps(q + 16), pz)),
+                           _mm_loadu_ps(q + 24));
+            miss = _mm_or_ps(miss, _mm_cmpgt_ps(d, limit));
+        }
+
+        _mm_storeu_ps(times + half,
+                      _mm_or_ps(_mm_and_ps(miss, _mm_set1_ps(-1.0f)),
+                                _mm_andnot_ps(miss, hitTime)));
+    }
+}
+#endif
+
+
+#ifdef HAVE_AVX_KERNEL
+__attribute__((target("avx")))
+static void blockAVX(const float* block, int edges,
+                     const float* origin, const float* dir,
+                     float* times)
+{
+    const __m256 dx = _mm256_set1_ps(dir[0]);
+    const __m256 dy = _mm256_set1_ps(dir[1]);
+    const __m256 dz = _mm256_set1_ps(dir[2]);
+    const __m256 ox = _mm256_set1_ps(origin[0]);
+    const __m256 oy = _mm256_set1_ps(origin[1]);
+    const __m256 oz = _mm256_set1_ps(origin[2]);
+
+    const __m256 nx = _mm256_loadu_ps(block);
+    const __m256 ny = _mm256_loadu_ps(block + 8);
+    const __m256 nz = _mm256_loadu_ps(block + 16);
+    const __m256 nd = _mm256_loadu_ps(block + 24);
+
+    const __m256 linedot =
+        _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, dx),
+                                    _mm256_mul_ps(ny, dy)),
+                      _mm256_mul_ps(nz, dz));
+    __m256 miss = _mm256_cmp_ps(linedot, _mm256_set1_ps(-0.001f), _CMP_GE_OQ);
+    const __m256 origindot =
+        _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, ox),
+                                    _mm256_mul_ps(ny, oy)),
+                      _mm256_mul_ps(nz, oz));
+    const __m256 hitTime =
+        _mm256_div_ps(_mm256_xor_ps(_mm256_add_ps(nd, origindot),
+                                    _mm256_set1_ps(-0.0f)), linedot);
+    miss = _mm256_or_ps(miss, _mm256_cmp_ps(hitTime, _mm256_setzero_ps(),
+                                            _CMP_LT_OQ));
+
+    const __m256 px = _mm256_add_ps(_mm256_mul_ps(dx, hitTime), ox);
+    const __m256 py = _mm256_add_ps(_mm256_mul_ps(dy, hitTime), oy);
+    const __m256 pz = _mm256_add_ps(_mm256_mul_ps(dz, hitTime), oz);
+    const __m256 limit = _mm256_set1_ps(0.001f);
+    for (int e = 0; e < edges; e++)
+    {
+        if (_mm256_movemask_ps(miss) == 0xff)
+            break;
+        const float* q = block + ((4 + (4 * e)) * blockWidth);
+        const __m256 d =
+            _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(
+                                            _mm256_mul_ps(_mm256_loadu_ps(q), px),
+                                            _mm256_mul_ps(_mm256_loadu_ps(q + 8), py)),
+                                        _mm256_mul_ps(_mm256_loadu_ps(q + 16), pz)),
+                          _mm256_loadu_ps(q + 24));
+        miss = _mm256_or_ps(miss, _mm256_cmp_ps(d, limit, _CMP_GT_OQ));
+    }
+
+    _mm256_storeu_ps(times,
+                     _mm256_or_ps(_mm256_and_ps(miss, _mm256_set1_ps(-1.0f)),
+                                  _mm256_andnot_ps(miss, hitTime)));
+}
+#endif
+
+
+// the kernel called name, if this build and the CPU have it
+static BlockKernel findKernel(const char* name)
+{
+#ifdef HAVE_AVX_KERNEL
+    if (strcmp(name, "avx") == 0)
+    {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx") ? blockAVX : NULL;
+    }
+#endif
+#ifdef HAVE_SSE2_KERNEL
+    if (strcmp(name, "sse2") == 0)
+        return blockSSE2;
+#endif
+    if (strcmp(name, "scalar") == 0)
+        return blockScalar;
+    return NULL;
+}
+
+static const char* kernelNames[] = { "avx", "sse2", "scalar" };
+static const char* kernelName = NULL;
+
+static BlockKernel pickKernel()
+{
+    for (size_t i = 0; i < bzcountof(kernelNames); i++)
+    {
+        BlockKernel kernel = findKernel(kernelNames[i]);
+        if (kernel)
+        {
+            kernelName = kernelNames[i];
+            return kernel;
+        }
+    }
+    return NULL;
+}
+
+static BlockKernel blockKernel = pickKernel();
+
+
+const char* MeshFaceBatch::getKernelName()
+{
+    return kernelName;
+}
+
+
+bool MeshFaceBatch::useKernel(const char* name)
+{
+    for (size_t i = 0; i < bzcountof(kernelNames); i++)
+    {
+        if (strcmp(name, kernelNames[i]) != 0)
+            continue;
+        BlockKernel kernel = findKernel(kernelNames[i]);
+        if (!kernel)
+            return false;
+        kernelName = kernelNames[i];
+        blockKernel = kernel;
+        return true;
+    }
+    return false;
+}
+
+
+MeshFaceBatch::MeshFaceBatch()
+{
+}
+
+
+void MeshFaceBatch::addFace(const MeshFace* face, int slot)
+{
+    faces.push_back(face);
+    faceSlots.push_back(slot);
+}
+
+
+namespace
+{
+struct BlockOrder
+{
+    BlockOrder(const std::vector<const MeshFace*>& _faces, int _axis)
+        : faces(_faces), axis(_axis) {}
+    bool operator()(int a, int b) const
+    {
+        const int edgesA = faces[a]->getVertexCount();
+        const int edgesB = faces[b]->getVertexCount();
+        if (edgesA != edgesB)
+            return edgesA < edgesB;
+        const Extents& extsA = faces[a]->getExtents();
+        const Extents& extsB = faces[b]->getExtents();
+        return (extsA.mins[axis] + extsA.maxs[axis]) <
+               (extsB.mins[axis] + extsB.maxs[axis]);
+    }
+    const std::vector<const MeshFace*>& faces;
+    int axis;
+};
+}
+
+
+// can the ray, which starts at time zero and never stops, hit the box.
+// invDir is the inverse of the direction, zero where the direction is.
+static inline bool rayHitsBox(const float* origin, const float* dir,
+                              const float* invDir,
+                              const float* mins, const float* maxs)
+{
+    float inTime = 0.0f;
+    float outTime = MAXFLOAT;
+    for (int a = 0; a < 3; a++)
+    {
+        if (dir[a] == 0.0f)
+        {
+            if ((origin[a] < mins[a]) || (origin[a] > maxs[a]))
+                return false;
+            continue;
+        }
+        float t1 = (mins[a] - origin[a]) * invDir[a];
+        float t2 = (maxs[a] - origin[a]) * invDir[a];
+        if (t1 > t2)
+            std::swap(t1, t2);
+        inTime = std::max(inTime, t1);
+        outTime = std::min(outTime, t2);
+        if (inTime > outTime)
+            return false;
+    }
+    return true;
+}
+
+
+void MeshFaceBatch::finalize()
+{
+    blocks.clear();
+    data.clear();
+
+    // faces with the same number of edges go together, so that few of
+    // the edge rows are padding, and then along the widest axis, so that
+    // the blocks' boxes are small
+    const int count = (int)faces.size();
+    Extents exts;
+    std::vector<int> order(count);
+    for (int i = 0; i < count; i++)
+    {
+        order[i] = i;
+        exts.expandToBox(faces[i]->getExtents());
+    }
+    int axis = 0;
+    for (int a = 1; a < 3; a++)
+    {
+        if (exts.getWidth(a) > exts.getWidth(axis))
+            axis = a;
+    }
+    std::stable_sort(order.begin(), order.end(), BlockOrder(faces, axis));
+
+    for (int first = 0; first < count; first += blockWidth)
+    {
+        const int lanes = std::min(blockWidth, count - first);
+
+        Block block;
+        block.offset = (int)data.size();
+        block.edges = faces[order[first + lanes - 1]]->getVertexCount();
+        data.resize(data.size() + ((4 + (4 * block.edges)) * blockWidth), 0.0f);
+        float* rows = &data[block.offset];
+        Extents blockExts;
+
+        for (int lane = 0; lane < blockWidth; lane++)
+        {
+            block.slots[lane] = -1;
+            for (int e = 0; e < block.edges; e++)
+                rows[((4 + (4 * e) + 3) * blockWidth) + lane] = -1.0f;
+            if (lane >= lanes)
+                continue;
+
+            const MeshFace* face = faces[order[first + lane]];
+            block.slots[lane] = faceSlots[order[first + lane]];
+            Extents hitExts;
+            face->getHitExtents(hitExts);
+            blockExts.expandToBox(hitExts);
+            const float* plane = face->getPlane();
+            for (int k = 0; k < 4; k++)
+                rows[(k * blockWidth) + lane] = plane[k];
+            const afvec4* edgePlanes = face->getEdgePlanes();
+            for (int e = 0; e < face->getVertexCount(); e++)
+            {
+                for (int k = 0; k < 4; k++)
+                    rows[((4 + (4 * e) + k) * blockWidth) + lane] = edgePlanes[e][k];
+            }
+        }
+
+        memcpy(block.mins, blockExts.mins, sizeof(block.mins));
+        memcpy(block.maxs, blockExts.maxs, sizeof(block.maxs));
+        blocks.push_back(block);
+    }
+
+    // the planes are copied, the faces themselves aren't needed anymore
+    faces.clear();
+}
+
+
+void MeshFaceBatch::intersect(const Ray& ray, float* times) const
+{
+    const float* origin = ray.getOrigin();
+    const float* dir = ray.getDirection();
+    float invDir[3];
+    for (int a = 0; a < 3; a++)
+        invDir[a] = (dir[a] != 0.0f) ? (1.0f / dir[a]) : 0.0f;
+    float blockTimes[blockWidth];
+
+    for (size_t b = 0; b < blocks.size(); b++)
+    {
+        const Block& block = blocks[b];
+        if (rayHitsBox(origin, dir, invDir, block.mins, block.maxs))
+            blockKernel(&data[block.offset], block.edges, origin, dir, blockTimes);
+        else
+        {
+            for (int lane = 0; lane < blockWidth; lane++)
+                blockTimes[lane] = -1.0f;
+        }
+        for (int lane = 0; lane < blockWidth; lane++)
+        {
+            if (block.slots[lane] >= 0)
+                times[block.slots[lane]] = blockTimes[lane];
+        }
+    }
+}
+
+
+// Local Variables: ***
+// mode: C++ ***
+// tab-width: 4 ***
+// c-basic-offset: 4 ***
+// indent-tabs-mode: nil ***
+// End: ***
+// ex: shiftwidth=4 tabstop=4
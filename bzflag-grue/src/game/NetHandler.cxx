@@ -16,6 +16,14 @@
 
 // system headers
 #include <errno.h>
+#ifndef _WIN32
+#  define HAVE_WRITEV 1
+#  include <sys/uio.h>
+#endif
+#if defined(__linux__)
+#  define HAVE_MMSG 1
+#  include <sys/socket.h>
+#endif
 
 #include "bzfsAPI.h"
 
@@ -25,6 +33,24 @@
 
 const int udpBufSize = 128000;
 
+// number of datagrams moved with a single system call
+const int udpBatchSize = 64;
+
+// number of queued messages handed to a single writev
+const int maxWriteSegments = 64;
+
+// datagrams read from the udp socket but not yet handed out by udpReceive
+static char       udpRecvBuffer[udpBatchSize][MaxPacketLen];
+static struct sockaddr_in udpRecvAddr[udpBatchSize];
+static int        udpRecvLen[udpBatchSize];
+static int        udpRecvCount = 0;
+static int        udpRecvNext  = 0;
+
+static uint64_t udpAddrKey(const struct sockaddr_in &addr)
+{
+    return ((uint64_t)addr.sin_addr.s_addr << 16) | addr.sin_port;
+}
+
 std::vector<NetworkDataLogCallback*> logCallbacks;
 
 void addNetworkLogCallback(NetworkDataLogCallback * cb )
@@ -101,33 +127,54 @@ void NetHandler::destroyHandlers()
     }
 }
 
-void NetHandler::setFd(fd_set *read_set, fd_set *write_set, int &maxFile)
+void NetHandler::setPoller(NetPoller *_poller)
 {
-    for (int i = 0; i < maxHandlers; i++)
+    if (poller && udpSocket != -1)
+        poller->remove(udpSocket);
+
+    poller = _poller;
+    if (!poller)
+        return;
+
+    // the udp socket is shared and drained in one go, no need for edges
+    if (udpSocket != -1)
+        poller->add(udpSocket);
+
+    for (size_t i = 0; i < handlerByFD.size(); i++)
     {
-        NetHandler *player = netPlayer[i];
-        if (player && !player->closed)
-        {
-            FD_SET((unsigned int)player->fd, read_set);
-            if (player->outmsgSize > 0)
-                FD_SET((unsigned int)player->fd, write_set);
-            if (player->fd > maxFile)
-                maxFile = player->fd;
-        }
+        NetHandler *handler = handlerByFD[i];
+        if (handler && !handler->closed)
+            poller->add(handler->fd, true);
     }
+}
+
+NetHandler *NetHandler::getHandlerByFD(int _fd)
+{
+    if (_fd < 0 || _fd >= (int)handlerByFD.size())
+        return NULL;
+    return handlerByFD[_fd];
+}
 
-    FD_SET((unsigned int)udpSocket, read_set);
-    if (udpSocket > maxFile)
-        maxFile = udpSocket;
+void NetHandler::registerFD()
+{
+    if (fd < 0)
+        return;
+    if (fd >= (int)handlerByFD.size())
+        handlerByFD.resize(fd + 1, NULL);
+    handlerByFD[fd] = this;
 
+    // tcp sockets are read until they would block, so edges are enough
+    if (poller)
+        poller->add(fd, true);
+}
+
+void NetHandler::setDNSFd(fd_set *read_set, fd_set *write_set, int &maxFile)
+{
     for (int i = 0; i < maxHandlers; i++)
     {
         NetHandler *player = netPlayer[i];
-        if (player)
-        {
-            if (player->ares)
-                player->ares->setFd(read_set, write_set, maxFile);
-        }
+        if (player && player->ares && !player->reverseDNSDone())
+            player->ares->setFd(read_set, write_set, maxFile);
     }
 }
 
@@ -136,22 +183,86 @@ int NetHandler::getUdpSocket()
     return udpSocket;
 }
 
-int NetHandler::udpReceive(char *buffer, struct sockaddr_in *uaddr,
-                           bool &udpLinkRequest)
+bool NetHandler::hasBufferedUDP()
 {
-    AddrLen recvlen = sizeof(*uaddr);
+    return udpRecvNext < udpRecvCount;
+}
+
+// refill the receive ring, returns false when the socket has nothing to read
+static bool readUdpBatch(int sock, NetHandler::UdpStats &stats)
+{
+    udpRecvNext  = 0;
+    udpRecvCount = 0;
+
+#ifdef HAVE_MMSG
+    struct mmsghdr msgs[udpBatchSize];
+    struct iovec   iov[udpBatchSize];
+    memset(msgs, 0, sizeof(msgs));
+    for (int i = 0; i < udpBatchSize; i++)
+    {
+        iov[i].iov_base = udpRecvBuffer[i];
+        iov[i].iov_len  = MaxUDPPacketLen;
+        msgs[i].msg_hdr.msg_name    = &udpRecvAddr[i];
+        msgs[i].msg_hdr.msg_namelen = sizeof(udpRecvAddr[i]);
+        msgs[i].msg_hdr.msg_iov     = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen  = 1;
+    }
     int n;
-    uint16_t len;
-    uint16_t code;
+    do
+    {
+        n = recvmmsg(sock, msgs, udpBatchSize, MSG_DONTWAIT, NULL);
+        stats.recvCalls++;
+    }
+    while ((n < 0) && (getErrno() == EINTR));
+    if (n <= 0)
+        return false;
+    for (int i = 0; i < n; i++)
+        udpRecvLen[i] = (int)msgs[i].msg_len;
+    udpRecvCount = n;
+#else
+    AddrLen recvlen = sizeof(udpRecvAddr[0]);
+    int n;
+    do
+    {
+        n = recvfrom(sock, udpRecvBuffer[0], MaxUDPPacketLen, 0,
+                     (struct sockaddr *) &udpRecvAddr[0], &recvlen);
+        stats.recvCalls++;
+    }
+    while ((n < 0) && (getErrno() == EINTR));
+    if (n < 0)
+        return false;
+    udpRecvLen[0] = n;
+    udpRecvCount = 1;
+#endif
+    stats.datagramsIn += udpRecvCount;
+    return true;
+}
+
+int NetHandler::udpReceive(char *&buffer, struct sockaddr_in *uaddr,
+                           bool &udpLinkRequest)
+{
     while (true)
     {
-        n = recvfrom(udpSocket, buffer, MaxUDPPacketLen, 0, (struct sockaddr *) uaddr,
-                     &recvlen);
-        if ((n < 0) || (n >= 4))
-            break;
+        if (!hasBufferedUDP() && !readUdpBatch(udpSocket, udpStats))
+            return -1;
+
+        const int slot = udpRecvNext++;
+        buffer = udpRecvBuffer[slot];
+        *uaddr = udpRecvAddr[slot];
+        const int id = udpHandle(buffer, udpRecvLen[slot], uaddr, udpLinkRequest);
+        if (id != -1)
+            return id;
     }
-    // Error receiving data (or no data)
-    if (n < 0 || uaddr->sin_port < 1024)
+}
+
+int NetHandler::udpHandle(const char *buffer, int n, struct sockaddr_in *uaddr,
+                          bool &udpLinkRequest)
+{
+    uint16_t len;
+    uint16_t code;
+
+    // runt packets, or from a port no client would use
+    if (n < 4 || ntohs(uaddr->sin_port) < 1024)
         return -1;
 
     // read head
@@ -171,13 +282,16 @@ int NetHandler::udpReceive(char *buffer, struct sockaddr_in *uaddr,
     int id(-1);     // player index of the matched player
     int pi;
     udpLinkRequest = false;
-    for (pi = 0; pi < maxHandlers; pi++)
+    std::unordered_map<uint64_t, int>::iterator sender = udpSenders.find(udpAddrKey(*uaddr));
+    if (sender != udpSenders.end())
+    {
+        pi = sender->second;
         if (netPlayer[pi] && !netPlayer[pi]->closed
                 && netPlayer[pi]->isMyUdpAddrPort(*uaddr))
-        {
             id = pi;
-            break;
-        }
+        else
+            udpSenders.erase(sender);
+    }
     if (id == -1 && (len == 1) && (code == MsgUDPLinkRequest))
     {
         // It is a UDP lInk Request ... try to match it
@@ -193,6 +307,7 @@ int NetHandler::udpReceive(char *buffer, struct sockaddr_in *uaddr,
                 if (uaddr->sin_port)
                     netPlayer[index]->uaddr.sin_port = uaddr->sin_port;
                 netPlayer[index]->udpin = true;
+                udpSenders[udpAddrKey(netPlayer[index]->uaddr)] = index;
                 udpLinkRequest = true;
                 logDebugMessage(2,"Player slot %d inbound UDP up %s:%d actual %d\n",
                                 index,
@@ -229,15 +344,18 @@ than %s:%d\n",
     }
     else
     {
-        logDebugMessage(4,"Player slot %d uread() %s:%d len %d from %s:%d on %i\n",
-                        id,
-                        inet_ntoa(netPlayer[id]->uaddr.sin_addr),
-                        ntohs(netPlayer[id]->uaddr.sin_port), n,
-                        inet_ntoa(uaddr->sin_addr), ntohs(uaddr->sin_port),
-                        udpSocket);
+        // formatting the addresses costs more than the rest of the datagram
+        if (debugLevel >= 4)
+            logDebugMessage(4,"Player slot %d uread() %s:%d len %d from %s:%d on %i\n",
+                            id,
+                            inet_ntoa(netPlayer[id]->uaddr.sin_addr),
+                            ntohs(netPlayer[id]->uaddr.sin_port), n,
+                            inet_ntoa(uaddr->sin_addr), ntohs(uaddr->sin_port),
+                            udpSocket);
 #ifdef NETWORK_STATS
         netPlayer[id]->countMessage(code, len, 0);
 #endif
+        receivedCount++;
 
         callNetworkDataLog (false, true, (const unsigned char*)buf,len,netPlayer[id]);
 
@@ -250,36 +368,38 @@ than %s:%d\n",
     return id;
 }
 
-bool NetHandler::isUdpFdSet(fd_set *read_set)
-{
-    if (FD_ISSET(udpSocket, read_set))
-        return true;
-    return false;
-}
-
 void NetHandler::checkDNS(fd_set *read_set, fd_set *write_set)
 {
     for (int i = 0; i < maxHandlers; i++)
     {
         NetHandler *player = netPlayer[i];
-        if (player)
-        {
-            if (player->ares)
-                player->ares->process(read_set, write_set);
-        }
+        if (player && player->ares && !player->reverseDNSDone())
+            player->ares->process(read_set, write_set);
     }
 }
 
 int NetHandler::udpSocket = -1;
 NetHandler *NetHandler::netPlayer[maxHandlers] = {NULL};
+NetPoller *NetHandler::poller = NULL;
+unsigned long NetHandler::receivedCount = 0;
+std::vector<NetHandler*> NetHandler::handlerByFD;
+std::unordered_map<uint64_t, int> NetHandler::udpSenders;
+std::vector<NetHandler*> NetHandler::udpQueue;
+NetHandler::UdpStats NetHandler::udpStats = {0, 0, 0, 0};
+int NetHandler::queueLowWater  = 4 * 1024;
+int NetHandler::queueHighWater = 8 * 1024;
+int NetHandler::queueMaxBytes  = 16 * 1024;
 
 NetHandler::NetHandler(PlayerInfo* _info, const struct sockaddr_in &clientAddr,
                        int _playerIndex, int _fd)
     : ares(new AresHandler(_playerIndex)), info(_info), uaddr(clientAddr),
       playerIndex(_playerIndex), fd(_fd), peer(clientAddr),
       tcplen(0), closed(false),
-      outmsgOffset(0), outmsgSize(0), outmsgCapacity(0), outmsg(0),
-      udpOutputLen(0), udpin(false), udpout(false), toBeKicked(false),
+      outmsgSize(0), partialLane(-1), peakQueued(0), bytesDropped(0),
+      congested(false), congestedTime(0.0f),
+      udpCopiedLen(0), udpSegmentCount(0), udpOutputLen(0),
+      udpQueued(false), udpin(false), udpout(false),
+      toBeKicked(false),
       time(_info->now)
 {
     // update player state
@@ -305,14 +425,18 @@ NetHandler::NetHandler(PlayerInfo* _info, const struct sockaddr_in &clientAddr,
 #endif
     if (!netPlayer[playerIndex])
         netPlayer[playerIndex] = this;
+    registerFD();
     ares->queryHostname((const struct sockaddr *) &clientAddr);
 }
 
 NetHandler::NetHandler(const struct sockaddr_in &_clientAddr, int _fd)
     : ares(0), info(0), playerIndex(-1), fd(_fd),
       tcplen(0), closed(false),
-      outmsgOffset(0), outmsgSize(0), outmsgCapacity(0), outmsg(0),
-      udpOutputLen(0), udpin(false), udpout(false), toBeKicked(false),
+      outmsgSize(0), partialLane(-1), peakQueued(0), bytesDropped(0),
+      congested(false), congestedTime(0.0f),
+      udpCopiedLen(0), udpSegmentCount(0), udpOutputLen(0),
+      udpQueued(false), udpin(false), udpout(false),
+      toBeKicked(false),
       time(TimeKeeper::getCurrent())
 {
     // store address information for player
@@ -340,6 +464,7 @@ NetHandler::NetHandler(const struct sockaddr_in &_clientAddr, int _fd)
     acceptUDP = true;
 
 #endif
+    registerFD();
 }
 
 void NetHandler::setPlayer ( PlayerInfo* p, int index )
@@ -362,30 +487,48 @@ NetHandler::~NetHandler()
 #endif
     if (ares)
         delete(ares);
+    forgetUdpAddrPort();
+    if (udpQueued)
+    {
+        for (size_t i = 0; i < udpQueue.size(); i++)
+        {
+            if (udpQueue[i] == this)
+            {
+                udpQueue.erase(udpQueue.begin() + i);
+                break;
+            }
+        }
+    }
+    if (poller)
+        poller->remove(fd);
+    if (fd >= 0 && fd < (int)handlerByFD.size() && handlerByFD[fd] == this)
+        handlerByFD[fd] = NULL;
     // shutdown TCP socket
     shutdown(fd, SHUT_RDWR);
     close(fd);
 
-    delete[] outmsg;
+    for (int lane = 0; lane < LaneCount; lane++)
+    {
+        for (size_t i = 0; i < outQueue[lane].size(); i++)
+            outQueue[lane][i].msg->unref();
+    }
+    udpRelease();
 
     if (netPlayer[playerIndex] == this)
         netPlayer[playerIndex] = NULL;
 }
 
-bool NetHandler::isFdSet(fd_set *set)
-{
-    if (FD_ISSET(fd, set))
-        return true;
-    return false;
-}
-
 int NetHandler::send(const void *buffer, size_t length)
 {
 
     int n = ::send(fd, (const char *)buffer, (int)length, 0);
     if (n >= 0)
         return n;
+    return sendError();
+}
 
+int NetHandler::sendError()
+{
     // get error code
     const int err = getErrno();
 
@@ -412,21 +555,97 @@ int NetHandler::send(const void *buffer, size_t length)
     return 0;
 }
 
-int NetHandler::bufferedSend(const void *buffer, size_t length)
+int NetHandler::sendQueue()
 {
-    // try flushing buffered data
-    if (outmsgSize != 0)
+    while (outmsgSize > 0)
     {
-        const int n = send(outmsg + outmsgOffset, outmsgSize);
-        if (n == -1)
-            return -1;
-        if (n > 0)
+        // a message that went out in part has to be finished before
+        // anything else, then the lanes go in order
+        const OutSegment *segments[maxWriteSegments];
+        int lanes[maxWriteSegments];
+        int count = 0;
+        if (partialLane >= 0)
         {
-            outmsgOffset += n;
-            outmsgSize   -= n;
+            segments[count] = &outQueue[partialLane].front();
+            lanes[count++]  = partialLane;
         }
+        for (int lane = 0; lane < LaneCount && count < maxWriteSegments; lane++)
+        {
+            std::deque<OutSegment>::const_iterator it = outQueue[lane].begin();
+            if (lane == partialLane)
+                ++it;
+            for (; it != outQueue[lane].end() && count < maxWriteSegments; ++it)
+            {
+                segments[count] = &*it;
+                lanes[count++]  = lane;
+            }
+        }
+
+        // hand the socket as many queued messages as we can at once
+#ifdef HAVE_WRITEV
+        struct iovec iov[maxWriteSegments];
+        size_t wanted = 0;
+        for (int i = 0; i < count; i++)
+        {
+            iov[i].iov_base = const_cast<char *>(segments[i]->msg->getData() + segments[i]->offset);
+            iov[i].iov_len  = segments[i]->msg->getSize() - segments[i]->offset;
+            wanted += iov[i].iov_len;
+        }
+        int n = (int)writev(fd, iov, count);
+        if (n < 0)
+            n = sendError();
+#else
+        const size_t wanted = segments[0]->msg->getSize() - segments[0]->offset;
+        const int n = send(segments[0]->msg->getData() + segments[0]->offset, wanted);
+#endif
+        if (n <= 0)
+            return n;
+
+        // drop whatever went out, the last message touched may be partial
+        outmsgSize -= n;
+        size_t left = n;
+        for (int i = 0; i < count && left > 0; i++)
+        {
+            OutSegment &segment = outQueue[lanes[i]].front();
+            const size_t size = segment.msg->getSize() - segment.offset;
+            if (left < size)
+            {
+                segment.offset += left;
+                partialLane = lanes[i];
+                break;
+            }
+            left -= size;
+            segment.msg->unref();
+            outQueue[lanes[i]].pop_front();
+            if (partialLane == lanes[i])
+                partialLane = -1;
+        }
+
+        // the socket is full
+        if ((size_t)n < wanted)
+            break;
     }
-    // if the buffer is empty try writing the data immediately
+    return 0;
+}
+
+int NetHandler::bufferedSend(const void *buffer, size_t length, Lane lane)
+{
+    return queueSend((const char *)buffer, length, NULL, lane);
+}
+
+int NetHandler::bufferedSend(NetMessage *msg, Lane lane)
+{
+    return queueSend(msg->getData(), msg->getSize(), msg, lane);
+}
+
+int NetHandler::queueSend(const char *buffer, size_t length, NetMessage *shared,
+                          Lane lane)
+{
+    // try flushing buffered data
+    if (outmsgSize != 0 && sendQueue() == -1)
+        return -1;
+    // if the queue is empty try writing the data immediately
+    bool partial = false;
     if ((outmsgSize == 0) && length > 0)
     {
         const int n = send(buffer, length);
@@ -434,68 +653,104 @@ int NetHandler::bufferedSend(const void *buffer, size_t length)
             return -1;
         if (n > 0)
         {
-            buffer  = (const void*)(((const char*)buffer) + n);
+            buffer += n;
             length -= n;
+            partial = true;
         }
     }
-    // write leftover data to the buffer
+    // queue leftover data
     if (length > 0)
     {
-        // is there enough room in buffer?
-        if (outmsgCapacity < outmsgSize + (int)length)
+        // if the queue is getting too big then drop the player.  chances
+        // are the network is down or too unreliable to that player.
+        if (outmsgSize + (int)length > queueMaxBytes)
         {
-            // double capacity until it's big enough
-            int newCapacity = (outmsgCapacity == 0) ? 512 : outmsgCapacity;
-            while (newCapacity < outmsgSize + (int)length)
-                newCapacity <<= 1;
-
-            // if the buffer is getting too big then drop the player.  chances
-            // are the network is down or too unreliable to that player.
-            // FIXME -- is 20kB too big?  too small?
-            if (newCapacity >= 20 * 1024)
+            if (info != NULL && playerIndex >= 0)
             {
-                if (info != NULL && playerIndex >= 0)
-                {
-                    logDebugMessage(2,"Player %s [%d] drop, unresponsive with %d bytes queued\n",
-                                    info->getCallSign(), playerIndex, outmsgSize + (int)length);
-                }
-                toBeKicked = true;
-                toBeKickedReason = "send queue too big";
-                return 0;
+                logDebugMessage(2,"Player %s [%d] drop, unresponsive with %d bytes queued\n",
+                                info->getCallSign(), playerIndex, outmsgSize + (int)length);
             }
-
-            // allocate memory
-            char *newbuf = new char[newCapacity];
-
-            // copy old data over
-            memmove(newbuf, outmsg + outmsgOffset, outmsgSize);
-
-            // cutover
-            delete[] outmsg;
-            outmsg           = newbuf;
-            outmsgOffset   = 0;
-            outmsgCapacity = newCapacity;
+            bytesDropped += length;
+            toBeKicked = true;
+            toBeKickedReason = "send queue too big";
+            return 0;
         }
 
-        // if we can't fit new data at the end of the buffer then move existing
-        // data to head of buffer
-        // FIXME -- use a ring buffer to avoid moving memory
-        if (outmsgOffset + outmsgSize + (int)length > outmsgCapacity)
+        // shared messages are referenced, anything else is copied
+        OutSegment segment;
+        if (shared)
         {
-            memmove(outmsg, outmsg + outmsgOffset, outmsgSize);
-            outmsgOffset = 0;
+            shared->ref();
+            segment.msg    = shared;
+            segment.offset = shared->getSize() - length;
         }
-
-        // append data
-        memmove(outmsg + outmsgOffset + outmsgSize, buffer, length);
+        else
+        {
+            segment.msg    = NetMessage::copy(buffer, length);
+            segment.offset = 0;
+        }
+        outQueue[lane].push_back(segment);
         outmsgSize += (int)length;
+        if (partial)
+            partialLane = lane;
     }
+    updateWatermark();
+    if (poller)
+        poller->setWantWrite(fd, outmsgSize > 0);
     return 0;
 }
 
+void NetHandler::setQueueLimits(int low, int high, int max)
+{
+    queueLowWater  = low;
+    queueHighWater = high;
+    queueMaxBytes  = max;
+}
+
+void NetHandler::updateWatermark()
+{
+    if (outmsgSize > peakQueued)
+        peakQueued = outmsgSize;
+
+    if (!congested && outmsgSize > queueHighWater)
+    {
+        congested = true;
+        congestedSince = TimeKeeper::getCurrent();
+        if (info != NULL && playerIndex >= 0)
+        {
+            logDebugMessage(3,"Player %s [%d] send queue above %d bytes\n",
+                            info->getCallSign(), playerIndex, queueHighWater);
+        }
+    }
+    else if (congested && outmsgSize <= queueLowWater)
+    {
+        congested = false;
+        congestedTime += float(TimeKeeper::getCurrent() - congestedSince);
+    }
+}
+
+float NetHandler::getTimeAboveWatermark() const
+{
+    if (!congested)
+        return congestedTime;
+    return congestedTime + float(TimeKeeper::getCurrent() - congestedSince);
+}
+
+void NetHandler::resetQueueStats()
+{
+    peakQueued    = outmsgSize;
+    bytesDropped  = 0;
+    congestedTime = 0.0f;
+    if (congested)
+        congestedSince = TimeKeeper::getCurrent();
+}
+
 void NetHandler::closing()
 {
     closed = true;
+    forgetUdpAddrPort();
+    if (poller)
+        poller->remove(fd);
 }
 
 void NetHandler::SetAllowUDP(bool set)
@@ -503,6 +758,38 @@ void NetHandler::SetAllowUDP(bool set)
     acceptUDP = set;
 }
 
+NetHandler::Lane NetHandler::laneFor(uint16_t code)
+{
+    switch (code)
+    {
+    case MsgMessage:
+    case MsgGetWorld:
+        return BulkLane;
+    }
+    return StateLane;
+}
+
+bool NetHandler::isUdpMessage(uint16_t code) const
+{
+    // Check if UDP Link is used instead of TCP
+    if (!udpout)
+        return false;
+
+    // only send bulk messages by UDP
+    switch (code)
+    {
+    case MsgShotBegin:
+    case MsgShotEnd:
+    case MsgPlayerUpdate:
+    case MsgPlayerUpdateSmall:
+    case MsgGMUpdate:
+    case MsgLagPing:
+    case MsgGameTime:
+        return true;
+    }
+    return false;
+}
+
 int NetHandler::pwrite(const void *b, int l)
 {
 
@@ -522,25 +809,7 @@ int NetHandler::pwrite(const void *b, int l)
     countMessage(code, len, 1);
 #endif
 
-    bool useUDP = false;
-
-    // Check if UDP Link is used instead of TCP, if so jump into udpSend
-    if (udpout)
-    {
-        // only send bulk messages by UDP
-        switch (code)
-        {
-        case MsgShotBegin:
-        case MsgShotEnd:
-        case MsgPlayerUpdate:
-        case MsgPlayerUpdateSmall:
-        case MsgGMUpdate:
-        case MsgLagPing:
-        case MsgGameTime:
-            useUDP = true;
-            break;
-        }
-    }
+    const bool useUDP = isUdpMessage(code);
 
     callNetworkDataLog (true, useUDP, (const unsigned char*)b,len,this);
 
@@ -551,15 +820,38 @@ int NetHandler::pwrite(const void *b, int l)
         return 0;
     }
 
-    return bufferedSend(b, l);
+    return bufferedSend(b, l, laneFor(code));
 }
 
-int NetHandler::pflush(fd_set *set)
+int NetHandler::pwrite(NetMessage *msg)
 {
-    if (FD_ISSET(fd, set))
-        return bufferedSend(NULL, 0);
-    else
+    if (closed)
+        return 0;
+
+    const uint16_t code = msg->getCode();
+#ifdef NETWORK_STATS
+    countMessage(code, msg->getLen(), 1);
+#endif
+
+    const bool useUDP = isUdpMessage(code);
+
+    callNetworkDataLog (true, useUDP, (const unsigned char*)msg->getData(),
+                        msg->getLen(), this);
+
+    if (useUDP || code == MsgUDPLinkRequest)
+    {
+        udpSend(msg->getData(), msg->getSize(), msg);
         return 0;
+    }
+
+    return bufferedSend(msg, laneFor(code));
+}
+
+int NetHandler::pflush()
+{
+    if (outmsgSize == 0)
+        return 0;
+    return bufferedSend(NULL, 0);
 }
 
 RxStatus NetHandler::tcpReceive()
@@ -597,6 +889,7 @@ RxStatus NetHandler::tcpReceive()
 #ifdef NETWORK_STATS
     countMessage(code, len, 0);
 #endif
+    receivedCount++;
 
     callNetworkDataLog (false, false, (const unsigned char*)buf,len,this);
 
@@ -627,7 +920,11 @@ RxStatus NetHandler::receive(size_t length, bool *retry)
     if (closed) return returnValue;
 
     if ((int)length <= tcplen) return ReadAll;
-    int size = recv(fd, tcpmsg + tcplen, (int)length - tcplen, 0);
+    // a signal would lose the edge of an edge triggered socket, so try again
+    int size;
+    do
+        size = recv(fd, tcpmsg + tcplen, (int)length - tcplen, 0);
+    while ((size < 0) && (getErrno() == EINTR));
     if (size > 0)
     {
         tcplen += size;
@@ -642,8 +939,8 @@ RxStatus NetHandler::receive(size_t length, bool *retry)
         // get error code
         const int err = getErrno();
 
-        // ignore if it's one of these errors
-        if (err == EAGAIN || err == EINTR)
+        // ignore if it's this error
+        if (err == EAGAIN)
         {
             if (retry)
                 *retry = true;
@@ -669,24 +966,122 @@ void *NetHandler::getTcpBuffer()
 
 void NetHandler::flushUDP()
 {
-    if (udpOutputLen)
+    if (!udpOutputLen)
+        return;
+
+#ifdef HAVE_WRITEV
+    struct iovec iov[maxUdpSegments];
+    for (int i = 0; i < udpSegmentCount; i++)
+    {
+        iov[i].iov_base = const_cast<char *>(udpSegments[i].data);
+        iov[i].iov_len  = udpSegments[i].len;
+    }
+    struct msghdr hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.msg_name    = &uaddr;
+    hdr.msg_namelen = sizeof(uaddr);
+    hdr.msg_iov     = iov;
+    hdr.msg_iovlen  = udpSegmentCount;
+    if (sendmsg(udpSocket, &hdr, 0) < 0)
+        bytesDropped += udpOutputLen;
+    udpStats.sendCalls++;
+    udpStats.datagramsOut++;
+#else
+    char datagram[MaxPacketLen];
+    int len = 0;
+    for (int i = 0; i < udpSegmentCount; i++)
     {
-        sendto(udpSocket, udpOutputBuffer, udpOutputLen, 0,
-               (struct sockaddr*)&uaddr, sizeof(uaddr));
-        udpOutputLen = 0;
+        memcpy(datagram + len, udpSegments[i].data, udpSegments[i].len);
+        len += udpSegments[i].len;
     }
+    udpSendTo(datagram, len);
+#endif
+    udpRelease();
 }
 
 void NetHandler::flushAllUDP()
 {
-    for (int i = 0; i < maxHandlers; i++)
+#ifdef HAVE_MMSG
+    static struct iovec iov[udpBatchSize * maxUdpSegments];
+    struct mmsghdr msgs[udpBatchSize];
+    NetHandler     *sent[udpBatchSize];
+    size_t next = 0;
+
+    while (next < udpQueue.size())
     {
-        if (netPlayer[i] && !netPlayer[i]->closed)
-            netPlayer[i]->flushUDP();
+        // gather as many players as fit in one call
+        int count = 0;
+        int segments = 0;
+        memset(msgs, 0, sizeof(msgs));
+        for (; next < udpQueue.size() && count < udpBatchSize; next++)
+        {
+            NetHandler *handler = udpQueue[next];
+            if (handler->closed || !handler->udpOutputLen)
+                continue;
+            struct iovec *first = &iov[segments];
+            for (int i = 0; i < handler->udpSegmentCount; i++, segments++)
+            {
+                iov[segments].iov_base = const_cast<char *>(handler->udpSegments[i].data);
+                iov[segments].iov_len  = handler->udpSegments[i].len;
+            }
+            msgs[count].msg_hdr.msg_name    = &handler->uaddr;
+            msgs[count].msg_hdr.msg_namelen = sizeof(handler->uaddr);
+            msgs[count].msg_hdr.msg_iov     = first;
+            msgs[count].msg_hdr.msg_iovlen  = handler->udpSegmentCount;
+            sent[count++] = handler;
+        }
+
+        // sendmmsg stops at the first datagram it could not send, udp
+        // output is never retried so drop that one and go on with the rest
+        int done = 0;
+        while (done < count)
+        {
+            const int n = sendmmsg(udpSocket, msgs + done, count - done, 0);
+            udpStats.sendCalls++;
+            if (n <= 0)
+            {
+                sent[done]->bytesDropped += sent[done]->udpOutputLen;
+                done++;
+            }
+            else
+            {
+                udpStats.datagramsOut += n;
+                done += n;
+            }
+        }
+        for (int i = 0; i < count; i++)
+            sent[i]->udpRelease();
+    }
+#else
+    for (size_t i = 0; i < udpQueue.size(); i++)
+    {
+        if (!udpQueue[i]->closed)
+            udpQueue[i]->flushUDP();
     }
+#endif
+
+    // closed players keep their output, same as before they were queued
+    size_t kept = 0;
+    for (size_t i = 0; i < udpQueue.size(); i++)
+    {
+        NetHandler *handler = udpQueue[i];
+        if (handler->udpOutputLen)
+            udpQueue[kept++] = handler;
+        else
+            handler->udpQueued = false;
+    }
+    udpQueue.resize(kept);
     pendingUDP = false;
 }
 
+void NetHandler::resetUdpStats()
+{
+    udpStats.datagramsIn  = 0;
+    udpStats.recvCalls    = 0;
+    udpStats.datagramsOut = 0;
+    udpStats.sendCalls    = 0;
+}
+
 std::string NetHandler::reasonToKick()
 {
     std::string reason;
@@ -771,7 +1166,7 @@ void NetHandler::dumpMessageStats()
 }
 #endif
 
-void NetHandler::udpSend(const void *b, size_t l)
+void NetHandler::udpSend(const void *b, size_t l, NetMessage *shared)
 {
 #ifdef TESTLINK
     if ((random()%LINKQUALITY) == 0)
@@ -784,35 +1179,83 @@ void NetHandler::udpSend(const void *b, size_t l)
     // setting sizeLimit to -1 will disable udp-buffering
     const int sizeLimit = (int)MaxPacketLen - 4;
 
-    // If the new data does not fit into the buffer, send the buffer
-    if (udpOutputLen && (udpOutputLen + l > (int)MaxPacketLen))
-    {
-        sendto(udpSocket, udpOutputBuffer, udpOutputLen, 0,
-               (struct sockaddr*)&uaddr, sizeof(uaddr));
-        udpOutputLen = 0;
-    }
+    // If the new data does not fit into the datagram, send what we have
+    if (udpOutputLen && ((udpOutputLen + l > (int)MaxPacketLen)
+                         || udpSegmentCount == maxUdpSegments))
+        flushUDP();
     // If nothing is buffered and new data will mostly fill it, send
     // without copying
     if (!udpOutputLen && ((int)l > sizeLimit))
-    {
-        sendto(udpSocket, (const char *)b, (int)l, 0, (struct sockaddr*)&uaddr,
-               sizeof(uaddr));
-    }
+        udpSendTo(b, l);
     else
     {
         // Buffer new data
-        memcpy(&udpOutputBuffer[udpOutputLen], (const char *)b, l);
-        udpOutputLen += (int)l;
+        udpAppend(b, l, shared);
         // Send buffer if is almost full
         if (udpOutputLen > sizeLimit)
-        {
-            sendto(udpSocket, udpOutputBuffer, udpOutputLen, 0,
-                   (struct sockaddr*)&uaddr, sizeof(uaddr));
-            udpOutputLen = 0;
-        }
+            flushUDP();
     }
     if (udpOutputLen)
+    {
         pendingUDP = true;
+        if (!udpQueued)
+        {
+            udpQueued = true;
+            udpQueue.push_back(this);
+        }
+    }
+}
+
+void NetHandler::udpAppend(const void *b, size_t l, NetMessage *shared)
+{
+    if (shared)
+    {
+        shared->ref();
+        UdpSegment &segment = udpSegments[udpSegmentCount++];
+        segment.msg  = shared;
+        segment.data = (const char *)b;
+        segment.len  = (int)l;
+    }
+    else
+    {
+        char *dest = udpOutputBuffer + udpCopiedLen;
+        memcpy(dest, (const char *)b, l);
+        udpCopiedLen += (int)l;
+
+        // copies in a row end up next to each other
+        UdpSegment *last = udpSegmentCount ? &udpSegments[udpSegmentCount - 1] : NULL;
+        if (last && !last->msg && last->data + last->len == dest)
+            last->len += (int)l;
+        else
+        {
+            UdpSegment &segment = udpSegments[udpSegmentCount++];
+            segment.msg  = NULL;
+            segment.data = dest;
+            segment.len  = (int)l;
+        }
+    }
+    udpOutputLen += (int)l;
+}
+
+void NetHandler::udpRelease()
+{
+    for (int i = 0; i < udpSegmentCount; i++)
+    {
+        if (udpSegments[i].msg)
+            udpSegments[i].msg->unref();
+    }
+    udpSegmentCount = 0;
+    udpCopiedLen    = 0;
+    udpOutputLen    = 0;
+}
+
+void NetHandler::udpSendTo(const void *b, size_t l)
+{
+    if (sendto(udpSocket, (const char *)b, (int)l, 0, (struct sockaddr*)&uaddr,
+               sizeof(uaddr)) < 0)
+        bytesDropped += l;
+    udpStats.sendCalls++;
+    udpStats.datagramsOut++;
 }
 
 bool NetHandler::isMyUdpAddrPort(struct sockaddr_in _uaddr)
@@ -821,6 +1264,15 @@ bool NetHandler::isMyUdpAddrPort(struct sockaddr_in _uaddr)
            (memcmp(&uaddr.sin_addr, &_uaddr.sin_addr, sizeof(uaddr.sin_addr)) == 0);
 }
 
+void NetHandler::forgetUdpAddrPort()
+{
+    if (!udpin)
+        return;
+    std::unordered_map<uint64_t, int>::iterator sender = udpSenders.find(udpAddrKey(uaddr));
+    if (sender != udpSenders.end() && sender->second == playerIndex)
+        udpSenders.erase(sender);
+}
+
 const std::string NetHandler::getPlayerHostInfo()
 {
     return TextUtils::format("%s%s%s%s%s%s",
@@ -0,0 +1,65 @@
+/* bzflag
+ * Copyright (c) 1993-2021 Tim Riker
+ *
+ * This package is free software;  you can redistribute it and/or
+ * modify it under the terms of the license found in the file
+ * named COPYING that should have accompanied this file.
+ *
+ * THIS PACKAGE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+/* interface header */
+#include "NetMessage.h"
+
+/* system implementation headers */
+#include <new>
+#include <string.h>
+
+/* common implementation headers */
+#include "Pack.h"
+
+NetMessage* NetMessage::allocate(size_t size)
+{
+    // the message data lives right behind the object, one allocation each
+    void *mem = ::operator new(sizeof(NetMessage) + size);
+    return new (mem) NetMessage(size);
+}
+
+NetMessage* NetMessage::create(uint16_t code, uint16_t len, const void *payload)
+{
+    NetMessage *msg = allocate(len + 4);
+    msg->code = code;
+    msg->len  = len;
+
+    void *buf = msg->getBuffer();
+    buf = nboPackUShort(buf, len);
+    buf = nboPackUShort(buf, code);
+    if (len)
+        memcpy(buf, payload, len);
+    return msg;
+}
+
+NetMessage* NetMessage::copy(const void *data, size_t size)
+{
+    NetMessage *msg = allocate(size);
+    memcpy(msg->getBuffer(), data, size);
+    return msg;
+}
+
+void NetMessage::unref()
+{
+    if (--refCount > 0)
+        return;
+    this->~NetMessage();
+    ::operator delete(this);
+}
+
+// Local Variables: ***
+// mode: C++ ***
+// tab-width: 4 ***
+// c-basic-offset: 4 ***
+// indent-tabs-mode: nil ***
+// End: ***
+// ex: shiftwidth=4 tabstop=4
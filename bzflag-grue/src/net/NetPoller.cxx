@@ -0,0 +1,461 @@
+/* bzflag
+ * Copyright (c) 1993-2021 Tim Riker
+ *
+ * This package is free software;  you can redistribute it and/or
+ * modify it under the terms of the license found in the file
+ * named COPYING that should have accompanied this file.
+ *
+ * THIS PACKAGE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+/* interface header */
+#include "NetPoller.h"
+
+/* system implementation headers */
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#if defined(__linux__)
+#  define HAVE_EPOLL 1
+#  include <sys/epoll.h>
+#  include <unistd.h>
+#endif
+
+
+//
+// NetPoller
+//
+
+NetPoller::NetPoller()
+    : maxRegistered(-1), transientReady(0), registeredCount(0), wakeups(0),
+      eventCount(0)
+{
+    FD_ZERO(&transientReadReady);
+    FD_ZERO(&transientWriteReady);
+}
+
+NetPoller::~NetPoller()
+{
+}
+
+const char* NetPoller::getName() const
+{
+    switch (getBackend())
+    {
+    case EpollBackend:
+        return "epoll";
+    case SelectBackend:
+    default:
+        return "select";
+    }
+}
+
+bool NetPoller::parseBackend(const char *name, Backend &backend)
+{
+    if (strcasecmp(name, "select") == 0)
+        backend = SelectBackend;
+    else if (strcasecmp(name, "epoll") == 0)
+        backend = EpollBackend;
+    else
+        return false;
+    return true;
+}
+
+void NetPoller::setFlags(int fd, unsigned char flags)
+{
+    if (fd < 0)
+        return;
+    if (fd >= (int)fdFlags.size())
+    {
+        if (!flags)
+            return;
+        fdFlags.resize(fd + 1, 0);
+    }
+
+    const unsigned char oldFlags = fdFlags[fd];
+    if (oldFlags == flags)
+        return;
+    fdFlags[fd] = flags;
+
+    if ((oldFlags & Registered) && !(flags & Registered))
+        registeredCount--;
+    else if (!(oldFlags & Registered) && (flags & Registered))
+        registeredCount++;
+
+    if (flags && fd > maxRegistered)
+        maxRegistered = fd;
+    else if (!flags && fd == maxRegistered)
+    {
+        while (maxRegistered >= 0 && !fdFlags[maxRegistered])
+            maxRegistered--;
+    }
+
+    // the pending marker is not interest the backend cares about
+    if ((oldFlags & ~Pending) != (flags & ~Pending))
+        updateInterest(fd, oldFlags, flags);
+}
+
+void NetPoller::add(int fd, bool edgeTriggered)
+{
+    unsigned char flags = Registered;
+    if (edgeTriggered)
+        flags |= EdgeTriggered;
+    setFlags(fd, flags);
+}
+
+void NetPoller::remove(int fd)
+{
+    setFlags(fd, 0);
+}
+
+bool NetPoller::isRegistered(int fd) const
+{
+    return (getFlags(fd) & Registered) != 0;
+}
+
+void NetPoller::setWantWrite(int fd, bool want)
+{
+    const unsigned char flags = getFlags(fd);
+    if (!(flags & Registered))
+        return;
+    if (want)
+        setFlags(fd, flags | WantWrite);
+    else
+        setFlags(fd, flags & ~WantWrite);
+}
+
+void NetPoller::setPending(int fd)
+{
+    const unsigned char flags = getFlags(fd);
+    if (!(flags & Registered) || (flags & Pending))
+        return;
+    setFlags(fd, flags | Pending);
+    pending.push_back(fd);
+}
+
+void NetPoller::setTransient(fd_set &read_set, fd_set &write_set, int maxFile)
+{
+    std::vector<int> current;
+
+    for (int fd = 0; fd <= maxFile; fd++)
+    {
+        const bool r = FD_ISSET(fd, &read_set) != 0;
+        const bool w = FD_ISSET(fd, &write_set) != 0;
+        if (!r && !w)
+            continue;
+        current.push_back(fd);
+        unsigned char flags = getFlags(fd) & ~(TransientRead | TransientWrite);
+        if (r)
+            flags |= TransientRead;
+        if (w)
+            flags |= TransientWrite;
+        setFlags(fd, flags);
+    }
+
+    // drop whatever was asked for last time and not anymore
+    for (size_t i = 0; i < transientFds.size(); i++)
+    {
+        const int fd = transientFds[i];
+        if (fd <= maxFile && (FD_ISSET(fd, &read_set) || FD_ISSET(fd, &write_set)))
+            continue;
+        setFlags(fd, getFlags(fd) & ~(TransientRead | TransientWrite));
+    }
+
+    transientFds.swap(current);
+}
+
+void NetPoller::addEvent(int fd, bool readable, bool writable)
+{
+    const unsigned char flags = getFlags(fd);
+
+    if (flags & (TransientRead | TransientWrite))
+    {
+        if (fd < FD_SETSIZE)
+        {
+            if (readable)
+                FD_SET((unsigned int)fd, &transientReadReady);
+            if (writable)
+                FD_SET((unsigned int)fd, &transientWriteReady);
+        }
+        transientReady++;
+        return;
+    }
+
+    if (!(flags & Registered))
+        return;
+
+    // the kernel beat us to it, no need to report it twice
+    if (flags & Pending)
+    {
+        setFlags(fd, flags & ~Pending);
+        readable = true;
+    }
+
+    Event event;
+    event.fd       = fd;
+    event.readable = readable;
+    event.writable = writable;
+    events.push_back(event);
+}
+
+int NetPoller::wait(float timeout)
+{
+    events.clear();
+    FD_ZERO(&transientReadReady);
+    FD_ZERO(&transientWriteReady);
+    transientReady = 0;
+
+    // somebody still has unread input, just peek at what else is ready
+    if (!pending.empty() || timeout < 0.0f)
+        timeout = 0.0f;
+
+    const int nfound = backendWait(timeout);
+
+    for (size_t i = 0; i < pending.size(); i++)
+    {
+        const int fd = pending[i];
+        const unsigned char flags = getFlags(fd);
+        if (!(flags & Pending))
+            continue;
+        setFlags(fd, flags & ~Pending);
+        addEvent(fd, true, false);
+    }
+    pending.clear();
+
+    wakeups++;
+    eventCount += events.size();
+
+    const int ready = (int)events.size() + transientReady;
+    if (nfound < 0 && ready == 0)
+        return -1;
+    return ready;
+}
+
+void NetPoller::resetStats()
+{
+    wakeups    = 0;
+    eventCount = 0;
+}
+
+
+//
+// select() backend, available everywhere
+//
+
+class SelectPoller : public NetPoller
+{
+public:
+    virtual Backend getBackend() const
+    {
+        return SelectBackend;
+    }
+
+protected:
+    virtual void updateInterest(int, unsigned char, unsigned char) {}
+    virtual int  backendWait(float timeout);
+};
+
+int SelectPoller::backendWait(float timeout)
+{
+    fd_set read_set, write_set;
+    FD_ZERO(&read_set);
+    FD_ZERO(&write_set);
+
+    int maxFile = -1;
+    for (int fd = 0; fd <= maxRegistered && fd < FD_SETSIZE; fd++)
+    {
+        const unsigned char flags = fdFlags[fd];
+        if (!flags)
+            continue;
+        if (flags & (Registered | TransientRead))
+            FD_SET((unsigned int)fd, &read_set);
+        if (flags & (WantWrite | TransientWrite))
+            FD_SET((unsigned int)fd, &write_set);
+        maxFile = fd;
+    }
+
+    struct timeval tv;
+    tv.tv_sec  = long(floorf(timeout));
+    tv.tv_usec = long(1.0e+6f * (timeout - floorf(timeout)));
+    const int nfound = select(maxFile + 1, &read_set, &write_set, 0, &tv);
+    if (nfound <= 0)
+        return nfound;
+
+    for (int fd = 0; fd <= maxFile; fd++)
+    {
+        const bool r = FD_ISSET(fd, &read_set) != 0;
+        const bool w = FD_ISSET(fd, &write_set) != 0;
+        if (r || w)
+            addEvent(fd, r, w);
+    }
+    return nfound;
+}
+
+
+//
+// epoll() backend, linux only
+//
+
+#ifdef HAVE_EPOLL
+class EpollPoller : public NetPoller
+{
+public:
+    EpollPoller();
+    ~EpollPoller();
+
+    bool isValid() const
+    {
+        return epollFd != -1;
+    }
+    virtual Backend getBackend() const
+    {
+        return EpollBackend;
+    }
+
+protected:
+    virtual void updateInterest(int fd, unsigned char oldFlags,
+                                unsigned char newFlags);
+    virtual int  backendWait(float timeout);
+
+private:
+    static uint32_t interestMask(unsigned char flags);
+
+    int       epollFd;
+    std::vector<struct epoll_event>   readyList;
+};
+
+EpollPoller::EpollPoller() : readyList(64)
+{
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (epollFd == -1)
+        nerror("couldn't create epoll instance");
+}
+
+EpollPoller::~EpollPoller()
+{
+    if (epollFd != -1)
+        close(epollFd);
+}
+
+uint32_t EpollPoller::interestMask(unsigned char flags)
+{
+    uint32_t mask = 0;
+    if (flags & (Registered | TransientRead))
+        mask |= EPOLLIN;
+    if (flags & (WantWrite | TransientWrite))
+        mask |= EPOLLOUT;
+    // edge triggered sockets listen for both, they only fire on a change
+    if ((flags & Registered) && (flags & EdgeTriggered))
+        mask |= EPOLLOUT | EPOLLET;
+    return mask;
+}
+
+void EpollPoller::updateInterest(int fd, unsigned char oldFlags,
+                                 unsigned char newFlags)
+{
+    const uint32_t oldMask = interestMask(oldFlags);
+    const uint32_t newMask = interestMask(newFlags);
+    if (oldMask == newMask)
+        return;
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events  = newMask;
+    ev.data.fd = fd;
+
+    if (!newMask)
+    {
+        // the socket may already be closed, in which case the kernel forgot it
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, &ev);
+        return;
+    }
+
+    // libcurl and c-ares close and reopen sockets behind our back, so the
+    // kernel's idea of what is registered may differ from ours
+    int op = oldMask ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+    if (epoll_ctl(epollFd, op, fd, &ev) == -1)
+    {
+        if (op == EPOLL_CTL_MOD && errno == ENOENT)
+            op = EPOLL_CTL_ADD;
+        else if (op == EPOLL_CTL_ADD && errno == EEXIST)
+            op = EPOLL_CTL_MOD;
+        else
+        {
+            logDebugMessage(1,"epoll_ctl failed on fd %d: %s\n", fd, strerror(errno));
+            return;
+        }
+        if (epoll_ctl(epollFd, op, fd, &ev) == -1)
+            logDebugMessage(1,"epoll_ctl failed on fd %d: %s\n", fd, strerror(errno));
+    }
+}
+
+int EpollPoller::backendWait(float timeout)
+{
+    // round up, a zero timeout for a sub millisecond wait would just spin
+    const int ms = (int)ceilf(timeout * 1000.0f);
+
+    const int nfound = epoll_wait(epollFd, &readyList[0], (int)readyList.size(), ms);
+    for (int i = 0; i < nfound; i++)
+    {
+        const uint32_t mask = readyList[i].events;
+        addEvent(readyList[i].data.fd,
+                 (mask & (EPOLLIN | EPOLLHUP | EPOLLERR)) != 0,
+                 (mask & (EPOLLOUT | EPOLLERR)) != 0);
+    }
+
+    // the list was full, make room for more next time
+    if (nfound == (int)readyList.size())
+        readyList.resize(readyList.size() * 2);
+
+    return nfound;
+}
+#endif
+
+
+//
+// factory
+//
+
+bool NetPoller::isAvailable(Backend backend)
+{
+    switch (backend)
+    {
+    case SelectBackend:
+        return true;
+    case EpollBackend:
+#ifdef HAVE_EPOLL
+        return true;
+#else
+        return false;
+#endif
+    }
+    return false;
+}
+
+NetPoller* NetPoller::create(Backend preferred)
+{
+#ifdef HAVE_EPOLL
+    if (preferred == EpollBackend)
+    {
+        EpollPoller *poller = new EpollPoller;
+        if (poller->isValid())
+            return poller;
+        delete poller;
+        logDebugMessage(1,"epoll is not usable, falling back to select\n");
+    }
+#else
+    if (preferred != SelectBackend)
+        logDebugMessage(1,"requested poller backend is not available, using select\n");
+#endif
+    return new SelectPoller;
+}
+
+// Local Variables: ***
+// mode: C++ ***
+// tab-width: 4 ***
+// c-basic-offset: 4 ***
+// indent-tabs-mode: nil ***
+// End: ***
+// ex: shiftwidth=4 tabstop=4
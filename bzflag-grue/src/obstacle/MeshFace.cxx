@@ -15,6 +15,8 @@
 
 // System headers
 #include <math.h>
+#include <algorithm>
+#include <vector>
 
 // Common headers
 #include "global.h"
@@ -26,6 +28,7 @@
 
 
 const char* MeshFace::typeName = "MeshFace";
+const float MeshFace::boxMargin = 0.01f;
 
 
 MeshFace::MeshFace(MeshObstacle* _mesh)
@@ -349,6 +352,89 @@ float MeshFace::intersect(const Ray& ray) const
 }
 
 
+// intersect() takes points up to 0.001 outside of each edge.  Around
+// a sharp corner that reaches a long way past the face, and a face
+// with its vertices in a line has no corners at all.  The points that
+// pass are a polygon in the face's plane, it is worked out in the
+// plane with twice the slack, for the rounding of the edge tests.
+void MeshFace::getHitExtents(Extents& exts) const
+{
+    exts = extents;
+
+    // a point on the plane and two directions along it
+    const double n[3] = { plane[0], plane[1], plane[2] };
+    const double o[3] = { -plane[3] * n[0], -plane[3] * n[1], -plane[3] * n[2] };
+    int least = 0;
+    for (int a = 1; a < 3; a++)
+    {
+        if (fabs(n[a]) < fabs(n[least]))
+            least = a;
+    }
+    double u[3] = { 0.0, 0.0, 0.0 };
+    u[(least + 1) % 3] = n[(least + 2) % 3];
+    u[(least + 2) % 3] = -n[(least + 1) % 3];
+    const double ulen = sqrt((u[0] * u[0]) + (u[1] * u[1]) + (u[2] * u[2]));
+    for (int a = 0; a < 3; a++)
+        u[a] /= ulen;
+    const double v[3] = { (n[1] * u[2]) - (n[2] * u[1]),
+                          (n[2] * u[0]) - (n[0] * u[2]),
+                          (n[0] * u[1]) - (n[1] * u[0])
+                        };
+
+    // edge e passes the points x of the plane with ex.x <= ec
+    const double slack = 0.002;
+    std::vector<double> ex(vertexCount), ey(vertexCount), ec(vertexCount);
+    std::vector<double> angles(vertexCount);
+    for (int e = 0; e < vertexCount; e++)
+    {
+        const float* ep = edgePlanes[e];
+        ex[e] = (ep[0] * u[0]) + (ep[1] * u[1]) + (ep[2] * u[2]);
+        ey[e] = (ep[0] * v[0]) + (ep[1] * v[1]) + (ep[2] * v[2]);
+        ec[e] = slack - ep[3] - ((ep[0] * o[0]) + (ep[1] * o[1]) + (ep[2] * o[2]));
+        angles[e] = atan2(ey[e], ex[e]);
+    }
+
+    // the polygon is unbounded unless the edges face every way
+    std::sort(angles.begin(), angles.end());
+    double gap = angles[0] + (2.0 * M_PI) - angles[vertexCount - 1];
+    for (int e = 1; e < vertexCount; e++)
+        gap = std::max(gap, angles[e] - angles[e - 1]);
+    bool bounded = (gap < (M_PI - 1.0e-6));
+
+    // its corners are where two edges cross inside all the others
+    bool cornered = false;
+    for (int a = 0; bounded && (a < vertexCount); a++)
+    {
+        for (int b = a + 1; b < vertexCount; b++)
+        {
+            const double det = (ex[a] * ey[b]) - (ey[a] * ex[b]);
+            if (fabs(det) < 1.0e-12)
+                continue;
+            const double x = ((ec[a] * ey[b]) - (ey[a] * ec[b])) / det;
+            const double y = ((ex[a] * ec[b]) - (ec[a] * ex[b])) / det;
+            bool inside = true;
+            for (int e = 0; inside && (e < vertexCount); e++)
+                inside = ((ex[e] * x) + (ey[e] * y)) <= (ec[e] + 1.0e-6);
+            if (!inside)
+                continue;
+            float corner[3];
+            for (int k = 0; k < 3; k++)
+                corner[k] = (float)(o[k] + (x * u[k]) + (y * v[k]));
+            exts.expandToPoint(corner);
+            cornered = true;
+        }
+    }
+    if (!bounded || !cornered)
+    {
+        const float mins[3] = { -MAXFLOAT, -MAXFLOAT, -MAXFLOAT };
+        const float maxs[3] = { +MAXFLOAT, +MAXFLOAT, +MAXFLOAT };
+        exts.set(mins, maxs);
+        return;
+    }
+    exts.addMargin(boxMargin);
+}
+
+
 void MeshFace::get3DNormal(const float* p, float* n) const
 {
     if (!smoothBounce || !useNormals())
@@ -18,6 +18,7 @@
 // system headers
 #include <math.h>
 #include <stdlib.h>
+#include <algorithm>
 
 // common headers
 #include "global.h"
@@ -34,6 +35,13 @@
 
 
 const char* MeshObstacle::typeName = "MeshObstacle";
+bool MeshObstacle::serverUnpack = false;
+
+
+void MeshObstacle::setServerUnpack(bool value)
+{
+    serverUnpack = value;
+}
 
 
 MeshObstacle::MeshObstacle()
@@ -409,10 +417,191 @@ void MeshObstacle::finalize()
     angle = 0.0f;
     ZFlip = false;
 
+    makeBVH();
+
     return;
 }
 
 
+// faces in a BVH leaf, smaller meshes are just scanned
+static const int bvhLeafSize = 4;
+static const int bvhMinFaces = 16;
+
+
+namespace
+{
+struct CenterLess
+{
+    CenterLess(const std::vector<cfvec3>& _centers, int _axis)
+        : centers(_centers), axis(_axis) {}
+    bool operator()(int a, int b) const
+    {
+        return centers[a].data[axis] < centers[b].data[axis];
+    }
+    const std::vector<cfvec3>& centers;
+    int axis;
+};
+}
+
+
+void MeshObstacle::makeBVH()
+{
+    bvhNodes.clear();
+    bvhFaces.clear();
+    if (faceCount <= bvhMinFaces)
+        return;
+
+    // the boxes are where each face's intersect() can hit, the mins and
+    // then the maxs, the centers are those of the faces themselves
+    std::vector<cfvec3> centers(faceCount);
+    std::vector<float> boxes(faceCount * 6);
+    bvhFaces.resize(faceCount);
+    for (int f = 0; f < faceCount; f++)
+    {
+        const Extents& exts = faces[f]->getExtents();
+        Extents hitExts;
+        faces[f]->getHitExtents(hitExts);
+        for (int a = 0; a < 3; a++)
+        {
+            centers[f].data[a] = 0.5f * (exts.mins[a] + exts.maxs[a]);
+            boxes[(f * 6) + a] = hitExts.mins[a];
+            boxes[(f * 6) + 3 + a] = hitExts.maxs[a];
+        }
+        bvhFaces[f] = f;
+    }
+
+    bvhNodes.reserve((2 * faceCount) / bvhLeafSize + 1);
+    buildBVH(0, faceCount, centers, boxes);
+
+    return;
+}
+
+
+int MeshObstacle::buildBVH(int first, int count,
+                           const std::vector<cfvec3>& centers,
+                           const std::vector<float>& boxes)
+{
+    const int index = (int)bvhNodes.size();
+    bvhNodes.push_back(BVHNode());
+
+    Extents exts;
+    float cmins[3] = { +MAXFLOAT, +MAXFLOAT, +MAXFLOAT };
+    float cmaxs[3] = { -MAXFLOAT, -MAXFLOAT, -MAXFLOAT };
+    for (int i = first; i < (first + count); i++)
+    {
+        const int f = bvhFaces[i];
+        const Extents box(&boxes[f * 6], &boxes[(f * 6) + 3]);
+        exts.expandToBox(box);
+        for (int a = 0; a < 3; a++)
+        {
+            cmins[a] = std::min(cmins[a], centers[f].data[a]);
+            cmaxs[a] = std::max(cmaxs[a], centers[f].data[a]);
+        }
+    }
+
+    // split at the median along the axis where the faces spread the most
+    int axis = 0;
+    for (int a = 1; a < 3; a++)
+    {
+        if ((cmaxs[a] - cmins[a]) > (cmaxs[axis] - cmins[axis]))
+            axis = a;
+    }
+
+    int second = 0;
+    const bool leaf = (count <= bvhLeafSize) || (cmaxs[axis] <= cmins[axis]);
+    if (!leaf)
+    {
+        const int half = count / 2;
+        std::nth_element(bvhFaces.begin() + first,
+                         bvhFaces.begin() + first + half,
+                         bvhFaces.begin() + first + count,
+                         CenterLess(centers, axis));
+        buildBVH(first, half, centers, boxes);
+        second = buildBVH(first + half, count - half, centers, boxes);
+    }
+
+    // the children may have moved the vector
+    BVHNode& node = bvhNodes[index];
+    memcpy(node.mins, exts.mins, sizeof(node.mins));
+    memcpy(node.maxs, exts.maxs, sizeof(node.maxs));
+    node.first = leaf ? first : second;
+    node.count = leaf ? count : 0;
+
+    return index;
+}
+
+
+// does the segment from origin to (origin + dir) cross the box
+static inline bool segmentInBox(const float origin[3], const float dir[3],
+                                const float mins[3], const float maxs[3])
+{
+    float tmin = 0.0f;
+    float tmax = 1.0f;
+    for (int a = 0; a < 3; a++)
+    {
+        if (dir[a] == 0.0f)
+        {
+            if ((origin[a] < mins[a]) || (origin[a] > maxs[a]))
+                return false;
+            continue;
+        }
+        const float inv = 1.0f / dir[a];
+        float t1 = (mins[a] - origin[a]) * inv;
+        float t2 = (maxs[a] - origin[a]) * inv;
+        if (t1 > t2)
+            std::swap(t1, t2);
+        tmin = std::max(tmin, t1);
+        tmax = std::min(tmax, t2);
+        if (tmin > tmax)
+            return false;
+    }
+    return true;
+}
+
+
+bool MeshObstacle::segmentHitsFace(const float origin[3],
+                                   const float dir[3]) const
+{
+    const Ray ray(origin, dir);
+    if (bvhNodes.empty())
+    {
+        for (int f = 0; f < faceCount; f++)
+        {
+            const float hittime = faces[f]->intersect(ray);
+            if ((hittime > 0.0f) && (hittime <= 1.0f))
+                return true;
+        }
+        return false;
+    }
+
+    int stack[64];
+    int depth = 0;
+    stack[depth++] = 0;
+
+    while (depth > 0)
+    {
+        const int index = stack[--depth];
+        const BVHNode& node = bvhNodes[index];
+        if (!segmentInBox(origin, dir, node.mins, node.maxs))
+            continue;
+        if (node.count == 0)
+        {
+            stack[depth++] = node.first;
+            stack[depth++] = index + 1;
+            continue;
+        }
+        for (int i = node.first; i < (node.first + node.count); i++)
+        {
+            const float hittime = faces[bvhFaces[i]]->intersect(ray);
+            if ((hittime > 0.0f) && (hittime <= 1.0f))
+                return true;
+        }
+    }
+
+    return false;
+}
+
+
 const char* MeshObstacle::getType() const
 {
     return typeName;
@@ -465,8 +654,8 @@ bool MeshObstacle::isValid() const
 
 bool MeshObstacle::containsPoint(const float point[3]) const
 {
-    // this should use the CollisionManager's rayTest function
-//  const ObsList* olist = COLLISIONMGR.rayTest (&ray, t);
+    // the faces' own hierarchy is tighter than the CollisionManager's
+    // octree, which would also hand back every other obstacle
     return containsPointNoOctree(point);
 }
 
@@ -476,7 +665,7 @@ bool MeshObstacle::containsPointNoOctree(const float point[3]) const
     if (checkCount <= 0)
         return false;
 
-    int c, f;
+    int c;
     float dir[3];
     bool hasOutsides = false;
 
@@ -485,38 +674,14 @@ bool MeshObstacle::containsPointNoOctree(const float point[3]) const
         if (checkTypes[c] == CheckInside)
         {
             vec3sub (dir, checkPoints[c], point);
-            Ray ray(point, dir);
-            bool hitFace = false;
-            for (f = 0; f < faceCount; f++)
-            {
-                const MeshFace* face = faces[f];
-                const float hittime = face->intersect(ray);
-                if ((hittime > 0.0f) && (hittime <= 1.0f))
-                {
-                    hitFace = true;
-                    break;
-                }
-            }
-            if (!hitFace)
+            if (!segmentHitsFace(point, dir))
                 return true;
         }
         else if (checkTypes[c] == CheckOutside)
         {
             hasOutsides = true;
             vec3sub (dir, point, checkPoints[c]);
-            Ray ray(checkPoints[c], dir);
-            bool hitFace = false;
-            for (f = 0; f < faceCount; f++)
-            {
-                const MeshFace* face = faces[f];
-                const float hittime = face->intersect(ray);
-                if ((hittime > 0.0f) && (hittime <= 1.0f))
-                {
-                    hitFace = true;
-                    break;
-                }
-            }
-            if (!hitFace)
+            if (!segmentHitsFace(checkPoints[c], dir))
                 return false;
         }
         else
@@ -777,7 +942,7 @@ const void *MeshObstacle::unpack(const void *buf)
     drawInfoOwner = (stateByte & (1 << 4)) != 0;
     ricochet      = (stateByte & (1 << 5)) != 0;
 
-    if (drawInfoOwner && (vertexCount >= 1))
+    if (drawInfoOwner && (vertexCount >= 1) && !serverUnpack)
     {
         // remove the extraneous vertex
         vertexCount--;
@@ -792,7 +957,7 @@ const void *MeshObstacle::unpack(const void *buf)
             int32_t rewindLen;
             nboUnpackInt(drawInfoSize, rewindLen);
 
-            const bool useDrawInfo = BZDB.isTrue("useDrawInfo");
+            const bool useDrawInfo = serverUnpack || BZDB.isTrue("useDrawInfo");
 
             if (rewindLen <= (int)(texcoordCount * sizeof(afvec2)))
             {
@@ -823,7 +988,10 @@ const void *MeshObstacle::unpack(const void *buf)
                 // setup the drawInfo arrays
                 if (useDrawInfo)
                 {
-                    drawInfo->clientSetup(this);
+                    if (serverUnpack)
+                        drawInfo->serverSetup(this);
+                    else
+                        drawInfo->clientSetup(this);
                     if (!drawInfo->isValid())
                     {
                         delete drawInfo;